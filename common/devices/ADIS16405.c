@@ -19,8 +19,23 @@
 #define WRITE_ADDR(addr) ((addr) |	0x80)
 #define READ_ADDR(addr)  ((addr) & ~0x80)
 
-#define BURST_EXCHANGE_LEN (sizeof(ADIS16405Data)+ 2) //+2 for initial addr
-uint8_t adis_raw_in[BURST_EXCHANGE_LEN];
+#define BURST_EXCHANGE_LEN ADIS_BURST_EXCHANGE_LEN //+2 for initial addr
+#define FRAME_MASK (ADIS_FRAME_RING_LEN - 1)
+
+/* Burst frames are DMAed straight into this ring. frame_head counts frames
+ * completed, frame_tail counts frames the consumer has released and
+ * frame_busy is set while a burst is in flight into slot frame_head. The
+ * ISRs only ever write the slot at frame_head, so everything between
+ * frame_tail and frame_head belongs to the consumer until it releases it.
+ * reg_busy is set while adis_get() or adis_set() has the SPI, which they
+ * run with reg_spicfg so their transfers never reach spi_complete().
+ */
+static ADIS16405Frame adis_frames[ADIS_FRAME_RING_LEN];
+static volatile uint32_t frame_head;
+static volatile uint32_t frame_tail;
+static volatile bool_t frame_busy;
+static volatile bool_t reg_busy;
+static ADIS16405Stats adis_stats;
 EventSource ADIS16405_data_ready;
 
 static const ADIS16405Config * CONF;
@@ -41,22 +56,84 @@ const ADIS16405Config adis_olimex_e407 = {
 static void adis_data_ready(EXTDriver *extp UNUSED, expchannel_t channel UNUSED)
 {
 	static uint8_t address[BURST_EXCHANGE_LEN] = {0x3E, 0};
+	halrtcnt_t now = halGetCounterValue();
+	ADIS16405Frame * frame;
+
 //	spiAcquireBus(CONF->SPID);TODO
 	chSysLockFromIsr();
-	spiSelectI(CONF->SPID);
-	spiStartExchangeI(CONF->SPID, BURST_EXCHANGE_LEN, address, adis_raw_in);
+	if(frame_busy || reg_busy){
+		++adis_stats.spi_busy;
+	} else if(frame_head - frame_tail >= ADIS_FRAME_RING_LEN){
+		++adis_stats.ring_full;
+	} else {
+		frame = &adis_frames[frame_head & FRAME_MASK];
+		frame->drdy_time = now;
+		frame_busy = TRUE;
+		++adis_stats.bursts;
+		spiSelectI(CONF->SPID);
+		spiStartExchangeI(CONF->SPID, BURST_EXCHANGE_LEN, address, frame->raw);
+	}
 	chSysUnlockFromIsr();
 }
 
 static void spi_complete(SPIDriver * SPID){
+	halrtcnt_t now = halGetCounterValue();
+
 	chSysLockFromIsr();
+	if(!frame_busy){
+		// not a burst adis_data_ready() started
+		spiUnselectI(SPID);
+		chSysUnlockFromIsr();
+		return;
+	}
+	adis_frames[frame_head & FRAME_MASK].done_time = now;
 	spiUnselectI(SPID);
-//	todo: timestamp here to measure delay in event broadcasts
+	++frame_head;
+	++adis_stats.frames;
+	chDbgAssert(adis_stats.frames == adis_stats.bursts, "spi_complete(), #1", "frame without a burst");
+	frame_busy = FALSE;
 	chEvtBroadcastI(&ADIS16405_data_ready);
 	chSysUnlockFromIsr();
 //	spiReleaseBus(CONF->SPID); TODO
 }
 
+/* ADIS SPI configuration
+ * 656250Hz, CPHA=1, CPOL=1, MSb first.
+ * For burst mode ADIS SPI is limited to 1Mhz.
+ */
+static SPIConfig spicfg = {
+	.end_cb = spi_complete,
+	.cr1 = SPI_CR1_CPOL | SPI_CR1_CPHA | SPI_CR1_BR_2 | SPI_CR1_BR_1
+};
+
+/* The same for register access, without the burst completion callback */
+static SPIConfig reg_spicfg = {
+	.end_cb = NULL,
+	.cr1 = SPI_CR1_CPOL | SPI_CR1_CPHA | SPI_CR1_BR_2 | SPI_CR1_BR_1
+};
+
+/* Takes the SPI from the bursts for a register access: waits out one in
+ * flight, then holds data ready off until reg_end().
+ */
+static void reg_begin(void){
+	spiAcquireBus(CONF->SPID);
+	chSysLock();
+	while(frame_busy){
+		chThdSleepS(1);
+	}
+	reg_busy = TRUE;
+	chSysUnlock();
+	spiStart(CONF->SPID, &reg_spicfg);
+}
+
+static void reg_end(void){
+	spiStart(CONF->SPID, &spicfg);
+	chSysLock();
+	reg_busy = FALSE;
+	chSysUnlock();
+	spiReleaseBus(CONF->SPID);
+}
+
 void adis_init(const ADIS16405Config * conf) {
 	uint32_t PINMODE = PAL_STM32_OTYPE_PUSHPULL | PAL_STM32_OSPEED_HIGHEST | PAL_STM32_PUDR_FLOATING;
 	/* SPI pins setup */
@@ -72,16 +149,11 @@ void adis_init(const ADIS16405Config * conf) {
 	palSetPadMode(conf->dio3.port, conf->dio3.pad, PAL_MODE_INPUT_PULLDOWN | PAL_STM32_OSPEED_HIGHEST);
 	palSetPadMode(conf->dio4.port, conf->dio4.pad, PAL_MODE_INPUT_PULLDOWN | PAL_STM32_OSPEED_HIGHEST);
 
-	/* ADIS SPI configuration
-	 * 656250Hz, CPHA=1, CPOL=1, MSb first.
-	 * For burst mode ADIS SPI is limited to 1Mhz.
-	 */
-	static SPIConfig spicfg = {
-		.end_cb = spi_complete,
-		.cr1 = SPI_CR1_CPOL | SPI_CR1_CPHA | SPI_CR1_BR_2 | SPI_CR1_BR_1
-	};
+	/* Chip select for both SPI configurations */
 	spicfg.ssport = conf->spi_cs.port;
 	spicfg.sspad = conf->spi_cs.pad;
+	reg_spicfg.ssport = conf->spi_cs.port;
+	reg_spicfg.sspad = conf->spi_cs.pad;
 	spiStart(conf->SPID, &spicfg);
 
 	/* Enable the external interrupt */
@@ -96,14 +168,14 @@ uint16_t adis_get(adis_regaddr addr){ //todo: array
 	uint8_t txbuf[2] = {addr, 0};
 	uint8_t rxbuf[2];
 
-	spiAcquireBus(CONF->SPID);
+	reg_begin();
 	spiSelect(CONF->SPID);
 
 	spiSend(CONF->SPID, sizeof(txbuf), txbuf);
 	spiReceive(CONF->SPID, sizeof(rxbuf), rxbuf);
 
 	spiUnselect(CONF->SPID);
-	spiReleaseBus(CONF->SPID);
+	reg_end();
 
 	return rxbuf[0] << 8 | rxbuf[1];
 }
@@ -113,13 +185,13 @@ void adis_set(adis_regaddr addr, uint16_t value){ //todo:array
 		WRITE_ADDR(addr+1), value >> 8,
 		WRITE_ADDR(addr),   value
 	};
-	spiAcquireBus(CONF->SPID);
+	reg_begin();
 	spiSelect(CONF->SPID);
 
 	spiSend(CONF->SPID, sizeof(txbuf), txbuf);
 
 	spiUnselect(CONF->SPID);
-	spiReleaseBus(CONF->SPID);
+	reg_end();
 }
 
 
@@ -147,10 +219,62 @@ static void buffer_to_burst_data(uint8_t * raw, ADIS16405Data * data){
 	data->aux_adc    = (raw[22] << 8 | raw[23]) & 0x0fff;
 }
 
+void adis_frame_decode(const ADIS16405Frame * frame, ADIS16405Data * data){
+	buffer_to_burst_data((uint8_t *)frame->raw + 2, data); //first 2 bytes are padding
+}
+
+/*! \brief Latest sample
+ *
+ * Provides the last sample or 0s if no sample received. Every frame up to it
+ * is released, so don't mix this with adis_frames_acquire().
+ */
 void adis_get_data(ADIS16405Data * data){ // TODO: adis error struct
-	// provides last sample or 0s if no sample received.
+	uint32_t head;
+
+	chSysLock();
+	head = frame_head;
+	frame_tail = head;
+	chSysUnlock();
+	// the ISRs won't write this slot again until ADIS_FRAME_RING_LEN - 1
+	// more bursts have completed
+	adis_frame_decode(&adis_frames[(head - 1) & FRAME_MASK], data);
+}
+
+/*! \brief Zero-copy access to the oldest unreleased frames
+ *
+ * Points frames at the oldest frame not yet released and returns how many
+ * frames follow it contiguously in the ring, 0 if there are none. They stay
+ * valid until adis_frames_release(); anything left past the end of the ring
+ * comes back from the next call.
+ */
+unsigned adis_frames_acquire(const ADIS16405Frame ** frames){
+	uint32_t head, tail;
+	unsigned count;
+
+	chSysLock();
+	head = frame_head;
+	tail = frame_tail;
+	chSysUnlock();
+
+	count = head - tail;
+	if(count > ADIS_FRAME_RING_LEN - (tail & FRAME_MASK)){
+		count = ADIS_FRAME_RING_LEN - (tail & FRAME_MASK);
+	}
+	*frames = &adis_frames[tail & FRAME_MASK];
+	return count;
+}
+
+/*! \brief Give the first count acquired frames back to the driver
+ */
+void adis_frames_release(unsigned count){
+	chSysLock();
+	frame_tail += count;
+	chSysUnlock();
+}
+
+void adis_get_stats(ADIS16405Stats * stats){
 	chSysLock();
-	buffer_to_burst_data(adis_raw_in + 2, data); //first 2 bytes are padding
+	*stats = adis_stats;
 	chSysUnlock();
 }
 
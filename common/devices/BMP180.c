@@ -1,3 +1,4 @@
+#include <stdbool.h>
 #include "BMP180.h"
 #include "utils_general.h"
 #include "utils_hal.h"
@@ -30,46 +31,22 @@ EVENTSOURCE_DECL(BMP180DataEvt);
 EvTimer BMP180Timer;
 
 static int initialized;
-static const systime_t I2C_TIMEOUT = MS2ST(400);
 
 static I2CDriver * I2CD;
 static const struct BMP180Config * CONF;
 static struct BMP180Data lastsample;
 
-static int handle_i2c_return(msg_t status) {
-	i2cflags_t errors;
-	switch(status){
-	case RDY_OK:
-		break;
-	case RDY_RESET:
-		errors = i2cGetErrors(I2CD);
-		return errors;
-	case RDY_TIMEOUT:
-	/* On a timeout ChibiOS will set the bus into I2C_LOCKED, which will
-	 * cause an assert to be hit if a bus transfer is tried again.
-	 * I2C_LOCKED can only be cleared by i2cStart(), but i2cStart will hit
-	 * an assert if i2cStop is not issued before restarting.
-	 * This seems like a really terrible way to handle timeous*/
-		i2cStop(I2CD);
-		i2cStart(I2CD, I2CD->config);
-		return RDY_TIMEOUT;
-	}
-	return RDY_OK;
-}
-
+static struct BMP180Calibration cal;
+static bool calibrated;
+static int32_t b5;                  // from the last temperature
+static bool have_b5;
+static struct BMP180Compensated lastcomp;
+static bool have_comp;
 
 static int set(int id, uint8_t data){
 	chDbgAssert(initialized, "BMP180 not initialized (set)", NULL);
 	uint8_t tx[2] = {id, data};
-	i2cAcquireBus(I2CD);
-	msg_t status = i2cMasterTransmitTimeout(I2CD, BMP180_ADDR, tx, sizeof(tx), NULL, 0, I2C_TIMEOUT);
-	int r = handle_i2c_return(status);
-	if(r) {
-		i2cReleaseBus(I2CD);
-		return r;
-	}
-	i2cReleaseBus(I2CD);
-	return RDY_OK;
+	return i2cSchedTransmit(I2CD, BMP180_ADDR, tx, sizeof(tx), NULL, 0, 0);
 }
 
 
@@ -77,22 +54,85 @@ static int get(int id, void *data, unsigned int len){
 	chDbgAssert(initialized, "BMP180 not initialized (get)", NULL);
 	uint8_t tx[1] = {id};
 	uint8_t rx[4] = {0};
-	i2cAcquireBus(I2CD);
-	msg_t status = i2cMasterTransmitTimeout(I2CD, BMP180_ADDR, tx, sizeof(tx), rx, sizeof(rx), I2C_TIMEOUT);
-	int r = handle_i2c_return(status);
+	int r = i2cSchedTransmit(I2CD, BMP180_ADDR, tx, sizeof(tx), rx, sizeof(rx), 0);
 	if(r) {
-		i2cReleaseBus(I2CD);
 		return r;
 	}
-	i2cReleaseBus(I2CD);
 	memcpy(data, rx, len);
 	return RDY_OK;
 }
 
+/* The pump's transactions: read the last conversion, start the next */
+static uint8_t pump_reg[1] = {OUT_MSB};
+static uint8_t pump_rx[4];
+static uint8_t pump_ctrl[2] = {CTRL_MEAS, 0};
+static void * pump_dest;
+static unsigned pump_len;
+static unsigned pump_oss;           // of the conversion being read
+
+/* Runs on the I2C scheduler thread, the math is a few hundred cycles */
+static void compensate(void) {
+	struct BMP180Compensated c;
+
+	if(pump_len == 2) {
+		lastcomp.temperature = BMP180Temperature(&cal, BMP180RawTemperature(pump_rx), &b5);
+		have_b5 = true;
+		return;
+	}
+	if(!have_b5) {
+		return;
+	}
+	c.temperature = lastcomp.temperature;
+	c.pressure = BMP180Pressure(&cal, BMP180RawPressure(pump_rx, pump_oss), pump_oss, b5);
+	c.altitude = BMP180Altitude(c.pressure, CONF->ground_pa ? CONF->ground_pa : BMP180_SEA_LEVEL_PA);
+	chSysLock();
+	lastcomp = c;
+	have_comp = true;
+	chSysUnlock();
+}
+
+static void pump_read_done(struct I2CTransaction * t) {
+	if(t->status == RDY_OK) {
+		memcpy(pump_dest, pump_rx, pump_len);
+		if(calibrated) {
+			compensate();
+		}
+		chSysLock();
+		chEvtBroadcastI(&BMP180DataEvt);
+		chSysUnlock();
+	}
+}
+
+static struct I2CTransaction pump_read = {
+	.addr = BMP180_ADDR,
+	.tx = pump_reg,
+	.txlen = sizeof(pump_reg),
+	.rx = pump_rx,
+	.rxlen = sizeof(pump_rx),
+	.priority = I2C_PRIO_NORMAL,
+	.deadline = MS2ST(10),
+	.callback = pump_read_done,
+};
+
+static struct I2CTransaction pump_start = {
+	.addr = BMP180_ADDR,
+	.tx = pump_ctrl,
+	.txlen = sizeof(pump_ctrl),
+	.priority = I2C_PRIO_NORMAL,
+	.deadline = MS2ST(10),
+};
+
 void BMP180_getSample(struct BMP180Data *data){
 	memcpy(data, &lastsample, sizeof(lastsample));
 };
 
+int BMP180_getCompensated(struct BMP180Compensated * data) {
+	chSysLock();
+	*data = lastcomp;
+	chSysUnlock();
+	return have_comp ? 0 : -1;
+}
+
 int BMP180_softReset(void) {
 	return set(SOFT, 0xB6);
 }
@@ -103,22 +143,42 @@ int BMP180_id(uint8_t * id) {
 
 void BMP180_pump(eventid_t e UNUSED) {
 	static int i = 100;
+	static bool primed;
+
+	// the bus hasn't got to the last tick's yet, let it catch up
+	if(pump_read.status == I2C_TXN_PENDING || pump_start.status == I2C_TXN_PENDING) {
+		return;
+	}
+	// nothing has been converted yet, so start with a temperature to read
+	if(!primed) {
+		pump_ctrl[1] = TEMPERATURE | SCO | OSS1;
+		i2cSchedSubmit(I2CD, &pump_start);
+		primed = true;
+		return;
+	}
+
 	switch(i) {
 	case 99:
-		get(OUT_MSB, &lastsample.pressure, 3);
-		set(CTRL_MEAS, TEMPERATURE | SCO | OSS1);
+		pump_dest = &lastsample.pressure;
+		pump_len = 3;
+		pump_oss = OSS8 >> 6;
+		pump_ctrl[1] = TEMPERATURE | SCO | OSS1;
 		break;
 	case 100:
-		get(OUT_MSB, &lastsample.temperature, 2);
-		set(CTRL_MEAS, PRESSURE | SCO | OSS8);
+		pump_dest = &lastsample.temperature;
+		pump_len = 2;
+		pump_ctrl[1] = PRESSURE | SCO | OSS8;
 		i = 1;
 		break;
 	default:
-		get(OUT_MSB, &lastsample.pressure, 3);
-		set(CTRL_MEAS, PRESSURE | SCO | OSS8);
+		pump_dest = &lastsample.pressure;
+		pump_len = 3;
+		pump_oss = OSS8 >> 6;
+		pump_ctrl[1] = PRESSURE | SCO | OSS8;
 	}
 	++i;
-	chEvtBroadcast(&BMP180DataEvt);
+	i2cSchedSubmit(I2CD, &pump_read);
+	i2cSchedSubmit(I2CD, &pump_start);
 }
 
 void BMP180_start(const struct BMP180Config * conf) {
@@ -131,6 +191,14 @@ void BMP180_start(const struct BMP180Config * conf) {
 	i2cUtilsStart(conf->i2cd, &i2cfg, &conf->pins);
 	I2CD = conf->i2cd;
 	CONF = conf;
+	i2cSchedDevice(I2CD, BMP180_ADDR, "BMP180");
+
+	// the calibration never changes, read it once
+	uint8_t reg = BMP180_CAL_ADDR;
+	uint8_t raw[BMP180_CAL_LEN];
+	if(i2cSchedTransmit(I2CD, BMP180_ADDR, &reg, 1, raw, sizeof(raw), 0) == RDY_OK) {
+		calibrated = BMP180CalibrationParse(raw, &cal) == 0;
+	}
 
 	evtInit(&BMP180Timer, MS2ST(10));
 	evtStart(&BMP180Timer);
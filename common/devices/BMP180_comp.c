@@ -0,0 +1,121 @@
+#include "BMP180_comp.h"
+
+static int16_t get16(const uint8_t * p){
+	return (int16_t)(p[0] << 8 | p[1]);
+}
+
+int BMP180CalibrationParse(const uint8_t * raw, struct BMP180Calibration * cal){
+	int i;
+
+	for(i = 0; i < BMP180_CAL_LEN; i += 2){
+		uint16_t w = raw[i] << 8 | raw[i + 1];
+		if(w == 0 || w == 0xFFFF){
+			return -1;
+		}
+	}
+	cal->AC1 = get16(raw + 0);
+	cal->AC2 = get16(raw + 2);
+	cal->AC3 = get16(raw + 4);
+	cal->AC4 = (uint16_t)get16(raw + 6);
+	cal->AC5 = (uint16_t)get16(raw + 8);
+	cal->AC6 = (uint16_t)get16(raw + 10);
+	cal->B1 = get16(raw + 12);
+	cal->B2 = get16(raw + 14);
+	cal->MB = get16(raw + 16);
+	cal->MC = get16(raw + 18);
+	cal->MD = get16(raw + 20);
+	return 0;
+}
+
+int32_t BMP180RawTemperature(const uint8_t * raw){
+	return raw[0] << 8 | raw[1];
+}
+
+int32_t BMP180RawPressure(const uint8_t * raw, unsigned oss){
+	return (int32_t)(raw[0] << 16 | raw[1] << 8 | raw[2]) >> (8 - oss);
+}
+
+int32_t BMP180Temperature(const struct BMP180Calibration * cal, int32_t ut, int32_t * b5){
+	int32_t x1 = ((ut - cal->AC6) * cal->AC5) >> 15;
+	int32_t x2 = ((int32_t)cal->MC << 11) / (x1 + cal->MD);
+	*b5 = x1 + x2;
+	return (*b5 + 8) >> 4;
+}
+
+int32_t BMP180Pressure(const struct BMP180Calibration * cal, int32_t up, unsigned oss, int32_t b5){
+	int32_t b6 = b5 - 4000;
+	int32_t x1 = (cal->B2 * ((b6 * b6) >> 12)) >> 11;
+	int32_t x2 = (cal->AC2 * b6) >> 11;
+	int32_t x3 = x1 + x2;
+	int32_t b3 = ((((int32_t)cal->AC1 * 4 + x3) << oss) + 2) / 4;
+	uint32_t b4, b7;
+	int32_t p;
+
+	x1 = (cal->AC3 * b6) >> 13;
+	x2 = (cal->B1 * ((b6 * b6) >> 12)) >> 16;
+	x3 = ((x1 + x2) + 2) >> 2;
+	b4 = (cal->AC4 * (uint32_t)(x3 + 32768)) >> 15;
+	b7 = ((uint32_t)up - b3) * (50000 >> oss);
+	if(b7 < 0x80000000){
+		p = (b7 * 2) / b4;
+	} else {
+		p = (b7 / b4) * 2;
+	}
+	x1 = (p >> 8) * (p >> 8);
+	x1 = (x1 * 3038) >> 16;
+	x2 = (-7357 * p) >> 16;
+	return p + ((x1 + x2 + 3791) >> 4);
+}
+
+/* 4433000 * (1 - r^(1/5.255)) cm for r = p / p0 from 0.25 to 1.5 in 1/128 steps */
+#define ALT_R0 (1 << 28)            // 0.25 in Q30
+#define ALT_STEP_BITS 23            // 1/128 in Q30
+#define ALT_STEPS 160
+static const int32_t altitude_cm[ALT_STEPS + 1] = {
+	1027909, 1007911, 988398, 969345, 950727, 932523, 914714, 897280,
+	880204, 863471, 847065, 830972, 815179, 799675, 784446, 769484,
+	754777, 740316, 726093, 712097, 698323, 684761, 671404, 658247,
+	645282, 632503, 619904, 607480, 595225, 583134, 571203, 559427,
+	547801, 536322, 524984, 513785, 502720, 491786, 480980, 470298,
+	459737, 449294, 438967, 428752, 418646, 408648, 398754, 388963,
+	379271, 369677, 360178, 350773, 341459, 332234, 323097, 314045,
+	305077, 296192, 287387, 278660, 270011, 261438, 252939, 244513,
+	236159, 227875, 219659, 211511, 203430, 195414, 187461, 179572,
+	171745, 163978, 156270, 148622, 141031, 133497, 126018, 118595,
+	111225, 103908, 96644, 89431, 82269, 75156, 68093, 61078,
+	54110, 47190, 40315, 33486, 26702, 19962, 13265, 6611,
+	0, -6570, -13098, -19586, -26034, -32443, -38813, -45144,
+	-51438, -57694, -63913, -70096, -76243, -82355, -88431, -94473,
+	-100481, -106455, -112396, -118304, -124180, -130023, -135835, -141616,
+	-147365, -153085, -158774, -164433, -170062, -175663, -181234, -186778,
+	-192293, -197780, -203240, -208672, -214078, -219456, -224809, -230136,
+	-235436, -240712, -245962, -251187, -256387, -261563, -266715, -271843,
+	-276947, -282028, -287086, -292120, -297132, -302122, -307089, -312034,
+	-316957, -321859, -326739, -331598, -336436, -341254, -346050, -350827,
+	-355583,
+};
+
+int32_t BMP180Altitude(int32_t pa, int32_t p0){
+	uint32_t q, rem, r, i, frac;
+
+	if(pa <= 0 || p0 <= 0){
+		return altitude_cm[0];
+	}
+	// r = pa / p0 in Q30 with two 32 bit divides, pa and p0 are under 2^17
+	q = ((uint32_t)pa << 15) / (uint32_t)p0;
+	rem = ((uint32_t)pa << 15) % (uint32_t)p0;
+	if(q >= 1 << 16){           // r of 2 or more
+		return altitude_cm[ALT_STEPS];
+	}
+	r = q << 15 | ((rem << 15) / (uint32_t)p0);
+
+	if(r < ALT_R0){
+		return altitude_cm[0];
+	}
+	i = (r - ALT_R0) >> ALT_STEP_BITS;
+	if(i >= ALT_STEPS){
+		return altitude_cm[ALT_STEPS];
+	}
+	frac = ((r - ALT_R0) >> (ALT_STEP_BITS - 16)) & 0xFFFF;
+	return altitude_cm[i] + (((altitude_cm[i + 1] - altitude_cm[i]) * (int32_t)frac) >> 16);
+}
@@ -16,7 +16,6 @@
 
 static struct BQ3060Config * CONF;
 static bool initialized = false;
-static const systime_t I2C_TIMEOUT = MS2ST(400);
 
 EVENTSOURCE_DECL(BQ3060_data_ready);
 EVENTSOURCE_DECL(BQ3060_battery_fault);
@@ -77,21 +76,6 @@ void Status(){
     BQ3060_FETStatus = 0x56,
 }
  */
-static void Physical(struct BQ3060Data * data){
-    BQ3060Get(BQ3060_Temperature, &(data->Temperature));
-    BQ3060Get(BQ3060_TS1Temperature, (uint16_t *)&(data->TS1Temperature));
-    BQ3060Get(BQ3060_TS2Temperature, (uint16_t *)&(data->TS2Temperature));
-    BQ3060Get(BQ3060_TempRange, &(data->TempRange));
-    BQ3060Get(BQ3060_Current, (uint16_t *)&(data->Current));
-    BQ3060Get(BQ3060_AverageCurrent, (uint16_t *)&(data->AverageCurrent));
-    BQ3060Get(BQ3060_Voltage, &(data->Voltage));
-    BQ3060Get(BQ3060_CellVoltage4, &(data->CellVoltage4));
-    BQ3060Get(BQ3060_CellVoltage3, &(data->CellVoltage3));
-    BQ3060Get(BQ3060_CellVoltage2, &(data->CellVoltage2));
-    BQ3060Get(BQ3060_CellVoltage1, &(data->CellVoltage1));
-    BQ3060Get(BQ3060_PackVoltage, &(data->PackVoltage));
-    BQ3060Get(BQ3060_AverageVoltage, &(data->AverageVoltage));
-}
 /* Danger:
  *
  * Safety status : 0x51
@@ -157,44 +141,181 @@ static void Physical(struct BQ3060Data * data){
  */
 
 void BQ3060_get_data(struct BQ3060Data * data){
-//    chSysLock();
+    chSysLock();
     *data = buffer;
-//    chSysUnlock();
+    chSysUnlock();
 }
 
 //crntAlarms - current alarms {safetyAlarm,failureAlert,permanentFailure}
 uint16_t crntAlarms[3];
 
-static void read_handler(eventid_t id UNUSED){
-	//if any battery issues have occurred we fire
-	//the event associated with BQ3060_battery_fault
-	//read the safety alert register (0x50)
-	BQ3060Get(0x50,&crntAlarms[0]);
-	//read the pending failure alert register (0x52)
-	BQ3060Get(0x52,&crntAlarms[1]);
-	//read the permanent failure status register (0x53)
-	BQ3060Get(0x53,&crntAlarms[2]);
-	if (crntAlarms[0] || crntAlarms[1] || crntAlarms[2]) {
-		chEvtBroadcast(&BQ3060_battery_fault);
-	}
-
-    Physical(&buffer);
+/* Registers are read in groups by how fast they change. The bq3060 has no
+ * block command that returns these words together, so a group is batched
+ * on the bus instead: all its word reads are queued on the I2C scheduler at
+ * once and run back to back, and the last one's completion is the group's.
+ */
+#define GROUP_MAX 9
+
+struct group {
+    const uint8_t * regs;
+    uint16_t * const * dest;
+    unsigned count;
+    uint8_t priority;
+    systime_t deadline;
+    struct I2CTransaction t[GROUP_MAX];
+    uint8_t rx[GROUP_MAX][2];
+    uint16_t values[GROUP_MAX];
+    EventSource done;
+};
+
+// safety alert, PF alert and PF status, anything non zero is a fault
+static const uint8_t alarm_regs[] = {
+    BQ3060_SafetyAlert, BQ3060_PFAlert, BQ3060_PFStatus,
+};
+static uint16_t * const alarm_dest[] = {
+    &crntAlarms[0], &crntAlarms[1], &crntAlarms[2],
+};
+
+static const uint8_t fast_regs[] = {
+    BQ3060_Current, BQ3060_AverageCurrent, BQ3060_Voltage,
+    BQ3060_CellVoltage4, BQ3060_CellVoltage3, BQ3060_CellVoltage2,
+    BQ3060_CellVoltage1, BQ3060_PackVoltage, BQ3060_AverageVoltage,
+};
+static uint16_t * const fast_dest[] = {
+    (uint16_t *)&buffer.Current, (uint16_t *)&buffer.AverageCurrent, &buffer.Voltage,
+    &buffer.CellVoltage4, &buffer.CellVoltage3, &buffer.CellVoltage2,
+    &buffer.CellVoltage1, &buffer.PackVoltage, &buffer.AverageVoltage,
+};
+
+static const uint8_t slow_regs[] = {
+    BQ3060_Temperature, BQ3060_TS1Temperature, BQ3060_TS2Temperature, BQ3060_TempRange,
+};
+static uint16_t * const slow_dest[] = {
+    &buffer.Temperature, (uint16_t *)&buffer.TS1Temperature,
+    (uint16_t *)&buffer.TS2Temperature, &buffer.TempRange,
+};
+
+static struct group alarms = {
+    .regs = alarm_regs, .dest = alarm_dest, .count = ARRAY_SIZE(alarm_regs),
+    .priority = I2C_PRIO_NORMAL, .deadline = MS2ST(BQ3060_ALARM_MS),
+};
+static struct group fast = {
+    .regs = fast_regs, .dest = fast_dest, .count = ARRAY_SIZE(fast_regs),
+    .priority = I2C_PRIO_LOW, .deadline = MS2ST(BQ3060_FAST_MS),
+};
+static struct group slow = {
+    .regs = slow_regs, .dest = slow_dest, .count = ARRAY_SIZE(slow_regs),
+    .priority = I2C_PRIO_LOW, .deadline = MS2ST(BQ3060_SLOW_MS),
+};
+
+static void group_init(struct group * g){
+    unsigned i;
+
+    chEvtInit(&g->done);
+    for(i = 0; i < g->count; ++i){
+        g->t[i].addr = BQ3060_ADDR;
+        g->t[i].tx = &g->regs[i];
+        g->t[i].txlen = 1;
+        g->t[i].rx = g->rx[i];
+        g->t[i].rxlen = sizeof(g->rx[i]);
+        g->t[i].priority = g->priority;
+        g->t[i].deadline = g->deadline;
+        g->t[i].timeout = SMBUS_TIMEOUT;
+    }
+    g->t[g->count - 1].done = &g->done;
+}
+
+static void group_submit(struct group * g){
+    unsigned i;
+
+    // still out from last time, the bus is behind
+    if(g->t[g->count - 1].status == I2C_TXN_PENDING){
+        return;
+    }
+    chSysLock();
+    for(i = 0; i < g->count; ++i){
+        i2cSchedSubmitI(CONF->I2CD, &g->t[i]);
+    }
+    chSchRescheduleS();
+    chSysUnlock();
+}
+
+/* Copies out what was read, a failed read keeps the last value */
+static void group_collect(struct group * g){
+    unsigned i;
+
+    for(i = 0; i < g->count; ++i){
+        if(g->t[i].status == RDY_OK){
+            g->values[i] = g->rx[i][0] | g->rx[i][1] << 8;
+        }
+    }
+    chSysLock();
+    for(i = 0; i < g->count; ++i){
+        *g->dest[i] = g->values[i];
+    }
+    chSysUnlock();
+}
+
+static void alarms_done(eventid_t id UNUSED){
+    static uint16_t reported[3];
+    static systime_t last_report;
+
+    group_collect(&alarms);
+    //if any battery issues have occurred we fire
+    //the event associated with BQ3060_battery_fault,
+    //right away when they change and once a second while they last
+    if(crntAlarms[0] || crntAlarms[1] || crntAlarms[2]){
+        if(memcmp(reported, crntAlarms, sizeof(reported)) ||
+           chTimeNow() - last_report >= S2ST(1)){
+            memcpy(reported, crntAlarms, sizeof(reported));
+            last_report = chTimeNow();
+            chEvtBroadcast(&BQ3060_battery_fault);
+        }
+    } else {
+        memset(reported, 0, sizeof(reported));
+    }
+}
+
+static void fast_done(eventid_t id UNUSED){
+    group_collect(&fast);
     chEvtBroadcast(&BQ3060_data_ready);
 }
 
+static void slow_done(eventid_t id UNUSED){
+    group_collect(&slow);
+}
+
+static void tick(eventid_t id UNUSED){
+    static unsigned ticks;
+
+    group_submit(&alarms);
+    if(ticks % (BQ3060_SLOW_MS / BQ3060_ALARM_MS) == 0){
+        group_submit(&slow);
+    }
+    if(ticks % (BQ3060_FAST_MS / BQ3060_ALARM_MS) == 0){
+        group_submit(&fast);
+    }
+    ++ticks;
+}
 
 static WORKING_AREA(wa_read, 512);
 static msg_t read_thread(void * p UNUSED){
     chRegSetThreadName("BQ3060");
 
     EvTimer timer;
-    evtInit(&timer, S2ST(1));
+    evtInit(&timer, MS2ST(BQ3060_ALARM_MS));
 
-    struct EventListener eltimer;
+    struct EventListener eltimer, elalarms, elfast, elslow;
     static const evhandler_t evhndl[] = {
-            read_handler
+            tick,
+            alarms_done,
+            fast_done,
+            slow_done
     };
     chEvtRegister(&timer.et_es, &eltimer, 0);
+    chEvtRegister(&alarms.done, &elalarms, 1);
+    chEvtRegister(&fast.done, &elfast, 2);
+    chEvtRegister(&slow.done, &elslow, 3);
 
     evtStart(&timer);
     while(TRUE){
@@ -215,6 +336,10 @@ void BQ3060Start(struct BQ3060Config * conf){
         STD_DUTY_CYCLE,
     };
     i2cUtilsStart(CONF->I2CD, &i2cfg, CONF->I2CP);
+    i2cSchedDevice(CONF->I2CD, BQ3060_ADDR, "BQ3060");
+    group_init(&alarms);
+    group_init(&fast);
+    group_init(&slow);
 
     chThdCreateStatic(wa_read, sizeof(wa_read), NORMALPRIO, read_thread, NULL);
     initialized = true;
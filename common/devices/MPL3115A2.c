@@ -19,146 +19,267 @@ EVENTSOURCE_DECL(MPL3115A2DataEvt);
 static EVENTSOURCE_DECL(MPL3115A2Interrupt);
 
 #define MPL3115A2_ADDR 0x60
-static const systime_t I2C_TIMEOUT = MS2ST(400);
+
+#define SAMPLE_MASK (MPL3115A2_SAMPLE_RING_LEN - 1)
 
 static I2CDriver * I2CD;
 static struct MPL3115A2Config * CONF;
-static struct MPL3115A2Data lastsample;
+
+/* Same arrangement as the MPU9150's: sample_head counts samples added,
+ * sample_tail samples released, and what's between belongs to the consumer.
+ */
+static struct MPL3115A2Sample samples[MPL3115A2_SAMPLE_RING_LEN];
+static volatile uint32_t sample_head;
+static volatile uint32_t sample_tail;
+static struct MPL3115A2Stats stats;
+
+static uint8_t fifo_buf[MPL3115A2_FIFO_LEN * MPL3115A2_FIFO_SAMPLE_LEN];
+static volatile systime_t interrupt_time;
+static systime_t started;               // last one shot conversion start
+
+/* Shortest time between one shot samples, datasheet table 9, per OS ratio */
+static const uint16_t conversion_ms[] = {6, 10, 18, 34, 66, 130, 258, 512};
 
 
 int MPL3115A2_Get(uint8_t register_id, uint8_t* data, int len){
 	chDbgAssert(initialized, DBG_PREFIX"MPL315A2 driver not initialized", NULL);
 
 	uint8_t tx[] = {register_id};
-	i2cflags_t errors;
-	i2cAcquireBus(I2CD);
-	msg_t status = i2cMasterTransmitTimeout(I2CD,  MPL3115A2_ADDR, tx, sizeof(tx), data, len, I2C_TIMEOUT);
-	switch(status){
-	case RDY_OK:
-		i2cReleaseBus(I2CD);
-		break;
-	case RDY_RESET:
-		errors = i2cGetErrors(I2CD);
-		i2cReleaseBus(I2CD);
-		return errors;
-	case RDY_TIMEOUT:
-		i2cReleaseBus(I2CD);
-		return RDY_TIMEOUT;
-	default:
-		i2cReleaseBus(I2CD);
-	}
-
-	return RDY_OK;
+	return i2cSchedTransmit(I2CD, MPL3115A2_ADDR, tx, sizeof(tx), data, len, 0);
 }
 
 int MPL3115A2_Set(uint8_t register_id, uint8_t data){
 	chDbgAssert(initialized, DBG_PREFIX"MPL315A2 driver not initialized", NULL);
 
 	uint8_t tx[] = {register_id, data};
-	i2cflags_t errors;
-	i2cAcquireBus(I2CD);
-	msg_t status = i2cMasterTransmitTimeout(I2CD, MPL3115A2_ADDR, tx, sizeof(tx), NULL, 0, I2C_TIMEOUT);
-	switch(status){
-	case RDY_OK:
-		i2cReleaseBus(I2CD);
-		break;
-	case RDY_RESET:
-		errors = i2cGetErrors(I2CD);
-		i2cReleaseBus(I2CD);
-		return errors;
-	case RDY_TIMEOUT:
-		i2cReleaseBus(I2CD);
-		return RDY_TIMEOUT;
-	default:
-		i2cReleaseBus(I2CD);
-	}
-
-	return RDY_OK;
+	return i2cSchedTransmit(I2CD, MPL3115A2_ADDR, tx, sizeof(tx), NULL, 0, 0);
 }
 
 
-static void get_data(eventid_t id UNUSED){
-
-	uint8_t buf[7]; // XXX should be 6 probs?
-	MPL3115A2_Get(0, buf, sizeof(buf));
+static void add_sample(systime_t time, uint8_t status, const uint8_t * raw){
+	struct MPL3115A2Sample * d;
 
+	if(sample_head - sample_tail >= MPL3115A2_SAMPLE_RING_LEN){
+		++stats.ring_full;
+		return;
+	}
+	d = &samples[sample_head & SAMPLE_MASK];
+	d->time = time;
+	d->data.status = status;
+	d->data.pressure = raw[0] << 16 | raw[1] << 8 | raw[2];
+	d->data.temperature = raw[3] << 8 | raw[4];
 	chSysLock();
-	lastsample.status = buf[0];
-	lastsample.pressure = buf[1] << 16 | buf[2] << 8 | buf[3];
-	lastsample.temperature = buf[4] << 8 | buf[5];
+	++sample_head;
 	chSysUnlock();
+	++stats.samples;
+}
+
+static void start_conversion(void){
+	MPL3115A2_Set(MPL_CTRL_REG1, CONF->os << MPL3115A2_CTL1_OS_BITS | 1 << MPL3115A2_CTL1_OST_BIT);
+	started = chTimeNow();
+}
+
+/* One shot mode: take the finished conversion and start the next */
+static void read_oneshot(systime_t time){
+	uint8_t buf[6];    // STATUS, then pressure and temperature
+
+	// reading STATUS and the data clears DRDY
+	if(MPL3115A2_Get(MPL_STATUS, buf, sizeof(buf)) != RDY_OK){
+		++stats.i2c_errors;
+		return;
+	}
+	if(!(buf[0] & MPL_STATUS_PDR)){
+		// the interrupt for the last one never came, or there isn't one yet
+		if(chTimeNow() - started > MS2ST(2 * conversion_ms[CONF->os])){
+			++stats.stalls;
+			start_conversion();
+		}
+		return;
+	}
+	start_conversion();
+	add_sample(time, buf[0], buf + 1);
 	chEvtBroadcast(&MPL3115A2DataEvt);
+}
 
+/* FIFO mode: everything queued, in one read */
+static void drain_fifo(systime_t time){
+	uint8_t status;
+	unsigned count, i;
+	uint8_t flags = MPL_STATUS_PTDR | MPL_STATUS_PDR | MPL_STATUS_TDR;
+	systime_t step = S2ST(1 << CONF->time_step);
+
+	// reading F_STATUS clears the watermark interrupt
+	if(MPL3115A2_Get(MPL_F_STATUS, &status, 1) != RDY_OK){
+		++stats.i2c_errors;
+		return;
+	}
+	count = status & MPL_F_CNT_MASK;
+	if(count == 0){
+		return;
+	}
+	if(count > MPL3115A2_FIFO_LEN){
+		count = MPL3115A2_FIFO_LEN;
+	}
+	if(MPL3115A2_Get(MPL_F_DATA, fifo_buf, count * MPL3115A2_FIFO_SAMPLE_LEN) != RDY_OK){
+		++stats.i2c_errors;
+		return;
+	}
+	if(status & MPL_F_OVF){
+		++stats.fifo_overflows;
+		flags |= MPL_STATUS_PTOW;
+	}
+	// the newest came in about when the interrupt did, the rest a step apart
+	for(i = 0; i < count; ++i){
+		add_sample(time - (count - 1 - i) * step, flags,
+		           fifo_buf + i * MPL3115A2_FIFO_SAMPLE_LEN);
+		flags &= ~MPL_STATUS_PTOW;
+	}
+	chEvtBroadcast(&MPL3115A2DataEvt);
+}
+
+static void service(systime_t time){
+	if(CONF->fifo){
+		drain_fifo(time);
+	} else {
+		read_oneshot(time);
+	}
 }
 
 static void init(void){
+	uint8_t buf[6];
 
 	MPL3115A2_Set(MPL_CTRL_REG1, 0x0);	 // STANDBY mode
 	MPL3115A2_Set(MPL_PT_DATA_CFG, 0x07);// DRDY | PDEFE | TDEFE
 	MPL3115A2_Set(MPL_CTRL_REG3, 0x10);  // Interrupt active low, open drain
-	MPL3115A2_Set(MPL_CTRL_REG4, 0x80);  // DRDY interrupt
-	MPL3115A2_Set(MPL_CTRL_REG5, 0x80);  // DRDY on int1
 
-	// Clear any active interrupts
-	uint8_t buf[7];
-	MPL3115A2_Get(0, buf, 7);
-
-	MPL3115A2_Set(MPL_CTRL_REG1, 0x1);	 // ACTIVE mode
+	if(CONF->fifo){
+		MPL3115A2_Set(MPL_F_SETUP, 0);   // the FIFO only changes mode through off
+		MPL3115A2_Set(MPL_F_SETUP, MPL_F_MODE_CIRCULAR | CONF->watermark);
+		MPL3115A2_Set(MPL_CTRL_REG2, CONF->time_step);
+		MPL3115A2_Set(MPL_CTRL_REG4, MPL_INT_FIFO);
+		MPL3115A2_Set(MPL_CTRL_REG5, MPL_INT_FIFO);    // FIFO on int1
+		MPL3115A2_Get(MPL_F_STATUS, buf, 1);
+		MPL3115A2_Set(MPL_CTRL_REG1, CONF->os << MPL3115A2_CTL1_OS_BITS |
+		                             1 << MPL3115A2_CTL1_SBYB_BIT); // ACTIVE mode
+	} else {
+		MPL3115A2_Set(MPL_F_SETUP, 0);
+		MPL3115A2_Set(MPL_CTRL_REG4, MPL_INT_DRDY);
+		MPL3115A2_Set(MPL_CTRL_REG5, MPL_INT_DRDY);    // DRDY on int1
+		// Clear any active interrupts
+		MPL3115A2_Get(MPL_STATUS, buf, sizeof(buf));
+		start_conversion();
+	}
 }
 
-#if 0
 static void onInterrupt(EXTDriver *extp UNUSED, expchannel_t channel UNUSED){
 
 	chSysLockFromIsr();
+	interrupt_time = chTimeNow();
 	chEvtBroadcastI(&MPL3115A2Interrupt);
 	chSysUnlockFromIsr();
 }
-#endif
+
+static void interrupt_handler(eventid_t id UNUSED){
+	service(interrupt_time);
+}
+
+static void poll_handler(eventid_t id UNUSED){
+	service(chTimeNow());
+}
 
 static WORKING_AREA(wa, 1024);
 static msg_t commthd(void * p UNUSED){
-	init();
-#if 1
-	// FIXME: I cant get interrupt mode to work
-	EvTimer timer;
-	evtInit(&timer, S2ST(1));
-	struct EventListener eltimer;
 	static const evhandler_t evhndl[] = {
-		get_data
+		interrupt_handler,
+		poll_handler
 	};
-	chEvtRegister(&timer.et_es, &eltimer, 0);
-	evtStart(&timer);
-	while(TRUE){
-		chEvtDispatch(evhndl, chEvtWaitAny(ALL_EVENTS));
-	}
-#else
 	struct EventListener interrupt;
-	static const evhandler_t e[] = {
-		get_data
-	};
-	chEvtRegister(&MPL3115A2Interrupt, &interrupt, 0);
+	struct EventListener eltimer;
+	EvTimer timer;
+	bool use_interrupt = CONF->interrupt.port != NULL;
+	systime_t period;
+
+	chRegSetThreadName("MPL3115A2");
+
+	if(use_interrupt){
+		chEvtRegister(&MPL3115A2Interrupt, &interrupt, 0);
+		palSetPadMode(CONF->interrupt.port, CONF->interrupt.pad, PAL_MODE_INPUT_PULLUP | PAL_STM32_OSPEED_HIGHEST);
+		extAddCallback(&(CONF->interrupt), EXT_CH_MODE_FALLING_EDGE | EXT_CH_MODE_AUTOSTART, onInterrupt);
+		extUtilsStart();
+	}
 
-	palSetPadMode(CONF->interrupt.port, CONF->interrupt.pad, PAL_MODE_INPUT_PULLUP | PAL_STM32_OSPEED_HIGHEST);
-	extAddCallback(&(CONF->interrupt), EXT_CH_MODE_FALLING_EDGE | EXT_CH_MODE_AUTOSTART, onInterrupt);
-	extUtilsStart();
+	/* init() reads whatever interrupt was pending after the callback is in,
+	 * so the line is high again and the first edge isn't lost. Without an
+	 * interrupt the timer does all the work; with one it only catches an
+	 * edge that went missing.
+	 */
+	init();
+
+	if(use_interrupt){
+		period = MS2ST(MPL3115A2_RESCUE_MS);
+	} else if(CONF->fifo){
+		period = S2ST(1 << CONF->time_step);
+	} else {
+		period = MS2ST(conversion_ms[CONF->os]);
+	}
+	evtInit(&timer, period);
+	chEvtRegister(&timer.et_es, &eltimer, 1);
+	evtStart(&timer);
 
-   // get_data(0);
 	while(TRUE){
-		chEvtDispatch(e, chEvtWaitAny(ALL_EVENTS));
+		chEvtDispatch(evhndl, chEvtWaitAny(ALL_EVENTS));
 	}
-#endif
 	return -1;
 }
 
+/*! \brief Copy the latest sample, releasing every sample held */
 void MPL3115A2GetData(struct MPL3115A2Data * data){
+	uint32_t head;
 
 	chSysLock();
-	memcpy(data, &lastsample, sizeof(lastsample));
+	head = sample_head;
+	sample_tail = head;
 	chSysUnlock();
+	memcpy(data, &samples[(head - 1) & SAMPLE_MASK].data, sizeof(*data));
+}
+
+/*! \brief Point at the oldest unreleased sample
+ *
+ * Returns how many samples follow it contiguously in the ring, 0 if there
+ * are none. They stay valid until MPL3115A2SamplesRelease().
+ */
+unsigned MPL3115A2SamplesAcquire(const struct MPL3115A2Sample ** d){
+	uint32_t head, tail;
+	unsigned count;
 
+	chSysLock();
+	head = sample_head;
+	tail = sample_tail;
+	chSysUnlock();
+
+	count = head - tail;
+	if(count > MPL3115A2_SAMPLE_RING_LEN - (tail & SAMPLE_MASK)){
+		count = MPL3115A2_SAMPLE_RING_LEN - (tail & SAMPLE_MASK);
+	}
+	*d = &samples[tail & SAMPLE_MASK];
+	return count;
+}
+
+void MPL3115A2SamplesRelease(unsigned count){
+	chSysLock();
+	sample_tail += count;
+	chSysUnlock();
+}
+
+void MPL3115A2GetStats(struct MPL3115A2Stats * s){
+	chSysLock();
+	*s = stats;
+	chSysUnlock();
 }
 
 void MPL3115A2Start(struct MPL3115A2Config * conf) {
+	chDbgAssert(!conf->fifo || (conf->watermark > 0 && conf->watermark < MPL3115A2_FIFO_LEN
+	            && conf->time_step < 16), DBG_PREFIX"MPL3115A2 FIFO config out of range", NULL);
 	I2CD = conf->i2cd;
 	CONF = conf;
 	static const I2CConfig i2cfg = {
@@ -167,6 +288,7 @@ void MPL3115A2Start(struct MPL3115A2Config * conf) {
 		FAST_DUTY_CYCLE_2,
 	};
 	i2cUtilsStart(I2CD, &i2cfg, &(conf->pins));
+	i2cSchedDevice(I2CD, MPL3115A2_ADDR, "MPL3115A2");
 	initialized=TRUE;
 
 	palSetPadMode(GPIOF, GPIOF_PIN14, PAL_MODE_OUTPUT_PUSHPULL);
@@ -3,80 +3,228 @@
  * API to support reading sensor data from an MPU9150 IMU via I2C.
  *
  * The MPU9150 is an MPU6050 & AKM8975C in the same package with some extra
- * stuff. For this driver the AKM is accessed only in the 9150's master mode.
+ * stuff. For this driver the AKM is accessed in the 9150's I2C bypass mode,
+ * where it sits on the same bus as the 9150 itself.
+ *
+ * A sample is one auto incrementing read of ACCEL_XOUT_H through GYRO_ZOUT_L,
+ * temperature included, instead of a transaction per register byte. In FIFO
+ * mode the 9150 queues those same 14 bytes for every sample and the driver
+ * drains everything queued in a single read of FIFO_R_W every
+ * MPU9150_POLL_MS, so a transaction's overhead is paid once for a whole run
+ * of samples. The 9150 has no FIFO level interrupt, only data ready, which
+ * would be one per sample, so in FIFO mode the interrupt only signals an
+ * overflow.
  */
 
 #include <stddef.h>
 #include <stdbool.h>
+#include <string.h>
 
 #include "ch.h"
 #include "hal.h"
+#include "evtimer.h"
 
 #include "utils_general.h"
 #include "utils_hal.h"
 #include "MPU9150.h"
 
+#define SAMPLE_MASK (MPU9150_SAMPLE_RING_LEN - 1)
 
 static int initialized;
 static I2CDriver *I2CD;
-static const systime_t I2C_TIMEOUT = MS2ST(400);
-static EventSource interrupt;
+static const MPU9150Config * CONF;
+static EVENTSOURCE_DECL(interrupt);
 
-EventSource MPU9150_data_ready;
+EVENTSOURCE_DECL(mpu9150_data_event);
 
-int MPU9150_Get(uint8_t register_id, uint8_t* data){
-	if(initialized == false)
-		return -1;
+/* Decoded samples. sample_head counts samples added, sample_tail counts
+ * samples the consumer has released; everything between the two belongs to
+ * the consumer. Only the read thread adds samples.
+ */
+static MPU9150_read_data samples[MPU9150_SAMPLE_RING_LEN];
+static volatile uint32_t sample_head;
+static volatile uint32_t sample_tail;
 
+static uint8_t fifo_buf[MPU9150_FIFO_SAMPLES * MPU9150_SAMPLE_LEN];
+static uint8_t magn_asa[3];
+static MPU9150_magn_data lastmagn;
+static MPU9150Stats stats;
+
+static int get(uint8_t addr, uint8_t register_id, uint8_t* data, int len){
 	uint8_t tx[] = {register_id};
-	uint8_t rx[1];
-	i2cflags_t errors;
-	i2cAcquireBus(I2CD);
-	msg_t status = i2cMasterTransmitTimeout(I2CD,  MPU9150_a_g_ADDR, tx, sizeof(tx), rx, sizeof(rx), I2C_TIMEOUT);
-	switch(status){
-	case RDY_OK:
-		i2cReleaseBus(I2CD);
-		break;
-	case RDY_RESET:
-		errors = i2cGetErrors(I2CD);
-		i2cReleaseBus(I2CD);
-		return errors;
-	case RDY_TIMEOUT:
-		i2cReleaseBus(I2CD);
-		return RDY_TIMEOUT;
-	default:
-		i2cReleaseBus(I2CD);
+	int r = i2cSchedTransmitPrio(I2CD, addr, I2C_PRIO_HIGH, tx, sizeof(tx), data, len, 0);
+	if(r != RDY_OK){
+		++stats.i2c_errors;
+	}
+	return r;
+}
+
+static int set(uint8_t addr, uint8_t register_id, uint8_t data){
+	uint8_t tx[] = {register_id, data};
+	int r = i2cSchedTransmitPrio(I2CD, addr, I2C_PRIO_HIGH, tx, sizeof(tx), NULL, 0, 0);
+	if(r != RDY_OK){
+		++stats.i2c_errors;
 	}
+	return r;
+}
 
-	*data = rx[0];
-	return RDY_OK;
+/*! \brief Read len registers from register_id on, in one transaction
+ *
+ * The 9150 auto increments the register address, except on FIFO_R_W which
+ * it reads the FIFO through.
+ */
+int MPU9150_Get(uint8_t register_id, uint8_t* data, int len){
+	chDbgAssert(initialized, DBG_PREFIX"MPU9150 driver not initialized", NULL);
+	return get(MPU9150_a_g_ADDR, register_id, data, len);
 }
+
 int MPU9150_Set(uint8_t register_id, uint8_t data){
-	if(initialized == false)
-		return -1;
+	chDbgAssert(initialized, DBG_PREFIX"MPU9150 driver not initialized", NULL);
+	return set(MPU9150_a_g_ADDR, register_id, data);
+}
 
-	uint8_t tx[] = {register_id, data};
-	i2cflags_t errors;
-	i2cAcquireBus(I2CD);
-	msg_t status = i2cMasterTransmitTimeout(I2CD, MPU9150_a_g_ADDR, tx, sizeof(tx), NULL, 0, I2C_TIMEOUT);
-	switch(status){
-	case RDY_OK:
-		i2cReleaseBus(I2CD);
-		break;
-	case RDY_RESET:
-		errors = i2cGetErrors(I2CD);
-		i2cReleaseBus(I2CD);
-		return errors;
-	case RDY_TIMEOUT:
-		i2cReleaseBus(I2CD);
-		return RDY_TIMEOUT;
-	default:
-		i2cReleaseBus(I2CD);
+/* One sample as the registers, or the FIFO, hold it */
+static void decode(const uint8_t * raw, MPU9150_read_data * d){
+	d->accel_xyz.x = raw[0] << 8 | raw[1];
+	d->accel_xyz.y = raw[2] << 8 | raw[3];
+	d->accel_xyz.z = raw[4] << 8 | raw[5];
+	d->celsius     = raw[6] << 8 | raw[7];
+	d->gyro_xyz.x  = raw[8] << 8 | raw[9];
+	d->gyro_xyz.y  = raw[10] << 8 | raw[11];
+	d->gyro_xyz.z  = raw[12] << 8 | raw[13];
+}
+
+/* Adds count raw samples to the ring, dropping what doesn't fit */
+static void add_samples(const uint8_t * raw, unsigned count){
+	unsigned i;
+
+	for(i = 0; i < count; ++i, raw += MPU9150_SAMPLE_LEN){
+		if(sample_head - sample_tail >= MPU9150_SAMPLE_RING_LEN){
+			stats.ring_full += count - i;
+			break;
+		}
+		decode(raw, &samples[sample_head & SAMPLE_MASK]);
+		chSysLock();
+		++sample_head;
+		chSysUnlock();
+		++stats.samples;
 	}
+}
 
+/*! \brief read one sample, accel, temperature and gyro, in one transaction
+ *
+ */
+int mpu9150_read_sample(MPU9150_read_data * d){
+	uint8_t raw[MPU9150_SAMPLE_LEN];
+	int r = MPU9150_Get(A_G_ACCEL_XOUT_H, raw, sizeof(raw));
+	if(r == RDY_OK)
+		decode(raw, d);
+	return r;
+}
+
+static void reset_fifo(void){
+	MPU9150_Set(A_G_USER_CTRL, MPU9150_USER_FIFO_RESET);
+	MPU9150_Set(A_G_USER_CTRL, MPU9150_USER_FIFO_EN);
+}
+
+/* Everything queued, in one read */
+static void drain_fifo(void){
+	uint8_t status;
+	uint16_t count;
+
+	if(MPU9150_Get(A_G_INT_STATUS, &status, 1) != RDY_OK)
+		return;
+	if(status & MPU9150_INT_FIFO_OFLOW){
+		// the oldest samples were overwritten, no telling where one starts
+		++stats.fifo_overflows;
+		reset_fifo();
+		return;
+	}
+
+	count = mpu9150_a_g_fifo_cnt() / MPU9150_SAMPLE_LEN;
+	if(count == 0)
+		return;
+	if(count > MPU9150_FIFO_SAMPLES)
+		count = MPU9150_FIFO_SAMPLES;
+	if(MPU9150_Get(A_G_FIFO_R_W, fifo_buf, count * MPU9150_SAMPLE_LEN) != RDY_OK){
+		reset_fifo();
+		return;
+	}
+	add_samples(fifo_buf, count);
+	chEvtBroadcast(&mpu9150_data_event);
+}
+
+static void read_registers(void){
+	uint8_t raw[MPU9150_SAMPLE_LEN];
+
+	// with INT_RD_CLEAR this read also clears the interrupt
+	if(MPU9150_Get(A_G_ACCEL_XOUT_H, raw, sizeof(raw)) != RDY_OK)
+		return;
+	add_samples(raw, 1);
+	chEvtBroadcast(&mpu9150_data_event);
+}
+
+/* Raw reading times the fuse ROM sensitivity, H * ((ASA - 128) / 256 + 1) */
+static int16_t magn_adjust(int16_t h, uint8_t asa){
+	return h + (int16_t)(((int32_t)h * (asa - 128)) / 256);
+}
+
+/*! \brief read the AK8975's last measurement and start the next
+ *
+ * A measurement takes up to 9ms. Returns -1 if none was ready.
+ */
+int mpu9150_magn_read(MPU9150_magn_data * d){
+	uint8_t raw[8];  // ST1, HXL..HZH, ST2
+	int r = get(MPU9150_magn_ADDR, MAGN_STATUS_1, raw, sizeof(raw));
+	set(MPU9150_magn_ADDR, MAGN_CNTL, MPU9150_MAGN_SINGLE);
+	if(r != RDY_OK)
+		return r;
+	if(!(raw[0] & MPU9150_MAGN_ST1_DRDY))
+		return -1;
+	if(raw[7] & (MPU9150_MAGN_ST2_DERR | MPU9150_MAGN_ST2_HOFL)){
+		++stats.magn_overflows;
+		return -1;
+	}
+	d->x = magn_adjust((int16_t)(raw[2] << 8 | raw[1]), magn_asa[0]);
+	d->y = magn_adjust((int16_t)(raw[4] << 8 | raw[3]), magn_asa[1]);
+	d->z = magn_adjust((int16_t)(raw[6] << 8 | raw[5]), magn_asa[2]);
 	return RDY_OK;
 }
 
+static void magn_start(void){
+	// sensitivity adjustment is only readable in fuse ROM mode
+	set(MPU9150_magn_ADDR, MAGN_CNTL, MPU9150_MAGN_FUSE_ROM);
+	get(MPU9150_magn_ADDR, MAGN_ASAX, magn_asa, sizeof(magn_asa));
+	set(MPU9150_magn_ADDR, MAGN_CNTL, MPU9150_MAGN_POWER_DOWN);
+	set(MPU9150_magn_ADDR, MAGN_CNTL, MPU9150_MAGN_SINGLE);
+}
+
+static void setup(void){
+	mpu9150_reg_data pin_cfg = MPU9150_INT_LEVEL | MPU9150_LATCH_INT_EN | MPU9150_INT_RD_CLEAR;
+
+	mpu9150_reset();
+	MPU9150_set_pm1(MPU9150_PM1_X_GYRO_CLOCKREF);
+	MPU9150_Set(A_G_CONFIG, 0x01);   // DLPF at 184Hz, so a 1kHz sample clock
+	MPU9150_set_gyro_sample_rate_div(CONF->sample_rate_div);
+	MPU9150_set_accel_config(CONF->accel_scale);
+	MPU9150_set_gyro_config(CONF->gyro_scale);
+
+	if(CONF->magn)
+		pin_cfg |= MPU9150_I2C_BYPASS;
+	MPU9150_set_pin_cfg(pin_cfg);
+
+	if(CONF->fifo){
+		reset_fifo();
+		MPU9150_set_fifo_en(MPU9150_FIFO_ACCEL | MPU9150_FIFO_TEMP |
+		                    MPU9150_FIFO_XG | MPU9150_FIFO_YG | MPU9150_FIFO_ZG);
+		MPU9150_set_int_enable(MPU9150_INT_FIFO_OFLOW);
+	} else {
+		MPU9150_set_int_enable(MPU9150_INT_DATA_RDY);
+	}
+
+	if(CONF->magn)
+		magn_start();
+}
 
 static void on_interrupt(EXTDriver *extp UNUSED, expchannel_t channel UNUSED){
 	chSysLockFromIsr();
@@ -84,23 +232,51 @@ static void on_interrupt(EXTDriver *extp UNUSED, expchannel_t channel UNUSED){
 	chSysUnlockFromIsr();
 }
 
-static void get_all_sensors(eventid_t u){
-	i2cMasterTransmitTimeout();
-	chEvtBroadcast(&MPU9150_data_ready);
+static void interrupt_handler(eventid_t id UNUSED){
+	if(CONF->fifo)
+		drain_fifo();
+	else
+		read_registers();
+}
+
+static void poll_handler(eventid_t id UNUSED){
+	MPU9150_magn_data d;
+
+	if(CONF->fifo)
+		drain_fifo();
+	if(CONF->magn && mpu9150_magn_read(&d) == RDY_OK){
+		chSysLock();
+		lastmagn = d;
+		chSysUnlock();
+		++stats.magn_samples;
+	}
 }
 
-static WORKING_AREA(wa_read, 128);
+static WORKING_AREA(wa_read, 512);
 static msg_t read_thd(void * arg UNUSED){
 	chRegSetThreadName("MPU9150");
 
-	struct EventListener listener;
 	static const evhandler_t handlers[] = {
-		get_all_sensors
+		interrupt_handler,
+		poll_handler
 	};
+	struct EventListener listener;
+	struct EventListener poll_listener;
+	EvTimer poll;
+
+	setup();
+
 	chEvtRegister(&interrupt, &listener, 0);
+	if(CONF->fifo || CONF->magn){
+		evtInit(&poll, MS2ST(MPU9150_POLL_MS));
+		chEvtRegister(&poll.et_es, &poll_listener, 1);
+		evtStart(&poll);
+	}
+	// a latched interrupt from before setup would never edge again
+	mpu9150_a_g_read_int_status();
 
 	while (TRUE) {
-		chEvtDispatch(handlers, chEvtWaitOne(ALL_EVENTS));
+		chEvtDispatch(handlers, chEvtWaitAny(ALL_EVENTS));
 	}
 	return -1;
 }
@@ -109,10 +285,11 @@ static msg_t read_thd(void * arg UNUSED){
 /*! \brief Initialize MPU9150 driver
  *
  */
-void MPU9150_init(MPU9150Config  *conf) {
+void MPU9150_init(const MPU9150Config  *conf) {
 //TODO: If I2C is active, check if config is correct
 
 	I2CD = conf->I2CD;
+	CONF = conf;
 
 	static const I2CConfig i2cfg = {
 		OPMODE_I2C,
@@ -120,61 +297,118 @@ void MPU9150_init(MPU9150Config  *conf) {
 		FAST_DUTY_CYCLE_2,
 	};
 	i2cUtilsStart(I2CD, &i2cfg, &(conf->pins));
-	chEvtInit(&MPU9150_data_ready);
-	chEvtinit(&interrupt);
+	i2cSchedDevice(I2CD, MPU9150_a_g_ADDR, "MPU9150");
+	i2cSchedDevice(I2CD, MPU9150_magn_ADDR, "AK8975");
+	initialized = true;
 
-	extAddCallback(conf->interrupt, EXT_CH_MODE_FALLING_EDGE | EXT_CH_MODE_AUTOSTART, on_interrupt);
+	palSetPadMode(conf->interrupt.port, conf->interrupt.pad, PAL_MODE_INPUT_PULLUP);
+	extAddCallback(&(conf->interrupt), EXT_CH_MODE_FALLING_EDGE | EXT_CH_MODE_AUTOSTART, on_interrupt);
 	extUtilsStart();
 
 	chThdCreateStatic(wa_read, sizeof(wa_read), NORMALPRIO, read_thd, NULL);
+}
 
-	initialized = true;
+/*! \brief Copy the latest sample, releasing every sample held
+ *
+ */
+void mpu9150_get_data(MPU9150_read_data * d) {
+	uint32_t head;
+
+	chSysLock();
+	head = sample_head;
+	sample_tail = head;
+	chSysUnlock();
+	// the read thread won't write this slot again until
+	// MPU9150_SAMPLE_RING_LEN - 1 more samples are in
+	memcpy(d, &samples[(head - 1) & SAMPLE_MASK], sizeof(*d));
+}
+
+/*! \brief Point at the oldest unreleased sample
+ *
+ * Returns how many samples follow it contiguously in the ring, 0 if there
+ * are none. They stay valid until mpu9150_samples_release(); anything left
+ * past the end of the ring comes with the next call.
+ */
+unsigned mpu9150_samples_acquire(const MPU9150_read_data ** d) {
+	uint32_t head, tail;
+	unsigned count;
+
+	chSysLock();
+	head = sample_head;
+	tail = sample_tail;
+	chSysUnlock();
+
+	count = head - tail;
+	if(count > MPU9150_SAMPLE_RING_LEN - (tail & SAMPLE_MASK)){
+		count = MPU9150_SAMPLE_RING_LEN - (tail & SAMPLE_MASK);
+	}
+	*d = &samples[tail & SAMPLE_MASK];
+	return count;
+}
+
+void mpu9150_samples_release(unsigned count) {
+	chSysLock();
+	sample_tail += count;
+	chSysUnlock();
+}
+
+void mpu9150_get_magn(MPU9150_magn_data * d) {
+	chSysLock();
+	*d = lastmagn;
+	chSysUnlock();
+}
+
+void mpu9150_get_stats(MPU9150Stats * s) {
+	chSysLock();
+	*s = stats;
+	chSysUnlock();
 }
 
 void mpu9150_reset(void) {
 	/*! Turn on power */
-	MPU9150_set(I2CD, A_G_PWR_MGMT_1, MPU9150_PM1_RESET);
+	MPU9150_Set(A_G_PWR_MGMT_1, MPU9150_PM1_RESET);
 	chThdSleepMilliseconds(200);  // wait for device reset
 
-	MPU9150_set(I2CD, A_G_SIGNAL_PATH_RESET, 0b111);
+	MPU9150_Set(A_G_SIGNAL_PATH_RESET, 0b111);
 	chThdSleepMilliseconds(200);  // wait for signal path reset
 }
 
 void MPU9150_set_pm1(mpu9150_reg_data d) {
 	/*! Turn on power */
-	MPU9150_set(A_G_PWR_MGMT_1, &d);
+	MPU9150_Set(A_G_PWR_MGMT_1, d);
 }
 
 void MPU9150_set_pin_cfg(mpu9150_reg_data d) {
-	MPU9150_set(A_G_INT_PIN_CFG, &d);
+	MPU9150_Set(A_G_INT_PIN_CFG, d);
 }
 
 void MPU9150_set_int_enable(mpu9150_reg_data d) {
-	MPU9150_set(A_G_INT_ENABLE, &d);
+	MPU9150_Set(A_G_INT_ENABLE, d);
 }
 
 void MPU9150_set_accel_config(mpu9150_reg_data d) {
-	MPU9150_set(A_G_ACCEL_CONFIG, &d);
+	MPU9150_Set(A_G_ACCEL_CONFIG, d);
 }
 
 void MPU9150_set_gyro_sample_rate_div(mpu9150_reg_data d) {
-	MPU9150_set(A_G_SMPLRT_DIV, &d);
+	MPU9150_Set(A_G_SMPLRT_DIV, d);
 }
 
 void MPU9150_set_gyro_config(mpu9150_reg_data d) {
-	MPU9150_set(A_G_GYRO_CONFIG, &d);
+	MPU9150_Set(A_G_GYRO_CONFIG, d);
 }
 
 void MPU9150_set_fifo_en(mpu9150_reg_data d) {
-	MPU9150_set(A_G_FIFO_EN, &d);
+	MPU9150_Set(A_G_FIFO_EN, d);
 }
 
 /*! \brief read the accel-gyro id
  *
  */
-void mpu9150_a_g_read_id(void) {
-	mpu9150_reg_data d;
-	MPU9150_get(A_G_WHO_AM_I, &d);
+mpu9150_reg_data mpu9150_a_g_read_id(void) {
+	mpu9150_reg_data d = 0;
+	MPU9150_Get(A_G_WHO_AM_I, &d, 1);
+	return d;
 }
 
 /*! \brief Convert register value to degrees C
@@ -190,91 +424,63 @@ int16_t mpu9150_temp_to_dC(int16_t raw_temp) {
  *
  */
 int16_t mpu9150_a_g_read_temperature(void) {
-	mpu9150_reg_data d;
-
-	int16_t		 raw_temp = 0;
-
-	MPU9150_get(A_G_TEMP_OUT_H, &d);
-	raw_temp = mpu9150_driver.rxbuf[0] << 8;
-
-	MPU9150_get(A_G_TEMP_OUT_L, &d);
-	raw_temp = raw_temp | mpu9150_driver.rxbuf[0];
+	uint8_t raw[2] = {0};
 
-	return raw_temp;
+	MPU9150_Get(A_G_TEMP_OUT_H, raw, sizeof(raw));
+	return raw[0] << 8 | raw[1];
 }
 
 /*! \brief read the interrupt status register
  *
  * Clears interrupt bits
  */
-void mpu9150_a_g_read_int_status(void) {
-	mpu9150_reg_data d;
-	MPU9150_get(A_G_INT_STATUS, &d);
+mpu9150_reg_data mpu9150_a_g_read_int_status(void) {
+	mpu9150_reg_data d = 0;
+	MPU9150_Get(A_G_INT_STATUS, &d, 1);
+	return d;
 }
 
 /*! \brief read the accel-gyro fifo count
  *
  */
 uint16_t mpu9150_a_g_fifo_cnt(void) {
-	mpu9150_reg_data d;
-	uint16_t fifo_count = 0;
+	uint8_t raw[2] = {0};
 
-	MPU9150_get(A_G_FIFO_COUNTH, &d);
-	fifo_count = mpu9150_driver.rxbuf[0] << 8;
-
-	MPU9150_get(A_G_FIFO_COUNTL, &d);
-	fifo_count = fifo_count | (mpu9150_driver.rxbuf[0] << 8);
-
-	return fifo_count;
+	MPU9150_Get(A_G_FIFO_COUNTH, raw, sizeof(raw));
+	return raw[0] << 8 | raw[1];
 }
 
 /*! \brief read the accel x,y,z
  *
  */
 void mpu9150_a_read_x_y_z(MPU9150_accel_data* d) {
-	mpu9150_reg_data rdata = 0;
-
-	MPU9150_get(A_G_ACCEL_XOUT_H, &rdata);
-	d->x = rdata << 8;
-	MPU9150_get(A_G_ACCEL_XOUT_L, &rdata);
-	d->x = (d->x | rdata);
-	MPU9150_get(A_G_ACCEL_YOUT_H, &rdata);
-	d->y = rdata << 8;
-	MPU9150_get(A_G_ACCEL_YOUT_L, &rdata);
-	d->y = (d->y | rdata);
-	MPU9150_get(A_G_ACCEL_ZOUT_H, &rdata);
-	d->z = rdata << 8;
-	MPU9150_get(A_G_ACCEL_ZOUT_L, &rdata);
-	d->z = (d->z | rdata);
+	uint8_t raw[6] = {0};
+
+	MPU9150_Get(A_G_ACCEL_XOUT_H, raw, sizeof(raw));
+	d->x = raw[0] << 8 | raw[1];
+	d->y = raw[2] << 8 | raw[3];
+	d->z = raw[4] << 8 | raw[5];
 }
 
 /*! \brief read the gyro x,y,z
  *
  */
 void mpu9150_g_read_x_y_z(MPU9150_gyro_data* d) {
+	uint8_t raw[6] = {0};
 
-	mpu9150_reg_data rdata = 0;
-
-	MPU9150_get(A_G_GYRO_XOUT_H, &rdata);
-	d->x = rdata << 8;
-	MPU9150_get(A_G_GYRO_XOUT_L, &rdata);
-	d->x= (d->x | rdata);
-	MPU9150_get(A_G_GYRO_YOUT_H, &rdata);
-	d->y= rdata << 8;
-	MPU9150_get(A_G_GYRO_YOUT_L, &rdata);
-	d->y = (d->y | rdata);
-	MPU9150_get(A_G_GYRO_ZOUT_H, &rdata);
-	d->z = rdata << 8;
-	MPU9150_get(A_G_GYRO_ZOUT_L, &rdata);
-	d->z = (d->z | rdata);
+	MPU9150_Get(A_G_GYRO_XOUT_H, raw, sizeof(raw));
+	d->x = raw[0] << 8 | raw[1];
+	d->y = raw[2] << 8 | raw[3];
+	d->z = raw[4] << 8 | raw[5];
 }
 
 /*! \read the magnetometer AK8975C id
  *
  */
-void mpu9150_magn_read_id(void) {
-	mpu9150_reg_data d;
-	MPU9150_get(MAGN_DEVICE_ID, &d);
+mpu9150_reg_data mpu9150_magn_read_id(void) {
+	mpu9150_reg_data d = 0;
+	get(MPU9150_magn_ADDR, MAGN_DEVICE_ID, &d, 1);
+	return d;
 }
 
 //! @}
@@ -74,6 +74,37 @@ typedef struct ADIS16405Data {
 	uint16_t aux_adc;   //  Auxiliary ADC measurement
 } ADIS16405Data;
 
+/*! Bytes clocked in by one burst read, the first two are padding */
+#define ADIS_BURST_EXCHANGE_LEN (sizeof(ADIS16405Data) + 2)
+
+/*! Raw burst frames kept for the consumer, must be a power of two */
+#ifndef ADIS_FRAME_RING_LEN
+#define ADIS_FRAME_RING_LEN 16
+#endif
+
+/*! \typedef ADIS16405Frame
+ * One raw burst read, as DMA left it, with halGetCounterValue() timestamps of
+ * the data ready edge and of the end of the transfer.
+ */
+typedef struct ADIS16405Frame {
+	halrtcnt_t drdy_time;
+	halrtcnt_t done_time;
+	uint8_t    raw[ADIS_BURST_EXCHANGE_LEN];
+} ADIS16405Frame;
+
+/*! \typedef ADIS16405Stats
+ * Frame ring counters. A burst is skipped when every slot is still held by
+ * the consumer (ring_full) or when data ready fires while the last burst or
+ * a register access still has the SPI (spi_busy). frames trails bursts only
+ * while one is in flight.
+ */
+typedef struct ADIS16405Stats {
+	uint32_t bursts;
+	uint32_t frames;
+	uint32_t ring_full;
+	uint32_t spi_busy;
+} ADIS16405Stats;
+
 /*! \typedef adis_config
  *
  * Configuration for the ADIS connections
@@ -100,6 +131,10 @@ void adis_init(const ADIS16405Config * conf);
 uint16_t adis_get(adis_regaddr addr);
 void adis_set(adis_regaddr addr, uint16_t value);
 void adis_get_data(ADIS16405Data * data);
+unsigned adis_frames_acquire(const ADIS16405Frame ** frames);
+void adis_frames_release(unsigned count);
+void adis_frame_decode(const ADIS16405Frame * frame, ADIS16405Data * data);
+void adis_get_stats(ADIS16405Stats * stats);
 void adis_reset(void);
 uint16_t adis_self_test(void);
 
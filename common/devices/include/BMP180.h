@@ -3,22 +3,36 @@
 
 #include "utils_hal.h"
 #include "evtimer.h"
+#include "BMP180_comp.h"
 
 struct BMP180Config {
 	I2CDriver * i2cd;
 	I2CPins pins;
+	int32_t ground_pa;      // altitude is above this pressure, 0 for sea level
 };
 
+/* The raw OUT registers, as sent */
 struct BMP180Data {
 	uint32_t pressure;
 	uint16_t temperature;
 };
 
+/* Compensated with the sensor's own calibration */
+struct BMP180Compensated {
+	int32_t pressure;       // Pa
+	int16_t temperature;    // 0.1 C
+	int32_t altitude;       // cm
+};
+
 extern EventSource BMP180DataEvt;
 extern EvTimer BMP180Timer;
 
 void BMP180_start(const struct BMP180Config * conf);
 void BMP180_getSample(struct BMP180Data * data);
+/* Returns -1 until the calibration is read and a temperature and a
+ * pressure are in
+ */
+int BMP180_getCompensated(struct BMP180Compensated * data);
 int BMP180_softReset(void);
 int BMP180_id(uint8_t * id);
 void BMP180_pump(eventid_t e);
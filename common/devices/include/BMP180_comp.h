@@ -0,0 +1,52 @@
+/*
+ * BMP180 compensation, integer only
+ *
+ * The BMP180 hands over uncompensated temperature (UT) and pressure (UP)
+ * counts. Its EEPROM holds eleven calibration words that turn them into
+ * 0.1 C and Pa with the datasheet's integer algorithm (BST-BMP180-DS000,
+ * section 3.5), which is what's here: 32 bit shifts, multiplies and two
+ * divides, so it suits a Cortex-M4 without touching the FPU. Altitude comes
+ * from a table of the barometric formula over p / p0 and a linear
+ * interpolation, good to half a metre at the sensor's 300 hPa limit and
+ * ten centimetres from there to the ground.
+ *
+ * Nothing in here depends on ChibiOS so it can be tested on a host.
+ */
+
+#ifndef BMP180_COMP_H_
+#define BMP180_COMP_H_
+
+#include <stdint.h>
+
+/* The EEPROM block, AC1 MSB first through MD LSB */
+#define BMP180_CAL_ADDR 0xAA
+#define BMP180_CAL_LEN 22
+
+#define BMP180_SEA_LEVEL_PA 101325
+
+struct BMP180Calibration {
+	int16_t AC1, AC2, AC3;
+	uint16_t AC4, AC5, AC6;
+	int16_t B1, B2;
+	int16_t MB, MC, MD;
+};
+
+/* Unpacks the EEPROM block. Returns -1 if a word reads 0 or 0xFFFF, which
+ * the datasheet says none can, meaning the read went wrong.
+ */
+int BMP180CalibrationParse(const uint8_t * raw, struct BMP180Calibration * cal);
+
+/* Raw counts from the OUT_MSB registers. oss is the oversampling setting, 0 to 3 */
+int32_t BMP180RawTemperature(const uint8_t * raw);
+int32_t BMP180RawPressure(const uint8_t * raw, unsigned oss);
+
+/* Temperature in 0.1 C. b5 gets the intermediate the pressure needs */
+int32_t BMP180Temperature(const struct BMP180Calibration * cal, int32_t ut, int32_t * b5);
+
+/* Pressure in Pa, from up read at oss and the b5 of a recent temperature */
+int32_t BMP180Pressure(const struct BMP180Calibration * cal, int32_t up, unsigned oss, int32_t b5);
+
+/* Height above where the pressure is p0, in cm */
+int32_t BMP180Altitude(int32_t pa, int32_t p0);
+
+#endif
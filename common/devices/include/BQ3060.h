@@ -117,6 +117,20 @@ struct BQ3060Data{
 	uint16_t AverageVoltage;
 };
 
+/* How often each group of registers is read. The alarms go at the
+ * fastest, current and voltages at FAST and temperatures at SLOW, which
+ * must both be multiples of it.
+ */
+#ifndef BQ3060_ALARM_MS
+#define BQ3060_ALARM_MS 200
+#endif
+#ifndef BQ3060_FAST_MS
+#define BQ3060_FAST_MS 1000
+#endif
+#ifndef BQ3060_SLOW_MS
+#define BQ3060_SLOW_MS 10000
+#endif
+
 struct BQ3060Config{
 	I2CDriver *I2CD;
 	I2CPins   *I2CP;
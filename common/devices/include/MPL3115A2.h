@@ -13,6 +13,7 @@
 #ifndef _MPL3115A2_H
 #define _MPL3115A2_H
 
+#include <stdbool.h>
 #include "utils_hal.h"
 
 #define MPL3115A2_CTL1_ALT_BIT 7
@@ -88,8 +89,40 @@ typedef enum {
 } MPL3115A2_os_ratio;
 
 
+/*! DR_STATUS bits, also the STATUS register while the FIFO is off */
+#define MPL_STATUS_PTOW 0x80
+#define MPL_STATUS_PTDR 0x08
+#define MPL_STATUS_PDR  0x04
+#define MPL_STATUS_TDR  0x02
+
+/*! F_STATUS and F_SETUP */
+#define MPL_F_OVF       0x80
+#define MPL_F_WMRK_FLAG 0x40
+#define MPL_F_CNT_MASK  0x3F
+#define MPL_F_MODE_CIRCULAR 0x40
+
+/*! CTRL_REG4 and CTRL_REG5 interrupt sources */
+#define MPL_INT_DRDY    0x80
+#define MPL_INT_FIFO    0x40
+
+#define MPL3115A2_FIFO_LEN 32
+#define MPL3115A2_FIFO_SAMPLE_LEN 5
+
+#ifndef MPL3115A2_SAMPLE_RING_LEN
+#define MPL3115A2_SAMPLE_RING_LEN 64      // a power of two
+#endif
+
+/*! With an interrupt, how often to check for one that got missed */
+#ifndef MPL3115A2_RESCUE_MS
+#define MPL3115A2_RESCUE_MS 1000
+#endif
+
 /*! \typedef  mpl3115a2 data
  *
+ * Raw registers: pressure is Pa in Q18.2 in the top 20 of 24 bits,
+ * temperature is C in Q8.4 in the top 12 of 16. Samples out of the FIFO
+ * have PTDR, PDR and TDR set, and PTOW too on the first after the FIFO
+ * overflowed.
  */
 struct MPL3115A2Data {
 	uint8_t status;
@@ -97,20 +130,53 @@ struct MPL3115A2Data {
 	int16_t temperature;
 };
 
+/*! \typedef A queued sample and when it was taken, in system ticks */
+struct MPL3115A2Sample {
+	systime_t time;
+	struct MPL3115A2Data data;
+};
+
+/*! \typedef Sample queue counters
+ *
+ * ring_full counts samples lost because the consumer held every slot,
+ * fifo_overflows FIFO reads that found samples overwritten, and stalls
+ * one shot conversions restarted after their interrupt never came.
+ */
+struct MPL3115A2Stats {
+	uint32_t samples;
+	uint32_t ring_full;
+	uint32_t fifo_overflows;
+	uint32_t stalls;
+	uint32_t i2c_errors;
+};
+
 /*! \typedef mpl3115a2_config
  *
- * Configuration for the MPU IMU connections
+ * Configuration for the MPL barometer connections and acquisition.
+ *
+ * Without fifo, each one shot conversion starts as the last one is read, so
+ * samples come as fast as the oversampling allows: 6ms at MPL_OS_1 up to
+ * 512ms at MPL_OS_128. With fifo the chip samples on its own every
+ * 2^time_step seconds, the shortest it can, and the driver reads watermark
+ * samples at a time.
  */
 struct MPL3115A2Config {
 	I2CDriver * i2cd;
 	I2CPins pins;
-	struct pin interrupt;
+	struct pin interrupt;        /*! INT1, port NULL to poll instead */
+	MPL3115A2_os_ratio os;
+	bool fifo;
+	uint8_t time_step;           /*! fifo: 0 to 15 */
+	uint8_t watermark;           /*! fifo: 1 to 31 */
 };
 
 extern EventSource MPL3115A2DataEvt;
 
 void MPL3115A2Start(struct MPL3115A2Config * conf);
+int MPL3115A2_Get(uint8_t register_id, uint8_t* data, int len);
+int MPL3115A2_Set(uint8_t register_id, uint8_t data);
 void MPL3115A2GetData(struct MPL3115A2Data * data);
+unsigned MPL3115A2SamplesAcquire(const struct MPL3115A2Sample ** samples);
+void MPL3115A2SamplesRelease(unsigned count);
+void MPL3115A2GetStats(struct MPL3115A2Stats * stats);
 #endif
-
-
@@ -11,11 +11,15 @@
 #ifndef _MPU9150_H
 #define _MPU9150_H
 
+#include <stdbool.h>
+
 #include "ch.h"
 #include "hal.h"
 
 #include "utils_hal.h"
 
+typedef uint8_t mpu9150_reg_data;
+
 /*! register 55 INT pin/Bypass */
 #define     MPU9150_CLKOUT_EN                     ((mpu9150_reg_data)(1<<0))
 #define     MPU9150_I2C_BYPASS                    ((mpu9150_reg_data)(1<<1))
@@ -32,6 +36,48 @@
 #define     MPU9150_PM1_RESET                     ((mpu9150_reg_data)(1<<7))
 #define     MPU9150_INT_EN_DATA_RD_EN             ((mpu9150_reg_data)(1<<0))
 
+/*! register 56 Interrupt enable, register 58 Interrupt status */
+#define     MPU9150_INT_DATA_RDY                  ((mpu9150_reg_data)(1<<0))
+#define     MPU9150_INT_FIFO_OFLOW                ((mpu9150_reg_data)(1<<4))
+
+/*! register 35 FIFO enable */
+#define     MPU9150_FIFO_ACCEL                    ((mpu9150_reg_data)(1<<3))
+#define     MPU9150_FIFO_ZG                       ((mpu9150_reg_data)(1<<4))
+#define     MPU9150_FIFO_YG                       ((mpu9150_reg_data)(1<<5))
+#define     MPU9150_FIFO_XG                       ((mpu9150_reg_data)(1<<6))
+#define     MPU9150_FIFO_TEMP                     ((mpu9150_reg_data)(1<<7))
+
+/*! register 106 User control */
+#define     MPU9150_USER_FIFO_RESET               ((mpu9150_reg_data)(1<<2))
+#define     MPU9150_USER_FIFO_EN                  ((mpu9150_reg_data)(1<<6))
+
+/*! AK8975 CNTL modes, ST1 and ST2 bits */
+#define     MPU9150_MAGN_POWER_DOWN               ((mpu9150_reg_data)0x00)
+#define     MPU9150_MAGN_SINGLE                   ((mpu9150_reg_data)0x01)
+#define     MPU9150_MAGN_FUSE_ROM                 ((mpu9150_reg_data)0x0F)
+#define     MPU9150_MAGN_ST1_DRDY                 ((mpu9150_reg_data)(1<<0))
+#define     MPU9150_MAGN_ST2_DERR                 ((mpu9150_reg_data)(1<<2))
+#define     MPU9150_MAGN_ST2_HOFL                 ((mpu9150_reg_data)(1<<3))
+
+/*! Bytes from ACCEL_XOUT_H to GYRO_ZOUT_L, one sample: accel, temperature,
+ * gyro, big endian. The FIFO queues the same 14 bytes per sample.
+ */
+#define MPU9150_SAMPLE_LEN 14
+
+/*! FIFO size, and the most whole samples it can hold */
+#define MPU9150_FIFO_LEN 1024
+#define MPU9150_FIFO_SAMPLES (MPU9150_FIFO_LEN / MPU9150_SAMPLE_LEN)
+
+/*! Samples kept for the consumer, must be a power of two */
+#ifndef MPU9150_SAMPLE_RING_LEN
+#define MPU9150_SAMPLE_RING_LEN 128
+#endif
+
+/*! How often the FIFO is drained and the AK8975 read, it measures in 9ms */
+#ifndef MPU9150_POLL_MS
+#define MPU9150_POLL_MS 10
+#endif
+
 
 #define MPU9150_a_g_ADDR 0x68    // See page 8 , MPU9150 Register Map and Descriptions r4.0
 #define MPU9150_magn_ADDR 0x0C    // See page 28, MPU9150 Product Specification r4.0
@@ -220,6 +266,7 @@ typedef struct MPU9150_gyro_data MPU9150_gyro_data;
 
 /*! \typedef Read Data from mpu9150
  *
+ * celsius is the raw temperature register, see mpu9150_temp_to_dC()
  */
 struct MPU9150_read_data {
 	MPU9150_gyro_data     gyro_xyz;
@@ -229,36 +276,77 @@ struct MPU9150_read_data {
 
 typedef struct MPU9150_read_data MPU9150_read_data;
 
+/*! \typedef Structure for magnetometer data
+ *
+ * Adjusted by the AK8975's fuse ROM sensitivity, 0.3uT per LSB
+ */
+struct MPU9150_magn_data {
+	int16_t x;
+	int16_t y;
+	int16_t z;
+}  __attribute__((packed)) ;
+typedef struct MPU9150_magn_data MPU9150_magn_data;
+
+/*! \typedef MPU9150Stats
+ * Sample ring counters. A sample is lost when every slot is still held by
+ * the consumer (ring_full); fifo_overflows counts FIFO resets after the
+ * FIFO filled before it was drained.
+ */
+typedef struct {
+	uint32_t samples;
+	uint32_t ring_full;
+	uint32_t fifo_overflows;
+	uint32_t i2c_errors;
+	uint32_t magn_samples;
+	uint32_t magn_overflows;
+} MPU9150Stats;
+
 /*! \typedef mpu9150_config
  *
- * Configuration for the MPU IMU connections
+ * Configuration for the MPU IMU connections and acquisition
  */
 typedef struct {
-	struct pin sda;
-	struct pin scl;
-	struct pin interrupt;
 	I2CDriver * I2CD;
+	I2CPins pins;
+	struct pin interrupt;
+	mpu9150_reg_data sample_rate_div;  /*! 1kHz / (1 + div) samples per second */
+	mpu9150_accel_scale accel_scale;
+	mpu9150_gyro_scale gyro_scale;
+	bool fifo;   /*! queue samples in the FIFO and drain it, else read each one */
+	bool magn;   /*! also read the AK8975, through I2C bypass */
 } MPU9150Config;
 
 
 extern EventSource mpu9150_data_event;
 
-void         mpu9150_start(I2CDriver* i2c) ;
-void         mpu9150_reset(I2CDriver* i2cptr) ;
-
-void         mpu9150_write_gyro_config(I2CDriver* i2cptr, mpu9150_reg_data d) ;
-void         mpu9150_write_accel_config(I2CDriver* i2cptr, mpu9150_reg_data d) ;
-void         mpu9150_a_g_read_id(I2CDriver* i2cptr) ;
-void         mpu9150_magn_read_id(I2CDriver* i2cptr);
-void         mpu9150_write_pm1(I2CDriver* i2cptr, mpu9150_reg_data d) ;
-void         mpu9150_write_pin_cfg(I2CDriver* i2cptr, mpu9150_reg_data d) ;
-void         mpu9150_write_int_enable(I2CDriver* i2cptr, mpu9150_reg_data d) ;
-void         mpu9150_a_g_read_int_status(I2CDriver* i2cptr) ;
-void         mpu9150_a_read_x_y_z(I2CDriver* i2cptr, MPU9150_accel_data* d) ;
-void         mpu9150_g_read_x_y_z(I2CDriver* i2cptr, MPU9150_gyro_data* d) ;
-void         mpu9150_write_gyro_sample_rate_div(I2CDriver* i2cptr, mpu9150_reg_data d) ;
-int16_t      mpu9150_temp_to_dC(int16_t raw_temp) ;
-int16_t      mpu9150_a_g_read_temperature(I2CDriver* i2cptr) ;
+void         MPU9150_init(const MPU9150Config * conf);
+int          MPU9150_Get(uint8_t register_id, uint8_t* data, int len);
+int          MPU9150_Set(uint8_t register_id, uint8_t data);
+void         mpu9150_reset(void);
+
+void         mpu9150_get_data(MPU9150_read_data * d);
+unsigned     mpu9150_samples_acquire(const MPU9150_read_data ** samples);
+void         mpu9150_samples_release(unsigned count);
+void         mpu9150_get_magn(MPU9150_magn_data * d);
+void         mpu9150_get_stats(MPU9150Stats * stats);
+
+int          mpu9150_read_sample(MPU9150_read_data * d);
+int          mpu9150_magn_read(MPU9150_magn_data * d);
+void         MPU9150_set_pm1(mpu9150_reg_data d);
+void         MPU9150_set_pin_cfg(mpu9150_reg_data d);
+void         MPU9150_set_int_enable(mpu9150_reg_data d);
+void         MPU9150_set_accel_config(mpu9150_reg_data d);
+void         MPU9150_set_gyro_sample_rate_div(mpu9150_reg_data d);
+void         MPU9150_set_gyro_config(mpu9150_reg_data d);
+void         MPU9150_set_fifo_en(mpu9150_reg_data d);
+mpu9150_reg_data mpu9150_a_g_read_id(void);
+mpu9150_reg_data mpu9150_magn_read_id(void);
+mpu9150_reg_data mpu9150_a_g_read_int_status(void);
+uint16_t     mpu9150_a_g_fifo_cnt(void);
+void         mpu9150_a_read_x_y_z(MPU9150_accel_data* d);
+void         mpu9150_g_read_x_y_z(MPU9150_gyro_data* d);
+int16_t      mpu9150_temp_to_dC(int16_t raw_temp);
+int16_t      mpu9150_a_g_read_temperature(void);
 
 /*!
  * @}
@@ -8,6 +8,8 @@
  * \addtogroup psas_sdclog
  * @{
  */
+#include <stddef.h>
+
 #include "ch.h"
 #include "hal.h"
 #include "ff.h"
@@ -16,16 +18,20 @@
 #include "usbdetail.h"
 
 #include "crc_16_reflect.h"
+#include "sdcblock.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 
-/* A 162 byte message written at 1000hz will use 4GB in about 6.5 Hours */
+/* A full GENERIC_message written at 1000hz will use 4GB in about 6.5 Hours.
+ * Only the head and data_length bytes of payload are written to the card
+ * though (sdc_message_bytes), so a 24 byte ADIS or MPL sample at 1000hz takes
+ * about 20 hours.
+ */
 #define         SDC_MAX_PAYLOAD_BYTES                       150
 #define         SDC_NUM_ID_CHARS                            4
-#define         SDC_BOM_MARK                                0x5a5a
 #define         SDC_MARKER_BYTES                            ((int) (SDC_MAX_PAYLOAD_BYTES + 50))
 
 
@@ -47,19 +53,6 @@ typedef struct sdc_eod_marker {
 	uint8_t sdc_eodmarks[SDC_MARKER_BYTES];
 } sdc_eod_marker;
 
-typedef enum SDC_ERRORCode {
-	SDC_OK                   = 0,
-	SDC_NULL_PARAMETER_ERROR = -1,
-	SDC_FSYNC_ERROR          = -2,
-	SDC_FWRITE_ERROR         = -3,
-	SDC_SYNC_ERROR           = -4,
-	SDC_FREAD_ERROR          = -5,
-	SDC_ASSERT_ERROR         = -6,
-	SDC_CHECKSUM_ERROR       = -7,
-	SDC_FSEEK_ERROR          = -8,
-	SDC_UNKNOWN_ERROR        = -99
-} SDC_ERRORCode;
-
 struct Message_head {
 	char                 ID[SDC_NUM_ID_CHARS];         // This must be first part of data. Reserved value: 0xa5a5
 	uint32_t             index;
@@ -85,6 +78,15 @@ struct GENERIC_message {
 } __attribute__((packed));
 typedef struct GENERIC_message GENERIC_message;
 
+/*! Bytes of a GENERIC_message that are written to the card */
+static inline size_t sdc_message_bytes(const GENERIC_message* d) {
+	uint16_t len = d->mh.data_length;
+	if(len > SDC_MAX_PAYLOAD_BYTES) {
+		len = SDC_MAX_PAYLOAD_BYTES;
+	}
+	return offsetof(GENERIC_message, data) + len;
+}
+
 static inline void sdc_reset_fp_index(void) {
 	sdc_fp_index = 0;
 }
@@ -107,8 +109,11 @@ FRESULT         sdc_scan_files(BaseSequentialStream *chp, char *path) ;
 SDC_ERRORCode sdc_f_write(FIL* fp, void* buff, unsigned int btr,  unsigned int*  bytes_written);
 SDC_ERRORCode sdc_f_read(FIL* fp, void* buff, unsigned int btr,  unsigned int*  bytes_read) ;
 
+SDC_ERRORCode sdc_check_message(FIL* df, DWORD ofs, DWORD* entry_bytes) ;
 SDC_ERRORCode sdc_seek_eod(FIL* DATAFil ) ;
 
+void          sdc_fatfs_storage(SDCStorage* st, FIL* DATAFil) ;
+
 #ifdef __cplusplus
 }
 #endif
@@ -55,7 +55,9 @@ static const    unsigned        sdc_polling_interval             = 10;
 static const    unsigned        sdc_polling_delay                = 10;
 
 static          sdc_eod_marker  sdc_eod;
-static          uint16_t        sdc_bom_marker                   = SDC_BOM_MARK;
+
+/* Room to look for the next good message or eod marks past a bad message */
+static          uint8_t         sdc_scan_buf[2 * (sizeof(GENERIC_message) + SDC_ENTRY_OVERHEAD) + SDC_MARKER_BYTES];
 
 static          unsigned        sdc_debounce_count               = 0;
 
@@ -319,23 +321,33 @@ SDC_ERRORCode sdc_write_checksum(FIL* DATAFil, crc_t* crcd, uint32_t* bw) {
 }
 
 /*! \brief Store GENERIC_message to the SD card
- * Store 2 byte BOM (Beginning of message marker) befor GENERIC message.
- * This will be used to find the start of messages when searching for last good
- * data message in \sa sdc_seek_eom
+ * Store 2 byte BOM (Beginning of message marker) and 2 byte length before the
+ * GENERIC message, then only as much of the message as sdc_message_bytes()
+ * says is used. The BOM will be used to find the start of messages when
+ * searching for last good data message in \sa sdc_seek_eod
+ *
+ * The checksum written after it by sdc_write_checksum must cover the same
+ * sdc_message_bytes() of the message.
+ *
+ * Entry layout is the version 2 one from sdcblock.h:
+ * [SDC_BOM_MARK_V2][len][GENERIC_message, len bytes][chksum]
 */
 SDC_ERRORCode sdc_write_log_message(FIL* DATAFil, GENERIC_message* d, uint32_t* bw) {
 	SDC_ERRORCode rc;
+	uint16_t      head[2];
 
 	if((DATAFil == NULL) || (d==NULL) || (bw == NULL)) {
 		return SDC_NULL_PARAMETER_ERROR;
 	}
 
-	rc = sdc_f_write(DATAFil, (void *)(&sdc_bom_marker), sizeof(uint16_t), (unsigned int*) bw);
+	head[0] = SDC_BOM_MARK_V2;
+	head[1] = sdc_message_bytes(d);
+	rc = sdc_f_write(DATAFil, (void *)(head), sizeof(head), (unsigned int*) bw);
 	if(rc != SDC_OK ) {
 		return SDC_FWRITE_ERROR;
 	}
 
-	rc = sdc_f_write(DATAFil, (void *)(d), sizeof(GENERIC_message), (unsigned int*) bw);
+	rc = sdc_f_write(DATAFil, (void *)(d), head[1], (unsigned int*) bw);
 	if (rc)  {
 		return SDC_FWRITE_ERROR;
 	}
@@ -435,39 +447,76 @@ SDC_ERRORCode sdc_f_read(FIL* fp, void* buff, unsigned int btr,  unsigned int*	b
 	return SDC_OK;
 }
 
-SDC_ERRORCode sdc_check_message(FIL* df, DWORD ofs) {
+/*! \brief Check the log entry that starts (with its BOM) at ofs
+ *
+ * Both the fixed size version 1 entries and the length prefixed version 2
+ * entries from sdcblock.h are understood. On SDC_OK entry_bytes holds the
+ * length of the whole entry, BOM through checksum. The file pointer is
+ * restored either way.
+ */
+SDC_ERRORCode sdc_check_message(FIL* df, DWORD ofs, DWORD* entry_bytes) {
 	SDC_ERRORCode sdc_ret;
 
 	DWORD saved_ofs = sdc_fp_index;
-	crc_t crcd, crcd_calc;
-	uint8_t rd[sizeof(GENERIC_message)];
+	uint8_t rd[sizeof(GENERIC_message) + SDC_ENTRY_OVERHEAD];
 	unsigned int bytes_read;
+	size_t entry;
 
-	sdc_ret = sdc_set_fp_index(df, ofs) ;
-	if(sdc_ret != SDC_OK) { return sdc_ret; }
+	if((df == NULL) || (entry_bytes == NULL)) {
+		return SDC_NULL_PARAMETER_ERROR;
+	}
 
-	sdc_ret  = sdc_f_read(df, rd, sizeof(GENERIC_message), &bytes_read);
+	sdc_ret = sdc_set_fp_index(df, ofs) ;
 	if(sdc_ret != SDC_OK) { return sdc_ret; }
 
-	sdc_ret = sdc_f_read(df, &crcd, sizeof(crc_t), &bytes_read);
+	// a short read at the end of the file just means a short entry
+	sdc_ret  = sdc_f_read(df, rd, sizeof(rd), &bytes_read);
 	if(sdc_ret != SDC_OK) { return sdc_ret; }
 
-	// calc checksum
-	crcd_calc = crc_init();
-	crcd_calc = crc_update(crcd_calc, (const unsigned char*) &rd, sizeof(GENERIC_message));
-	crcd_calc = crc_finalize(crcd_calc);
-	if(crcd != crcd_calc) {
-		SDCDEBUG("%s: No valid checksum in data. Data: %u\tvs.\tCalc: %u\r\n", __func__, crcd, crcd_calc);
+	entry = sdc_entry_check(rd, bytes_read, sizeof(GENERIC_message));
 
-		sdc_ret = sdc_set_fp_index(df, saved_ofs) ;
-		if(sdc_ret != SDC_OK) { return sdc_ret; }
+	sdc_ret = sdc_set_fp_index(df, saved_ofs) ;
+	if(sdc_ret != SDC_OK) { return sdc_ret; }
 
+	if(entry == 0) {
 		return SDC_CHECKSUM_ERROR;
 	}
-	sdc_ret = sdc_set_fp_index(df, saved_ofs) ;
+	*entry_bytes = entry;
+	return SDC_OK;
+}
+
+/*! \brief Work out what follows a bad entry at ofs
+ *
+ * Eod marks before any good message means ofs is the end of data, a torn
+ * write of the last message. A good message before any eod marks means a
+ * damaged message in the middle of the log, carry on from there (resync).
+ * Returns the offset to continue from in next, or SDC_NO_EOD_ERROR if ofs is
+ * the end of data.
+ */
+static SDC_ERRORCode sdc_resync(FIL* df, DWORD ofs, DWORD* next) {
+	SDC_ERRORCode sdc_ret;
+	unsigned int  bytes_read;
+	unsigned int  i;
+	uint16_t      mark;
+
+	sdc_ret = sdc_set_fp_index(df, ofs) ;
 	if(sdc_ret != SDC_OK) { return sdc_ret; }
 
-	return SDC_OK;
+	sdc_ret = sdc_f_read(df, sdc_scan_buf, sizeof(sdc_scan_buf), &bytes_read);
+	if(sdc_ret != SDC_OK) { return sdc_ret; }
+
+	// Messages aren't halfword aligned any more, so step a byte at a time
+	for(i = 0; i + sizeof(uint16_t) <= bytes_read; ++i) {
+		memcpy(&mark, &sdc_scan_buf[i], sizeof(mark));
+		if(mark == sdc_eod.marker) {
+			return SDC_NO_EOD_ERROR;
+		}
+		if(i > 0 && sdc_entry_check(&sdc_scan_buf[i], bytes_read - i, sizeof(GENERIC_message))) {
+			*next = ofs + i;
+			return SDC_OK;
+		}
+	}
+	return SDC_NO_EOD_ERROR;
 }
 
 /*!
@@ -476,76 +525,51 @@ SDC_ERRORCode sdc_check_message(FIL* df, DWORD ofs) {
  *
  * Track from reset due to power cycle or watchdog for instance.
  *
+ * Hops from message to message using each entry's length, so the cost is
+ * per message rather than per halfword of the file.
  */
 SDC_ERRORCode sdc_seek_eod(FIL* DATAFil ) {
 	SDC_ERRORCode sdc_ret;
 
-	int32_t i ;
-	unsigned int bytes_read;
-	uint16_t eod_marker = 0xff;
-	uint16_t bom_marker = 0xff;
+	DWORD ofs = 0;
+	DWORD entry = 0;
 	unsigned int bw = 0;
-	DWORD jumpsize = (DWORD) (sizeof(GENERIC_message) + sizeof(crc_t));
 
 	sdc_reset_fp_index();
 
 	/* step 0: If first line has valid (checksum) data, then seek to end of data , else return	*/
-	sdc_ret = sdc_check_message(DATAFil, 2) ;
-	if(sdc_ret != SDC_OK) {
-		SDCDEBUG("%s: First message failed checksum\t%lu\r\n", __func__ );
-		sdc_reset_fp_index();
-		return sdc_ret;
-	}
-
-	// we are now at byte 2, go to end of first good message
-	sdc_ret = sdc_set_fp_index(DATAFil, sdc_fp_index + jumpsize) ;
+	sdc_ret = sdc_check_message(DATAFil, 0, &entry) ;
 	if(sdc_ret != SDC_OK) {
+		SDCDEBUG("%s: First message failed checksum\r\n", __func__ );
 		sdc_reset_fp_index();
 		return sdc_ret;
 	}
 
-	// check next halfword for eod marker....
-	sdc_ret = sdc_f_read(DATAFil, &eod_marker, sizeof(uint16_t), &bytes_read);
-	if(sdc_ret != SDC_OK) {
-		sdc_reset_fp_index();
-		return sdc_ret;
-	}
+	/* step 1: walk the messages until one doesn't check out */
+	while(TRUE) {
+		ofs += entry;
+		sdc_ret = sdc_check_message(DATAFil, ofs, &entry) ;
+		if(sdc_ret == SDC_OK) {
+			continue;
+		}
+		if(sdc_ret != SDC_CHECKSUM_ERROR) {
+			sdc_reset_fp_index();
+			return sdc_ret;
+		}
 
-	while(eod_marker != sdc_eod.marker) {
-		sdc_ret = sdc_f_read(DATAFil, &eod_marker, sizeof(uint16_t), &bytes_read);
+		sdc_ret = sdc_resync(DATAFil, ofs, &ofs);
+		if(sdc_ret == SDC_NO_EOD_ERROR) {
+			break;
+		}
 		if(sdc_ret != SDC_OK) {
 			sdc_reset_fp_index();
 			return sdc_ret;
 		}
+		SDCDEBUG("%s: skipped bad message, resync at %lu\r\n", __func__, ofs);
+		entry = 0;
 	}
 
-	// Found eod marker back up two previous messages
-	// If there is only one message in the file...just start over.
-	for(i=0 ; i<2; ++i) {
-		long int backjump	  = 0;
-		do {
-			backjump = sdc_fp_index - 4;
-			if(backjump < 0) {
-				sdc_reset_fp_index();
-				return SDC_UNKNOWN_ERROR;
-			}
-			sdc_ret = sdc_set_fp_index(DATAFil, sdc_fp_index - 4 ) ;
-			sdc_ret = sdc_f_read(DATAFil, &bom_marker, sizeof(uint16_t), &bytes_read);
-			if(sdc_ret != SDC_OK) {
-				sdc_reset_fp_index();
-				return sdc_ret;
-			}
-		} while (bom_marker != SDC_BOM_MARK) ;
-
-	}
-
-	sdc_ret = sdc_check_message(DATAFil, (DWORD) sdc_fp_index) ;
-	if(sdc_ret != SDC_OK) {
-		sdc_reset_fp_index();
-		return sdc_ret;
-	}
-
-	sdc_ret = sdc_set_fp_index(DATAFil, sdc_fp_index+jumpsize);
+	sdc_ret = sdc_set_fp_index(DATAFil, ofs);
 	if(sdc_ret != SDC_OK) {
 		sdc_reset_fp_index();
 		return sdc_ret;
@@ -570,5 +594,78 @@ SDC_ERRORCode sdc_seek_eod(FIL* DATAFil ) {
 	return SDC_OK;
 }
 
+/*
+ * SDCStorage for the block log (sdcblock.c) on top of a fatfs FIL.
+ * Like the wrappers above, try each operation twice before failing.
+ */
+static SDC_ERRORCode sdc_fatfs_write(void* ctx, uint32_t ofs, const void* buff, size_t btw) {
+	FIL*          fp = ctx;
+	SDC_ERRORCode sdc_ret;
+	FRESULT       f_ret;
+	UINT          bw = 0;
+
+	sdc_ret = sdc_set_fp_index(fp, ofs);
+	if(sdc_ret != SDC_OK) {
+		return sdc_ret;
+	}
+
+	f_ret = f_write(fp, buff, btw, &bw);
+	if(f_ret != FR_OK || bw != btw) {
+		SDCDEBUG("%s: f_write error: %d\tbtw: %d\tbw: %d\r\n", __func__, f_ret, btw, bw);
+		sdc_ret = sdc_set_fp_index(fp, ofs);
+		if(sdc_ret != SDC_OK) {
+			return sdc_ret;
+		}
+		f_ret = f_write(fp, buff, btw, &bw);
+		if(f_ret != FR_OK || bw != btw) {
+			return SDC_FWRITE_ERROR;
+		}
+	}
+	sdc_fp_index += bw;
+	return SDC_OK;
+}
+
+static SDC_ERRORCode sdc_fatfs_read(void* ctx, uint32_t ofs, void* buff, size_t btr) {
+	FIL*          fp = ctx;
+	SDC_ERRORCode sdc_ret;
+	unsigned int  br = 0;
+
+	if(ofs + btr > f_size(fp)) {
+		return SDC_FREAD_ERROR;
+	}
+	sdc_ret = sdc_set_fp_index(fp, ofs);
+	if(sdc_ret != SDC_OK) {
+		return sdc_ret;
+	}
+	sdc_ret = sdc_f_read(fp, buff, btr, &br);
+	if(sdc_ret != SDC_OK) {
+		return sdc_ret;
+	}
+	return (br == btr) ? SDC_OK : SDC_FREAD_ERROR;
+}
+
+static SDC_ERRORCode sdc_fatfs_sync(void* ctx) {
+	FIL*    fp = ctx;
+	FRESULT f_ret;
+
+	f_ret = f_sync(fp);
+	if (f_ret) {
+		f_ret = f_sync(fp);
+		if (f_ret) {
+			SDCDEBUG("f_sync error: %d\r\n", f_ret);
+			return SDC_SYNC_ERROR;
+		}
+	}
+	return SDC_OK;
+}
+
+/*! \brief Fill out an SDCStorage that logs to an open fatfs file */
+void sdc_fatfs_storage(SDCStorage* st, FIL* DATAFil) {
+	st->write = sdc_fatfs_write;
+	st->read  = sdc_fatfs_read;
+	st->sync  = sdc_fatfs_sync;
+	st->ctx   = DATAFil;
+}
+
 
 //! @}
@@ -0,0 +1,364 @@
+/*
+ * fc_capture.c
+ *
+ * High rate datagram capture, see fc_capture.h.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "fc_capture.h"
+
+static uint64_t realtime_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int write_all(int fd, const uint8_t* p, size_t len) {
+	while(len > 0) {
+		ssize_t n = write(fd, p, len);
+		if(n < 0) {
+			if(errno == EINTR) {
+				continue;
+			}
+			return -1;
+		}
+		p   += n;
+		len -= n;
+	}
+	return 0;
+}
+
+/* Writer */
+
+static void* writer_thread(void* ptr) {
+	struct fc_writer* w = ptr;
+
+	pthread_mutex_lock(&w->lock);
+	while(true) {
+		while(w->queued == 0 && !w->closing) {
+			pthread_cond_wait(&w->queued_cond, &w->lock);
+		}
+		if(w->queued == 0) {
+			break;
+		}
+		unsigned i = w->next_write;
+		pthread_mutex_unlock(&w->lock);
+
+		// the buffer is ours until queued drops, so no lock while writing
+		int ret = write_all(w->fd, w->buf[i], w->used[i]);
+
+		pthread_mutex_lock(&w->lock);
+		if(ret < 0 && w->error == 0) {
+			w->error = errno;
+		}
+		++w->writes;
+		w->next_write = (w->next_write + 1) % FC_WRITER_BUFFERS;
+		--w->queued;
+		pthread_cond_signal(&w->free_cond);
+	}
+	pthread_mutex_unlock(&w->lock);
+	return NULL;
+}
+
+/* Hands the buffer being filled to the writer thread. Call with the lock held.
+ * One buffer is always left for filling, so there's only room for
+ * FC_WRITER_BUFFERS - 1 in the queue.
+ */
+static bool queue_fill(struct fc_writer* w, bool wait) {
+	while(w->queued == FC_WRITER_BUFFERS - 1) {
+		if(!wait) {
+			return false;
+		}
+		pthread_cond_wait(&w->free_cond, &w->lock);
+	}
+	++w->queued;
+	pthread_cond_signal(&w->queued_cond);
+	w->fill = (w->fill + 1) % FC_WRITER_BUFFERS;
+	w->used[w->fill] = 0;
+	return true;
+}
+
+int fc_writer_open(struct fc_writer* w, const char* path) {
+	struct fc_capture_head head;
+	unsigned i;
+
+	memset(w, 0, sizeof(*w));
+	w->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if(w->fd < 0) {
+		return -1;
+	}
+	for(i = 0; i < FC_WRITER_BUFFERS; ++i) {
+		w->buf[i] = malloc(FC_WRITER_BUFSIZE);
+		if(w->buf[i] == NULL) {
+			goto fail;
+		}
+	}
+
+	memset(&head, 0, sizeof(head));
+	memcpy(head.magic, FC_CAPTURE_MAGIC, sizeof(FC_CAPTURE_MAGIC));
+	head.version     = FC_CAPTURE_VERSION;
+	head.record_size = sizeof(struct fc_record);
+	memcpy(w->buf[0], &head, sizeof(head));
+	w->used[0] = sizeof(head);
+
+	pthread_mutex_init(&w->lock, NULL);
+	pthread_cond_init(&w->queued_cond, NULL);
+	pthread_cond_init(&w->free_cond, NULL);
+	errno = pthread_create(&w->thread, NULL, writer_thread, w);
+	if(errno == 0) {
+		return 0;
+	}
+
+fail:
+	for(i = 0; i < FC_WRITER_BUFFERS; ++i) {
+		free(w->buf[i]);
+	}
+	close(w->fd);
+	return -1;
+}
+
+int fc_writer_put(struct fc_writer* w, const struct fc_record* r, const void* data) {
+	size_t need = sizeof(*r) + r->len;
+
+	// only this thread changes fill and its used, the lock is for the queue
+	if(w->used[w->fill] + need > FC_WRITER_BUFSIZE) {
+		pthread_mutex_lock(&w->lock);
+		bool room = queue_fill(w, false);
+		pthread_mutex_unlock(&w->lock);
+		if(!room) {
+			++w->dropped;
+			return -1;
+		}
+	}
+
+	uint8_t* p = w->buf[w->fill] + w->used[w->fill];
+	if(w->used[w->fill] == 0) {
+		w->fill_since_ns = r->t_ns;
+	}
+	memcpy(p, r, sizeof(*r));
+	memcpy(p + sizeof(*r), data, r->len);
+	w->used[w->fill] += need;
+	++w->records;
+	w->bytes += need;
+
+	// slow streams still reach the disk every so often
+	if(r->t_ns - w->fill_since_ns >= FC_WRITER_MAX_AGE_NS) {
+		fc_writer_flush(w);
+	}
+	return 0;
+}
+
+void fc_writer_flush(struct fc_writer* w) {
+	if(w->used[w->fill] == 0) {
+		return;
+	}
+	pthread_mutex_lock(&w->lock);
+	queue_fill(w, false);
+	pthread_mutex_unlock(&w->lock);
+}
+
+int fc_writer_close(struct fc_writer* w) {
+	unsigned i;
+
+	pthread_mutex_lock(&w->lock);
+	if(w->used[w->fill] > 0) {
+		queue_fill(w, true);
+	}
+	w->closing = true;
+	pthread_cond_signal(&w->queued_cond);
+	pthread_mutex_unlock(&w->lock);
+	pthread_join(w->thread, NULL);
+
+	for(i = 0; i < FC_WRITER_BUFFERS; ++i) {
+		free(w->buf[i]);
+	}
+	pthread_mutex_destroy(&w->lock);
+	pthread_cond_destroy(&w->queued_cond);
+	pthread_cond_destroy(&w->free_cond);
+
+	if(close(w->fd) < 0 && w->error == 0) {
+		w->error = errno;
+	}
+	if(w->error) {
+		errno = w->error;
+		return -1;
+	}
+	return 0;
+}
+
+/* Receiver */
+
+int fc_recv_init(struct fc_receiver* r, int fd) {
+	int on = 1;
+	int size = FC_RECV_RCVBUF;
+	socklen_t len = sizeof(r->rcvbuf);
+	struct timeval tv = {
+		.tv_sec  = FC_RECV_TIMEOUT_MS / 1000,
+		.tv_usec = (FC_RECV_TIMEOUT_MS % 1000) * 1000,
+	};
+	unsigned i;
+
+	memset(r, 0, sizeof(*r));
+	r->fd = fd;
+
+	if(setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on)) < 0) {
+		return -1;
+	}
+	if(setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) < 0) {
+		return -1;
+	}
+	// RCVBUFFORCE gets past rmem_max when we're allowed to, otherwise take
+	// what the kernel will give
+	if(setsockopt(fd, SOL_SOCKET, SO_RCVBUFFORCE, &size, sizeof(size)) < 0) {
+		setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+	}
+	getsockopt(fd, SOL_SOCKET, SO_RCVBUF, &r->rcvbuf, &len);
+
+	for(i = 0; i < FC_RECV_BATCH; ++i) {
+		r->iov[i].iov_base          = r->data[i];
+		r->iov[i].iov_len           = FC_RECV_MAXLEN;
+		r->msgs[i].msg_hdr.msg_iov    = &r->iov[i];
+		r->msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+	return 0;
+}
+
+static void record_addr(struct fc_record* rec, const struct sockaddr_storage* from) {
+	memset(rec->addr, 0, sizeof(rec->addr));
+	rec->port = 0;
+	if(from->ss_family == AF_INET) {
+		const struct sockaddr_in* in = (const struct sockaddr_in*) from;
+		rec->addr[10] = 0xff;
+		rec->addr[11] = 0xff;
+		memcpy(rec->addr + 12, &in->sin_addr, 4);
+		rec->port = ntohs(in->sin_port);
+	} else if(from->ss_family == AF_INET6) {
+		const struct sockaddr_in6* in6 = (const struct sockaddr_in6*) from;
+		memcpy(rec->addr, &in6->sin6_addr, 16);
+		rec->port = ntohs(in6->sin6_port);
+	}
+}
+
+/* Returns the SO_TIMESTAMPNS time, or 0 if there isn't one */
+static uint64_t kernel_time(struct msghdr* h) {
+	struct cmsghdr* c;
+
+	for(c = CMSG_FIRSTHDR(h); c != NULL; c = CMSG_NXTHDR(h, c)) {
+		if(c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_TIMESTAMPNS) {
+			struct timespec ts;
+			memcpy(&ts, CMSG_DATA(c), sizeof(ts));
+			return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+		}
+	}
+	return 0;
+}
+
+int fc_recv_poll(struct fc_receiver* r, struct fc_writer* w, fc_datagram_fn fn, void* user) {
+	uint64_t host_ns = 0;
+	int i, n;
+
+	// the kernel writes these back, so they need resetting every call
+	for(i = 0; i < FC_RECV_BATCH; ++i) {
+		r->msgs[i].msg_hdr.msg_name       = &r->from[i];
+		r->msgs[i].msg_hdr.msg_namelen    = sizeof(r->from[i]);
+		r->msgs[i].msg_hdr.msg_control    = r->control[i];
+		r->msgs[i].msg_hdr.msg_controllen = sizeof(r->control[i]);
+		r->msgs[i].msg_hdr.msg_flags      = 0;
+	}
+
+	// block for the first, then take whatever else is already queued
+	n = recvmmsg(r->fd, r->msgs, FC_RECV_BATCH, MSG_WAITFORONE, NULL);
+	if(n < 0) {
+		if(errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+			// idle, so whatever's buffered may as well go to disk
+			if(w != NULL) {
+				fc_writer_flush(w);
+			}
+			return 0;
+		}
+		return -1;
+	}
+
+	++r->batches;
+	if((unsigned) n > r->largest_batch) {
+		r->largest_batch = n;
+	}
+
+	for(i = 0; i < n; ++i) {
+		struct msghdr* h = &r->msgs[i].msg_hdr;
+		struct fc_record rec;
+
+		rec.flags = 0;
+		rec.t_ns  = kernel_time(h);
+		if(rec.t_ns == 0) {
+			if(host_ns == 0) {
+				host_ns = realtime_ns();
+			}
+			rec.t_ns   = host_ns;
+			rec.flags |= FC_RECORD_HOST_TIME;
+		}
+		if(h->msg_flags & MSG_TRUNC) {
+			rec.flags |= FC_RECORD_TRUNCATED;
+			++r->truncated;
+		}
+		rec.len = r->msgs[i].msg_len < FC_RECV_MAXLEN ? r->msgs[i].msg_len : FC_RECV_MAXLEN;
+		record_addr(&rec, &r->from[i]);
+
+		++r->datagrams;
+		r->bytes += rec.len;
+		if(w != NULL) {
+			fc_writer_put(w, &rec, r->data[i]);
+		}
+		if(fn != NULL) {
+			fn(&rec, r->data[i], user);
+		}
+	}
+	return n;
+}
+
+/* Reader */
+
+FILE* fc_capture_open(const char* path) {
+	struct fc_capture_head head;
+	FILE* f = fopen(path, "rb");
+
+	if(f == NULL) {
+		return NULL;
+	}
+	if(fread(&head, sizeof(head), 1, f) != 1
+	   || memcmp(head.magic, FC_CAPTURE_MAGIC, sizeof(FC_CAPTURE_MAGIC)) != 0
+	   || head.version != FC_CAPTURE_VERSION
+	   || head.record_size != sizeof(struct fc_record)) {
+		fclose(f);
+		errno = EINVAL;
+		return NULL;
+	}
+	return f;
+}
+
+int fc_capture_next(FILE* f, struct fc_record* r, uint8_t* data) {
+	size_t n = fread(r, 1, sizeof(*r), f);
+
+	if(n == 0 && feof(f)) {
+		return 0;
+	}
+	if(n != sizeof(*r) || r->len > FC_RECV_MAXLEN) {
+		return -1;
+	}
+	if(fread(data, 1, r->len, f) != r->len) {
+		return -1;
+	}
+	return 1;
+}
@@ -0,0 +1,144 @@
+/*
+ * fc_capture.h
+ *
+ * High rate datagram capture for the host side flight computer tools.
+ *
+ *     static struct fc_receiver rx;
+ *     struct fc_writer w;
+ *     fc_writer_open(&w, "si_fc.cap");
+ *     fc_recv_init(&rx, sock);
+ *     while(running)
+ *         fc_recv_poll(&rx, &w, NULL, NULL);
+ *     fc_writer_close(&w);
+ *
+ * The receiver takes up to FC_RECV_BATCH datagrams per recvmmsg() call, each
+ * with the time the kernel received it (SO_TIMESTAMPNS), and appends them
+ * untouched to the writer. The writer fills large buffers and a thread of its
+ * own writes them out, so a slow disk never holds up the socket. If every
+ * buffer is waiting on the disk, records are dropped and counted rather than
+ * blocking. Turning datagrams into CSV, or anything else, happens afterwards
+ * from the capture file with fc_capture_next().
+ *
+ * Capture file: a struct fc_capture_head, then for each datagram a struct
+ * fc_record and its len bytes of data, all in the capturing host's byte
+ * order. Datagram contents are as they came off the wire.
+ *
+ * recvmmsg() is a GNU extension, build with -D_GNU_SOURCE.
+ */
+
+#ifndef FC_CAPTURE_H_
+#define FC_CAPTURE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#define FC_CAPTURE_MAGIC      "PSASCAP"
+#define FC_CAPTURE_VERSION    1
+
+#define FC_RECV_BATCH         64
+#define FC_RECV_MAXLEN        1500           // ethernet MTU
+#define FC_RECV_RCVBUF        (4 << 20)      // socket receive buffer asked for
+#define FC_RECV_TIMEOUT_MS    200            // fc_recv_poll() returns 0 after this
+
+#define FC_WRITER_BUFFERS     8
+#define FC_WRITER_BUFSIZE     (1 << 20)
+#define FC_WRITER_MAX_AGE_NS  1000000000ULL  // a partly full buffer waits at most this long
+
+struct fc_capture_head {
+	char     magic[8];
+	uint32_t version;
+	uint32_t record_size;                   // sizeof(struct fc_record)
+} __attribute__((packed));
+
+#define FC_RECORD_TRUNCATED   0x1            // longer than FC_RECV_MAXLEN, the rest is lost
+#define FC_RECORD_HOST_TIME   0x2            // no kernel timestamp, read the clock after
+
+struct fc_record {
+	uint64_t t_ns;                          // CLOCK_REALTIME receive time
+	uint8_t  addr[16];                      // source, IPv4 as ::ffff:a.b.c.d
+	uint16_t port;                          // source port
+	uint16_t len;
+	uint32_t flags;
+} __attribute__((packed));
+
+struct fc_writer {
+	int             fd;
+	pthread_t       thread;
+	pthread_mutex_t lock;
+	pthread_cond_t  queued_cond;            // a buffer is ready to write, or closing
+	pthread_cond_t  free_cond;              // a buffer has been written
+	uint8_t*        buf[FC_WRITER_BUFFERS];
+	size_t          used[FC_WRITER_BUFFERS];
+	unsigned        fill;                   // buffer being filled
+	unsigned        next_write;             // oldest queued buffer
+	unsigned        queued;
+	uint64_t        fill_since_ns;          // first record in the buffer being filled
+	bool            closing;
+	int             error;                  // errno of the first failed write
+
+	uint64_t        records;
+	uint64_t        bytes;
+	uint64_t        dropped;                // records lost to a full queue
+	uint64_t        writes;
+};
+
+/* Creates path and starts the writer thread. Returns 0, or -1 with errno set */
+int fc_writer_open(struct fc_writer* w, const char* path);
+
+/* Appends a record and its data. Returns 0, or -1 if it was dropped */
+int fc_writer_put(struct fc_writer* w, const struct fc_record* r, const void* data);
+
+/* Queues the partly filled buffer for writing, if there's room */
+void fc_writer_flush(struct fc_writer* w);
+
+/* Writes out everything put so far and stops the thread. Returns 0, or -1
+ * with errno set if any write failed.
+ */
+int fc_writer_close(struct fc_writer* w);
+
+
+typedef void (*fc_datagram_fn)(const struct fc_record* r, const uint8_t* data, void* user);
+
+struct fc_receiver {
+	int                     fd;
+	struct mmsghdr          msgs[FC_RECV_BATCH];
+	struct iovec            iov[FC_RECV_BATCH];
+	struct sockaddr_storage from[FC_RECV_BATCH];
+	uint64_t                control[FC_RECV_BATCH][8];
+	uint8_t                 data[FC_RECV_BATCH][FC_RECV_MAXLEN];
+
+	uint64_t                datagrams;
+	uint64_t                bytes;
+	uint64_t                batches;
+	uint64_t                truncated;
+	unsigned                largest_batch;
+	int                     rcvbuf;         // what the kernel actually gave us
+};
+
+/* Sets fd up for fc_recv_poll(): kernel timestamps, a large receive buffer
+ * and a FC_RECV_TIMEOUT_MS receive timeout. Returns 0, or -1 with errno set.
+ */
+int fc_recv_init(struct fc_receiver* r, int fd);
+
+/* Receives one batch. Each datagram goes to w, unless w is NULL, and then to
+ * fn, unless fn is NULL. Returns the number of datagrams, 0 if none came
+ * within the timeout, or -1 with errno set.
+ */
+int fc_recv_poll(struct fc_receiver* r, struct fc_writer* w, fc_datagram_fn fn, void* user);
+
+
+/* Opens a capture file for reading. Returns NULL with errno set if it
+ * can't, or EINVAL if it isn't a capture this code can read.
+ */
+FILE* fc_capture_open(const char* path);
+
+/* Reads the next record, and up to FC_RECV_MAXLEN bytes of data. Returns 1,
+ * 0 at the end of the file, or -1 if the file is cut short or corrupt.
+ */
+int fc_capture_next(FILE* f, struct fc_record* r, uint8_t* data);
+
+#endif
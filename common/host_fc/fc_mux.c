@@ -0,0 +1,360 @@
+/*
+ * fc_mux.c
+ *
+ * Multi stream receive on pinned threads, see fc_mux.h.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <errno.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+#include "fc_mux.h"
+
+#define SLOT_BITS  __builtin_ctz(FC_MUX_SLOTS)
+#define SLOT_MASK  (FC_MUX_SLOTS - 1)
+
+#define STAT_ADD(x, n)  __atomic_fetch_add(&(x), (n), __ATOMIC_RELAXED)
+#define STAT_GET(x)     __atomic_load_n(&(x), __ATOMIC_RELAXED)
+#define STAT_SET(x, n)  __atomic_store_n(&(x), (n), __ATOMIC_RELAXED)
+
+static uint64_t realtime_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void stat_max(uint64_t* x, uint64_t v) {
+	uint64_t old = STAT_GET(*x);
+	while(v > old && !__atomic_compare_exchange_n(x, &old, v, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+		;
+	}
+}
+
+/* Stream table */
+
+static unsigned stream_slot(uint32_t addr, uint16_t port) {
+	uint64_t key = ((uint64_t) addr << 16) | port;
+	return (key * 0x9e3779b97f4a7c15ULL) >> (64 - SLOT_BITS);
+}
+
+static int stream_insert(struct fc_mux* m, unsigned index) {
+	const struct fc_stream* s = &m->config.streams[index];
+	unsigned i = stream_slot(s->addr, s->port);
+
+	while(m->slot[i]) {
+		const struct fc_stream* o = &m->config.streams[m->slot[i] - 1];
+		if(o->addr == s->addr && o->port == s->port) {
+			return -1;
+		}
+		i = (i + 1) & SLOT_MASK;
+	}
+	m->slot[i] = index + 1;
+	return 0;
+}
+
+static struct fc_stream* stream_lookup(const struct fc_mux* m, uint32_t addr, uint16_t port) {
+	unsigned i = stream_slot(addr, port);
+
+	while(m->slot[i]) {
+		struct fc_stream* s = &m->config.streams[m->slot[i] - 1];
+		if(s->addr == addr && s->port == port) {
+			return s;
+		}
+		i = (i + 1) & SLOT_MASK;
+	}
+	return NULL;
+}
+
+struct fc_stream* fc_mux_find(const struct fc_mux* m, const struct fc_record* r) {
+	static const uint8_t v4mapped[12] = { [10] = 0xff, [11] = 0xff };
+	struct fc_stream* s;
+	uint32_t addr = 0;
+
+	if(memcmp(r->addr, v4mapped, sizeof(v4mapped)) == 0) {
+		memcpy(&addr, r->addr + 12, sizeof(addr));
+		s = stream_lookup(m, addr, r->port);
+		if(s != NULL) {
+			return s;
+		}
+	}
+	// streams that don't care which node they come from
+	return stream_lookup(m, 0, r->port);
+}
+
+void fc_stream_stats_read(const struct fc_stream* s, struct fc_stream_stats* out) {
+	out->datagrams    = STAT_GET(s->stats.datagrams);
+	out->bytes        = STAT_GET(s->stats.bytes);
+	out->last_ns      = STAT_GET(s->stats.last_ns);
+	out->max_delay_ns = STAT_GET(s->stats.max_delay_ns);
+}
+
+/* Threads */
+
+static void on_datagram(const struct fc_record* r, const uint8_t* data, void* user) {
+	struct fc_mux_thread* t = user;
+	struct fc_mux*        m = t->mux;
+	struct fc_stream*     s = fc_mux_find(m, r);
+
+	STAT_ADD(t->datagrams, 1);
+	if(s == NULL) {
+		STAT_ADD(t->unknown, 1);
+	} else {
+		uint64_t now = realtime_ns();
+		STAT_ADD(s->stats.datagrams, 1);
+		STAT_ADD(s->stats.bytes, r->len);
+		STAT_SET(s->stats.last_ns, r->t_ns);
+		if(now > r->t_ns) {
+			stat_max(&s->stats.max_delay_ns, now - r->t_ns);
+		}
+	}
+	if(m->config.fn != NULL) {
+		m->config.fn(s, r, data, m->config.user);
+	}
+}
+
+static void* mux_thread(void* ptr) {
+	struct fc_mux_thread* t = ptr;
+	struct fc_mux*        m = t->mux;
+	struct epoll_event    ev[FC_MUX_MAX_PORTS];
+	int                   n, k;
+
+	if(t->cpu >= 0) {
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(t->cpu, &set);
+		// a machine with fewer CPUs than asked for runs unpinned
+		pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+	}
+
+	while(!m->stop) {
+		struct fc_writer* w = t->capturing && m->recording ? &t->writer : NULL;
+
+		n = epoll_wait(t->epfd, ev, FC_MUX_MAX_PORTS, FC_MUX_TIMEOUT_MS);
+		if(n < 0) {
+			if(errno == EINTR) {
+				continue;
+			}
+			m->error = errno;
+			break;
+		}
+		if(n == 0) {
+			if(t->capturing) {
+				fc_writer_flush(&t->writer);
+			}
+			continue;
+		}
+
+		STAT_ADD(t->wakeups, 1);
+		for(k = 0; k < n; ++k) {
+			// level triggered, anything left over wakes us again
+			int ret = fc_recv_poll(t->rx[ev[k].data.u32], w, on_datagram, t);
+			if(ret < 0) {
+				m->error = errno;
+				m->stop = true;
+				break;
+			}
+			if(ret > 0) {
+				STAT_ADD(t->batches, 1);
+			}
+		}
+	}
+	return NULL;
+}
+
+static void close_thread(struct fc_mux_thread* t, unsigned nports) {
+	unsigned i;
+
+	for(i = 0; i < nports; ++i) {
+		if(t->fd[i] >= 0) {
+			close(t->fd[i]);
+		}
+		free(t->rx[i]);
+	}
+	if(t->epfd >= 0) {
+		close(t->epfd);
+	}
+}
+
+static int open_thread(struct fc_mux* m, struct fc_mux_thread* t) {
+	const struct fc_mux_config* c = &m->config;
+	unsigned i;
+	int on = 1;
+
+	t->epfd = epoll_create1(0);
+	if(t->epfd < 0) {
+		return -1;
+	}
+	for(i = 0; i < c->nports; ++i) {
+		struct sockaddr_in sa;
+		struct epoll_event ev;
+
+		memset(&sa, 0, sizeof(sa));
+		sa.sin_family      = AF_INET;
+		sa.sin_port        = htons(c->ports[i]);
+		sa.sin_addr.s_addr = htonl(INADDR_ANY);
+
+		t->fd[i] = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+		if(t->fd[i] < 0) {
+			return -1;
+		}
+		if(setsockopt(t->fd[i], SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) < 0
+		   || bind(t->fd[i], (struct sockaddr*) &sa, sizeof(sa)) < 0) {
+			return -1;
+		}
+
+		t->rx[i] = malloc(sizeof(*t->rx[i]));
+		if(t->rx[i] == NULL || fc_recv_init(t->rx[i], t->fd[i]) < 0) {
+			return -1;
+		}
+
+		memset(&ev, 0, sizeof(ev));
+		ev.events   = EPOLLIN;
+		ev.data.u32 = i;
+		if(epoll_ctl(t->epfd, EPOLL_CTL_ADD, t->fd[i], &ev) < 0) {
+			return -1;
+		}
+	}
+
+	if(c->capture != NULL) {
+		char path[256];
+		snprintf(path, sizeof(path), "%s.%u.cap", c->capture, t->index);
+		if(fc_writer_open(&t->writer, path) < 0) {
+			return -1;
+		}
+		t->capturing = true;
+	}
+	return 0;
+}
+
+int fc_mux_start(struct fc_mux* m, const struct fc_mux_config* c) {
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	unsigned i, j, started = 0;
+	int err;
+
+	memset(m, 0, sizeof(*m));
+	m->config    = *c;
+	m->recording = true;
+
+	if(c->threads == 0 || c->threads > FC_MUX_MAX_THREADS
+	   || c->nports == 0 || c->nports > FC_MUX_MAX_PORTS
+	   || c->nstreams > FC_MUX_SLOTS / 2) {
+		errno = EINVAL;
+		return -1;
+	}
+	for(i = 0; i < c->nstreams; ++i) {
+		if(stream_insert(m, i) < 0) {
+			errno = EINVAL;
+			return -1;
+		}
+	}
+
+	for(i = 0; i < c->threads; ++i) {
+		struct fc_mux_thread* t = &m->thread[i];
+		t->mux   = m;
+		t->index = i;
+		t->epfd  = -1;
+		t->cpu   = c->first_cpu < 0 ? -1 : (int) ((c->first_cpu + i) % (cpus > 0 ? cpus : 1));
+		for(j = 0; j < FC_MUX_MAX_PORTS; ++j) {
+			t->fd[j] = -1;
+		}
+	}
+
+	for(i = 0; i < c->threads; ++i) {
+		if(open_thread(m, &m->thread[i]) < 0) {
+			goto fail;
+		}
+	}
+	for(started = 0; started < c->threads; ++started) {
+		errno = pthread_create(&m->thread[started].thread, NULL, mux_thread, &m->thread[started]);
+		if(errno) {
+			goto fail;
+		}
+	}
+	return 0;
+
+fail:
+	err = errno;
+	m->stop = true;
+	for(i = 0; i < started; ++i) {
+		pthread_join(m->thread[i].thread, NULL);
+	}
+	for(i = 0; i < c->threads; ++i) {
+		if(m->thread[i].capturing) {
+			fc_writer_close(&m->thread[i].writer);
+		}
+		close_thread(&m->thread[i], c->nports);
+	}
+	errno = err;
+	return -1;
+}
+
+int fc_mux_stop(struct fc_mux* m) {
+	unsigned i;
+
+	m->stop = true;
+	for(i = 0; i < m->config.threads; ++i) {
+		pthread_join(m->thread[i].thread, NULL);
+	}
+	for(i = 0; i < m->config.threads; ++i) {
+		struct fc_mux_thread* t = &m->thread[i];
+		if(t->capturing && fc_writer_close(&t->writer) < 0 && m->error == 0) {
+			m->error = errno;
+		}
+		close_thread(t, m->config.nports);
+	}
+	if(m->error) {
+		errno = m->error;
+		return -1;
+	}
+	return 0;
+}
+
+void fc_mux_report(const struct fc_mux* m, FILE* f) {
+	uint64_t now = realtime_ns();
+	unsigned i;
+
+	fprintf(f, "%-12s %21s %10s %12s %12s %10s\n",
+	        "stream", "source", "datagrams", "bytes", "max delay us", "idle s");
+	for(i = 0; i < m->config.nstreams; ++i) {
+		const struct fc_stream* s = &m->config.streams[i];
+		struct fc_stream_stats st;
+		char src[INET_ADDRSTRLEN + 8], ip[INET_ADDRSTRLEN];
+
+		fc_stream_stats_read(s, &st);
+		if(s->addr) {
+			inet_ntop(AF_INET, &s->addr, ip, sizeof(ip));
+		} else {
+			strcpy(ip, "*");
+		}
+		snprintf(src, sizeof(src), "%s:%u", ip, s->port);
+		fprintf(f, "%-12s %21s %10llu %12llu %12.1f ",
+		        s->name, src, (unsigned long long) st.datagrams, (unsigned long long) st.bytes,
+		        st.max_delay_ns / 1000.0);
+		if(st.datagrams) {
+			fprintf(f, "%10.1f\n", (now - st.last_ns) / 1e9);
+		} else {
+			fprintf(f, "%10s\n", "-");
+		}
+	}
+
+	fprintf(f, "%-12s %4s %10s %10s %12s %10s\n",
+	        "thread", "cpu", "wakeups", "batches", "datagrams", "unknown");
+	for(i = 0; i < m->config.threads; ++i) {
+		const struct fc_mux_thread* t = &m->thread[i];
+		fprintf(f, "%-12u %4d %10llu %10llu %12llu %10llu\n",
+		        i, t->cpu,
+		        (unsigned long long) STAT_GET(t->wakeups), (unsigned long long) STAT_GET(t->batches),
+		        (unsigned long long) STAT_GET(t->datagrams), (unsigned long long) STAT_GET(t->unknown));
+	}
+}
@@ -0,0 +1,122 @@
+/*
+ * fc_mux.h
+ *
+ * Receives every RocketNet stream the flight computer listens for on a few
+ * pinned threads.
+ *
+ * Each thread has its own socket on every listen port, opened with
+ * SO_REUSEPORT, and waits on all of them with one epoll set. The kernel
+ * picks the socket, and so the thread, for a datagram by hashing its
+ * addresses and ports. Every datagram from one node's socket therefore
+ * lands on the same thread and stays in order, and the streams spread
+ * over the threads with no locks between them.
+ *
+ * A datagram is matched to a stream by its source address and port through
+ * a hash table built at start, and counted in that stream's statistics with
+ * relaxed atomics. Anything else can read the statistics at any time. Each
+ * thread can also capture what it receives to a file of its own, see
+ * fc_capture.h.
+ *
+ *     struct fc_mux m;
+ *     struct fc_mux_config c = {
+ *         .ports = (uint16_t[]){ 36000 }, .nports = 1,
+ *         .streams = streams, .nstreams = nstreams,
+ *         .threads = 2, .first_cpu = 1,
+ *         .capture = "si_fc",
+ *     };
+ *     fc_mux_start(&m, &c);
+ *     ...
+ *     fc_mux_stop(&m);
+ */
+
+#ifndef FC_MUX_H_
+#define FC_MUX_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <pthread.h>
+
+#include "fc_capture.h"
+
+#define FC_MUX_MAX_PORTS    8
+#define FC_MUX_MAX_THREADS  16
+#define FC_MUX_SLOTS        256     // stream hash table, a power of two
+#define FC_MUX_TIMEOUT_MS   200
+
+struct fc_stream_stats {
+	uint64_t datagrams;
+	uint64_t bytes;
+	uint64_t last_ns;               // receive time of the latest datagram
+	uint64_t max_delay_ns;          // longest from the kernel to the callback
+};
+
+/* One sending socket on a node */
+struct fc_stream {
+	const char*            name;
+	uint32_t               addr;    // source IPv4 in network order, 0 for any
+	uint16_t               port;    // source port
+	struct fc_stream_stats stats;
+};
+
+/* s is NULL for a datagram from no known stream */
+typedef void (*fc_mux_fn)(struct fc_stream* s, const struct fc_record* r, const uint8_t* data, void* user);
+
+struct fc_mux_config {
+	const uint16_t*   ports;        // local ports to listen on
+	unsigned          nports;
+	struct fc_stream* streams;
+	unsigned          nstreams;
+	unsigned          threads;
+	int               first_cpu;    // thread i runs on first_cpu + i, -1 to not pin
+	const char*       capture;      // files are capture.<thread>.cap, NULL for none
+	fc_mux_fn         fn;           // called on the receiving thread, may be NULL
+	void*             user;
+};
+
+struct fc_mux_thread {
+	struct fc_mux*      mux;
+	unsigned            index;
+	pthread_t           thread;
+	int                 epfd;
+	int                 fd[FC_MUX_MAX_PORTS];
+	struct fc_receiver* rx[FC_MUX_MAX_PORTS];
+	struct fc_writer    writer;
+	bool                capturing;
+	int                 cpu;
+
+	uint64_t            wakeups;
+	uint64_t            batches;
+	uint64_t            datagrams;
+	uint64_t            unknown;    // from no known stream
+};
+
+struct fc_mux {
+	struct fc_mux_config config;
+	struct fc_mux_thread thread[FC_MUX_MAX_THREADS];
+	uint16_t             slot[FC_MUX_SLOTS];    // index into streams plus one
+	volatile bool        stop;
+	volatile bool        recording;             // captures only while set
+	int                  error;                 // errno a thread stopped on
+};
+
+/* Opens the sockets and starts the threads, recording. Returns 0, or -1
+ * with errno set.
+ */
+int fc_mux_start(struct fc_mux* m, const struct fc_mux_config* c);
+
+/* Stops and joins the threads and closes the sockets and captures. Returns
+ * 0, or -1 with errno set if a thread or a capture failed.
+ */
+int fc_mux_stop(struct fc_mux* m);
+
+/* Returns the stream a datagram came from, or NULL if it isn't a known one */
+struct fc_stream* fc_mux_find(const struct fc_mux* m, const struct fc_record* r);
+
+/* Copies a stream's statistics, safe while the threads run */
+void fc_stream_stats_read(const struct fc_stream* s, struct fc_stream_stats* out);
+
+/* Prints every stream's and thread's statistics */
+void fc_mux_report(const struct fc_mux* m, FILE* f);
+
+#endif
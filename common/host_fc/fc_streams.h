@@ -0,0 +1,52 @@
+/*
+ * fc_streams.h
+ *
+ * The RocketNet streams that reach the flight computer, as fc_mux streams.
+ * Addresses and ports are the ones in common/net/net_addrs.c, keep the two
+ * in step.
+ *
+ *     static struct fc_stream streams[] = FC_ROCKETNET_STREAMS;
+ */
+
+#ifndef FC_STREAMS_H_
+#define FC_STREAMS_H_
+
+#include "fc_mux.h"
+
+/* htonl() in macro form so the tables can be static initializers */
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define FC_HTONL(n) __builtin_bswap32(n)
+#elif __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define FC_HTONL(n) (n)
+#endif
+
+#define FC_IPV4(a,b,c,d) \
+		FC_HTONL( \
+			((uint32_t)((a) & 0xff) << 24) | \
+			((uint32_t)((b) & 0xff) << 16) | \
+			((uint32_t)((c) & 0xff) << 8)  | \
+			 (uint32_t)((d) & 0xff) \
+		)
+
+#define FC_LISTEN_PORT   36000
+
+#define FC_SENSOR_IP     FC_IPV4(10, 10, 10, 20)
+#define FC_ROLL_IP       FC_IPV4(10, 10, 10, 30)
+#define FC_RNH_IP        FC_IPV4(10, 10, 10, 5)
+#define FC_GPS_IP        FC_IPV4(10, 10, 10, 40)
+
+#define FC_ROCKETNET_STREAMS { \
+		{ .name = "adis",       .addr = FC_SENSOR_IP, .port = 35020 }, \
+		{ .name = "mpu",        .addr = FC_SENSOR_IP, .port = 35002 }, \
+		{ .name = "mpl",        .addr = FC_SENSOR_IP, .port = 35010 }, \
+		{ .name = "bmp",        .addr = FC_SENSOR_IP, .port = 35011 }, \
+		{ .name = "roll",       .addr = FC_ROLL_IP,   .port = 35003 }, \
+		{ .name = "rnh_batt",   .addr = FC_RNH_IP,    .port = 36101 }, \
+		{ .name = "rnh_port",   .addr = FC_RNH_IP,    .port = 36102 }, \
+		{ .name = "rnh_alarm",  .addr = FC_RNH_IP,    .port = 36103 }, \
+		{ .name = "rnh_umbdet", .addr = FC_RNH_IP,    .port = 36104 }, \
+		{ .name = "gps",        .addr = FC_GPS_IP,    .port = 35050 }, \
+		{ .name = "gps_cots",   .addr = FC_GPS_IP,    .port = 35051 }, \
+}
+
+#endif
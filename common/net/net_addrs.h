@@ -50,4 +50,7 @@ extern struct lwipthread_opts * GPS_LWIP;
 extern struct sockaddr * GPS_OUT_ADDR; // Data's gotta be flowing out, right?
 extern struct sockaddr * GPS_COTS_ADDR; // Data from the crescent COTS device
 
+/* Event logger */
+extern struct lwipthread_opts * EVENTLOGGER_LWIP;
+
 #endif /* NET_ADDRS_H_ */
@@ -0,0 +1,117 @@
+#include <string.h>
+
+#include "packetizer.h"
+
+static void put32(uint8_t * p, uint32_t v){
+	p[0] = v >> 24;
+	p[1] = v >> 16;
+	p[2] = v >> 8;
+	p[3] = v;
+}
+
+static uint32_t get32(const uint8_t * p){
+	return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+void packetizerPutHeader(uint8_t * buf, uint32_t seq, uint64_t offset){
+	put32(buf, seq);
+	put32(buf + 4, offset >> 32);
+	put32(buf + 8, offset);
+}
+
+void packetizerInit(struct Packetizer * p, uint8_t * bufs, volatile uint8_t * busy,
+                    unsigned count, size_t size, PacketizerSend send, void * user)
+{
+	unsigned i;
+
+	memset(p, 0, sizeof(*p));
+	p->bufs = bufs;
+	p->busy = busy;
+	p->count = count;
+	p->size = size;
+	p->send = send;
+	p->user = user;
+	p->fill = count - 1;
+	for(i = 0; i < count; ++i){
+		busy[i] = 0;
+	}
+}
+
+/* Takes the next free buffer after the last one and writes its header */
+static int claim(struct Packetizer * p){
+	unsigned i;
+
+	for(i = 1; i <= p->count; ++i){
+		unsigned b = (p->fill + i) % p->count;
+		if(!p->busy[b]){
+			uint8_t * buf = p->bufs + b * p->size;
+			p->busy[b] = 1;
+			packetizerPutHeader(buf, p->seq++, p->offset);
+			return b;
+		}
+	}
+	return -1;
+}
+
+static void emit(struct Packetizer * p){
+	uint8_t * buf = p->bufs + p->fill * p->size;
+
+	if(p->send(buf, PACKETIZER_HEADER + p->used, p->user) < 0){
+		++p->send_failures;
+		p->busy[p->fill] = 0;
+	} else {
+		++p->datagrams;
+	}
+	p->used = 0;
+	p->holding = 0;
+}
+
+void packetizerWrite(struct Packetizer * p, const uint8_t * data, size_t len){
+	size_t room = p->size - PACKETIZER_HEADER;
+
+	while(len > 0){
+		if(!p->holding){
+			int b = claim(p);
+			if(b < 0){
+				// everything is still out, skip what we were given
+				p->dropped += len;
+				p->offset += len;
+				return;
+			}
+			p->fill = b;
+			p->holding = 1;
+		}
+
+		size_t n = room - p->used < len ? room - p->used : len;
+		memcpy(p->bufs + p->fill * p->size + PACKETIZER_HEADER + p->used, data, n);
+		p->used += n;
+		p->offset += n;
+		data += n;
+		len -= n;
+
+		if(p->used == room){
+			emit(p);
+		}
+	}
+}
+
+void packetizerFrame(struct Packetizer * p, uint8_t * head, size_t len){
+	if(p->holding){
+		emit(p);
+	}
+	packetizerPutHeader(head, p->seq++, p->offset);
+	p->offset += len;
+}
+
+void packetizerRelease(struct Packetizer * p, const uint8_t * buf){
+	p->busy[(buf - p->bufs) / p->size] = 0;
+}
+
+int packetizerParse(const uint8_t * buf, size_t len, uint32_t * seq, uint64_t * offset){
+	if(len < PACKETIZER_HEADER){
+		return -1;
+	}
+	*seq = get32(buf);
+	*offset = (uint64_t)get32(buf + 4) << 32 | get32(buf + 8);
+	return len - PACKETIZER_HEADER;
+}
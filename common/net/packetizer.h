@@ -0,0 +1,84 @@
+/*
+ * Cuts a continuous byte stream into full sized datagrams
+ *
+ * A producer like the MAX2769 DMA hands over its data in whatever pieces its
+ * hardware works in. A Packetizer copies them end to end into a small pool
+ * of datagram buffers, and as each one fills, puts a header on it and hands
+ * it to a send function, so every datagram but the last carries as much of
+ * the stream as fits no matter where the producer's pieces begin and end.
+ *
+ * The header has a sequence number and the stream offset of the datagram's
+ * first data byte, so a receiver can put every byte back exactly where it
+ * belongs and knows precisely which bytes any loss took out. A buffer
+ * belongs to the sender from the send call until it's given back with
+ * packetizerRelease(); if no buffer is free when one is needed, the stream
+ * skips ahead rather than waiting, and the offsets show the gap.
+ *
+ * A producer can also send some of the stream in frames of its own, as
+ * flight-gps's raw Ethernet mode does, by taking each frame's header from
+ * packetizerFrame(). Those frames continue the datagrams' sequence numbers
+ * and offsets, so switching back and forth makes one stream, not a new one
+ * from zero. A receiver can treat both kinds of frame the same way.
+ *
+ * Nothing in here depends on ChibiOS or lwIP so it can be tested on a host.
+ */
+
+#ifndef PACKETIZER_H_
+#define PACKETIZER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Header, all network order: sequence number, then the 64 bit stream offset */
+#define PACKETIZER_HEADER 12
+
+/* Called with a full datagram. Returns 0 if buf now belongs to the sender
+ * until released, or less than 0 if it couldn't be sent and is free again.
+ */
+typedef int (*PacketizerSend)(uint8_t * buf, size_t len, void * user);
+
+struct Packetizer {
+	uint8_t * bufs;              // count buffers of size bytes, end to end
+	volatile uint8_t * busy;     // per buffer, set while the sender has it
+	unsigned count;
+	size_t size;                 // datagram size, header included
+	PacketizerSend send;
+	void * user;
+
+	unsigned fill;               // buffer being filled, or the last one
+	int holding;                 // fill is claimed
+	size_t used;                 // data bytes in it
+	uint32_t seq;
+	uint64_t offset;             // stream offset of the next byte written
+
+	uint32_t datagrams;          // sends that succeeded
+	uint32_t send_failures;
+	uint64_t dropped;            // stream bytes skipped for want of a buffer
+};
+
+void packetizerInit(struct Packetizer * p, uint8_t * bufs, volatile uint8_t * busy,
+                    unsigned count, size_t size, PacketizerSend send, void * user);
+
+/* Appends len bytes of the stream, sending every datagram that fills */
+void packetizerWrite(struct Packetizer * p, const uint8_t * data, size_t len);
+
+/* Gives a buffer back once the sender is done with it. Safe to call from
+ * another thread than the writer's.
+ */
+void packetizerRelease(struct Packetizer * p, const uint8_t * buf);
+
+/* Sends the datagram being filled, short if need be, then writes head for
+ * the next len bytes of the stream, which the caller sends in a frame of its
+ * own. The offset moves on by len whether or not that frame gets out.
+ */
+void packetizerFrame(struct Packetizer * p, uint8_t * head, size_t len);
+
+/* Writes a header with any sequence number and offset */
+void packetizerPutHeader(uint8_t * buf, uint32_t seq, uint64_t offset);
+
+/* Reads a datagram's header. Returns the number of data bytes after it, or
+ * -1 if len is too short to hold a header.
+ */
+int packetizerParse(const uint8_t * buf, size_t len, uint32_t * seq, uint64_t * offset);
+
+#endif
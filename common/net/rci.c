@@ -1,125 +1,389 @@
+
+
 #include <string.h>
 #include "ch.h"
+#include "hal.h"
+#include "chprintf.h"
 #include "lwip/sockets.h"
 #include "utils_general.h"
 #include "utils_sockets.h"
+#include "latency_hist.h"
 #include "rci.h"
+#include "rci_dispatch.h"
+
+#define RCI_PORT 23
+
+/* A connection starts out single shot: the first command is answered and the
+ * connection closed, which is what every existing client expects. Sending
+ * RCI_SESSION_CMD first turns it into a session that stays open, answers any
+ * number of pipelined commands in order and frames each reply, see rci.h.
+ * Up to RCI_MAX_SESSIONS connections are served at once, each by its own
+ * thread, so one client that's slow to send or read doesn't hold up the
+ * others. The command handlers themselves still run one at a time.
+ */
+#define RCI_SESSION_CMD   "#SESS"
+#define RCI_STATS_CMD     "#RCIS"
+
+struct rci_session {
+	int socket;                 // -1 when the slot is free
+	bool_t persistent;
+	systime_t opened;
+	uint32_t commands;
+	LatencyHist turnaround;     // command received to reply written
+	BinarySemaphore start;
+	char rx_buf[ETH_MTU];
+	char tx_buf[ETH_MTU];
+};
+
+static struct RCICommand * commands;
+static struct RCIDispatch dispatch;
+static struct rci_session sessions[RCI_MAX_SESSIONS];
+static WORKING_AREA(wa_session[RCI_MAX_SESSIONS], 2048);
+static SEMAPHORE_DECL(free_sessions, RCI_MAX_SESSIONS);
+static MUTEX_DECL(handler_lock);
+static uint32_t accepted;
+static uint32_t total_commands;
+static uint32_t udp_requests;
+static uint32_t udp_retries;
 
 static void handle_command(
 		struct RCICmdData * data,
-		struct RCIRetData * ret,
-		struct RCICommand * cmd)
+		struct RCIRetData * ret)
 {
-	for(;cmd->name != NULL; ++cmd){
-		if(cmd->function == NULL)
-			break;
-		int rclen = strlen(cmd->name);
-		if(!strncmp(data->data, cmd->name, MIN(data->len, rclen))){
-			//remove rci command from data and place it in name
-			data->name = cmd->name;
-			data->len -= rclen;
-			data->data += rclen;
-			//call the callback
-			cmd->function(data, ret, cmd->user);
-			break;
-		}
+	struct RCICommand * cmd = rciDispatchFind(&dispatch, data->data, data->len);
+	if(cmd == NULL)
+		return;
+
+	//remove rci command from data and place it in name
+	data->name = cmd->name;
+	data->len -= RCI_NAME_LEN;
+	data->data += RCI_NAME_LEN;
+	//call the callback
+	cmd->function(data, ret, cmd->user);
+}
+
+static int starts_with(const char * data, int len, const char * name){
+	int namelen = strlen(name);
+	return len >= namelen && !strncmp(data, name, namelen);
+}
+
+/* Built in #RCIS, one line per session slot:
+ * slot, socket (-1 when free), persistent, seconds open, commands, commands/s,
+ * mean and max turnaround in us. Then sessions accepted, commands answered,
+ * UDP requests and UDP retries answered from the cache since boot.
+ */
+static int session_stats(char * buf, int maxlen){
+	systime_t now = chTimeNow();
+	int len = 0;
+	int i;
+
+	for(i = 0; i < RCI_MAX_SESSIONS && len < maxlen; ++i){
+		struct rci_session * ss = &sessions[i];
+		uint32_t secs = ss->socket < 0 ? 0 : (now - ss->opened) / CH_FREQUENCY;
+		uint32_t mean = ss->turnaround.count ? ss->turnaround.total_us / ss->turnaround.count : 0;
+
+		len += chsnprintf(buf + len, maxlen - len, "%d %d %d %u %u %u %u %u\n",
+		                  i, ss->socket, ss->persistent, secs, ss->commands,
+		                  secs ? ss->commands / secs : ss->commands,
+		                  mean, ss->turnaround.max_us);
+	}
+	if(len < maxlen){
+		len += chsnprintf(buf + len, maxlen - len, "%u %u %u %u",
+		                  accepted, total_commands, udp_requests, udp_retries);
 	}
+	return MIN(len, maxlen);
 }
 
-static int get_command(int s, char * buffer, int buflen){
-	int cmdlen = 0;
-	int i = 0;
-	struct fd_set read;
-	FD_ZERO(&read);
-	FD_SET(s, &read);
-	do {
-		struct timeval timeout = {5, 0};
-		if(select(s+1, &read, NULL, NULL, &timeout) <= 0){
+static int write_all(int s, const char * buf, int len){
+	while(len > 0){
+		int n = write(s, buf, len);
+		if(n <= 0){
 			return -1;
 		}
-		int len = read(s, buffer, buflen-cmdlen);
-		if(len < 0){
-			return -1;
-		}
-		cmdlen += len;
-		for(; i + 1 < cmdlen; ++i){
-			if(buffer[i] == '\r' && buffer[i + 1] == '\n'){
-				/* remove trailing \r\n */
-				return i;
+		buf += n;
+		len -= n;
+	}
+	return 0;
+}
+
+/* Runs the built in or table command in data and leaves its reply in out,
+ * returning the reply length. ss is NULL for UDP requests, which have no
+ * session to turn persistent.
+ */
+static int execute(struct rci_session * ss, const char * data, int len, char * out, int maxlen){
+	struct RCICmdData cmd = {
+		.name = NULL,
+		.data = data,
+		.len = len,
+	};
+	struct RCIRetData ret = {
+		.data = out,
+		.len = 0,
+	};
+
+	chMtxLock(&handler_lock);
+	if(ss && starts_with(data, len, RCI_SESSION_CMD)){
+		ss->persistent = TRUE;
+		memcpy(ret.data, "OK", 2);
+		ret.len = 2;
+	} else if(starts_with(data, len, RCI_STATS_CMD)){
+		ret.len = session_stats(ret.data, maxlen);
+	} else {
+		handle_command(&cmd, &ret);
+	}
+	++total_commands;
+	chMtxUnlock();
+
+	chDbgAssert(ret.len <= maxlen, "execute(), #1", "reply overran its buffer");
+	return MIN(MAX(ret.len, 0), maxlen);
+}
+
+/* Runs one command and writes its reply. Replies in a session are the reply
+ * length as two bytes in network order then the reply, with nothing after
+ * it and sent even when empty. Single shot replies are the reply followed by
+ * \r\n, and nothing at all when empty.
+ */
+static int run_command(struct rci_session * ss, const char * data, int len){
+	const int header = sizeof(uint16_t);
+	char * reply = ss->tx_buf + header;
+	const int maxlen = RCI_MAX_REPLY;
+	halrtcnt_t start = halGetCounterValue();
+	int err = 0;
+
+	int n = execute(ss, data, len, reply, maxlen);
+	if(ss->persistent){
+		uint16_t netlen = htons(n);
+		memcpy(ss->tx_buf, &netlen, header);
+		err = write_all(ss->socket, ss->tx_buf, header + n);
+	} else if(n > 0){
+		//if there's data to return, return it to the address it came from
+		reply[n] = '\r';
+		reply[n + 1] = '\n';
+		err = write_all(ss->socket, reply, n + 2);
+	}
+
+	++ss->commands;
+	lat_hist_add(&ss->turnaround, (uint64_t)(halGetCounterValue() - start) * 1000000 / halGetCounterFrequency());
+	return err;
+}
+
+/* Serves one connection until it closes, times out, errors, or it's single
+ * shot and has had its command.
+ */
+static void serve(struct rci_session * ss){
+	int have = 0;
+
+	while(TRUE){
+		char * next = ss->rx_buf;
+		char * end = ss->rx_buf + have;
+		char * p;
+
+		// answer every complete command that's come in, in order
+		for(p = next; p + 1 < end; ++p){
+			if(p[0] != '\r' || p[1] != '\n'){
+				continue;
+			}
+			bool_t persistent = ss->persistent;
+			if(run_command(ss, next, p - next) < 0){
+				return;
 			}
+			// a #SESS on a single shot connection keeps it open
+			if(!persistent && !ss->persistent){
+				return;
+			}
+			next = p + 2;
+			++p;
 		}
-	} while(cmdlen < buflen);
-	return -1;
-}
 
-static void send_response( int s, char * buffer, int len, int maxlen){
-	// FIXME: check return of write, and continue to attempt to write if needed
-	len = MIN(len, maxlen-2);
-	if(len > 0){
-		buffer[len] = '\r';
-		buffer[len + 1] = '\n';
-		if(write(s, buffer, MIN(len + 2, maxlen)) < 0){
+		have = end - next;
+		memmove(ss->rx_buf, next, have);
+		if(have == sizeof(ss->rx_buf)){
 			return;
 		}
+
+		struct timeval timeout = {ss->persistent ? RCI_SESSION_IDLE_S : RCI_COMMAND_TIMEOUT_S, 0};
+		fd_set readable;
+		FD_ZERO(&readable);
+		FD_SET(ss->socket, &readable);
+		if(select(ss->socket + 1, &readable, NULL, NULL, &timeout) <= 0){
+			return;
+		}
+		int len = read(ss->socket, ss->rx_buf + have, sizeof(ss->rx_buf) - have);
+		if(len <= 0){
+			return;
+		}
+		have += len;
 	}
 }
 
-WORKING_AREA(wa_rci, THD_WA_SIZE(2048 + ETH_MTU*2));
-static msg_t rci_thread(void *p){
+static msg_t session_thread(void *p){
+	struct rci_session * ss = p;
+
+	chRegSetThreadName("RCI session");
+	while(TRUE){
+		chBSemWait(&ss->start);
+		serve(ss);
+		close(ss->socket);
+		chSysLock();
+		ss->socket = -1;
+		chSysUnlock();
+		chSemSignal(&free_sessions);
+	}
+	return -1;
+}
+
+WORKING_AREA(wa_rci, 1024);
+static msg_t rci_thread(void *p UNUSED){
 	chRegSetThreadName("RCI");
 
-	struct RCICommand * commands = (struct RCICommand *)p;
 	struct sockaddr from;
 	socklen_t fromlen;
 
 	struct sockaddr own;
-	set_sockaddr(&own, "0.0.0.0", 23);
-
-	char rx_buf[ETH_MTU];
-	char tx_buf[ETH_MTU];
+	set_sockaddr(&own, "0.0.0.0", RCI_PORT);
 
 	int socket = socket(AF_INET, SOCK_STREAM, 0);
 	chDbgAssert(socket >= 0, "Could not get RCI socket", NULL);
 	if(bind(socket, &own, sizeof(struct sockaddr_in)) < 0){
 		chDbgPanic("Could not bind RCI socket");
 	}
-	if(listen(socket, 1) < 0){
+	if(listen(socket, RCI_MAX_SESSIONS) < 0){
 		chDbgPanic("Could not listen on RCI socket");
 	}
 
 	while(TRUE) {
-		struct RCICmdData cmd = {
-			.name = NULL,
-			.data = rx_buf,
-			.len = 0,
-		};
-		struct RCIRetData ret = {
-			.data = tx_buf,
-			.len = 0,
-		};
+		// only accept once there's a session free to take the connection
+		chSemWait(&free_sessions);
 
 		fromlen = sizeof(from);
 		int s = accept(socket, &from, &fromlen);
 		if(s < 0){
+			chSemSignal(&free_sessions);
 			continue;
 		}
 
-		cmd.len = get_command(s, rx_buf, sizeof(rx_buf));
-		if(cmd.len < 0){
-			close(s);
+		struct rci_session * ss = sessions;
+		while(ss->socket >= 0){
+			++ss;
+		}
+		ss->persistent = FALSE;
+		ss->opened = chTimeNow();
+		ss->commands = 0;
+		memset(&ss->turnaround, 0, sizeof(ss->turnaround));
+		++accepted;
+		chSysLock();
+		ss->socket = s;
+		chSysUnlock();
+		chBSemSignal(&ss->start);
+	}
+	return -1;
+}
+
+/* UDP RCI
+ *
+ * A request is one datagram: a request id, four bytes the client picks, then
+ * the command, with or without its \r\n. The reply is one datagram back to
+ * the sender: the same id then the reply, which may be empty. A client that
+ * doesn't hear back sends the same datagram again. The last RCI_UDP_CACHE
+ * replies are kept by sender and id, so a retry whose reply was lost is
+ * answered again without running the command twice. Replies longer than
+ * RCI_UDP_CACHED_REPLY aren't kept and a retry runs the command again.
+ */
+struct rci_udp_reply {
+	struct sockaddr_in from;
+	uint32_t id;
+	int len;                    // -1 for an unused entry
+	char data[RCI_UDP_CACHED_REPLY];
+};
+
+static struct rci_udp_reply udp_cache[RCI_UDP_CACHE];
+static unsigned udp_cache_next;
+static char udp_rx_buf[ETH_MTU];
+static char udp_tx_buf[ETH_MTU];
+
+static struct rci_udp_reply * udp_cached(const struct sockaddr_in * from, uint32_t id){
+	int i;
+	for(i = 0; i < RCI_UDP_CACHE; ++i){
+		struct rci_udp_reply * r = &udp_cache[i];
+		if(r->len >= 0 && r->id == id &&
+		   r->from.sin_addr.s_addr == from->sin_addr.s_addr &&
+		   r->from.sin_port == from->sin_port){
+			return r;
+		}
+	}
+	return NULL;
+}
+
+WORKING_AREA(wa_rci_udp, 2048);
+static msg_t rci_udp_thread(void *p UNUSED){
+	const int header = sizeof(uint32_t);
+	struct sockaddr_in from;
+	socklen_t fromlen;
+	struct sockaddr own;
+	int i;
+
+	chRegSetThreadName("RCI UDP");
+	for(i = 0; i < RCI_UDP_CACHE; ++i){
+		udp_cache[i].len = -1;
+	}
+
+	set_sockaddr(&own, "0.0.0.0", RCI_PORT);
+	int socket = socket(AF_INET, SOCK_DGRAM, 0);
+	chDbgAssert(socket >= 0, "Could not get RCI UDP socket", NULL);
+	if(bind(socket, &own, sizeof(struct sockaddr_in)) < 0){
+		chDbgPanic("Could not bind RCI UDP socket");
+	}
+
+	while(TRUE){
+		fromlen = sizeof(from);
+		int len = recvfrom(socket, udp_rx_buf, sizeof(udp_rx_buf), 0, (struct sockaddr *)&from, &fromlen);
+		if(len < header){
 			continue;
 		}
+		++udp_requests;
 
-		handle_command(&cmd, &ret, commands);
+		uint32_t id;
+		memcpy(&id, udp_rx_buf, header);
+		memcpy(udp_tx_buf, &id, header);
 
-		//if there's data to return, return it to the address it came from
-		send_response(s, ret.data, ret.len, sizeof(tx_buf));
-		close(s);
+		struct rci_udp_reply * cached = udp_cached(&from, id);
+		int n;
+		if(cached){
+			++udp_retries;
+			n = cached->len;
+			memcpy(udp_tx_buf + header, cached->data, n);
+		} else {
+			len -= header;
+			if(len >= 2 && udp_rx_buf[header + len - 2] == '\r' && udp_rx_buf[header + len - 1] == '\n'){
+				len -= 2;
+			}
+			n = execute(NULL, udp_rx_buf + header, len, udp_tx_buf + header, RCI_MAX_REPLY);
+			if(n <= RCI_UDP_CACHED_REPLY){
+				struct rci_udp_reply * r = &udp_cache[udp_cache_next++ % RCI_UDP_CACHE];
+				r->from = from;
+				r->id = id;
+				r->len = n;
+				memcpy(r->data, udp_tx_buf + header, n);
+			}
+		}
+		sendto(socket, udp_tx_buf, header + n, 0, (struct sockaddr *)&from, fromlen);
 	}
 	return -1;
 }
 
+static void set_commands(struct RCICommand * cmd){
+	chDbgAssert(!commands || commands == cmd, "RCICreate and RCICreateUDP need the same commands", NULL);
+	if(commands == NULL){
+		int err = rciDispatchInit(&dispatch, cmd);
+		chDbgAssert(err == 0, "RCI command names must be unique, '#' and four characters", NULL);
+		(void)err;
+		commands = cmd;
+	}
+}
+
 void RCICreate(struct RCICommand * cmd){
+	int i;
+
 	chDbgAssert(cmd, "RCICreate needs a config", NULL);
 
 #if 0 //FIXME: because of threads this doesn't actually work all the time.
@@ -134,7 +398,17 @@ void RCICreate(struct RCICommand * cmd){
 	}
 	chDbgAssert(thd, "RCICreate needs lwip started beforehand", NULL);
 #endif
-	chThdCreateStatic(wa_rci, sizeof(wa_rci), NORMALPRIO, rci_thread, (void *)cmd);
+	set_commands(cmd);
+	for(i = 0; i < RCI_MAX_SESSIONS; ++i){
+		sessions[i].socket = -1;
+		chBSemInit(&sessions[i].start, TRUE);
+		chThdCreateStatic(wa_session[i], sizeof(wa_session[i]), NORMALPRIO, session_thread, &sessions[i]);
+	}
+	chThdCreateStatic(wa_rci, sizeof(wa_rci), NORMALPRIO, rci_thread, NULL);
 }
 
-
+void RCICreateUDP(struct RCICommand * cmd){
+	chDbgAssert(cmd, "RCICreateUDP needs a config", NULL);
+	set_commands(cmd);
+	chThdCreateStatic(wa_rci_udp, sizeof(wa_rci_udp), NORMALPRIO + 1, rci_udp_thread, NULL);
+}
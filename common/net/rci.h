@@ -20,27 +20,76 @@ struct RCICmdData{
 struct RCIRetData{
 	char * const data;  // Output. Place data here to send to addr in from
 	int len;            // length of data in return_data. Max length is
-                        // ETH_MTU from utils_socket.h
+                        // RCI_MAX_REPLY
 };
 
+/* Room for a reply in data: an ETH_MTU buffer (from utils_sockets.h) less
+ * the UDP request id, which takes more than a session's length header or a
+ * single shot reply's \r\n
+ */
+#define RCI_MAX_REPLY (ETH_MTU - 4)
+
 /* RCI command handler function type*/
 typedef void (*rcicmd_t)(struct RCICmdData * cmd, struct RCIRetData * ret, void * user);
 
-/* Data type that ties an rcicmd name to a function */
+/* Data type that ties an rcicmd name to a function. Names are '#' and four
+ * characters, anything after the name in a request is the command's data.
+ */
 struct RCICommand{
 	const char *name;  // Command name
 	rcicmd_t function; // Command handler function to invoke
 	void * user;       // User data to pass to the function
 };
 
+/* Connections served at once, each takes a thread and two ETH_MTU buffers */
+#ifndef RCI_MAX_SESSIONS
+#define RCI_MAX_SESSIONS 2
+#endif
+
+/* Seconds to wait for the rest of a command, and for the next command in a
+ * session before closing it
+ */
+#ifndef RCI_COMMAND_TIMEOUT_S
+#define RCI_COMMAND_TIMEOUT_S 5
+#endif
+#ifndef RCI_SESSION_IDLE_S
+#define RCI_SESSION_IDLE_S 30
+#endif
+
 /* Starts the RCI. Once a null terminated RCICommand array has been filled out,
- * this will handle setting up the socket and a thread to run the RCI in. The
+ * this will handle setting up the socket and threads to run the RCI in. The
  * lwip main thread is required to have been started beforehand.
  *
- * The socket listens on port 23
+ * The socket listens on port 23. Commands end in \r\n. By default a
+ * connection gets one command, its reply followed by \r\n (or nothing if the
+ * reply is empty), and is then closed. A connection whose first command is
+ * #SESS instead stays open until the client closes it or it has been idle for
+ * RCI_SESSION_IDLE_S, and can send any number of commands without waiting for
+ * replies. Every reply, starting with the "OK" to #SESS, is then sent in order
+ * as a two byte network order length followed by that many bytes.
+ *
+ * #RCIS returns a line of statistics for each session as text, see rci.c.
  */
 void RCICreate(struct RCICommand * cmd);
 
+/* UDP replies kept for answering retries, and the longest reply kept */
+#ifndef RCI_UDP_CACHE
+#define RCI_UDP_CACHE 4
+#endif
+#ifndef RCI_UDP_CACHED_REPLY
+#define RCI_UDP_CACHED_REPLY 64
+#endif
+
+/* Also answers the same commands over UDP on port 23, for quick polls that
+ * shouldn't pay for a TCP connection. A request is one datagram of a four
+ * byte request id followed by the command, the reply is one datagram of the
+ * same id followed by the reply. Resend the same datagram if no reply comes:
+ * recent replies are cached, so a retry isn't run twice as long as its reply
+ * fits in RCI_UDP_CACHED_REPLY. Call it with the array given to RCICreate(),
+ * either before or after it.
+ */
+void RCICreateUDP(struct RCICommand * cmd);
+
 #endif /* RNET_CMD_INTERP_H_ */
 
 
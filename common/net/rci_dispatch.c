@@ -0,0 +1,61 @@
+#include <string.h>
+
+#include "rci_dispatch.h"
+
+#define SLOT_MASK (RCI_DISPATCH_SLOTS - 1)
+
+static uint32_t name_key(const char * name){
+	uint32_t key;
+	memcpy(&key, name + 1, sizeof(key));
+	return key;
+}
+
+/* Fibonacci hashing, the top bits of the product are the best mixed */
+static unsigned key_slot(uint32_t key){
+	return (key * 2654435769u) >> (32 - __builtin_ctz(RCI_DISPATCH_SLOTS));
+}
+
+int rciDispatchInit(struct RCIDispatch * d, struct RCICommand * commands){
+	struct RCICommand * cmd;
+	unsigned count = 0;
+
+	memset(d, 0, sizeof(*d));
+	d->commands = commands;
+
+	for(cmd = commands; cmd->name != NULL && cmd->function != NULL; ++cmd){
+		if(strlen(cmd->name) != RCI_NAME_LEN || cmd->name[0] != '#'){
+			return -1;
+		}
+		if(++count > RCI_DISPATCH_SLOTS / 2){
+			return -1;
+		}
+
+		uint32_t key = name_key(cmd->name);
+		unsigned s = key_slot(key);
+		while(d->slot[s].index){
+			if(d->slot[s].key == key){
+				return -1;
+			}
+			s = (s + 1) & SLOT_MASK;
+		}
+		d->slot[s].key = key;
+		d->slot[s].index = cmd - commands + 1;
+	}
+	return 0;
+}
+
+struct RCICommand * rciDispatchFind(const struct RCIDispatch * d, const char * data, int len){
+	if(len < RCI_NAME_LEN || data[0] != '#'){
+		return NULL;
+	}
+
+	uint32_t key = name_key(data);
+	unsigned s = key_slot(key);
+	while(d->slot[s].index){
+		if(d->slot[s].key == key){
+			return &d->commands[d->slot[s].index - 1];
+		}
+		s = (s + 1) & SLOT_MASK;
+	}
+	return NULL;
+}
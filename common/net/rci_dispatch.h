@@ -0,0 +1,45 @@
+/*
+ * RCI command lookup
+ *
+ * Every RCI command name is '#' and four characters, and the four characters
+ * packed into a word make its key. rciDispatchInit() hashes the keys of a
+ * command table once into a small open addressed table, after which finding
+ * the command for a request is a hash and usually a single compare, however
+ * many commands the board has. A request only matches a command whose whole
+ * name it starts with, so "#ELOGR" finds #ELOG with "R" left as its data but
+ * "#ELO" finds nothing.
+ *
+ * Nothing in here depends on ChibiOS or lwIP so it can be benchmarked on a
+ * host.
+ */
+
+#ifndef RCI_DISPATCH_H_
+#define RCI_DISPATCH_H_
+
+#include <stdint.h>
+#include "rci.h"
+
+#define RCI_NAME_LEN 5
+
+/* Must be a power of two, at least twice the number of commands a board has */
+#ifndef RCI_DISPATCH_SLOTS
+#define RCI_DISPATCH_SLOTS 64
+#endif
+
+struct RCIDispatch {
+	struct RCICommand * commands;
+	struct {
+		uint32_t key;
+		uint8_t index;      // into commands, plus one. 0 for an empty slot
+	} slot[RCI_DISPATCH_SLOTS];
+};
+
+/* Returns 0, or -1 if a name isn't '#' and four characters, a name is in the
+ * table twice, or there are more than RCI_DISPATCH_SLOTS / 2 commands.
+ */
+int rciDispatchInit(struct RCIDispatch * d, struct RCICommand * commands);
+
+/* Returns the command for the request in data, or NULL */
+struct RCICommand * rciDispatchFind(const struct RCIDispatch * d, const char * data, int len);
+
+#endif
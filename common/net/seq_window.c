@@ -0,0 +1,168 @@
+#include <string.h>
+
+#include "seq_window.h"
+
+static void burst(struct SeqStats * stats, uint32_t run){
+	unsigned b = run == 1 ? 0 : 32 - __builtin_clz(run - 1);
+	++stats->burst[b < SEQ_BURST_BUCKETS ? b : SEQ_BURST_BUCKETS - 1];
+}
+
+/* Moves the front of the window on by k, counting what falls off the back */
+static void advance(struct SeqWindow * w, uint32_t k){
+	uint32_t leaving = k < SEQ_WINDOW_LEN ? k : SEQ_WINDOW_LEN;
+	uint32_t i;
+
+	// oldest first, so runs come out in order
+	for(i = 0; i < leaving; ++i){
+		if(w->seen & (1ULL << (SEQ_WINDOW_LEN - 1 - i))){
+			if(w->run){
+				burst(&w->stats, w->run);
+				w->run = 0;
+			}
+		} else {
+			++w->run;
+			++w->stats.lost;
+		}
+	}
+	// a jump past the whole window loses everything it skipped
+	if(k > SEQ_WINDOW_LEN){
+		w->run += k - SEQ_WINDOW_LEN;
+		w->stats.lost += k - SEQ_WINDOW_LEN;
+	}
+
+	w->seen = k < SEQ_WINDOW_LEN ? w->seen << k : 0;
+	w->next += k;
+}
+
+static void restart(struct SeqWindow * w, uint32_t seq){
+	// nothing before the first datagram counts as lost
+	w->seen = ~0ULL;
+	w->next = seq + 1;
+	w->run = 0;
+	w->started = 1;
+}
+
+enum SeqClass seqWindowUpdate(struct SeqWindow * w, uint32_t seq){
+	if(!w->started){
+		restart(w, seq);
+		++w->stats.received;
+		return SEQ_FIRST;
+	}
+
+	int32_t ahead = seq - w->next;
+	if(ahead >= 0){
+		advance(w, ahead + 1);
+		w->seen |= 1;
+		++w->stats.received;
+		return ahead ? SEQ_AHEAD : SEQ_NEXT;
+	}
+
+	uint32_t age = w->next - 1 - seq;
+	if(age < SEQ_WINDOW_LEN){
+		uint64_t bit = 1ULL << age;
+		if(w->seen & bit){
+			++w->stats.duplicate;
+			return SEQ_DUPLICATE;
+		}
+		w->seen |= bit;
+		++w->stats.received;
+		++w->stats.late;
+		return SEQ_LATE;
+	}
+	if(age < SEQ_WINDOW_LEN + SEQ_RESYNC_DISTANCE){
+		++w->stats.stale;
+		return SEQ_STALE;
+	}
+
+	if(w->run){
+		burst(&w->stats, w->run);
+	}
+	restart(w, seq);
+	++w->stats.resyncs;
+	++w->stats.received;
+	return SEQ_RESYNC;
+}
+
+
+int seqReorderOldest(const struct SeqReorder * ro){
+	int oldest = -1;
+	uint32_t best = 0;
+	unsigned i;
+
+	for(i = 0; i < ro->depth; ++i){
+		if(!(ro->used & (1u << i))){
+			continue;
+		}
+		uint32_t d = ro->seq[i] - ro->deliver;
+		if(oldest < 0 || d < best){
+			oldest = i;
+			best = d;
+		}
+	}
+	return oldest;
+}
+
+int seqReorderReady(const struct SeqReorder * ro){
+	int oldest = seqReorderOldest(ro);
+	if(oldest < 0){
+		return -1;
+	}
+	if(ro->seq[oldest] == ro->deliver || (unsigned)__builtin_popcount(ro->used) >= ro->depth){
+		return oldest;
+	}
+	return -1;
+}
+
+size_t seqReorderTake(struct SeqReorder * ro, int slot, uint8_t * out){
+	size_t len = ro->len[slot];
+
+	memcpy(out, ro->data + slot * ro->slotSize, len);
+	ro->used &= ~(1u << slot);
+	ro->skipped += ro->seq[slot] - ro->deliver;
+	ro->deliver = ro->seq[slot] + 1;
+	return len;
+}
+
+enum SeqReorderAction seqReorderOffer(struct SeqReorder * ro, uint32_t seq, const uint8_t * data, size_t len){
+	unsigned i;
+
+	if(!ro->started){
+		ro->started = 1;
+		ro->deliver = seq;
+	}
+
+	int32_t ahead = seq - ro->deliver;
+	if(ahead < -(int32_t)(SEQ_WINDOW_LEN + SEQ_RESYNC_DISTANCE)){
+		// the sender started over, so does delivery
+		ro->used = 0;
+		ro->deliver = seq;
+		ahead = 0;
+	}
+	if(ahead < 0){
+		return SEQ_DROP;
+	}
+	if(ahead == 0){
+		++ro->deliver;
+		return SEQ_DELIVER;
+	}
+
+	for(i = 0; i < ro->depth; ++i){
+		if((ro->used & (1u << i)) && ro->seq[i] == seq){
+			return SEQ_DROP;
+		}
+	}
+	for(i = 0; i < ro->depth; ++i){
+		if(!(ro->used & (1u << i))){
+			if(len > ro->slotSize){
+				len = ro->slotSize;
+			}
+			memcpy(ro->data + i * ro->slotSize, data, len);
+			ro->seq[i] = seq;
+			ro->len[i] = len;
+			ro->used |= 1u << i;
+			return SEQ_STASH;
+		}
+	}
+	// full, the caller should have taken seqReorderReady() first
+	return SEQ_DROP;
+}
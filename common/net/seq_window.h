@@ -0,0 +1,114 @@
+/*
+ * Sequence number bookkeeping for sequenced sockets
+ *
+ * A SeqWindow remembers which of the last SEQ_WINDOW_LEN sequence numbers
+ * have arrived, as a bitmap behind the highest one seen, and sorts each new
+ * datagram into next in line, ahead of a gap, late (filling a gap), a
+ * duplicate, or stale (older than the window). A sequence number only counts
+ * as lost once it falls out of the back of the window without having
+ * arrived, so a datagram that's merely reordered is never counted lost, and
+ * each run of lost datagrams goes into a burst length histogram as it leaves.
+ *
+ * A SeqReorder is an optional small stash of datagrams that arrived ahead of
+ * a gap, so they can be handed on in order once the gap fills, or once the
+ * stash is full and the gap is given up on.
+ *
+ * Nothing in here depends on ChibiOS or lwIP so it can be tested on a host.
+ */
+
+#ifndef SEQ_WINDOW_H_
+#define SEQ_WINDOW_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SEQ_WINDOW_LEN 64
+
+/* A datagram further behind the window than this means the sender restarted
+ * its count rather than that the datagram is very late
+ */
+#ifndef SEQ_RESYNC_DISTANCE
+#define SEQ_RESYNC_DISTANCE 1024
+#endif
+
+/* Lost runs of 1, 2, 3-4, 5-8, 9-16, 17-32, 33-64 and 65 or more */
+#define SEQ_BURST_BUCKETS 8
+
+struct SeqStats {
+	uint32_t received;  // datagrams that were new, in order or not
+	uint32_t late;      // of those, the ones that filled a gap
+	uint32_t duplicate;
+	uint32_t stale;     // too old to tell whether they're duplicates
+	uint32_t lost;
+	uint32_t resyncs;   // times the sender's count jumped back and we followed
+	uint32_t burst[SEQ_BURST_BUCKETS];
+};
+
+enum SeqClass {
+	SEQ_FIRST,          // first datagram, the window starts here
+	SEQ_NEXT,           // the one after the highest so far
+	SEQ_AHEAD,          // past a gap
+	SEQ_LATE,           // fills a gap
+	SEQ_DUPLICATE,
+	SEQ_STALE,
+	SEQ_RESYNC,         // far behind, restarted the window from it
+};
+
+struct SeqWindow {
+	uint32_t next;      // one past the highest sequence number seen
+	uint64_t seen;      // bit i set: next - 1 - i has arrived
+	uint32_t run;       // lost in a row so far, still leaving the window
+	int started;
+	struct SeqStats stats;
+};
+
+enum SeqClass seqWindowUpdate(struct SeqWindow * w, uint32_t seq);
+
+/* Reorder stash. Slots hold a sequence number, a length and up to slotSize
+ * bytes each; depth can be at most 32.
+ */
+struct SeqReorder {
+	unsigned depth;
+	size_t slotSize;
+	uint32_t used;      // bitmap of full slots
+	uint32_t deliver;   // next sequence number to hand on
+	int started;
+	uint32_t * seq;
+	size_t * len;
+	uint8_t * data;
+	uint32_t skipped;   // sequence numbers given up on
+};
+
+#define DECL_SEQ_REORDER(DEPTH, SLOTSIZE) { \
+	.depth = (DEPTH), \
+	.slotSize = (SLOTSIZE), \
+	.seq = (uint32_t[DEPTH]){ 0 }, \
+	.len = (size_t[DEPTH]){ 0 }, \
+	.data = (uint8_t[(DEPTH) * (SLOTSIZE)]){ 0 }, \
+}
+
+/* Returns the stashed slot to hand on now, or -1. That's the oldest one if it
+ * is next in line, or if the stash is full and the gap in front of it has to
+ * be given up on.
+ */
+int seqReorderReady(const struct SeqReorder * ro);
+
+/* Returns the oldest stashed slot, or -1 if the stash is empty */
+int seqReorderOldest(const struct SeqReorder * ro);
+
+/* Copies a slot out, frees it and moves delivery on past it. Returns the
+ * length.
+ */
+size_t seqReorderTake(struct SeqReorder * ro, int slot, uint8_t * out);
+
+/* What to do with a datagram that just arrived: hand it on now, stash it,
+ * or drop it because its turn has been and gone.
+ */
+enum SeqReorderAction {
+	SEQ_DELIVER,
+	SEQ_STASH,
+	SEQ_DROP,
+};
+enum SeqReorderAction seqReorderOffer(struct SeqReorder * ro, uint32_t seq, const uint8_t * data, size_t len);
+
+#endif
@@ -0,0 +1,42 @@
+#include <string.h>
+
+#include "ch.h"
+#include "hal.h"
+
+#include "utils_rawether.h"
+
+void rawEtherSocket(struct RawEtherSocket * rs, MACDriver * mac, const uint8_t * src, uint16_t type) {
+	memset(rs, 0, sizeof(*rs));
+	rs->mac = mac;
+	memset(rs->header, 0xff, 6);   // broadcast until connected
+	memcpy(rs->header + 6, src, 6);
+	rs->header[12] = type >> 8;
+	rs->header[13] = type;
+}
+
+void rawEtherConnect(struct RawEtherSocket * rs, const uint8_t * dst) {
+	memcpy(rs->header, dst, 6);
+}
+
+int rawEtherSend(struct RawEtherSocket * rs, const void * head, size_t headlen, const void * data, size_t len) {
+	MACTransmitDescriptor td;
+
+	if (RAWETHER_HEADER + headlen + len > STM32_MAC_BUFFERS_SIZE ||
+	    macWaitTransmitDescriptor(rs->mac, &td, TIME_IMMEDIATE) != RDY_OK) {
+		++rs->dropped;
+		return -1;
+	}
+
+	/* Each write lands after the last in the descriptor's buffer, which the
+	 * MAC's DMA sends from once it's released
+	 */
+	macWriteTransmitDescriptor(&td, rs->header, RAWETHER_HEADER);
+	if (headlen)
+		macWriteTransmitDescriptor(&td, (uint8_t *)head, headlen);
+	if (len)
+		macWriteTransmitDescriptor(&td, (uint8_t *)data, len);
+	macReleaseTransmitDescriptor(&td);
+
+	++rs->sent;
+	return 0;
+}
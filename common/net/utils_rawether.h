@@ -0,0 +1,43 @@
+/*
+ * Raw Ethernet transmit
+ *
+ * For streams too fast to spend a UDP/IP stack and a tcpip thread switch on
+ * every buffer. A RawEtherSocket writes whole frames with a fixed header,
+ * destination, source and EtherType, straight into the MAC's transmit
+ * descriptors from the calling thread and never goes near lwIP. It takes
+ * descriptors the same way lwIP's own output does, one at a time under the
+ * driver's lock, so lwIP keeps working on the same MAC alongside it (RCI
+ * included).
+ *
+ * A send never waits: with no free descriptor the frame is dropped and
+ * counted.
+ */
+
+#ifndef UTILS_RAWETHER_H_
+#define UTILS_RAWETHER_H_
+
+#include "hal.h"
+
+#define RAWETHER_HEADER 14
+
+/* IEEE 802 local experimental EtherType, what the PSAS streams use */
+#define RAWETHER_TYPE_PSAS 0x88B5
+
+struct RawEtherSocket {
+	MACDriver * mac;
+	uint8_t header[RAWETHER_HEADER];
+	uint32_t sent;
+	uint32_t dropped;   // no transmit descriptor free, or the link was down
+};
+
+void rawEtherSocket(struct RawEtherSocket * rs, MACDriver * mac, const uint8_t * src, uint16_t type);
+
+/* Sets the destination MAC */
+void rawEtherConnect(struct RawEtherSocket * rs, const uint8_t * dst);
+
+/* Sends one frame of the socket's header, then head, then data. Returns 0,
+ * or -1 if the frame was dropped.
+ */
+int rawEtherSend(struct RawEtherSocket * rs, const void * head, size_t headlen, const void * data, size_t len);
+
+#endif
@@ -69,7 +69,15 @@ int seqSocket(struct SeqSocket* ss, const struct sockaddr * addr) {
 	return 0;
 }
 
-int seqRecvfrom(struct SeqSocket* ss, int flags, struct sockaddr* from, socklen_t* fromlen) {
+int seqSetReorder(struct SeqSocket* ss, struct SeqReorder* ro) {
+	if (ro && (ro->depth == 0 || ro->depth > 32 || ro->slotSize < ss->maxSize))
+		return -1;
+	ss->reorder = ro;
+	return 0;
+}
+
+/* Reads one datagram into ss->buffer, returns the payload length */
+static int seqRecvDatagram(struct SeqSocket* ss, int flags, struct sockaddr* from, socklen_t* fromlen, uint32_t* seq) {
 	int packetLen = recvfrom(ss->socket, ss->buffer - sizeof(uint32_t), ss->maxSize + sizeof(uint32_t), flags, from, fromlen);
 	if (packetLen < 0)
 		return packetLen;
@@ -82,18 +90,62 @@ int seqRecvfrom(struct SeqSocket* ss, int flags, struct sockaddr* from, socklen_
 		return -1;
 	}
 
-	uint32_t seq = ntohl(((uint32_t*)ss->buffer)[-1]);
-	if (seq != ss->seqRecv)
-		if (seqErrorLogger)
-			seqErrorLogger(ss->seqRecv, seq, ss->buffer, len - sizeof(uint32_t));
+	*seq = ntohl(((uint32_t*)ss->buffer)[-1]);
+	return len - sizeof(uint32_t);
+}
+
+static enum SeqClass seqAccount(struct SeqSocket* ss, uint32_t seq, int len) {
+	uint32_t expected = ss->window.next;
+	enum SeqClass c = seqWindowUpdate(&ss->window, seq);
+
+	if (c != SEQ_NEXT && c != SEQ_FIRST && seqErrorLogger)
+		seqErrorLogger(expected, seq, ss->buffer, len);
+	ss->seqRecv = ss->window.next;
+	return c;
+}
+
+static int seqRecvReordered(struct SeqSocket* ss, int flags, struct sockaddr* from, socklen_t* fromlen) {
+	struct SeqReorder* ro = ss->reorder;
+	uint32_t seq;
+	int slot;
+
+	while (TRUE) {
+		slot = seqReorderReady(ro);
+		if (slot >= 0)
+			return seqReorderTake(ro, slot, ss->buffer);
+
+		int len = seqRecvDatagram(ss, flags, from, fromlen, &seq);
+		if (len < 0) {
+			// nothing else is coming for now, so stop waiting on the gap
+			if (errno == EWOULDBLOCK && (slot = seqReorderOldest(ro)) >= 0)
+				return seqReorderTake(ro, slot, ss->buffer);
+			return len;
+		}
+
+		enum SeqClass c = seqAccount(ss, seq, len);
+		if (c == SEQ_DUPLICATE || c == SEQ_STALE)
+			continue;
+		if (seqReorderOffer(ro, seq, ss->buffer, len) == SEQ_DELIVER)
+			return len;
+	}
+}
+
+int seqRecvfrom(struct SeqSocket* ss, int flags, struct sockaddr* from, socklen_t* fromlen) {
+	uint32_t seq;
+
+	if (ss->reorder)
+		return seqRecvReordered(ss, flags, from, fromlen);
+
+	int len = seqRecvDatagram(ss, flags, from, fromlen, &seq);
+	if (len < 0)
+		return len;
 
-	ss->seqRecv = seq + 1;
-	if(seq < ss->seqRecv) {
+	enum SeqClass c = seqAccount(ss, seq, len);
+	if (c == SEQ_DUPLICATE || c == SEQ_STALE) {
 		errno = EIO;
 		return -1;
-	} else {
-		return packetLen - sizeof(uint32_t);
 	}
+	return len;
 }
 
 int seqRecv(struct SeqSocket* ss, int flags) {
@@ -139,5 +191,55 @@ int seqWrite(struct SeqSocket* ss, size_t size) {
 }
 
 
+/* Batched sequenced sockets */
 
+void seqBatchInit(struct SeqBatch* sb, struct SeqSocket* ss, size_t sampleSize, systime_t maxLatency) {
+	sb->ss = ss;
+	sb->sampleSize = sampleSize;
+	sb->maxSamples = (ss->maxSize - sizeof(uint16_t)) / sampleSize;
+	sb->maxLatency = maxLatency;
+	sb->count = 0;
+	sb->first = 0;
+	sb->datagrams = 0;
+	sb->samples = 0;
+	sb->errors = 0;
+}
+
+/* Returns where to write the next sample, seqBatchCommit() adds it */
+uint8_t* seqBatchNext(struct SeqBatch* sb) {
+	return sb->ss->buffer + sizeof(uint16_t) + sb->count * sb->sampleSize;
+}
+
+int seqBatchFlush(struct SeqBatch* sb) {
+	if (sb->count == 0)
+		return 0;
+
+	uint16_t count = htons(sb->count);
+	memcpy(sb->ss->buffer, &count, sizeof(count));
+	int ret = seqWrite(sb->ss, SEQ_BATCH_BYTES(sb->count, sb->sampleSize));
+
+	// a failed send loses the batch rather than holding up newer samples
+	sb->count = 0;
+	if (ret < 0) {
+		++sb->errors;
+		return ret;
+	}
+	++sb->datagrams;
+	return ret;
+}
+
+int seqBatchCommit(struct SeqBatch* sb) {
+	if (sb->count++ == 0)
+		sb->first = chTimeNow();
+	++sb->samples;
+
+	if (sb->count >= sb->maxSamples || chTimeNow() - sb->first >= sb->maxLatency)
+		return seqBatchFlush(sb);
+	return 0;
+}
 
+int seqBatchPoll(struct SeqBatch* sb) {
+	if (sb->count && chTimeNow() - sb->first >= sb->maxLatency)
+		return seqBatchFlush(sb);
+	return 0;
+}
@@ -10,6 +10,7 @@
 #include "lwipthread.h"
 #include "lwip/sockets.h"
 #include "lwip/ip_addr.h"
+#include "seq_window.h"
 
 /* Ethernet MTU in bytes - useful for creating UDP rx and tx buffers*/
 #define ETH_MTU 1500
@@ -28,7 +29,15 @@ void set_sockaddr(struct sockaddr * addr, const char * ip, uint16_t port);
 /* Returns an AF_INET UDP socket bound to addr, or less than 0 on failure */
 int get_udp_socket(const struct sockaddr *addr);
 
-/* Sequenced socket utilities */
+/* Sequenced socket utilities
+ *
+ * Every datagram starts with a uint32_t sequence number in network byte
+ * order. On receive the window sorts each datagram by its sequence number
+ * and keeps loss, reorder and duplicate counts in window.stats; duplicates
+ * and datagrams too old to check fail with EIO, anything else new is
+ * returned even if it's late. seqRecv is the sequence number after the
+ * highest one received.
+ */
 
 struct SeqSocket {
 	size_t maxSize;
@@ -36,6 +45,8 @@ struct SeqSocket {
 	uint32_t seqSend;
 	uint32_t seqRecv;
 	uint8_t* buffer;
+	struct SeqWindow window;
+	struct SeqReorder* reorder;
 };
 
 #define DECL_SEQ_SOCKET(MAXSIZE) { \
@@ -51,6 +62,15 @@ void seqSetErrorLogger(SeqErrorLogger logger);
 
 int seqSocket(struct SeqSocket* ss, const struct sockaddr * addr);
 
+/* Hands received datagrams on in sequence order. Datagrams that arrive past
+ * a gap wait in ro until the gap fills, until ro is full, or until the socket
+ * has nothing more to read; then the gap is given up on. Datagrams whose turn
+ * has already gone are dropped. ro's slots must hold ss->maxSize bytes,
+ * declare it with DECL_SEQ_REORDER(depth, maxSize). Returns 0, or -1 if ro
+ * is the wrong size.
+ */
+int seqSetReorder(struct SeqSocket* ss, struct SeqReorder* ro);
+
 int seqRead(struct SeqSocket* ss);
 int seqRecv(struct SeqSocket* ss, int flags);
 int seqRecvfrom(struct SeqSocket* ss, int flags, struct sockaddr* from, socklen_t* fromlen);
@@ -59,4 +79,38 @@ int seqWrite(struct SeqSocket* ss, size_t size);
 int seqSend(struct SeqSocket* ss, size_t size, int flags);
 int seqSendto(struct SeqSocket* ss, size_t size, int flags, const struct sockaddr* to, socklen_t tolen);
 
+/* Batched sequenced sockets
+ *
+ * Packs several fixed size samples into one sequenced datagram:
+ *
+ * [uint32_t seq][uint16_t count][count * sampleSize bytes of samples]
+ *
+ * with seq and count in network byte order. The batch is sent once it holds
+ * as many samples as fit in the SeqSocket's maxSize, declare it with
+ * SEQ_BATCH_BYTES(samples, sampleSize), or once its oldest sample is
+ * maxLatency ticks old. Nothing sends on its own, so whoever owns the batch
+ * has to call seqBatchPoll() at least every maxLatency ticks in case samples
+ * stop coming.
+ */
+
+#define SEQ_BATCH_BYTES(SAMPLES, SAMPLESIZE) (sizeof(uint16_t) + (SAMPLES) * (SAMPLESIZE))
+
+struct SeqBatch {
+	struct SeqSocket* ss;
+	size_t sampleSize;
+	uint16_t maxSamples;
+	systime_t maxLatency;
+	uint16_t count;
+	systime_t first;     // when the oldest sample in the batch was added
+	uint32_t datagrams;
+	uint32_t samples;
+	uint32_t errors;
+};
+
+void seqBatchInit(struct SeqBatch* sb, struct SeqSocket* ss, size_t sampleSize, systime_t maxLatency);
+uint8_t* seqBatchNext(struct SeqBatch* sb);
+int seqBatchCommit(struct SeqBatch* sb);
+int seqBatchFlush(struct SeqBatch* sb);
+int seqBatchPoll(struct SeqBatch* sb);
+
 #endif
@@ -0,0 +1,118 @@
+#include "ch.h"
+
+#include "lwip/api.h"
+#include "lwip/pbuf.h"
+#include "lwip/tcpip.h"
+#include "lwip/udp.h"
+#include "lwip/sockets.h"
+
+#include "utils_zerocopy.h"
+
+struct zc_send {
+	struct ZeroCopySocket * zs;
+	void * buf;
+	u16_t len;
+};
+
+static struct zc_send zc_sends[ZC_MAX_PENDING];
+static MEMORYPOOL_DECL(zc_pool, sizeof(struct zc_send), NULL);
+static bool_t zc_pool_loaded;
+
+static void zc_output(void * arg) {
+	struct zc_send * send = arg;
+	struct ZeroCopySocket * zs = send->zs;
+	void * buf = send->buf;
+	struct pbuf * p;
+	err_t err = ERR_MEM;
+
+	/* A PBUF_REF has no room in front for headers so udp_send() chains a
+	 * header pbuf in front of it rather than copying. Anything lwIP has to
+	 * hold on to past udp_send(), a packet waiting on ARP say, it copies out
+	 * of the reference first, so once we've freed p the buffer is ours.
+	 */
+	p = pbuf_alloc(PBUF_TRANSPORT, send->len, PBUF_REF);
+	if (p) {
+		p->payload = buf;
+		err = udp_send(zs->conn->pcb.udp, p);
+		pbuf_free(p);
+	}
+
+	if (err == ERR_OK)
+		++zs->sent;
+	else
+		++zs->errors;
+
+	chPoolFree(&zc_pool, send);
+	if (zs->done)
+		zs->done(buf, err, zs->user);
+}
+
+int zcSocket(struct ZeroCopySocket * zs, const struct sockaddr * addr, ZeroCopyDone done, void * user) {
+	const struct sockaddr_in * in = (const struct sockaddr_in *)addr;
+	ip_addr_t ip;
+	unsigned i;
+
+	chSysLock();
+	if (!zc_pool_loaded) {
+		for (i = 0; i < ZC_MAX_PENDING; ++i)
+			chPoolFreeI(&zc_pool, &zc_sends[i]);
+		zc_pool_loaded = TRUE;
+	}
+	chSysUnlock();
+
+	zs->done = done;
+	zs->user = user;
+	zs->sent = 0;
+	zs->errors = 0;
+	zs->dropped = 0;
+
+	zs->conn = netconn_new(NETCONN_UDP);
+	if (!zs->conn)
+		return -1;
+
+	inet_addr_to_ipaddr(&ip, &in->sin_addr);
+	if (netconn_bind(zs->conn, &ip, ntohs(in->sin_port)) != ERR_OK) {
+		netconn_delete(zs->conn);
+		zs->conn = NULL;
+		return -2;
+	}
+	return 0;
+}
+
+int zcConnect(struct ZeroCopySocket * zs, const struct sockaddr * to) {
+	const struct sockaddr_in * in = (const struct sockaddr_in *)to;
+	ip_addr_t ip;
+
+	inet_addr_to_ipaddr(&ip, &in->sin_addr);
+	if (netconn_connect(zs->conn, &ip, ntohs(in->sin_port)) != ERR_OK)
+		return -1;
+	return 0;
+}
+
+int zcSend(struct ZeroCopySocket * zs, void * buf, size_t len) {
+	struct zc_send * send;
+
+	if (len > 0xffff) {
+		errno = EMSGSIZE;
+		return -1;
+	}
+
+	send = chPoolAlloc(&zc_pool);
+	if (!send) {
+		++zs->dropped;
+		errno = ENOBUFS;
+		return -1;
+	}
+	send->zs = zs;
+	send->buf = buf;
+	send->len = len;
+
+	// don't block if the tcpip thread's mailbox is full, the caller decides
+	if (tcpip_callback_with_block(zc_output, send, 0) != ERR_OK) {
+		chPoolFree(&zc_pool, send);
+		++zs->dropped;
+		errno = ENOBUFS;
+		return -1;
+	}
+	return 0;
+}
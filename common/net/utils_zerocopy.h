@@ -0,0 +1,49 @@
+/*
+ * Zero-copy UDP transmit
+ *
+ * send() on an lwIP socket hands the buffer to the tcpip thread and blocks
+ * until the tcpip thread has sent it. A ZeroCopySocket posts the send and
+ * returns right away. The tcpip thread wraps the caller's buffer in a
+ * PBUF_REF pbuf, so lwIP never copies it into a pbuf of its own, sends it
+ * with the raw UDP API and then calls the socket's done callback with the
+ * buffer. The buffer belongs to lwIP from zcSend() until done is called, and
+ * the producer must not write to it in between.
+ *
+ * done runs on the tcpip thread: keep it short and don't call the socket or
+ * netconn APIs from it.
+ */
+
+#ifndef UTILS_ZEROCOPY_H_
+#define UTILS_ZEROCOPY_H_
+
+#include "lwip/api.h"
+#include "lwip/sockets.h"
+
+/* Sends in flight at once, across all zero-copy sockets */
+#ifndef ZC_MAX_PENDING
+#define ZC_MAX_PENDING 8
+#endif
+
+typedef void (*ZeroCopyDone)(void * buf, err_t err, void * user);
+
+struct ZeroCopySocket {
+	struct netconn * conn;
+	ZeroCopyDone done;
+	void * user;
+	uint32_t sent;     // written by the tcpip thread
+	uint32_t errors;   // written by the tcpip thread, sends lwIP failed
+	uint32_t dropped;  // written by the sender, sends that were never posted
+};
+
+/* Binds a UDP netconn to addr. Returns 0, or less than 0 on failure */
+int zcSocket(struct ZeroCopySocket * zs, const struct sockaddr * addr, ZeroCopyDone done, void * user);
+int zcConnect(struct ZeroCopySocket * zs, const struct sockaddr * to);
+
+/* Queues len bytes of buf to the connected address. Returns 0 once the send
+ * is posted, done will follow. Returns -1 with errno set to ENOBUFS if it
+ * couldn't be posted, in which case done is never called and buf is still
+ * the caller's.
+ */
+int zcSend(struct ZeroCopySocket * zs, void * buf, size_t len);
+
+#endif
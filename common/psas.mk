@@ -4,7 +4,7 @@ PSAS_OPENOCD       = ../../toolchain/openocd
 PSAS_DEVICES       = $(PSAS_COMMON)/devices
 PSAS_UTIL          = $(PSAS_COMMON)/util
 PSAS_NET           = $(PSAS_COMMON)/net
-PSAS_NETSRC        = $(PSAS_NET)/rci.c $(PSAS_NET)/net_addrs.c $(PSAS_NET)/utils_sockets.c
+PSAS_NETSRC        = $(PSAS_NET)/rci.c $(PSAS_NET)/rci_dispatch.c $(PSAS_NET)/net_addrs.c $(PSAS_NET)/utils_sockets.c $(PSAS_NET)/seq_window.c $(PSAS_NET)/utils_zerocopy.c
 PSAS_BOARDS        = $(PSAS_COMMON)/boards
 PSAS_RULES         = $(PSAS_OPENOCD)/openocd.mk
 
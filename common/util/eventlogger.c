@@ -8,6 +8,7 @@
 
 #include "psas_sdclog.h"
 #include "usbdetail.h"
+#include "rci.h"
 
 #include "eventlogger.h"
 
@@ -21,6 +22,10 @@
 #define UNUSED __attribute__((unused))
 
 #define EVENTBUFF_LENGTH 64
+/* Write the partial block out if no events arrive for this long */
+#define EVENTLOG_FLUSH_MS 100
+/* How often the event rings are drained while the mailbox is empty */
+#define EVENTLOG_POLL_MS 5
 #define EVENTLOG_DEBUG true
 
 #ifdef EVENTLOG_DEBUG
@@ -49,6 +54,31 @@ static msg_t eventlogger(void* _);
  */
 GENERIC_message* make_msg(const char* id, const uint8_t* data, uint16_t data_length);
 
+/*
+ * Converts nanoseconds to a psas_timespec timestamp.
+ */
+static void to_psas_time(uint8_t * ts, uint64_t time_ns);
+
+/*
+ * This appends one message head and data to the log block, recording how long
+ * it waited to be logged and how long the append took.
+ */
+static SDC_ERRORCode log_record(const GENERIC_message* msg, size_t len);
+
+/*
+ * This copies everything waiting in the event rings into the log block,
+ * returning the number of records drained.
+ */
+static unsigned drain_rings(void);
+
+/*
+ * These time the block writes and syncs the block log makes through
+ * card_storage.
+ */
+static SDC_ERRORCode timed_write(void* ctx, uint32_t ofs, const void* buf, size_t len);
+static SDC_ERRORCode timed_read(void* ctx, uint32_t ofs, void* buf, size_t len);
+static SDC_ERRORCode timed_sync(void* ctx);
+
 
 
 /*
@@ -75,6 +105,37 @@ static GENERIC_message msg_data[EVENTBUFF_LENGTH] __attribute__((aligned(sizeof(
 
 static WORKING_AREA(wa_thread_eventlogger, 2048);
 
+/*
+ * Messages are packed into sector aligned blocks by the block log rather than
+ * written one by one, see sdcblock.h.
+ */
+static SDCBlockLog log_block;
+static SDCStorage  card_storage;
+static const SDCStorage log_storage = {
+	.write = timed_write,
+	.read  = timed_read,
+	.sync  = timed_sync,
+	.ctx   = &card_storage,
+};
+
+/*
+ * Pipeline statistics for the #ELOG RCI command. The logger thread and the
+ * log_event() callers update these, eventlogger_get_stats() copies them out.
+ */
+static EventLogStats stats = {
+	.version = EVENTLOG_STATS_VERSION,
+	.size    = sizeof(EventLogStats),
+};
+/* counts at the last reset, for the statistics that live elsewhere */
+static uint32_t ring_dropped_base;
+static uint32_t block_writes_base;
+
+/*
+ * Rings registered with eventlogger_ring_init(). Only ever added to, so the
+ * logger thread can walk the list without locking.
+ */
+static EventLogRing* event_rings = NULL;
+
 
 
 /*
@@ -97,11 +158,107 @@ bool log_event(const char* id, const uint8_t* data, uint16_t data_length) {
 	msg_t status;
 
 	GENERIC_message* msg = make_msg(id, data, data_length);
-	if (msg == NULL) return false;
+	if (msg == NULL) {
+		chSysLock();
+		stats.pool_empty++;
+		chSysUnlock();
+		return false;
+	}
 
 	status = chMBPost(&event_mail, (msg_t) msg, TIME_IMMEDIATE);
+	if (status != RDY_OK) {
+		chPoolFree(&msg_pool, msg);
+		chSysLock();
+		stats.mail_full++;
+		chSysUnlock();
+		return false;
+	}
+
+	return true;
+}
+
+
+/*
+ * eventlogger_ring_init
+ *
+ * Sets up an event ring over buf and hands it to the logger thread. size must
+ * be a power of two and buf must be word aligned. Each record takes a 4 byte
+ * ring header plus the GENERIC_message head and data_length bytes of data,
+ * rounded up to a multiple of 4.
+ */
+void eventlogger_ring_init(EventLogRing* ring, uint8_t* buf, uint32_t size) {
+	bool ok = spsc_ring_init(&ring->ring, buf, size);
+
+	chDbgAssert(ok, "eventlogger_ring_init(), #1", "bad ring buffer");
+	if (!ok) return;
+	ring->index = 0;
+
+	chSysLock();
+	ring->next  = event_rings;
+	event_rings = ring;
+	chSysUnlock();
+}
+
 
-	return status == RDY_OK;
+/*
+ * log_event_ring
+ *
+ * Like log_event(), but the message is built in place in the ring owned by
+ * the caller, with no memory pool or mailbox. Returns false if the ring was
+ * full or data_length is more than SDC_MAX_PAYLOAD_BYTES; dropped records are
+ * counted in ring->ring.dropped.
+ */
+bool log_event_ring(EventLogRing* ring, const char* id, const uint8_t* data, uint16_t data_length) {
+	GENERIC_message* msg;
+
+	if (data_length > SDC_MAX_PAYLOAD_BYTES) {
+		++ring->ring.dropped;
+		return false;
+	}
+
+	msg = spsc_ring_reserve(&ring->ring, offsetof(GENERIC_message, data) + data_length);
+	if (msg == NULL) return false;
+
+	strncpy(msg->mh.ID, id, SDC_NUM_ID_CHARS);
+	msg->mh.index = ring->index++;
+	to_psas_time(msg->mh.ts.ns, rtcGetTimeUsec(&RTCD1) * 1000);
+	msg->mh.data_length = data_length;
+	memset(&msg->logtime, 0, sizeof(msg->logtime));
+	memcpy(&msg->data, data, data_length);
+
+	spsc_ring_commit(&ring->ring);
+	return true;
+}
+
+
+/*
+ * eventlogger_get_stats
+ *
+ * Copies out the logging pipeline statistics, optionally starting them over.
+ */
+void eventlogger_get_stats(EventLogStats* out, bool reset) {
+	EventLogRing* ring;
+	uint32_t      ring_dropped = 0;
+	uint32_t      block_writes = log_block.block_writes;
+
+	for (ring = event_rings; ring != NULL; ring = ring->next) {
+		ring_dropped += ring->ring.dropped;
+	}
+
+	chSysLock();
+	*out = stats;
+	if (reset) {
+		memset((uint8_t*) &stats + offsetof(EventLogStats, logged), 0,
+		       sizeof(stats) - offsetof(EventLogStats, logged));
+	}
+	chSysUnlock();
+
+	out->ring_dropped = ring_dropped - ring_dropped_base;
+	out->block_writes = block_writes - block_writes_base;
+	if (reset) {
+		ring_dropped_base = ring_dropped;
+		block_writes_base = block_writes;
+	}
 }
 
 
@@ -132,7 +289,7 @@ void eventlogger_init(void) {
  * ============================ ************************************************
  */
 /* Utility to convert nanoseconds to psas time. Should go somewhere else*/
-static to_psas_time(uint8_t * ts, uint64_t time_ns){
+static void to_psas_time(uint8_t * ts, uint64_t time_ns){
 	ts[0] = time_ns >> 40;
 	ts[1] = time_ns >> 32;
 	ts[2] = time_ns >> 24;
@@ -147,11 +304,10 @@ static to_psas_time(uint8_t * ts, uint64_t time_ns){
  * Log messages from the event mailbox to the SD card.
  */
 static msg_t eventlogger(void *_ UNUSED) {
-	uint32_t        write_errs = 0;
-	uint32_t        bytes_written;
 	bool            log_opened = false;
 	FIL             LogFile;
 	GENERIC_message* posted;
+	systime_t       last_logged = chTimeNow();
 
 	chRegSetThreadName("eventlogger");
 	LOG_DEBUG("Started eventlog thread\r\n");
@@ -180,17 +336,20 @@ static msg_t eventlogger(void *_ UNUSED) {
 
 			int tries = 0;
 			do {
-				file_err = f_open(&LogFile, sdc_log_file, FA_OPEN_EXISTING | FA_WRITE);
+				file_err = f_open(&LogFile, sdc_log_file, FA_OPEN_EXISTING | FA_READ | FA_WRITE);
 				tries++;
 			} while (file_err && tries < 3);
 
+			sdc_fatfs_storage(&card_storage, &LogFile);
+			sdc_block_init(&log_block, &log_storage, sizeof(GENERIC_message), (uint32_t) rtcGetTimeUsec(&RTCD1));
+
 			// if we couldn't open the log file, try to create a new one
 			if (file_err) {
 				LOG_DEBUG("Failed to open existing log file \"%s\"\r\n", sdc_log_file);
 
 				tries = 0;
 				do {
-					file_err = f_open(&LogFile, sdc_log_file, FA_CREATE_ALWAYS | FA_WRITE);
+					file_err = f_open(&LogFile, sdc_log_file, FA_CREATE_ALWAYS | FA_READ | FA_WRITE);
 					tries++;
 				} while (file_err && tries < 3);
 
@@ -204,6 +363,13 @@ static msg_t eventlogger(void *_ UNUSED) {
 			} else {
 				LOG_DEBUG("Opened existing log file \"%s\"\r\n", sdc_log_file);
 				log_opened = true;
+
+				// continue after the last message that made it to the card
+				if (sdc_block_seek_eod(&log_block) == SDC_OK) {
+					LOG_DEBUG("Found end of data at %lu\r\n", sdc_block_eod(&log_block));
+				} else {
+					LOG_DEBUG("No end of data found, starting a new log\r\n");
+				}
 			}
 
 			continue;
@@ -219,60 +385,43 @@ static msg_t eventlogger(void *_ UNUSED) {
 			continue;
 		}
 
-		// if sd card has been mounted and the log file has been opened, wait
-		// for a message from our mailbox and log it to disk.
+		// if sd card has been mounted and the log file has been opened, drain
+		// the event rings, then wait for a message from our mailbox and log it
+		// to disk.
 		if (fs_ready && log_opened) {
-			int           i;
 			int           status;
-			crc_t         crc16;
-			psas_timespec logged_ts;
-			uint64_t      posted_ns = 0;
-			uint64_t      ns_delay = 0;
+			unsigned      drained;
 
-			chMBFetch(&event_mail, (msg_t *) &posted, TIME_INFINITE);
-			status = sdc_write_log_message(&LogFile, posted, &bytes_written);
-
-			if (status != FR_OK) {
-				write_errs++;
-				LOG_DEBUG( "Could not log message %5d: error %d\r\n"
-				         , posted->mh.index
-				         , status
-				         );
-				goto msg_cleanup;
+			drained = drain_rings();
+			if (drained) {
+				last_logged = chTimeNow();
 			}
 
-			crc16 = crc_init();
-			crc16 = crc_update(crc16, (const unsigned char*) posted, sizeof(GENERIC_message));
-			crc16 = crc_finalize(crc16);
+			if (chMBFetch(&event_mail, (msg_t *) &posted,
+			              drained ? TIME_IMMEDIATE : MS2ST(EVENTLOG_POLL_MS)) != RDY_OK) {
+				// flush the partial block while there is nothing else to do
+				if (chTimeNow() - last_logged >= MS2ST(EVENTLOG_FLUSH_MS)) {
+					status = sdc_block_flush(&log_block);
+					if (status != SDC_OK) {
+						chSysLock();
+						stats.write_errors++;
+						chSysUnlock();
+						LOG_DEBUG("Could not flush log block: error %d\r\n", status);
+					}
+					last_logged = chTimeNow();
+				}
+				continue;
+			}
+			last_logged = chTimeNow();
 
-			status = sdc_write_checksum(&LogFile, &crc16, &bytes_written);
-			if (status != FR_OK) {
-				write_errs++;
-				LOG_DEBUG( "Could not write checksum for message %5d: error %d\r\n"
+			status = log_record(posted, sdc_message_bytes(posted));
+			if (status != SDC_OK) {
+				LOG_DEBUG( "Could not log message %5d: error %d\r\n"
 				         , posted->mh.index
 				         , status
 				         );
-				goto msg_cleanup;
-			}
-
-			// calculate time between when the message was created and when we
-			// logged it, in ns
-			uint64_t now = rtcGetTimeUsec(&RTCD1);
-			to_psas_time(logged_ts.ns, now*1000);
-
-			for (i = 0; i < sizeof(logged_ts.ns); i++) {
-				posted_ns += (uint64_t) posted->mh.ts.ns[i] << (i * 8);
-				ns_delay += (uint64_t) logged_ts.ns[i] << (i * 8);
 			}
-			ns_delay -= posted_ns;
 
-			LOG_DEBUG( "Logged message %5u with delay of %3u.%06u ms\r\n"
-			         , posted->mh.index
-			         , (uint32_t) (ns_delay / 1000000)
-			         , (uint32_t) (ns_delay % 1000000)
-			         );
-
-msg_cleanup:
 			chPoolFree(&msg_pool, posted);
 			continue;
 		}
@@ -282,6 +431,103 @@ msg_cleanup:
 }
 
 
+/* Microseconds since a halGetCounterValue() reading */
+static uint32_t elapsed_us(halrtcnt_t start) {
+	return (halGetCounterValue() - start) / (halGetCounterFrequency() / 1000000);
+}
+
+static void stats_add(LatencyHist* h, uint32_t us) {
+	chSysLock();
+	lat_hist_add(h, us);
+	chSysUnlock();
+}
+
+/* psas_timespec holds big endian nanoseconds */
+static uint64_t psas_time_us(const psas_timespec* ts) {
+	uint64_t ns = 0;
+	unsigned i;
+
+	for (i = 0; i < sizeof(ts->ns); i++) {
+		ns = (ns << 8) | ts->ns[i];
+	}
+	return ns / 1000;
+}
+
+
+static SDC_ERRORCode log_record(const GENERIC_message* msg, size_t len) {
+	uint64_t      now = rtcGetTimeUsec(&RTCD1);
+	uint64_t      posted = psas_time_us(&msg->mh.ts);
+	uint64_t      wait = now > posted ? now - posted : 0;
+	halrtcnt_t    start;
+	SDC_ERRORCode status;
+
+	stats_add(&stats.queue_wait, wait < UINT32_MAX ? (uint32_t) wait : UINT32_MAX);
+
+	start = halGetCounterValue();
+	status = sdc_block_append(&log_block, msg, len);
+	stats_add(&stats.append, elapsed_us(start));
+
+	chSysLock();
+	if (status == SDC_OK) {
+		stats.logged++;
+	} else {
+		stats.write_errors++;
+	}
+	chSysUnlock();
+	return status;
+}
+
+
+static SDC_ERRORCode timed_write(void* ctx, uint32_t ofs, const void* buf, size_t len) {
+	const SDCStorage* card = ctx;
+	halrtcnt_t        start = halGetCounterValue();
+	SDC_ERRORCode     status = card->write(card->ctx, ofs, buf, len);
+
+	stats_add(&stats.block_write, elapsed_us(start));
+	return status;
+}
+
+
+static SDC_ERRORCode timed_read(void* ctx, uint32_t ofs, void* buf, size_t len) {
+	const SDCStorage* card = ctx;
+
+	return card->read(card->ctx, ofs, buf, len);
+}
+
+
+static SDC_ERRORCode timed_sync(void* ctx) {
+	const SDCStorage* card = ctx;
+	halrtcnt_t        start = halGetCounterValue();
+	SDC_ERRORCode     status = card->sync(card->ctx);
+
+	stats_add(&stats.sync, elapsed_us(start));
+	return status;
+}
+
+
+static unsigned drain_rings(void) {
+	EventLogRing* ring;
+	unsigned      drained = 0;
+
+	for (ring = event_rings; ring != NULL; ring = ring->next) {
+		const void* record;
+		uint32_t    len;
+
+		// records are already laid out as the head and data of a
+		// GENERIC_message, so they go straight into the log block
+		while ((record = spsc_ring_peek(&ring->ring, &len)) != NULL) {
+			int status = log_record(record, len);
+			if (status != SDC_OK) {
+				LOG_DEBUG("Could not log ring message: error %d\r\n", status);
+			}
+			spsc_ring_release(&ring->ring);
+			drained++;
+		}
+	}
+	return drained;
+}
+
+
 GENERIC_message* make_msg(const char* id, const uint8_t* data, uint16_t data_length) {
 	static int msg_index = 0;
 
@@ -304,3 +550,19 @@ GENERIC_message* make_msg(const char* id, const uint8_t* data, uint16_t data_len
 
 	return msg;
 }
+
+
+static void elog_stats(struct RCICmdData* cmd, struct RCIRetData* ret, void* user UNUSED) {
+	EventLogStats s;
+
+	// "#ELOGR" starts the statistics over after reporting them
+	eventlogger_get_stats(&s, cmd->len > 0 && cmd->data[0] == 'R');
+	memcpy(ret->data, &s, sizeof(s));
+	ret->len = sizeof(s);
+}
+
+const struct RCICommand RCI_CMD_ELOG = {
+	.name = "#ELOG",
+	.function = elog_stats,
+	.user = NULL
+};
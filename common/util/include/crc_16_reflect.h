@@ -30,6 +30,23 @@ extern "C" {
 #define CRC_ALGO_TABLE_DRIVEN 1
 
 
+/**
+ * Number of bytes crc_update() folds in per table step: 1 (plain pycrc
+ * table-driven), 4 or 8. Each step needs its own 512 byte table, so 8 costs
+ * 4kB of flash.
+ *
+ * The STM32F4 CRC unit is fixed to the CRC-32 polynomial (0x04C11DB7) with
+ * no reflection or 16 bit mode, so it can't produce this crc and there is
+ * no hardware path.
+ *****************************************************************************/
+#ifndef CRC_SLICE_BY
+#define CRC_SLICE_BY 8
+#endif
+#if CRC_SLICE_BY != 1 && CRC_SLICE_BY != 4 && CRC_SLICE_BY != 8
+#error "CRC_SLICE_BY must be 1, 4 or 8"
+#endif
+
+
 /**
  * The type of the CRC values.
  *
@@ -10,12 +10,60 @@
 #ifndef PSAS_EVENTLOGGER_H_
 #define PSAS_EVENTLOGGER_H_
 
+#include "spscring.h"
+#include "latency_hist.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 
 
+/*
+ * Types
+ * ===== ***********************************************************************
+ */
+
+/*
+ * A sensor handler that logs often should own one of these rather than use
+ * log_event(). Records go into its lock-free ring without any kernel calls and
+ * the logger thread drains every ring in bulk. Only the one thread that owns
+ * the ring may call log_event_ring() on it.
+ */
+typedef struct EventLogRing {
+	SPSCRing               ring;
+	uint32_t               index;
+	struct EventLogRing *  next;
+} EventLogRing;
+
+/*
+ * Logging pipeline statistics, as returned by the #ELOG RCI command. This is
+ * sent as is, so only ever add fields at the end and bump the version.
+ */
+#define EVENTLOG_STATS_VERSION 1
+
+struct EventLogStats {
+	uint16_t             version;
+	uint16_t             size;          // sizeof(EventLogStats)
+
+	uint32_t             logged;        // messages appended to the log block
+	uint32_t             pool_empty;    // log_event() drops, no free message
+	uint32_t             mail_full;     // log_event() drops, mailbox full
+	uint32_t             ring_dropped;  // log_event_ring() drops, ring full or record too long
+	uint32_t             write_errors;  // failed appends and flushes
+	uint32_t             block_writes;
+
+	LatencyHist          queue_wait;    // message timestamp until the logger got to it
+	LatencyHist          append;        // sdc_block_append(), including any block write
+	LatencyHist          block_write;   // one block written to the card
+	LatencyHist          sync;          // f_sync of the log file
+} __attribute__((packed));
+typedef struct EventLogStats EventLogStats;
+
+extern const struct RCICommand RCI_CMD_ELOG;
+
+
+
 /*
  * API Functions
  * ============= ***************************************************************
@@ -23,6 +71,9 @@ extern "C" {
 
 void eventlogger_init(void);
 bool log_event(const char* id, const uint8_t* data, uint16_t data_length);
+void eventlogger_ring_init(EventLogRing* ring, uint8_t* buf, uint32_t size);
+bool log_event_ring(EventLogRing* ring, const char* id, const uint8_t* data, uint16_t data_length);
+void eventlogger_get_stats(EventLogStats* stats, bool reset);
 
 
 
@@ -0,0 +1,61 @@
+/*! \file latency_hist.h
+ *  Fixed bucket log2 latency histograms.
+ */
+
+#ifndef PSAS_LATENCY_HIST_H_
+#define PSAS_LATENCY_HIST_H_
+
+/*!
+ * \addtogroup latency_hist
+ * @{
+ */
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Bucket 0 counts samples of 0us, bucket n counts samples from 2^(n-1) up to
+ * 2^n - 1 us, and the last bucket also takes everything longer. Adding a
+ * sample is a count leading zeros and a few stores, cheap enough to leave on
+ * in flight code. The struct has no pointers and a fixed layout so it can be
+ * sent to the host as is.
+ */
+
+#define         LAT_HIST_BUCKETS                            24
+
+struct LatencyHist {
+	uint32_t             count;
+	uint32_t             max_us;
+	uint64_t             total_us;
+	uint32_t             bucket[LAT_HIST_BUCKETS];
+} __attribute__((packed));
+typedef struct LatencyHist LatencyHist;
+
+static inline unsigned lat_hist_bucket(uint32_t us) {
+	unsigned b = us ? 32 - __builtin_clz(us) : 0;
+	return b < LAT_HIST_BUCKETS ? b : LAT_HIST_BUCKETS - 1;
+}
+
+/*! Smallest latency that lands in bucket b */
+static inline uint32_t lat_hist_bucket_floor(unsigned b) {
+	return b ? 1u << (b - 1) : 0;
+}
+
+static inline void lat_hist_add(LatencyHist * h, uint32_t us) {
+	++h->count;
+	h->total_us += us;
+	if(us > h->max_us) {
+		h->max_us = us;
+	}
+	++h->bucket[lat_hist_bucket(us)];
+}
+
+#ifdef __cplusplus
+}
+#endif
+//! @}
+
+#endif
@@ -0,0 +1,150 @@
+/*! \file sdcblock.h
+ *  Block-buffered SD card log engine.
+ */
+
+#ifndef PSAS_SDCBLOCK_H_
+#define PSAS_SDCBLOCK_H_
+
+/*!
+ * \addtogroup sdcblock
+ * @{
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "crc_16_reflect.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Nothing in here depends on ChibiOS or FatFs, the card (or a file on the
+ * host) is reached through an SDCStorage. The on-disk layout is a series of
+ * fixed size blocks, each one starting on a sector boundary:
+ *
+ * [SDCBlockHeader][entry][entry]...[eod..eod]
+ *
+ * Each entry starts with a BOM mark that also gives the version of its
+ * layout:
+ *
+ *   version 1, SDC_BOM_MARK:    [BOM][record_size byte record][crc]
+ *   version 2, SDC_BOM_MARK_V2: [BOM][uint16_t len][len byte record][crc]
+ *
+ * The crc covers the record only. Only version 2 entries are written, so a
+ * GENERIC_message costs its header plus data_length rather than the whole
+ * struct. Version 1 entries are still read back.
+ *
+ * Records never straddle a block. Every block that is written out has its
+ * unused tail filled with the end of data fiducial, so the last block on
+ * the card always ends in eod marks no matter when power was lost. A block
+ * is only part of the log if its header carries the session of the file and
+ * the sequence number equal to its position, which is how stale blocks from
+ * an earlier file or an earlier power cycle are told apart.
+ *
+ * Since the blocks of the log are exactly the ones at the start of the file
+ * that pass that test, the end of data is found by a binary search over
+ * block headers. Recovery reads O(log(blocks)) headers and one whole block,
+ * so it takes about as long on a full 4GB card as on an empty one.
+ */
+
+#define         SDC_SECTOR_BYTES                            512
+#ifndef SDC_BLOCK_SECTORS
+#define         SDC_BLOCK_SECTORS                           4
+#endif
+#define         SDC_BLOCK_BYTES                             (SDC_SECTOR_BYTES * SDC_BLOCK_SECTORS)
+
+/* Number of block writes between storage syncs */
+#ifndef SDC_BLOCK_SYNC_COUNT
+#define         SDC_BLOCK_SYNC_COUNT                        8
+#endif
+
+#define         SDC_BOM_MARK                                0x5a5a
+#define         SDC_BOM_MARK_V2                             0x5b5a
+/* BOM, length and crc around each version 2 record */
+#define         SDC_ENTRY_OVERHEAD                          (3 * sizeof(uint16_t))
+#define         SDC_EOD_BYTE                                0xa5
+#define         SDC_EOD_MARK                                ((SDC_EOD_BYTE << 8) | SDC_EOD_BYTE)
+#define         SDC_BLOCK_MAGIC                             0x4253   // "SB"
+#define         SDC_BLOCK_VERSION                           2
+/* Offsets are 32 bits, like fatfs file sizes */
+#define         SDC_BLOCK_MAX                               (UINT32_MAX / SDC_BLOCK_BYTES)
+
+typedef enum SDC_ERRORCode {
+	SDC_OK                   = 0,
+	SDC_NULL_PARAMETER_ERROR = -1,
+	SDC_FSYNC_ERROR          = -2,
+	SDC_FWRITE_ERROR         = -3,
+	SDC_SYNC_ERROR           = -4,
+	SDC_FREAD_ERROR          = -5,
+	SDC_ASSERT_ERROR         = -6,
+	SDC_CHECKSUM_ERROR       = -7,
+	SDC_FSEEK_ERROR          = -8,
+	SDC_NO_EOD_ERROR         = -9,
+	SDC_UNKNOWN_ERROR        = -99
+} SDC_ERRORCode;
+
+/*! Backing store for the block log.
+ *
+ * Offsets are absolute byte offsets from the start of the log. read() must
+ * return SDC_FREAD_ERROR if fewer than len bytes are available.
+ */
+typedef struct SDCStorage {
+	SDC_ERRORCode (*write)(void * ctx, uint32_t ofs, const void * buf, size_t len);
+	SDC_ERRORCode (*read)(void * ctx, uint32_t ofs, void * buf, size_t len);
+	SDC_ERRORCode (*sync)(void * ctx);
+	void * ctx;
+} SDCStorage;
+
+struct SDCBlockHeader {
+	uint16_t             magic;
+	uint8_t              version;
+	uint8_t              flags;
+	uint32_t             session;
+	uint32_t             seq;
+	uint32_t             records;      // records logged before this block
+} __attribute__((packed));
+typedef struct SDCBlockHeader SDCBlockHeader;
+
+typedef struct SDCBlockLog {
+	const SDCStorage *   storage;
+	size_t               record_size;  // version 1 record size, also the largest record accepted
+	uint32_t             session;
+	uint32_t             seq;          // sequence number of the block in RAM
+	size_t               fill;         // bytes of block[] holding header + records
+	bool                 dirty;        // block[] has records not yet written
+	unsigned             sync_wait;
+
+	// statistics
+	uint32_t             records;      // records in the log, including recovered ones
+	uint32_t             block_writes;
+	uint32_t             write_errors;
+
+	uint8_t              block[SDC_BLOCK_BYTES] __attribute__((aligned(4)));
+} SDCBlockLog;
+
+static inline uint32_t sdc_block_offset(const SDCBlockLog * log) {
+	return log->seq * SDC_BLOCK_BYTES;
+}
+
+/*! Offset of the next free byte, i.e. where the eod fiducial starts */
+static inline uint32_t sdc_block_eod(const SDCBlockLog * log) {
+	return sdc_block_offset(log) + log->fill;
+}
+
+size_t          sdc_entry_check(const uint8_t * p, size_t avail, size_t v1_size) ;
+
+SDC_ERRORCode   sdc_block_init(SDCBlockLog * log, const SDCStorage * storage,
+                               size_t record_size, uint32_t session) ;
+SDC_ERRORCode   sdc_block_append(SDCBlockLog * log, const void * record, size_t len) ;
+SDC_ERRORCode   sdc_block_flush(SDCBlockLog * log) ;
+SDC_ERRORCode   sdc_block_seek_eod(SDCBlockLog * log) ;
+
+#ifdef __cplusplus
+}
+#endif
+//! @}
+
+#endif
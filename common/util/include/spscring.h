@@ -0,0 +1,89 @@
+/*! \file spscring.h
+ *  Lock-free single producer, single consumer record ring.
+ */
+
+#ifndef PSAS_SPSCRING_H_
+#define PSAS_SPSCRING_H_
+
+/*!
+ * \addtogroup spscring
+ * @{
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L && !defined(__STDC_NO_ATOMICS__)
+#include <stdatomic.h>
+#define SPSC_C11_ATOMICS
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Variable length records are copied into a power of two sized byte ring.
+ * Exactly one thread (or handler) may write a given ring and exactly one may
+ * read it; with that rule neither side needs a lock, a critical section or a
+ * kernel call, only an acquire load of the other side's index and a release
+ * store of its own. Nothing in here depends on ChibiOS so the same code can be
+ * stress tested with pthreads on a host, see projects/eventlogger/host_fc.
+ *
+ * Each record is a 32 bit header holding the record length followed by the
+ * record, padded out to a multiple of 4 bytes so records stay word aligned.
+ * Records are never split across the end of the buffer: if one won't fit in
+ * the space left before the end the producer writes an SPSC_RING_WRAP header
+ * there and starts again at offset 0.
+ *
+ * When the ring is full the record is dropped and counted, the producer never
+ * waits for the consumer.
+ */
+
+#define         SPSC_RING_HEADER_BYTES                      sizeof(uint32_t)
+#define         SPSC_RING_WRAP                              0xffffffffu
+#define         SPSC_RING_MAX_RECORD                        0xffffu
+
+#ifdef SPSC_C11_ATOMICS
+typedef atomic_uint_least32_t spsc_index_t;
+#else
+typedef volatile uint32_t     spsc_index_t;
+#endif
+
+typedef struct SPSCRing {
+	spsc_index_t         head;         // bytes ever written, producer only
+	spsc_index_t         tail;         // bytes ever released, consumer only
+	uint8_t *            buf;
+	uint32_t             size;         // power of two
+	uint32_t             reserved;     // slot size of the pending spsc_ring_reserve()
+
+	// statistics, written by the producer only
+	uint32_t             records;
+	uint32_t             dropped;
+	uint32_t             high_water;   // most bytes ever in use
+} SPSCRing;
+
+/*! Bytes of ring a record of len bytes takes up */
+static inline uint32_t spsc_ring_slot(uint32_t len) {
+	return SPSC_RING_HEADER_BYTES + ((len + 3u) & ~3u);
+}
+
+bool            spsc_ring_init(SPSCRing * ring, void * buf, uint32_t size) ;
+
+/* producer side */
+void *          spsc_ring_reserve(SPSCRing * ring, uint32_t len) ;
+void            spsc_ring_commit(SPSCRing * ring) ;
+bool            spsc_ring_put(SPSCRing * ring, const void * record, uint32_t len) ;
+
+/* consumer side */
+const void *    spsc_ring_peek(SPSCRing * ring, uint32_t * len) ;
+void            spsc_ring_release(SPSCRing * ring) ;
+uint32_t        spsc_ring_used(SPSCRing * ring) ;
+
+#ifdef __cplusplus
+}
+#endif
+//! @}
+
+#endif
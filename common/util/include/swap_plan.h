@@ -0,0 +1,58 @@
+/* Compiled struct <-> network byte order conversion.
+ *
+ * A table of struct swap entries describes how a struct is laid out in a
+ * packet. Walking that table for every packet means a switch per field, so
+ * swap_plan_compile() turns it into a short list of runs instead: fields that
+ * sit next to each other in the struct and have the same width become one run
+ * that is swapped a word (or on the host, a vector) at a time with REV/REV16
+ * style operations. A table whose packet layout is byte for byte the struct
+ * (all bytes, or a big endian target) becomes a single memcpy.
+ *
+ * Nothing in here depends on ChibiOS so it can be benchmarked on a host.
+ */
+
+#ifndef SWAP_PLAN_H_
+#define SWAP_PLAN_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Utility for converting a struct to a network endian array and back
+ * Create an array of swap structs using the SWAP_FIELD macro and pass
+ * that, the structure, and the array to one of the swapped functions
+ */
+
+#define SWAP_FIELD(type, field) { offsetof(type, field), sizeof(((type *)0)->field), 1}
+#define SWAP_ARRAY(type, field) { offsetof(type, field), sizeof(((type *)0)->field[0]), \
+                                  sizeof(((type *)0)->field) / sizeof(((type *)0)->field[0])}
+
+struct swap {
+	size_t offset;
+	size_t length;
+	size_t elements;
+};
+
+#ifndef SWAP_PLAN_MAX_RUNS
+#define SWAP_PLAN_MAX_RUNS 16
+#endif
+
+struct swap_run {
+	uint16_t offset;  // in the struct, the packet is always contiguous
+	uint16_t bytes;
+	uint8_t width;    // 1, 2 or 4
+};
+
+struct swap_plan {
+	uint16_t len;     // packet bytes, same as len_swapped()
+	uint8_t runs;
+	struct swap_run run[SWAP_PLAN_MAX_RUNS];
+};
+
+/* Returns 0, or -1 if a field isn't 1, 2 or 4 bytes wide or the table needs
+ * more than SWAP_PLAN_MAX_RUNS runs.
+ */
+int swap_plan_compile(const struct swap *swaps, struct swap_plan *plan);
+void swap_plan_write(const struct swap_plan *plan, const void *data, uint8_t *buffer);
+void swap_plan_read(const struct swap_plan *plan, void *data, const uint8_t *buffer);
+
+#endif /* SWAP_PLAN_H_ */
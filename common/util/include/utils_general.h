@@ -41,19 +41,11 @@ case val:\
 
 #define ARRAY_SIZE(array) sizeof(array)/sizeof((array)[0])
 
-/* Utility for converting a struct to a network endian array and back
- * Create an array of swap structs using the SWAP_FIELD macro and pass
- * that, the structure, and the array to one of the swapped functions
+/* Utility for converting a struct to a network endian array and back, see
+ * swap_plan.h for struct swap and SWAP_FIELD. These walk the table for every
+ * call; packets sent often should use a compiled swap_plan instead.
  */
-
-#define SWAP_FIELD(type, field) { offsetof(type, field), sizeof(((type *)0)->field), 1}
-#define SWAP_ARRAY(type, field) { offsetof(type, field), sizeof(((type *)0)->field[0]), ARRAY_SIZE(((type *)0)->field)}
-
-struct swap {
-	size_t offset;
-	size_t length;
-	size_t elements;
-};
+#include "swap_plan.h"
 
 void write_swapped(const struct swap *swaps, const void *data, uint8_t *buffer);
 void read_swapped(const struct swap *swaps, void *data, const uint8_t *buffer);
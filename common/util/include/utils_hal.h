@@ -19,11 +19,107 @@ typedef struct{
 	struct pin SCL;
 } I2CPins;
 
+/* Also starts the bus's transaction scheduler, see below */
 void i2cUtilsStart(I2CDriver * driver, const I2CConfig * config, const I2CPins * pins);
 int SMBusGet(I2CDriver * driver, uint8_t addr, uint8_t command, uint16_t* data);
 int SMBusSet(I2CDriver * driver, uint8_t addr, uint8_t command, uint16_t data);
 void chprintI2cState(BaseSequentialStream * chp, i2cstate_t state);
 void chprintI2cError(BaseSequentialStream * chp, int err);
+
+/* I2C transaction scheduler
+ *
+ * Every bus started with i2cUtilsStart() gets a thread that owns it. Drivers
+ * queue transactions on the bus and carry on; the thread runs them one at a
+ * time, highest priority first and, within a priority, earliest deadline
+ * first, then calls the transaction's callback and broadcasts its event.
+ * The transfers themselves are the HAL's DMA ones.
+ *
+ * The thread is also the only place a bus gets recovered: a timeout or a
+ * bus error restarts the peripheral and clocks SCL until a slave stuck
+ * holding SDA lets go. A hung device costs the others on its bus one
+ * timeout, which can be set per transaction, instead of stalling every
+ * driver's thread on the bus lock.
+ *
+ * A transaction is the scheduler's from i2cSchedSubmit() until status stops
+ * being I2C_TXN_PENDING. Callbacks run on the scheduler thread and mustn't
+ * wait on the bus themselves; they may submit more.
+ */
+
+#ifndef I2C_SCHED_BUSES
+#define I2C_SCHED_BUSES 2
+#endif
+
+#ifndef I2C_SCHED_DEVICES
+#define I2C_SCHED_DEVICES 8       // per bus, for the statistics
+#endif
+
+#ifndef I2C_SCHED_TIMEOUT
+#define I2C_SCHED_TIMEOUT MS2ST(50)
+#endif
+
+/* SMBus slaves may stretch the clock up to 35ms in all, past that they
+ * count as hung, see SMBus 2.0 TTIMEOUT
+ */
+#define SMBUS_TIMEOUT MS2ST(35)
+
+#define I2C_PRIO_LOW     0
+#define I2C_PRIO_NORMAL  1
+#define I2C_PRIO_HIGH    2
+
+#define I2C_TXN_PENDING  (-100)
+
+struct I2CTransaction;
+typedef void (*i2ctxncb_t)(struct I2CTransaction * t);
+
+struct I2CTransaction {
+	uint8_t addr;
+	const uint8_t * tx;        // txlen 0 for a plain read
+	size_t txlen;
+	uint8_t * rx;              // rxlen 0 for a plain write
+	size_t rxlen;
+	uint8_t priority;
+	systime_t deadline;        // after submit, 0 for none
+	systime_t timeout;         // 0 for I2C_SCHED_TIMEOUT
+	i2ctxncb_t callback;       // may be NULL
+	EventSource * done;        // may be NULL
+	void * user;
+
+	// filled in by the scheduler
+	volatile int status;       // I2C_TXN_PENDING, RDY_OK, RDY_TIMEOUT or i2cflags_t
+	systime_t submitted;
+	struct I2CTransaction * next;
+};
+
+/* Per device, from submit to completion */
+struct I2CDeviceStats {
+	const char * name;
+	uint8_t addr;
+	uint32_t transactions;
+	uint32_t errors;
+	uint32_t timeouts;
+	uint32_t late;             // finished after their deadline
+	systime_t latency_max;
+	uint32_t latency_total;    // ticks, over transactions
+};
+
+/* Names addr on driver's bus in the statistics */
+void i2cSchedDevice(I2CDriver * driver, uint8_t addr, const char * name);
+void i2cSchedSubmit(I2CDriver * driver, struct I2CTransaction * t);
+void i2cSchedSubmitI(I2CDriver * driver, struct I2CTransaction * t);
+/* Queues a transaction and waits for it, at I2C_PRIO_NORMAL unless given.
+ * Returns RDY_OK, RDY_TIMEOUT or the
+ * i2cflags_t errors, like i2cMasterTransmitTimeout() did.
+ */
+int i2cSchedTransmit(I2CDriver * driver, uint8_t addr, const uint8_t * tx, size_t txlen,
+                     uint8_t * rx, size_t rxlen, systime_t timeout);
+int i2cSchedTransmitPrio(I2CDriver * driver, uint8_t addr, uint8_t priority,
+                         const uint8_t * tx, size_t txlen, uint8_t * rx, size_t rxlen,
+                         systime_t timeout);
+/* One line per device on every bus: name, address, transactions, errors,
+ * timeouts, late, mean and max latency in microseconds; then one per bus
+ * with its recoveries. Returns the length written.
+ */
+int i2cSchedStats(char * buf, int maxlen);
 #endif
 
 
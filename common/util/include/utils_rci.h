@@ -1,7 +1,12 @@
 #ifndef UTILS_RCI_H_
 #define UTILS_RCI_H_
 #include "rci.h"
+#include "hal.h"
 
 extern const struct RCICommand RCI_CMD_VERS;
+extern const struct RCICommand RCI_CMD_LWIP;
+#if HAL_USE_I2C
+extern const struct RCICommand RCI_CMD_I2CS;
+#endif
 
 #endif
@@ -0,0 +1,289 @@
+/*! \file sdcblock.c
+ *  Block-buffered SD card log engine.
+ *
+ *  Records are packed into SDC_BLOCK_BYTES sized blocks in RAM and written
+ *  out a whole block at a time. Compared to the per-record scheme in
+ *  psas_sdclog.c (record, checksum, 200 bytes of eod marks and a seek back
+ *  for every message) the card only ever sees sector aligned, sector sized
+ *  writes and the eod fiducial costs nothing more than the unused tail of
+ *  the block that is being written anyway.
+ */
+
+/*!
+ * \defgroup sdcblock PSAS Block SD Card Log
+ * @{
+ */
+
+#include <string.h>
+
+#include "crc_16_reflect.h"
+#include "sdcblock.h"
+
+static uint16_t sdc_block_get16(const uint8_t * p) {
+	uint16_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+/*! \brief Reset the RAM block to an empty block at position seq */
+static void sdc_block_start(SDCBlockLog * log, uint32_t seq) {
+	SDCBlockHeader hdr = {
+		.magic   = SDC_BLOCK_MAGIC,
+		.version = SDC_BLOCK_VERSION,
+		.flags   = 0,
+		.session = log->session,
+		.seq     = seq,
+		.records = log->records,
+	};
+
+	log->seq   = seq;
+	log->fill  = sizeof(hdr);
+	log->dirty = false;
+	memcpy(log->block, &hdr, sizeof(hdr));
+}
+
+static bool sdc_block_header_ok(const SDCBlockLog * log, const SDCBlockHeader * hdr, uint32_t seq) {
+	return hdr->magic   == SDC_BLOCK_MAGIC   &&
+	       hdr->version == SDC_BLOCK_VERSION &&
+	       hdr->session == log->session      &&
+	       hdr->seq     == seq;
+}
+
+/*! \brief Is block seq part of the log? Only reads the block header */
+static bool sdc_block_probe(const SDCBlockLog * log, uint32_t seq) {
+	SDCBlockHeader hdr;
+
+	if(seq >= SDC_BLOCK_MAX) {
+		return false;
+	}
+	if(log->storage->read(log->storage->ctx, seq * SDC_BLOCK_BYTES, &hdr, sizeof(hdr)) != SDC_OK) {
+		return false;
+	}
+	return sdc_block_header_ok(log, &hdr, seq);
+}
+
+static crc_t sdc_record_crc(const void * record, size_t len) {
+	crc_t crcd;
+
+	crcd = crc_init();
+	crcd = crc_update(crcd, (const unsigned char *) record, len);
+	return crc_finalize(crcd);
+}
+
+/*! \brief Validate the entry (BOM, record, crc) at p
+ *
+ * avail is the number of bytes readable at p and v1_size the record size of
+ * version 1 entries. Returns the size of the whole entry, or 0 if p doesn't
+ * hold a complete entry with a good checksum.
+ */
+size_t sdc_entry_check(const uint8_t * p, size_t avail, size_t v1_size) {
+	size_t len;
+	size_t hdr;
+
+	if(avail < sizeof(uint16_t)) {
+		return 0;
+	}
+	switch(sdc_block_get16(p)) {
+	case SDC_BOM_MARK:
+		hdr = sizeof(uint16_t);
+		len = v1_size;
+		break;
+	case SDC_BOM_MARK_V2:
+		if(avail < 2 * sizeof(uint16_t)) {
+			return 0;
+		}
+		hdr = 2 * sizeof(uint16_t);
+		len = sdc_block_get16(p + sizeof(uint16_t));
+		break;
+	default:
+		return 0;
+	}
+	if(hdr + len + sizeof(crc_t) > avail) {
+		return 0;
+	}
+	if(sdc_block_get16(p + hdr + len) != sdc_record_crc(p + hdr, len)) {
+		return 0;
+	}
+	return hdr + len + sizeof(crc_t);
+}
+
+SDC_ERRORCode sdc_block_init(SDCBlockLog * log, const SDCStorage * storage,
+                             size_t record_size, uint32_t session) {
+	if((log == NULL) || (storage == NULL) || (storage->write == NULL) || (storage->read == NULL)) {
+		return SDC_NULL_PARAMETER_ERROR;
+	}
+
+	log->storage     = storage;
+	log->record_size = record_size;
+	log->session     = session;
+	log->sync_wait   = SDC_BLOCK_SYNC_COUNT;
+	log->records     = 0;
+	log->block_writes = 0;
+	log->write_errors = 0;
+
+	sdc_block_start(log, 0);
+
+	// A record has to fit in a block with room to spare for the fiducial
+	if(sizeof(SDCBlockHeader) + SDC_ENTRY_OVERHEAD + record_size + sizeof(uint16_t) > SDC_BLOCK_BYTES) {
+		return SDC_ASSERT_ERROR;
+	}
+	return SDC_OK;
+}
+
+/*! \brief Write the RAM block out, padding its tail with eod marks
+ *
+ * The same block is rewritten each time it is flushed until it fills up, so
+ * the fiducial always sits right after the last record that reached the
+ * card.
+ */
+SDC_ERRORCode sdc_block_flush(SDCBlockLog * log) {
+	SDC_ERRORCode rc;
+
+	if(log == NULL) {
+		return SDC_NULL_PARAMETER_ERROR;
+	}
+	if(!log->dirty) {
+		return SDC_OK;
+	}
+
+	memset(log->block + log->fill, SDC_EOD_BYTE, SDC_BLOCK_BYTES - log->fill);
+	rc = log->storage->write(log->storage->ctx, sdc_block_offset(log), log->block, SDC_BLOCK_BYTES);
+	if(rc != SDC_OK) {
+		++log->write_errors;
+		return rc;
+	}
+	log->dirty = false;
+	++log->block_writes;
+
+	if((log->storage->sync != NULL) && (--log->sync_wait == 0)) {
+		log->sync_wait = SDC_BLOCK_SYNC_COUNT;
+		rc = log->storage->sync(log->storage->ctx);
+		if(rc != SDC_OK) {
+			++log->write_errors;
+			return rc;
+		}
+	}
+	return SDC_OK;
+}
+
+/*! \brief Add a record of len bytes to the log
+ *
+ * Nothing reaches the storage until the block is full or sdc_block_flush()
+ * is called, callers that need bounded latency should flush when idle.
+ */
+SDC_ERRORCode sdc_block_append(SDCBlockLog * log, const void * record, size_t len) {
+	SDC_ERRORCode rc;
+	uint16_t      bom = SDC_BOM_MARK_V2;
+	uint16_t      len16 = len;
+	crc_t         crcd;
+	uint8_t *     p;
+
+	if((log == NULL) || (record == NULL)) {
+		return SDC_NULL_PARAMETER_ERROR;
+	}
+	if(len > log->record_size) {
+		return SDC_ASSERT_ERROR;
+	}
+
+	// Block is full, write it out for the last time and start the next
+	if(log->fill + SDC_ENTRY_OVERHEAD + len > SDC_BLOCK_BYTES) {
+		rc = sdc_block_flush(log);
+		if(rc != SDC_OK) {
+			return rc;
+		}
+		sdc_block_start(log, log->seq + 1);
+	}
+
+	crcd = sdc_record_crc(record, len);
+
+	p = log->block + log->fill;
+	memcpy(p, &bom, sizeof(bom));
+	memcpy(p + sizeof(bom), &len16, sizeof(len16));
+	memcpy(p + 2 * sizeof(uint16_t), record, len);
+	memcpy(p + 2 * sizeof(uint16_t) + len, &crcd, sizeof(crcd));
+	log->fill += SDC_ENTRY_OVERHEAD + len;
+	log->dirty = true;
+	++log->records;
+
+	return SDC_OK;
+}
+
+/*!
+ * Instead of restarting from byte0 in an existing log, continue from the
+ * last record that made it to the card.
+ *
+ * Blocks of the session found in block 0 make up the log. Doubling the
+ * block number until a probe fails and then bisecting finds the last of
+ * them from its header alone. Only that block is read in full and walked
+ * record by record. On success it is back in RAM with fresh eod marks
+ * written after its last good record. On failure the log is reset to an
+ * empty block 0 and SDC_NO_EOD_ERROR (or the storage error) is returned.
+ */
+SDC_ERRORCode sdc_block_seek_eod(SDCBlockLog * log) {
+	SDC_ERRORCode  rc;
+	SDCBlockHeader hdr;
+	uint32_t       session;
+	uint32_t       lo;
+	uint32_t       hi;
+	uint32_t       mid;
+	size_t         pos;
+	size_t         entry;
+
+	if(log == NULL) {
+		return SDC_NULL_PARAMETER_ERROR;
+	}
+	session = log->session;
+
+	rc = log->storage->read(log->storage->ctx, 0, &hdr, sizeof(hdr));
+	if(rc != SDC_OK || hdr.magic != SDC_BLOCK_MAGIC || hdr.version != SDC_BLOCK_VERSION || hdr.seq != 0) {
+		sdc_block_start(log, 0);
+		return (rc != SDC_OK) ? rc : SDC_NO_EOD_ERROR;
+	}
+	log->session = hdr.session;
+
+	// lo is always part of the log and hi never is
+	lo = 0;
+	hi = 1;
+	while(sdc_block_probe(log, hi)) {
+		lo = hi;
+		hi = (hi < SDC_BLOCK_MAX / 2) ? hi * 2 : SDC_BLOCK_MAX;
+	}
+	while(hi - lo > 1) {
+		mid = lo + (hi - lo) / 2;
+		if(sdc_block_probe(log, mid)) {
+			lo = mid;
+		} else {
+			hi = mid;
+		}
+	}
+
+	// A truncated file can leave a header but not the whole block behind
+	for(;;) {
+		rc = log->storage->read(log->storage->ctx, lo * SDC_BLOCK_BYTES, log->block, SDC_BLOCK_BYTES);
+		memcpy(&hdr, log->block, sizeof(hdr));
+		if(rc == SDC_OK && sdc_block_header_ok(log, &hdr, lo)) {
+			break;
+		}
+		if(lo == 0) {
+			log->session = session;
+			sdc_block_start(log, 0);
+			return (rc != SDC_OK) ? rc : SDC_NO_EOD_ERROR;
+		}
+		--lo;
+	}
+
+	// Walk the records in the last block, eod marks or a torn write end it
+	log->records = hdr.records;
+	pos = sizeof(hdr);
+	while((entry = sdc_entry_check(log->block + pos, SDC_BLOCK_BYTES - pos, log->record_size)) != 0) {
+		pos += entry;
+		++log->records;
+	}
+
+	log->seq   = lo;
+	log->fill  = pos;
+	log->dirty = true;
+	return sdc_block_flush(log);
+}
+
+//! @}
@@ -0,0 +1,131 @@
+/*! \file spscring.c
+ *
+ * Lock-free single producer, single consumer record ring, see spscring.h.
+ */
+
+#include <string.h>
+
+#include "spscring.h"
+
+#ifdef SPSC_C11_ATOMICS
+#define load_relaxed(p)       atomic_load_explicit((p), memory_order_relaxed)
+#define load_acquire(p)       atomic_load_explicit((p), memory_order_acquire)
+#define store_release(p, v)   atomic_store_explicit((p), (v), memory_order_release)
+#define store_relaxed(p, v)   atomic_store_explicit((p), (v), memory_order_relaxed)
+#else
+#define load_relaxed(p)       __atomic_load_n((p), __ATOMIC_RELAXED)
+#define load_acquire(p)       __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define store_release(p, v)   __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define store_relaxed(p, v)   __atomic_store_n((p), (v), __ATOMIC_RELAXED)
+#endif
+
+static inline uint32_t *ring_header(SPSCRing * ring, uint32_t index) {
+	return (uint32_t *) (ring->buf + (index & (ring->size - 1)));
+}
+
+/*! \brief Set up a ring over buf
+ *
+ * size must be a power of two and buf must be 4 byte aligned.
+ */
+bool spsc_ring_init(SPSCRing * ring, void * buf, uint32_t size) {
+	if(ring == NULL || buf == NULL || size < 2 * SPSC_RING_HEADER_BYTES ||
+	   (size & (size - 1)) != 0 || ((uintptr_t) buf & 3) != 0) {
+		return false;
+	}
+	ring->buf        = buf;
+	ring->size       = size;
+	ring->reserved   = 0;
+	ring->records    = 0;
+	ring->dropped    = 0;
+	ring->high_water = 0;
+	store_relaxed(&ring->head, 0);
+	store_release(&ring->tail, 0);
+	return true;
+}
+
+/*! \brief Claim room for a len byte record
+ *
+ * Returns where to write the record, or NULL (and counts a drop) if the ring
+ * is too full. The record isn't visible to the consumer until
+ * spsc_ring_commit().
+ */
+void * spsc_ring_reserve(SPSCRing * ring, uint32_t len) {
+	uint32_t head = load_relaxed(&ring->head);
+	uint32_t tail = load_acquire(&ring->tail);
+	uint32_t slot = spsc_ring_slot(len);
+	uint32_t left = ring->size - (head & (ring->size - 1));
+	uint32_t skip = left < slot ? left : 0;
+
+	if(len > SPSC_RING_MAX_RECORD || ring->size - (head - tail) < skip + slot) {
+		++ring->dropped;
+		return NULL;
+	}
+	if(skip) {
+		*ring_header(ring, head) = SPSC_RING_WRAP;
+		head += skip;
+	}
+	*ring_header(ring, head) = len;
+	ring->reserved = skip + slot;
+	return ring_header(ring, head) + 1;
+}
+
+/*! \brief Publish the record claimed by the last spsc_ring_reserve() */
+void spsc_ring_commit(SPSCRing * ring) {
+	uint32_t head = load_relaxed(&ring->head) + ring->reserved;
+	uint32_t used = head - load_relaxed(&ring->tail);
+
+	store_release(&ring->head, head);
+	ring->reserved = 0;
+	++ring->records;
+	if(used > ring->high_water) {
+		ring->high_water = used;
+	}
+}
+
+/*! \brief Copy a record into the ring, false if it was dropped */
+bool spsc_ring_put(SPSCRing * ring, const void * record, uint32_t len) {
+	void * p = spsc_ring_reserve(ring, len);
+
+	if(p == NULL) {
+		return false;
+	}
+	memcpy(p, record, len);
+	spsc_ring_commit(ring);
+	return true;
+}
+
+/*! \brief The oldest record in the ring, or NULL if it is empty
+ *
+ * The record stays valid, in place, until spsc_ring_release().
+ */
+const void * spsc_ring_peek(SPSCRing * ring, uint32_t * len) {
+	uint32_t tail = load_relaxed(&ring->tail);
+	uint32_t head = load_acquire(&ring->head);
+	uint32_t hdr;
+
+	if(tail == head) {
+		return NULL;
+	}
+	hdr = *ring_header(ring, tail);
+	if(hdr == SPSC_RING_WRAP) {
+		tail += ring->size - (tail & (ring->size - 1));
+		store_release(&ring->tail, tail);
+		hdr = *ring_header(ring, tail);
+	}
+	if(len) {
+		*len = hdr;
+	}
+	return ring_header(ring, tail) + 1;
+}
+
+/*! \brief Hand the record returned by spsc_ring_peek() back to the producer */
+void spsc_ring_release(SPSCRing * ring) {
+	uint32_t tail = load_relaxed(&ring->tail);
+
+	store_release(&ring->tail, tail + spsc_ring_slot(*ring_header(ring, tail)));
+}
+
+/*! \brief Bytes in use, only exact when called from one of the two sides */
+uint32_t spsc_ring_used(SPSCRing * ring) {
+	return load_acquire(&ring->head) - load_acquire(&ring->tail);
+}
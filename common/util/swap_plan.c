@@ -0,0 +1,150 @@
+#include <string.h>
+
+#include "swap_plan.h"
+
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
+
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define NATIVE_IS_NETWORK 1
+#else
+#define NATIVE_IS_NETWORK 0
+#endif
+
+/* Byte swap each halfword of a word, REV16 on the Cortex-M4 */
+static inline uint32_t rev16(uint32_t x){
+#if defined(__ARM_ARCH) && __ARM_ARCH >= 6
+	__asm__("rev16 %0, %1" : "=r"(x) : "r"(x));
+	return x;
+#else
+	return ((x & 0x00ff00ffu) << 8) | ((x >> 8) & 0x00ff00ffu);
+#endif
+}
+
+/* Loads and stores go through memcpy, neither side has to be aligned. The
+ * Cortex-M4 and x86 both turn these into single unaligned word accesses.
+ */
+static inline uint32_t load32(const uint8_t *p){
+	uint32_t x;
+	memcpy(&x, p, sizeof(x));
+	return x;
+}
+
+static inline void store32(uint8_t *p, uint32_t x){
+	memcpy(p, &x, sizeof(x));
+}
+
+static void swap16(const uint8_t *in, uint8_t *out, size_t bytes){
+	size_t i = 0;
+#if defined(__SSSE3__)
+	const __m128i mask = _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+	for(; i + 16 <= bytes; i += 16){
+		__m128i v = _mm_loadu_si128((const __m128i *)(in + i));
+		_mm_storeu_si128((__m128i *)(out + i), _mm_shuffle_epi8(v, mask));
+	}
+#endif
+	for(; i + 4 <= bytes; i += 4){
+		store32(out + i, rev16(load32(in + i)));
+	}
+	if(i < bytes){
+		out[i] = in[i + 1];
+		out[i + 1] = in[i];
+	}
+}
+
+static void swap32(const uint8_t *in, uint8_t *out, size_t bytes){
+	size_t i = 0;
+#if defined(__SSSE3__)
+	const __m128i mask = _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+	for(; i + 16 <= bytes; i += 16){
+		__m128i v = _mm_loadu_si128((const __m128i *)(in + i));
+		_mm_storeu_si128((__m128i *)(out + i), _mm_shuffle_epi8(v, mask));
+	}
+#endif
+	for(; i < bytes; i += 4){
+		store32(out + i, __builtin_bswap32(load32(in + i)));
+	}
+}
+
+static inline void swap_run(const struct swap_run *run, const uint8_t *in, uint8_t *out){
+	// a lone field doesn't need the loop setup
+	if(run->bytes == run->width){
+		switch(run->width){
+		case 1:
+			*out = *in;
+			return;
+		case 2:
+			out[0] = in[1];
+			out[1] = in[0];
+			return;
+		default:
+			store32(out, __builtin_bswap32(load32(in)));
+			return;
+		}
+	}
+	switch(run->width){
+	case 2:
+		swap16(in, out, run->bytes);
+		break;
+	case 4:
+		swap32(in, out, run->bytes);
+		break;
+	default:
+		memcpy(out, in, run->bytes);
+		break;
+	}
+}
+
+int swap_plan_compile(const struct swap *swaps, struct swap_plan *plan){
+	struct swap_run *run = NULL;
+
+	plan->len = 0;
+	plan->runs = 0;
+	for(; swaps->length; ++swaps){
+		size_t width = swaps->length;
+		size_t bytes = swaps->length * swaps->elements;
+
+		if(width != 1 && width != 2 && width != 4){
+			return -1;
+		}
+		// nothing needs swapping if the target is already big endian
+		if(NATIVE_IS_NETWORK){
+			width = 1;
+		}
+		// fields that follow on in the struct join the run before them
+		if(run && run->width == width && run->offset + run->bytes == swaps->offset){
+			run->bytes += bytes;
+		} else {
+			if(plan->runs == SWAP_PLAN_MAX_RUNS){
+				return -1;
+			}
+			run = &plan->run[plan->runs++];
+			run->offset = swaps->offset;
+			run->bytes = bytes;
+			run->width = width;
+		}
+		plan->len += bytes;
+	}
+	return 0;
+}
+
+void swap_plan_write(const struct swap_plan *plan, const void *data, uint8_t *buffer){
+	const struct swap_run *run = plan->run;
+	const struct swap_run *end = plan->run + plan->runs;
+
+	for(; run < end; ++run){
+		swap_run(run, (const uint8_t *)data + run->offset, buffer);
+		buffer += run->bytes;
+	}
+}
+
+void swap_plan_read(const struct swap_plan *plan, void *data, const uint8_t *buffer){
+	const struct swap_run *run = plan->run;
+	const struct swap_run *end = plan->run + plan->runs;
+
+	for(; run < end; ++run){
+		swap_run(run, buffer, (uint8_t *)data + run->offset);
+		buffer += run->bytes;
+	}
+}
@@ -1,4 +1,6 @@
+#include "ch.h"
 #include "hal.h"
+#include "chprintf.h"
 #include "utils_general.h"
 #include "utils_hal.h"
 
@@ -69,7 +71,6 @@ void extUtilsStart(void){
 #if HAL_USE_I2C
 // TODO: SMBA?
 // TODO: Can the pins alt function table be used in some way?
-static const systime_t I2C_TIMEOUT = MS2ST(500);
 #define LOWDATA_BYTE(data) ((data) & 0xFF)
 #define HIGHDATA_BYTE(data) (((data) & 0xFF00) >> 8)
 #define DATA_FROM_BYTES(low, high) (((low) & 0xFF) | ((high) &0xFF) << 8)
@@ -80,6 +81,274 @@ static const systime_t I2C_TIMEOUT = MS2ST(500);
               | PAL_STM32_OSPEED_HIGHEST \
               | PAL_STM32_OTYPE_OPENDRAIN
 
+/*
+ * Transaction scheduler, one per bus
+ */
+struct I2CScheduler {
+    I2CDriver * driver;
+    I2CPins pins;
+    struct I2CTransaction * pending;    // most urgent first
+    Semaphore work;                     // counts pending
+    uint32_t recoveries;
+    unsigned ndevices;
+    struct I2CDeviceStats devices[I2C_SCHED_DEVICES];
+    WORKING_AREA(wa, 512);
+};
+
+static struct I2CScheduler schedulers[I2C_SCHED_BUSES];
+
+static struct I2CScheduler * sched_for(I2CDriver * driver){
+    int i;
+    for(i = 0; i < I2C_SCHED_BUSES; ++i){
+        if(schedulers[i].driver == driver){
+            return &schedulers[i];
+        }
+    }
+    chDbgPanic(DBG_PREFIX "no scheduler on this bus, start it with i2cUtilsStart");
+    return NULL;
+}
+
+static struct I2CDeviceStats * device_stats(struct I2CScheduler * s, uint8_t addr){
+    unsigned i;
+    for(i = 0; i < s->ndevices; ++i){
+        if(s->devices[i].addr == addr){
+            return &s->devices[i];
+        }
+    }
+    if(s->ndevices == I2C_SCHED_DEVICES){
+        return NULL;
+    }
+    s->devices[s->ndevices].addr = addr;
+    s->devices[s->ndevices].name = "?";
+    return &s->devices[s->ndevices++];
+}
+
+/* Does a before b: priority, then deadline, then first come */
+static bool more_urgent(const struct I2CTransaction * a, const struct I2CTransaction * b){
+    if(a->priority != b->priority){
+        return a->priority > b->priority;
+    }
+    if(a->deadline == 0 || b->deadline == 0){
+        return a->deadline != 0 && b->deadline == 0;
+    }
+    // wrap safe comparison of the absolute deadlines
+    return (int32_t)((a->submitted + a->deadline) - (b->submitted + b->deadline)) < 0;
+}
+
+/* Frees a slave stuck holding SDA low by clocking it through what it
+ * thinks it's still sending, then gives the bus a stop condition
+ */
+static void bus_clear(const I2CPins * pins){
+    int i;
+
+    palSetPad(pins->SCL.port, pins->SCL.pad);
+    palSetPadMode(pins->SCL.port, pins->SCL.pad, PAL_MODE_OUTPUT_OPENDRAIN);
+    palSetPadMode(pins->SDA.port, pins->SDA.pad, PAL_MODE_INPUT_PULLUP);
+    for(i = 0; i < 9 && !palReadPad(pins->SDA.port, pins->SDA.pad); ++i){
+        palClearPad(pins->SCL.port, pins->SCL.pad);
+        halPolledDelay(US2RTT(5));
+        palSetPad(pins->SCL.port, pins->SCL.pad);
+        halPolledDelay(US2RTT(5));
+    }
+    palClearPad(pins->SDA.port, pins->SDA.pad);
+    palSetPadMode(pins->SDA.port, pins->SDA.pad, PAL_MODE_OUTPUT_OPENDRAIN);
+    halPolledDelay(US2RTT(5));
+    palSetPad(pins->SDA.port, pins->SDA.pad);
+    halPolledDelay(US2RTT(5));
+
+    palSetPadMode(pins->SDA.port, pins->SDA.pad, I2C_PINMODE);
+    palSetPadMode(pins->SCL.port, pins->SCL.pad, I2C_PINMODE);
+}
+
+static void recover(struct I2CScheduler * s){
+    /* On a timeout ChibiOS sets the bus to I2C_LOCKED, which only
+     * i2cStart() clears, and i2cStart() wants an i2cStop() first.
+     */
+    const I2CConfig * config = s->driver->config;
+    i2cStop(s->driver);
+    bus_clear(&s->pins);
+    i2cStart(s->driver, config);
+    ++s->recoveries;
+}
+
+static void run(struct I2CScheduler * s, struct I2CTransaction * t){
+    i2ctxncb_t callback = t->callback;
+    EventSource * done = t->done;
+    systime_t timeout = t->timeout ? t->timeout : I2C_SCHED_TIMEOUT;
+    struct I2CDeviceStats * d;
+    systime_t latency;
+    msg_t status;
+
+    // the bus lock still keeps out anyone calling the HAL directly
+    i2cAcquireBus(s->driver);
+    if(t->txlen){
+        status = i2cMasterTransmitTimeout(s->driver, t->addr, t->tx, t->txlen,
+                                          t->rx, t->rxlen, timeout);
+    } else {
+        status = i2cMasterReceiveTimeout(s->driver, t->addr, t->rx, t->rxlen, timeout);
+    }
+    if(status == RDY_RESET){
+        status = i2cGetErrors(s->driver);
+        if(status & (I2CD_BUS_ERROR | I2CD_ARBITRATION_LOST | I2CD_TIMEOUT)){
+            recover(s);
+        }
+    } else if(status == RDY_TIMEOUT){
+        recover(s);
+    }
+    i2cReleaseBus(s->driver);
+
+    latency = chTimeNow() - t->submitted;
+    // i2cSchedDevice() may be adding the same device
+    chSysLock();
+    d = device_stats(s, t->addr);
+    chSysUnlock();
+    if(d){
+        ++d->transactions;
+        if(status == RDY_TIMEOUT){
+            ++d->timeouts;
+        } else if(status != RDY_OK){
+            ++d->errors;
+        }
+        if(t->deadline && latency > t->deadline){
+            ++d->late;
+        }
+        if(latency > d->latency_max){
+            d->latency_max = latency;
+        }
+        d->latency_total += latency;
+    }
+
+    t->status = status;
+    if(callback){
+        callback(t);
+    }
+    if(done){
+        chEvtBroadcast(done);
+    }
+}
+
+static msg_t sched_thread(void * arg){
+    struct I2CScheduler * s = arg;
+    struct I2CTransaction * t;
+
+    chRegSetThreadName("i2c sched");
+    while(TRUE){
+        chSemWait(&s->work);
+        chSysLock();
+        t = s->pending;
+        s->pending = t->next;
+        chSysUnlock();
+        run(s, t);
+    }
+    return -1;
+}
+
+static void sched_start(I2CDriver * driver, const I2CPins * pins){
+    int i;
+
+    for(i = 0; i < I2C_SCHED_BUSES; ++i){
+        if(schedulers[i].driver == driver){
+            return;
+        }
+    }
+    for(i = 0; i < I2C_SCHED_BUSES && schedulers[i].driver != NULL; ++i){
+        ;
+    }
+    chDbgAssert(i < I2C_SCHED_BUSES, DBG_PREFIX "raise I2C_SCHED_BUSES", NULL);
+
+    struct I2CScheduler * s = &schedulers[i];
+    s->driver = driver;
+    s->pins = *pins;
+    chSemInit(&s->work, 0);
+    chThdCreateStatic(s->wa, sizeof(s->wa), HIGHPRIO - 2, sched_thread, s);
+}
+
+void i2cSchedDevice(I2CDriver * driver, uint8_t addr, const char * name){
+    struct I2CScheduler * s = sched_for(driver);
+    struct I2CDeviceStats * d;
+
+    chSysLock();
+    d = device_stats(s, addr);
+    if(d){
+        d->name = name;
+    }
+    chSysUnlock();
+}
+
+void i2cSchedSubmitI(I2CDriver * driver, struct I2CTransaction * t){
+    struct I2CScheduler * s = sched_for(driver);
+    struct I2CTransaction ** p;
+
+    t->status = I2C_TXN_PENDING;
+    t->submitted = chTimeNow();
+    for(p = &s->pending; *p && !more_urgent(t, *p); p = &(*p)->next){
+        ;
+    }
+    t->next = *p;
+    *p = t;
+    chSemSignalI(&s->work);
+}
+
+void i2cSchedSubmit(I2CDriver * driver, struct I2CTransaction * t){
+    chSysLock();
+    i2cSchedSubmitI(driver, t);
+    chSchRescheduleS();
+    chSysUnlock();
+}
+
+static void wake(struct I2CTransaction * t){
+    chSemSignal(t->user);
+}
+
+int i2cSchedTransmitPrio(I2CDriver * driver, uint8_t addr, uint8_t priority,
+                         const uint8_t * tx, size_t txlen, uint8_t * rx, size_t rxlen,
+                         systime_t timeout){
+    Semaphore done;
+    struct I2CTransaction t = {
+        .addr = addr,
+        .tx = tx,
+        .txlen = txlen,
+        .rx = rx,
+        .rxlen = rxlen,
+        .priority = priority,
+        .timeout = timeout,
+        .callback = wake,
+        .user = &done,
+    };
+
+    chSemInit(&done, 0);
+    i2cSchedSubmit(driver, &t);
+    chSemWait(&done);
+    return t.status;
+}
+
+int i2cSchedTransmit(I2CDriver * driver, uint8_t addr, const uint8_t * tx, size_t txlen,
+                     uint8_t * rx, size_t rxlen, systime_t timeout){
+    return i2cSchedTransmitPrio(driver, addr, I2C_PRIO_NORMAL, tx, txlen, rx, rxlen, timeout);
+}
+
+int i2cSchedStats(char * buf, int maxlen){
+    int len = 0;
+    int i;
+    unsigned j;
+
+    for(i = 0; i < I2C_SCHED_BUSES && schedulers[i].driver; ++i){
+        struct I2CScheduler * s = &schedulers[i];
+        for(j = 0; j < s->ndevices && len < maxlen; ++j){
+            struct I2CDeviceStats d = s->devices[j];
+            uint32_t mean = d.transactions ? d.latency_total / d.transactions : 0;
+            len += chsnprintf(buf + len, maxlen - len, "%s %x %u %u %u %u %u %u\n",
+                              d.name, d.addr, d.transactions, d.errors, d.timeouts, d.late,
+                              (uint32_t)((uint64_t)mean * 1000000 / CH_FREQUENCY),
+                              (uint32_t)((uint64_t)d.latency_max * 1000000 / CH_FREQUENCY));
+        }
+        if(len < maxlen){
+            len += chsnprintf(buf + len, maxlen - len, "BUS%d %u\n", i, s->recoveries);
+        }
+    }
+    return len < maxlen ? len : maxlen;
+}
+
 void i2cUtilsStart(I2CDriver * driver, const I2CConfig * config, const I2CPins * pins){
     chDbgCheck(driver && config && pins, utils_i2cStart);
     chDbgAssert(driver->state != I2C_UNINIT,
@@ -103,6 +372,7 @@ void i2cUtilsStart(I2CDriver * driver, const I2CConfig * config, const I2CPins *
                 DBG_PREFIX "requested duty cycle does not match previously configured",
                 NULL);
     }
+    sched_start(driver, pins);
 }
 
 //FIXME: SMBus has many additional access modes. These are only the ones we use now
@@ -110,29 +380,11 @@ void i2cUtilsStart(I2CDriver * driver, const I2CConfig * config, const I2CPins *
 int SMBusGet(I2CDriver * driver, uint8_t addr, uint8_t command, uint16_t* data){
     uint8_t tx[1] = {command};
     uint8_t rx[2];
-    i2cflags_t errors;
-    i2cAcquireBus(driver);
-    msg_t status = i2cMasterTransmitTimeout(driver, addr, tx, sizeof(tx), rx, sizeof(rx), I2C_TIMEOUT);
-    switch(status){
-    case RDY_OK:
-        i2cReleaseBus(driver);
-        break;
-    case RDY_RESET:
-        errors = i2cGetErrors(driver);
-        i2cReleaseBus(driver);
-        return errors;
-    case RDY_TIMEOUT:
-        /* On a timeout ChibiOS will set the bus into I2C_LOCKED, which will
-         * cause an assert to be hit if a bus transfer is tried again.
-         * I2C_LOCKED can only be cleared by i2cStart(), but i2cStart will hit
-         * an assert if i2cStop is not issued before restarting.
-         * This seems like a really terrible way to handle timeous*/
-        i2cStop(driver);
-        i2cStart(driver, driver->config);
-        i2cReleaseBus(driver);
-        return RDY_TIMEOUT;
-    default:
-        i2cReleaseBus(driver);
+    // battery and charger housekeeping, anything else on the bus goes first
+    int status = i2cSchedTransmitPrio(driver, addr, I2C_PRIO_LOW, tx, sizeof(tx),
+                                      rx, sizeof(rx), SMBUS_TIMEOUT);
+    if(status != RDY_OK){
+        return status;
     }
 
     *data = DATA_FROM_BYTES(rx[0], rx[1]);
@@ -141,27 +393,7 @@ int SMBusGet(I2CDriver * driver, uint8_t addr, uint8_t command, uint16_t* data){
 
 int SMBusSet(I2CDriver * driver, uint8_t addr, uint8_t command, uint16_t data){
     uint8_t tx[3] = {command, LOWDATA_BYTE(data), HIGHDATA_BYTE(data)};
-    i2cflags_t errors;
-    i2cAcquireBus(driver);
-    msg_t status = i2cMasterTransmitTimeout(driver, addr, tx, sizeof(tx), NULL, 0, I2C_TIMEOUT);
-    switch(status){
-    case RDY_OK:
-        i2cReleaseBus(driver);
-        break;
-    case RDY_RESET:
-        errors = i2cGetErrors(driver);
-        i2cReleaseBus(driver);
-        return errors;
-    case RDY_TIMEOUT:
-        i2cStop(driver);
-        i2cStart(driver, driver->config);
-        i2cReleaseBus(driver);
-        return RDY_TIMEOUT;
-    default:
-        i2cReleaseBus(driver);
-    }
-
-    return RDY_OK;
+    return i2cSchedTransmitPrio(driver, addr, I2C_PRIO_LOW, tx, sizeof(tx), NULL, 0, SMBUS_TIMEOUT);
 }
 
 void chprintI2cState(BaseSequentialStream * chp, i2cstate_t state){
@@ -1,5 +1,10 @@
 #include "string.h"
+#include "lwip/opt.h"
+#include "lwip/memp.h"
+#include "lwip/stats.h"
 #include "utils_general.h"
+#include "utils_sockets.h"
+#include "utils_hal.h"
 #include "rci.h"
 
 /* GIT_COMMIT_VERSION is inserted by the build system, generated in
@@ -17,3 +22,72 @@ const struct RCICommand RCI_CMD_VERS = {
 	.function=version,
 	.user=NULL
 };
+
+#if LWIP_STATS
+static const char * const memp_names[MEMP_MAX] = {
+#define LWIP_MEMPOOL(name,num,size,desc) #name,
+#include "lwip/memp_std.h"
+};
+
+static int proto_stats(char * buf, int maxlen, const char * name, struct stats_proto * p){
+	return chsnprintf(buf, maxlen, "%s %u %u %u %u %u\n",
+	                  name, p->xmit, p->recv, p->drop, p->memerr, p->err);
+}
+#endif
+
+/* One line per memp pool with pbufs among them: name, available, in use,
+ * high water mark and failed allocations. Then the same for the heap, and
+ * for link and UDP: sent, received, dropped, out of memory and other errors.
+ * Empty if the project's lwipopts.h turns LWIP_STATS off.
+ */
+static void lwip_stats_cmd(struct RCICmdData * cmd UNUSED, struct RCIRetData * ret, void * user UNUSED){
+	int len = 0;
+#if LWIP_STATS
+	int maxlen = RCI_MAX_REPLY;
+	int i;
+
+#if MEMP_STATS
+	for(i = 0; i < MEMP_MAX && len < maxlen; ++i){
+		struct stats_mem * m = &lwip_stats.memp[i];
+		len += chsnprintf(ret->data + len, maxlen - len, "%s %u %u %u %u\n",
+		                  memp_names[i], m->avail, m->used, m->max, m->err);
+	}
+#endif
+#if MEM_STATS
+	if(len < maxlen){
+		len += chsnprintf(ret->data + len, maxlen - len, "HEAP %u %u %u %u\n",
+		                  lwip_stats.mem.avail, lwip_stats.mem.used,
+		                  lwip_stats.mem.max, lwip_stats.mem.err);
+	}
+#endif
+#if LINK_STATS
+	if(len < maxlen){
+		len += proto_stats(ret->data + len, maxlen - len, "LINK", &lwip_stats.link);
+	}
+#endif
+#if UDP_STATS
+	if(len < maxlen){
+		len += proto_stats(ret->data + len, maxlen - len, "UDP", &lwip_stats.udp);
+	}
+#endif
+	len = MIN(len, maxlen);
+#endif
+	ret->len = len;
+}
+const struct RCICommand RCI_CMD_LWIP = {
+	.name="#LWIP",
+	.function=lwip_stats_cmd,
+	.user=NULL
+};
+
+#if HAL_USE_I2C
+/* I2C transaction scheduler statistics, see i2cSchedStats() */
+static void i2c_stats_cmd(struct RCICmdData * cmd UNUSED, struct RCIRetData * ret, void * user UNUSED){
+	ret->len = i2cSchedStats(ret->data, RCI_MAX_REPLY);
+}
+const struct RCICommand RCI_CMD_I2CS = {
+	.name="#I2CS",
+	.function=i2c_stats_cmd,
+	.user=NULL
+};
+#endif
@@ -38,6 +38,7 @@ static const struct swap burst_swaps[] = {
 	SWAP_FIELD(ADIS16405Data, aux_adc),
 	{0},
 };
+static struct swap_plan burst_plan;
 
 static void adis_drdy_handler(eventid_t id UNUSED){
 	ADIS16405Data data;
@@ -45,7 +46,7 @@ static void adis_drdy_handler(eventid_t id UNUSED){
 
 	adis_get_data(&data);
 
-	write_swapped(burst_swaps, &data, buffer);
+	swap_plan_write(&burst_plan, &data, buffer);
 	if(write(sendsocket, buffer, sizeof(buffer)) < 0){
 		ledError();
 	}
@@ -80,6 +81,9 @@ void main(void){
 		ledError();
 	}
 
+	if(swap_plan_compile(burst_swaps, &burst_plan)){
+		ledError();
+	}
 	adis_init(&adis_olimex_e407);
 
 	/* Manage ADIS events */
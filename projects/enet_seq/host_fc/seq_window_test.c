@@ -0,0 +1,251 @@
+/*
+ * seq_window_test.c
+ *
+ * Feeds made up sequence number streams, with loss, reordering, duplicates
+ * and sender restarts, through the SeqSocket receive window and reorder
+ * stash and checks what they count and hand on.
+ *
+ * usage: seq_window_test [random datagrams]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "seq_window.h"
+
+#define SLOT 8
+
+static int failures;
+
+#define CHECK(cond) do { \
+	if(!(cond)) { \
+		printf("%s:%d: %s\n", __func__, __LINE__, #cond); \
+		++failures; \
+	} \
+} while(0)
+
+static enum SeqClass feed(struct SeqWindow * w, uint32_t seq) {
+	return seqWindowUpdate(w, seq);
+}
+
+/* Sends enough in order after last that every gap has left the window */
+static void flush(struct SeqWindow * w, uint32_t last) {
+	uint32_t i;
+	for(i = 1; i <= SEQ_WINDOW_LEN; ++i) {
+		feed(w, last + i);
+	}
+}
+
+static void test_in_order(void) {
+	struct SeqWindow w = {0};
+	uint32_t i;
+
+	CHECK(feed(&w, 100) == SEQ_FIRST);
+	for(i = 101; i < 1100; ++i) {
+		CHECK(feed(&w, i) == SEQ_NEXT);
+	}
+	CHECK(w.stats.received == 1000);
+	CHECK(w.stats.lost == 0 && w.stats.late == 0 && w.stats.duplicate == 0);
+	CHECK(w.next == 1100);
+}
+
+static void test_bursts(void) {
+	static const uint32_t runs[] = {1, 3, 10, 64, 65, 100};
+	static const unsigned bucket[] = {0, 2, 4, 6, 7, 7};
+	uint32_t expect[SEQ_BURST_BUCKETS] = {0};
+	struct SeqWindow w = {0};
+	uint32_t seq = 0, lost = 0;
+	unsigned i;
+
+	feed(&w, seq);
+	for(i = 0; i < sizeof(runs) / sizeof(runs[0]); ++i) {
+		seq += runs[i] + 1;
+		CHECK(feed(&w, seq) == SEQ_AHEAD);
+		CHECK(feed(&w, ++seq) == SEQ_NEXT);
+		lost += runs[i];
+		++expect[bucket[i]];
+	}
+	// nothing counts as lost until it leaves the window
+	CHECK(w.stats.lost < lost);
+	flush(&w, seq);
+	CHECK(w.stats.lost == lost);
+	CHECK(!memcmp(w.stats.burst, expect, sizeof(expect)));
+}
+
+static void test_reordered(void) {
+	struct SeqWindow w = {0};
+	uint32_t i;
+
+	feed(&w, 0);
+	// pairs swapped: 2 1 4 3 ...
+	for(i = 1; i < 1000; i += 2) {
+		CHECK(feed(&w, i + 1) == SEQ_AHEAD);
+		CHECK(feed(&w, i) == SEQ_LATE);
+	}
+	// 1001 held back until the rest of the window has arrived
+	CHECK(feed(&w, 1000 + SEQ_WINDOW_LEN) == SEQ_AHEAD);
+	for(i = 1002; i < 1000 + SEQ_WINDOW_LEN; ++i) {
+		feed(&w, i);
+	}
+	CHECK(feed(&w, 1001) == SEQ_LATE);
+	flush(&w, 1000 + SEQ_WINDOW_LEN);
+	CHECK(w.stats.lost == 0);
+	CHECK(w.stats.late == 500 + SEQ_WINDOW_LEN - 1);
+	CHECK(w.stats.received == 1001 + SEQ_WINDOW_LEN + SEQ_WINDOW_LEN);
+}
+
+static void test_duplicate_stale_resync(void) {
+	struct SeqWindow w = {0};
+	uint32_t i;
+
+	for(i = 0; i < 200; ++i) {
+		feed(&w, i);
+	}
+	CHECK(feed(&w, 199) == SEQ_DUPLICATE);
+	CHECK(feed(&w, 199 - SEQ_WINDOW_LEN + 1) == SEQ_DUPLICATE);
+	CHECK(feed(&w, 199 - SEQ_WINDOW_LEN) == SEQ_STALE);
+	CHECK(w.stats.duplicate == 2 && w.stats.stale == 1);
+	CHECK(w.stats.received == 200);
+
+	// the sender restarts from 0 well past the resync distance
+	for(; i < 200 + SEQ_WINDOW_LEN + SEQ_RESYNC_DISTANCE; ++i) {
+		feed(&w, i);
+	}
+	CHECK(feed(&w, 0) == SEQ_RESYNC);
+	CHECK(feed(&w, 1) == SEQ_NEXT);
+	CHECK(w.stats.resyncs == 1 && w.stats.lost == 0);
+}
+
+static void test_wrap(void) {
+	struct SeqWindow w = {0};
+	uint32_t seq = 0xfffffff0u;
+	int i;
+
+	feed(&w, seq);
+	for(i = 0; i < 40; ++i) {
+		CHECK(feed(&w, ++seq) == SEQ_NEXT);
+	}
+	CHECK(feed(&w, seq + 3) == SEQ_AHEAD);
+	CHECK(feed(&w, seq + 1) == SEQ_LATE);
+	flush(&w, seq + 3);
+	CHECK(w.stats.lost == 1 && w.stats.burst[0] == 1);
+}
+
+/* Random loss, swaps and duplicates against what was actually dropped */
+static void test_random(long n) {
+	struct SeqWindow w = {0};
+	uint32_t lost = 0, dups = 0, seq;
+	uint32_t pending = 0;
+	int holding = 0;
+
+	srand(1);
+	for(seq = 0; seq < n; ++seq) {
+		int r = rand() % 100;
+		if(r < 3) {
+			++lost;
+			continue;
+		}
+		if(r < 8 && !holding) {
+			// hold this one back until after the next
+			pending = seq;
+			holding = 1;
+			continue;
+		}
+		feed(&w, seq);
+		if(holding) {
+			feed(&w, pending);
+			holding = 0;
+		}
+		if(r >= 98) {
+			feed(&w, seq);
+			++dups;
+		}
+	}
+	if(holding) {
+		feed(&w, pending);
+	}
+	flush(&w, n - 1);
+	CHECK(w.stats.lost == lost);
+	CHECK(w.stats.duplicate == dups);
+	CHECK(w.stats.received + w.stats.lost == n + SEQ_WINDOW_LEN);
+	printf("random: %ld sent, %u received, %u late, %u duplicate, %u lost\n",
+	       n, w.stats.received, w.stats.late, w.stats.duplicate, w.stats.lost);
+}
+
+
+/* Reorder stash, driven the way seqRecvfrom() drives it */
+
+static int offer(struct SeqReorder * ro, uint32_t seq, uint32_t * out, int * n) {
+	uint8_t buf[SLOT], taken[SLOT];
+	int slot;
+
+	memcpy(buf, &seq, sizeof(seq));
+	if(seqReorderOffer(ro, seq, buf, sizeof(seq)) == SEQ_DELIVER) {
+		out[(*n)++] = seq;
+	}
+	while((slot = seqReorderReady(ro)) >= 0) {
+		seqReorderTake(ro, slot, taken);
+		memcpy(&out[(*n)++], taken, sizeof(seq));
+	}
+	return *n;
+}
+
+static void test_reorder(void) {
+	struct SeqReorder ro = DECL_SEQ_REORDER(4, SLOT);
+	struct SeqReorder restarted = DECL_SEQ_REORDER(4, SLOT);
+	static const uint32_t in[] = {10, 12, 11, 14, 15, 13, 16, 16, 9, 18, 19, 20, 21, 22, 23};
+	static const uint32_t want[] = {10, 11, 12, 13, 14, 15, 16, 18, 19, 20, 21, 22, 23};
+	uint32_t out[32];
+	int n = 0;
+	unsigned i;
+
+	for(i = 0; i < sizeof(in) / sizeof(in[0]); ++i) {
+		offer(&ro, in[i], out, &n);
+	}
+	// 17 never comes; a full stash gives it up after 18..21
+	CHECK(n == sizeof(want) / sizeof(want[0]));
+	CHECK(!memcmp(out, want, sizeof(want)));
+	CHECK(ro.skipped == 1);
+	CHECK(seqReorderOldest(&ro) < 0);
+
+	// with nothing more to read the oldest is handed on regardless
+	offer(&ro, 26, out, &n);
+	offer(&ro, 25, out, &n);
+	CHECK(n == sizeof(want) / sizeof(want[0]));
+	int slot = seqReorderOldest(&ro);
+	uint8_t taken[SLOT];
+	CHECK(slot >= 0 && seqReorderTake(&ro, slot, taken) == sizeof(uint32_t));
+	CHECK(!memcmp(taken, &(uint32_t){25}, sizeof(uint32_t)));
+	CHECK(ro.deliver == 26 && ro.skipped == 2);
+
+	// an old datagram is dropped; 26 was waiting its turn
+	n = 0;
+	offer(&ro, 0, out, &n);
+	CHECK(n == 1 && out[0] == 26);
+
+	// a restarted sender restarts delivery
+	n = 0;
+	offer(&restarted, 5000, out, &n);
+	offer(&restarted, 0, out, &n);
+	CHECK(n == 2 && out[1] == 0 && restarted.deliver == 1);
+}
+
+int main(int argc, char * argv[]) {
+	long n = argc > 1 ? atol(argv[1]) : 1000000;
+
+	test_in_order();
+	test_bursts();
+	test_reordered();
+	test_duplicate_stale_resync();
+	test_wrap();
+	test_random(n);
+	test_reorder();
+
+	if(failures) {
+		printf("%d checks failed\n", failures);
+		return 1;
+	}
+	printf("all checks passed\n");
+	return 0;
+}
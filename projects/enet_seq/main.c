@@ -1,4 +1,5 @@
 /* Tests sequenced socket utilites  */
+#include <stdlib.h>
 #include <string.h>
 
 #include "ch.h"
@@ -12,6 +13,7 @@
 
 #include "utils_general.h"
 #include "utils_sockets.h"
+#include "utils_zerocopy.h"
 #include "utils_shell.h"
 #include "utils_led.h"
 
@@ -32,6 +34,7 @@
 #define IP_DEVICE                            "192.168.0.196"
 
 #define DATA_UDP_MSG_SIZE                    50
+#define DATA_UDP_REORDER_DEPTH               4
 
 
 
@@ -65,12 +68,14 @@ msg_t data_udp_send_thread(void *p UNUSED){
 	}
 }
 
+static struct SeqSocket recver = DECL_SEQ_SOCKET(DATA_UDP_MSG_SIZE);
+static struct SeqReorder recver_reorder = DECL_SEQ_REORDER(DATA_UDP_REORDER_DEPTH, DATA_UDP_MSG_SIZE);
+
 WORKING_AREA(wa_data_udp_receive_thread, DATA_UDP_SEND_THREAD_STACK_SIZE);
 
 msg_t data_udp_receive_thread(void *p UNUSED) {
 	BaseSequentialStream* chp;
 
-	struct SeqSocket recver = DECL_SEQ_SOCKET(DATA_UDP_MSG_SIZE);
 	struct sockaddr_in self_addr;
 
 	chRegSetThreadName("data_udp_receive_thread");
@@ -79,6 +84,7 @@ msg_t data_udp_receive_thread(void *p UNUSED) {
 
 	set_sockaddr((struct sockaddr*)&self_addr, IP_DEVICE, DATA_UDP_RX_THREAD_PORT);
 	seqSocket(&recver, (struct sockaddr*)&self_addr);
+	seqSetReorder(&recver, &recver_reorder);
 
 	while(TRUE) {
 		if (seqRecv(&recver, 0) < 0)
@@ -89,6 +95,157 @@ msg_t data_udp_receive_thread(void *p UNUSED) {
 }
 
 
+/* GPS streaming benchmark
+ *
+ * Sends flight-gps sized datagrams, a sequence number and a MAX2769 half
+ * buffer, to IP_HOST as fast as they'll go for a few seconds. The copy run
+ * does what the sensor boards do today: copy the sample into a SeqSocket
+ * and send() it. The zero-copy run sends the same buffers with zcSend() and
+ * only waits when all of them are still in flight. For each it prints the
+ * datagrams and bits sent, the time the sending thread spent in the send
+ * path per datagram, and how the rate compares to the front end's.
+ */
+
+#define BENCH_TX_PORT                        35004
+#define BENCH_RX_PORT                        35005
+#define BENCH_HALF_BUFFER                    1024  // GPS_BUFFER_SIZE in MAX2769.h
+#define BENCH_DATAGRAM                       (sizeof(uint32_t) + BENCH_HALF_BUFFER)
+#define BENCH_BUFFERS                        ZC_MAX_PENDING
+#define BENCH_DEFAULT_SECONDS                5
+
+/* MAX2769 at 16.368 MHz and 2 bits a sample, in kbit/s */
+#define GPS_STREAM_KBPS                      32736
+
+static struct SeqSocket bench_seq = DECL_SEQ_SOCKET(BENCH_HALF_BUFFER);
+static struct ZeroCopySocket bench_zc;
+static uint8_t bench_bufs[BENCH_BUFFERS][BENCH_DATAGRAM];
+static SEMAPHORE_DECL(bench_free, BENCH_BUFFERS);
+
+struct bench_result {
+	uint32_t sent;
+	uint32_t failed;
+	systime_t elapsed;
+	uint64_t busy;      // halGetCounterValue() ticks spent sending
+};
+
+static void bench_sent(void * buf UNUSED, err_t err UNUSED, void * user UNUSED) {
+	chSemSignal(&bench_free);
+}
+
+static int bench_open(void) {
+	static bool_t opened;
+	struct sockaddr_in addr;
+
+	if (opened)
+		return 0;
+
+	set_sockaddr((struct sockaddr*)&addr, IP_DEVICE, BENCH_TX_PORT);
+	if (seqSocket(&bench_seq, (struct sockaddr*)&addr) < 0)
+		return -1;
+	set_sockaddr((struct sockaddr*)&addr, IP_DEVICE, BENCH_TX_PORT + 1);
+	if (zcSocket(&bench_zc, (struct sockaddr*)&addr, bench_sent, NULL) < 0)
+		return -1;
+
+	set_sockaddr((struct sockaddr*)&addr, IP_HOST, BENCH_RX_PORT);
+	if (connect(bench_seq.socket, (struct sockaddr*)&addr, sizeof(addr)) < 0)
+		return -1;
+	if (zcConnect(&bench_zc, (struct sockaddr*)&addr) < 0)
+		return -1;
+
+	opened = TRUE;
+	return 0;
+}
+
+static void bench_copy(systime_t duration, struct bench_result * r) {
+	systime_t start = chTimeNow();
+	unsigned n = 0;
+
+	while (chTimeNow() - start < duration) {
+		halrtcnt_t t0 = halGetCounterValue();
+		memcpy(bench_seq.buffer, bench_bufs[n++ % BENCH_BUFFERS] + sizeof(uint32_t), BENCH_HALF_BUFFER);
+		int ret = seqSend(&bench_seq, BENCH_HALF_BUFFER, 0);
+		r->busy += halGetCounterValue() - t0;
+		if (ret < 0)
+			++r->failed;
+		else
+			++r->sent;
+	}
+	r->elapsed = chTimeNow() - start;
+}
+
+static void bench_zerocopy(systime_t duration, struct bench_result * r) {
+	systime_t start = chTimeNow();
+	uint32_t seq = 0;
+	unsigned n = 0, i;
+
+	while (chTimeNow() - start < duration) {
+		if (chSemWaitTimeout(&bench_free, MS2ST(100)) != RDY_OK)
+			continue;
+
+		uint8_t * buf = bench_bufs[n++ % BENCH_BUFFERS];
+		halrtcnt_t t0 = halGetCounterValue();
+		((uint32_t*)buf)[0] = htonl(seq++);
+		int ret = zcSend(&bench_zc, buf, BENCH_DATAGRAM);
+		r->busy += halGetCounterValue() - t0;
+		if (ret < 0) {
+			chSemSignal(&bench_free);
+			++r->failed;
+		} else {
+			++r->sent;
+		}
+	}
+	// everything still in flight counts toward the run
+	for (i = 0; i < BENCH_BUFFERS; ++i)
+		chSemWait(&bench_free);
+	r->elapsed = chTimeNow() - start;
+	chSemReset(&bench_free, BENCH_BUFFERS);
+}
+
+static void bench_report(BaseSequentialStream *chp, const char * name, const struct bench_result * r) {
+	uint32_t ms = (uint64_t)r->elapsed * 1000 / CH_FREQUENCY;
+	uint32_t kbps = ms ? (uint64_t)r->sent * BENCH_DATAGRAM * 8 / ms : 0;
+	uint32_t ns = r->sent ? r->busy * 1000000000 / halGetCounterFrequency() / r->sent : 0;
+
+	chprintf(chp, "%-9s %6u sent %4u failed %6u kbit/s %3u%% of GPS, %5u ns/datagram sending\r\n",
+	         name, r->sent, r->failed, kbps, kbps * 100 / GPS_STREAM_KBPS, ns);
+}
+
+void cmd_zcbench(BaseSequentialStream *chp, int argc, char *argv[]) {
+	systime_t duration = S2ST(argc > 0 ? atoi(argv[0]) : BENCH_DEFAULT_SECONDS);
+	struct bench_result copy = {0}, zc = {0};
+	unsigned i, j;
+
+	if (bench_open() < 0) {
+		chprintf(chp, "couldn't open benchmark sockets\r\n");
+		return;
+	}
+	for (i = 0; i < BENCH_BUFFERS; ++i)
+		for (j = 0; j < BENCH_DATAGRAM; ++j)
+			bench_bufs[i][j] = i + j;
+
+	bench_copy(duration, &copy);
+	bench_report(chp, "copy", &copy);
+	bench_zerocopy(duration, &zc);
+	bench_report(chp, "zero-copy", &zc);
+	chprintf(chp, "zero-copy socket: %u sent %u errors %u dropped\r\n",
+	         bench_zc.sent, bench_zc.errors, bench_zc.dropped);
+}
+
+void cmd_seqstats(BaseSequentialStream *chp, int argc UNUSED, char *argv[] UNUSED) {
+	const struct SeqStats * st = &recver.window.stats;
+	static const char * runs[SEQ_BURST_BUCKETS] = {"1", "2", "3-4", "5-8", "9-16", "17-32", "33-64", "65+"};
+	unsigned i;
+
+	chprintf(chp, "received %u late %u duplicate %u stale %u lost %u resyncs %u\r\n",
+	         st->received, st->late, st->duplicate, st->stale, st->lost, st->resyncs);
+	chprintf(chp, "reorder: next %u, %u given up\r\n", recver_reorder.deliver, recver_reorder.skipped);
+	chprintf(chp, "lost in a row:");
+	for (i = 0; i < SEQ_BURST_BUCKETS; ++i)
+		chprintf(chp, " %s:%u", runs[i], st->burst[i]);
+	chprintf(chp, "\r\n");
+}
+
+
 int assertFail;
 
 void cmd_assert(BaseSequentialStream *chp UNUSED, int argc UNUSED, char *argv[] UNUSED) {
@@ -101,6 +258,8 @@ void main(void) {
 		{ "assert", cmd_assert },
 		{ "mem", cmd_mem },
 		{ "threads", cmd_threads },
+		{ "seqstats", cmd_seqstats },
+		{ "zcbench", cmd_zcbench },
 		{ NULL, NULL }
 	};
 	struct lwipthread_opts ip_opts;
@@ -0,0 +1,176 @@
+/*
+ * crc_bench.c
+ *
+ * Checks that the sliced crc_update() in common/util/crc_16_reflect.c gives
+ * the same answers as a bit at a time crc-16/modbus, then times each
+ * CRC_SLICE_BY variant. The Makefile builds crc_16_reflect.c once per
+ * variant with crc_update renamed to crc_update_sliceN.
+ *
+ * usage: crc_bench [iterations]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "crc_16_reflect.h"
+
+#define MAX_BUFFER  4096
+/* sizeof(GENERIC_message) and offsetof(GENERIC_message, data) */
+#define MSG_BYTES   178
+#define HEAD_BYTES  28
+
+typedef crc_t (*crc_update_fn)(crc_t crc, const unsigned char *data, size_t data_len);
+
+crc_t crc_update_slice1(crc_t crc, const unsigned char *data, size_t data_len);
+crc_t crc_update_slice4(crc_t crc, const unsigned char *data, size_t data_len);
+crc_t crc_update_slice8(crc_t crc, const unsigned char *data, size_t data_len);
+
+static const struct {
+	const char *  name;
+	crc_update_fn update;
+} variants[] = {
+	{"slice1", crc_update_slice1},
+	{"slice4", crc_update_slice4},
+	{"slice8", crc_update_slice8},
+};
+#define NUM_VARIANTS (sizeof(variants) / sizeof(variants[0]))
+
+static int failures;
+
+static crc_t crc_bitwise(crc_t crc, const unsigned char *data, size_t data_len) {
+	unsigned int i;
+
+	while (data_len--) {
+		crc ^= *data++;
+		for (i = 0; i < 8; ++i) {
+			crc = (crc & 1) ? (crc >> 1) ^ 0xa001 : crc >> 1;
+		}
+	}
+	return crc;
+}
+
+static void check(const char * what, const unsigned char * data, size_t len) {
+	crc_t        expect = crc_bitwise(crc_init(), data, len);
+	unsigned int v;
+
+	for (v = 0; v < NUM_VARIANTS; ++v) {
+		crc_t  got = variants[v].update(crc_init(), data, len);
+		size_t split;
+
+		// feeding the buffer in two pieces must not matter either
+		split = len ? (size_t) rand() % len : 0;
+		crc_t  chained = variants[v].update(crc_init(), data, split);
+		chained = variants[v].update(chained, data + split, len - split);
+
+		if (got != expect || chained != expect) {
+			printf("FAIL %s %s len %zu: expected 0x%04x got 0x%04x chained 0x%04x\n",
+			       variants[v].name, what, len, expect, got, chained);
+			++failures;
+		}
+	}
+}
+
+/* A GENERIC_message the way eventlogger builds it: ID, index, psas
+ * timestamp, data_length, RTC logtime and payload.
+ */
+static void make_message(unsigned char * msg, uint32_t index, uint16_t data_length) {
+	unsigned int i;
+
+	memset(msg, 0, MSG_BYTES);
+	memcpy(msg, (index & 1) ? "ADIS" : "MPL3", 4);
+	memcpy(msg + 4, &index, sizeof(index));
+	for (i = 0; i < 6; ++i) {
+		msg[8 + i] = (uint8_t) ((index * 1000003u) >> (i * 5));
+	}
+	memcpy(msg + 14, &data_length, sizeof(data_length));
+	memcpy(msg + 16, &index, sizeof(index));
+	for (i = 0; i < data_length; ++i) {
+		msg[HEAD_BYTES + i] = (uint8_t) rand();
+	}
+}
+
+static void run_checks(void) {
+	static unsigned char buf[MAX_BUFFER + 8];
+	unsigned char        msg[MSG_BYTES];
+	unsigned int         i;
+
+	check("check string", (const unsigned char *) "123456789", 9);
+	if (crc_update_slice8(crc_init(), (const unsigned char *) "123456789", 9) != 0x4b37) {
+		printf("FAIL check string is not 0x4b37\n");
+		++failures;
+	}
+
+	for (i = 0; i < 20000; ++i) {
+		size_t len = (size_t) rand() % (i < 1000 ? 64 : MAX_BUFFER);
+		size_t ofs = (size_t) rand() % 8;
+		size_t j;
+
+		for (j = 0; j < len; ++j) {
+			buf[ofs + j] = (unsigned char) rand();
+		}
+		check("random", buf + ofs, len);
+	}
+
+	for (i = 0; i < 20000; ++i) {
+		uint16_t data_length = (uint16_t) (rand() % (MSG_BYTES - HEAD_BYTES + 1));
+
+		make_message(msg, i, data_length);
+		check("full message", msg, MSG_BYTES);
+		check("compact message", msg, HEAD_BYTES + data_length);
+	}
+}
+
+static double now_s(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void bench(const char * what, const unsigned char * data, size_t len, unsigned long iterations) {
+	unsigned int  v;
+	unsigned long i;
+
+	printf("%-16s %5zu bytes:", what, len);
+	for (v = 0; v < NUM_VARIANTS; ++v) {
+		volatile crc_t sink;
+		crc_t          crc = crc_init();
+		double         start = now_s();
+		double         secs;
+
+		for (i = 0; i < iterations; ++i) {
+			crc = variants[v].update(crc, data, len);
+		}
+		sink = crc;
+		(void) sink;
+		secs = now_s() - start;
+		printf("  %s %7.1f MB/s", variants[v].name, (double) len * iterations / secs / 1e6);
+	}
+	printf("\n");
+}
+
+int main(int argc, char * argv[]) {
+	static unsigned char buf[MAX_BUFFER];
+	unsigned char        msg[MSG_BYTES];
+	unsigned long        iterations = argc > 1 ? strtoul(argv[1], NULL, 0) : 200000;
+	unsigned int         i;
+
+	srand(1);
+	run_checks();
+	if (failures) {
+		printf("%d mismatches\n", failures);
+		return 1;
+	}
+	printf("all variants match the bitwise crc\n");
+
+	for (i = 0; i < sizeof(buf); ++i) {
+		buf[i] = (unsigned char) rand();
+	}
+	make_message(msg, 1, 24);
+	bench("compact message", msg, HEAD_BYTES + 24, iterations * 4);
+	bench("full message", msg, MSG_BYTES, iterations);
+	bench("log block", buf, 2048, iterations / 10);
+	return 0;
+}
@@ -0,0 +1,124 @@
+/*
+ * elog_stats.c
+ *
+ * Fetches the eventlogger pipeline statistics from a board with the #ELOG RCI
+ * command and prints the counters and latency histograms.
+ *
+ * usage: elog_stats [-r] <board address> [port]
+ *
+ *   -r  start the statistics over after reading them (#ELOGR)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "eventlogger.h"
+
+#define RCI_PORT  23
+
+static int fetch(const char * addr, int port, int reset, uint8_t * buf, size_t buflen) {
+	struct sockaddr_in sa;
+	const char *       cmd = reset ? "#ELOGR\r\n" : "#ELOG\r\n";
+	size_t             got = 0;
+	ssize_t            n;
+	int                s;
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sin_family = AF_INET;
+	sa.sin_port   = htons(port);
+	if(inet_pton(AF_INET, addr, &sa.sin_addr) != 1) {
+		fprintf(stderr, "bad address %s\n", addr);
+		return -1;
+	}
+
+	s = socket(AF_INET, SOCK_STREAM, 0);
+	if(s < 0 || connect(s, (struct sockaddr *) &sa, sizeof(sa)) < 0) {
+		perror("connect");
+		return -1;
+	}
+	if(write(s, cmd, strlen(cmd)) < 0) {
+		perror("write");
+		close(s);
+		return -1;
+	}
+	// the RCI closes the connection after its one reply
+	while(got < buflen && (n = read(s, buf + got, buflen - got)) > 0) {
+		got += n;
+	}
+	close(s);
+	return (int) got;
+}
+
+static void print_hist(const char * name, const LatencyHist * h) {
+	unsigned b, last = 0;
+
+	printf("\n%s: %u samples, mean %llu us, max %u us\n", name, h->count,
+	       h->count ? (unsigned long long) (h->total_us / h->count) : 0ULL, h->max_us);
+	for(b = 0; b < LAT_HIST_BUCKETS; ++b) {
+		if(h->bucket[b]) {
+			last = b;
+		}
+	}
+	for(b = 0; h->count && b <= last; ++b) {
+		unsigned stars = (unsigned) ((uint64_t) h->bucket[b] * 50 / h->count);
+
+		printf("  %8u us %s %10u %6.2f%% ", lat_hist_bucket_floor(b),
+		       b == LAT_HIST_BUCKETS - 1 ? "+ " : "  ", h->bucket[b],
+		       100.0 * h->bucket[b] / h->count);
+		while(stars--) {
+			putchar('#');
+		}
+		putchar('\n');
+	}
+}
+
+int main(int argc, char * argv[]) {
+	uint8_t       buf[1500];
+	EventLogStats st;
+	int           reset = 0;
+	int           len;
+
+	if(argc > 1 && !strcmp(argv[1], "-r")) {
+		reset = 1;
+		--argc;
+		++argv;
+	}
+	if(argc < 2) {
+		fprintf(stderr, "usage: elog_stats [-r] <board address> [port]\n");
+		return 1;
+	}
+
+	len = fetch(argv[1], argc > 2 ? atoi(argv[2]) : RCI_PORT, reset, buf, sizeof(buf));
+	if(len < 0) {
+		return 1;
+	}
+	// the reply ends in \r\n
+	if((size_t) len < sizeof(st) + 2) {
+		fprintf(stderr, "short reply, %d bytes\n", len);
+		return 1;
+	}
+	memcpy(&st, buf, sizeof(st));
+	if(st.version != EVENTLOG_STATS_VERSION || st.size != sizeof(st)) {
+		fprintf(stderr, "stats version %u size %u, expected version %u size %zu\n",
+		        st.version, st.size, EVENTLOG_STATS_VERSION, sizeof(st));
+		return 1;
+	}
+
+	printf("logged        %10u\n", st.logged);
+	printf("pool empty    %10u\n", st.pool_empty);
+	printf("mailbox full  %10u\n", st.mail_full);
+	printf("ring dropped  %10u\n", st.ring_dropped);
+	printf("write errors  %10u\n", st.write_errors);
+	printf("block writes  %10u\n", st.block_writes);
+	print_hist("queue wait", &st.queue_wait);
+	print_hist("append", &st.append);
+	print_hist("block write", &st.block_write);
+	print_hist("sync", &st.sync);
+	return 0;
+}
@@ -0,0 +1,157 @@
+/*
+ * eod_bench.c
+ *
+ * Builds block log images of growing size with sdcblock.c, damages them the
+ * ways a power cut or a pulled card would, and times sdc_block_seek_eod()
+ * on each one. Every image must recover to exactly the records that are
+ * known to have survived.
+ *
+ *  - clean:     log closed normally
+ *  - truncated: file cut off part way into the last block
+ *  - torn:      second half of the last block overwritten with junk
+ *  - stale:     blocks from an older session left after the end of data
+ *
+ * usage: eod_bench [file] [max MB]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "sdcblock.h"
+
+/* Two of these fill a block, so the record count pins down the layout */
+#define RECORD_BYTES     1000
+#define RECORDS_PER_BLK  2
+
+enum damage { CLEAN, TRUNCATED, TORN, STALE, NUM_DAMAGE };
+static const char * damage_names[] = { "clean", "truncated", "torn", "stale" };
+
+static unsigned long reads;
+static unsigned long read_bytes;
+
+static SDC_ERRORCode file_write(void * ctx, uint32_t ofs, const void * buf, size_t len) {
+	return pwrite(*(int *) ctx, buf, len, ofs) == (ssize_t) len ? SDC_OK : SDC_FWRITE_ERROR;
+}
+
+static SDC_ERRORCode file_read(void * ctx, uint32_t ofs, void * buf, size_t len) {
+	++reads;
+	read_bytes += len;
+	return pread(*(int *) ctx, buf, len, ofs) == (ssize_t) len ? SDC_OK : SDC_FREAD_ERROR;
+}
+
+static double now_s(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int build(int fd, const SDCStorage * st, SDCBlockLog * log, uint32_t session, uint32_t records) {
+	uint8_t  rec[RECORD_BYTES];
+	uint32_t i;
+
+	if(sdc_block_init(log, st, RECORD_BYTES, session) != SDC_OK) {
+		return -1;
+	}
+	for(i = 0; i < records; ++i) {
+		memset(rec, (int) i, sizeof(rec));
+		memcpy(rec, &i, sizeof(i));
+		if(sdc_block_append(log, rec, sizeof(rec)) != SDC_OK) {
+			return -1;
+		}
+	}
+	if(sdc_block_flush(log) != SDC_OK) {
+		return -1;
+	}
+	return fsync(fd);
+}
+
+/* Damage the image and return how many records should survive */
+static uint32_t damage(int fd, const SDCStorage * st, SDCBlockLog * log, enum damage d, uint32_t records) {
+	static SDCBlockLog old;
+	uint32_t last = (records - 1) / RECORDS_PER_BLK;
+	uint8_t  junk[SDC_BLOCK_BYTES / 2];
+
+	switch(d) {
+	case TRUNCATED:
+		// the last block is lost, the one before it survives whole
+		if(ftruncate(fd, last * SDC_BLOCK_BYTES + 100)) {
+			perror("ftruncate");
+		}
+		return last * RECORDS_PER_BLK;
+	case TORN:
+		// the last block holds two records, keep only the first
+		memset(junk, 0x3c, sizeof(junk));
+		if(pwrite(fd, junk, sizeof(junk), last * SDC_BLOCK_BYTES + SDC_BLOCK_BYTES / 2) != sizeof(junk)) {
+			perror("pwrite");
+		}
+		return last * RECORDS_PER_BLK + 1;
+	case STALE:
+		// an older, longer log with another session, then this one on top
+		if(ftruncate(fd, 0) || build(fd, st, &old, 0x0bad, records * 2) || build(fd, st, log, 0x600d, records)) {
+			perror("stale");
+		}
+		return records;
+	default:
+		return records;
+	}
+}
+
+int main(int argc, char * argv[]) {
+	static SDCBlockLog log;
+	const char * path   = argc > 1 ? argv[1] : "LOGSMALL.bin";
+	uint32_t     max_mb = argc > 2 ? strtoul(argv[2], NULL, 0) : 256;
+	int          fd;
+	int          failed = 0;
+	SDCStorage   st = {
+		.write = file_write,
+		.read  = file_read,
+		.sync  = NULL,
+		.ctx   = &fd,
+	};
+	uint32_t     mb;
+	int          d;
+
+	fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if(fd < 0) {
+		perror("open");
+		return 1;
+	}
+
+	printf("%6s %-10s %10s %8s %10s %10s\n", "MB", "damage", "records", "reads", "read bytes", "ms");
+	for(mb = 1; mb <= max_mb; mb *= 4) {
+		uint32_t records = (mb << 20) / SDC_BLOCK_BYTES * RECORDS_PER_BLK - 1;
+
+		for(d = 0; d < NUM_DAMAGE; ++d) {
+			uint32_t expect;
+			double   start;
+			int      rc;
+
+			if(ftruncate(fd, 0) || build(fd, &st, &log, 0x600d, records)) {
+				perror("build");
+				return 1;
+			}
+			expect = damage(fd, &st, &log, d, records);
+
+			reads = read_bytes = 0;
+			sdc_block_init(&log, &st, RECORD_BYTES, 0);
+			start = now_s();
+			rc = sdc_block_seek_eod(&log);
+			start = now_s() - start;
+
+			printf("%6u %-10s %10u %8lu %10lu %10.3f%s\n", mb, damage_names[d], log.records,
+			       reads, read_bytes, start * 1e3,
+			       (rc != SDC_OK || log.records != expect) ? "  FAIL" : "");
+			if(rc != SDC_OK || log.records != expect) {
+				printf("       expected %u records, rc %d\n", expect, rc);
+				failed = 1;
+			}
+		}
+	}
+	close(fd);
+	return failed;
+}
@@ -0,0 +1,227 @@
+/*
+ * ring_stress.c
+ *
+ * Stress test for the lock-free ring in common/util/spscring.c. Each producer
+ * thread owns a ring and writes variable length records in bursts, the way a
+ * sensor handler would when a FIFO fills, and one consumer thread drains all
+ * of the rings the way the eventlogger thread does. The consumer checks every
+ * record's length, sequence number and contents; sequence gaps must add up to
+ * exactly the drops the producers counted.
+ *
+ * usage: ring_stress [producers] [records per producer] [ring bytes] [burst]
+ *                    [consumer delay us]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+
+#include "spscring.h"
+
+#define MAX_PRODUCERS  16
+#define MIN_RECORD     8
+/* offsetof(GENERIC_message, data) + SDC_MAX_PAYLOAD_BYTES */
+#define MAX_RECORD     178
+
+struct producer {
+	SPSCRing          ring;
+	pthread_t         thread;
+	uint32_t          id;
+	uint32_t          count;
+	uint32_t          burst;
+	uint8_t *         buf;
+
+	// consumer side
+	uint32_t          next_seq;
+	uint64_t          received;
+	uint64_t          gaps;
+	uint64_t          bytes;
+	volatile int      done;
+};
+
+static struct producer producers[MAX_PRODUCERS];
+static unsigned        num_producers;
+static unsigned        consumer_delay_us;
+static uint64_t        errors;
+
+static double now_s(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void sleep_us(unsigned us) {
+	struct timespec ts = { us / 1000000, (us % 1000000) * 1000L };
+	nanosleep(&ts, NULL);
+}
+
+static uint32_t record_len(uint32_t id, uint32_t seq) {
+	return MIN_RECORD + (seq * 2654435761u ^ id) % (MAX_RECORD - MIN_RECORD + 1);
+}
+
+static uint8_t record_byte(uint32_t seq, uint32_t i) {
+	return (uint8_t) (seq * 31 + i);
+}
+
+static void * producer_thread(void * arg) {
+	struct producer * p = arg;
+	unsigned int      seed = p->id;
+	uint32_t          seq;
+
+	for(seq = 0; seq < p->count; ++seq) {
+		uint32_t  len = record_len(p->id, seq);
+		uint8_t * rec = spsc_ring_reserve(&p->ring, len);
+		uint32_t  i;
+
+		if(rec != NULL) {
+			memcpy(rec, &p->id, sizeof(p->id));
+			memcpy(rec + 4, &seq, sizeof(seq));
+			for(i = 8; i < len; ++i) {
+				rec[i] = record_byte(seq, i);
+			}
+			spsc_ring_commit(&p->ring);
+		}
+		// a burst, then a quiet spell of up to 50us
+		if(p->burst && seq % p->burst == p->burst - 1) {
+			sleep_us(rand_r(&seed) % 50);
+		}
+	}
+	__atomic_store_n(&p->done, 1, __ATOMIC_RELEASE);
+	return NULL;
+}
+
+static unsigned drain(struct producer * p) {
+	const uint8_t * rec;
+	uint32_t        len;
+	unsigned        n = 0;
+
+	while((rec = spsc_ring_peek(&p->ring, &len)) != NULL) {
+		uint32_t id, seq, i;
+
+		memcpy(&id, rec, sizeof(id));
+		memcpy(&seq, rec + 4, sizeof(seq));
+		if(id != p->id || seq < p->next_seq || len != record_len(id, seq)) {
+			if(errors++ < 10) {
+				printf("producer %u: bad record id %u seq %u len %u, expected seq >= %u\n",
+				       p->id, id, seq, len, p->next_seq);
+			}
+		} else {
+			for(i = 8; i < len; ++i) {
+				if(rec[i] != record_byte(seq, i)) {
+					if(errors++ < 10) {
+						printf("producer %u: seq %u corrupt at byte %u\n", p->id, seq, i);
+					}
+					break;
+				}
+			}
+			p->gaps += seq - p->next_seq;
+			p->next_seq = seq + 1;
+		}
+		p->bytes += len;
+		++p->received;
+		++n;
+		spsc_ring_release(&p->ring);
+	}
+	return n;
+}
+
+static void * consumer_thread(void * arg) {
+	(void) arg;
+
+	for(;;) {
+		unsigned i, n = 0, done = 0;
+
+		for(i = 0; i < num_producers; ++i) {
+			// check done before draining so nothing committed is missed
+			done += __atomic_load_n(&producers[i].done, __ATOMIC_ACQUIRE);
+			n += drain(&producers[i]);
+		}
+		if(done == num_producers && n == 0) {
+			break;
+		}
+		if(consumer_delay_us) {
+			sleep_us(consumer_delay_us);
+		} else if(n == 0) {
+			sched_yield();
+		}
+	}
+	return NULL;
+}
+
+int main(int argc, char * argv[]) {
+	uint32_t  count      = argc > 2 ? strtoul(argv[2], NULL, 0) : 2000000;
+	uint32_t  ring_bytes = argc > 3 ? strtoul(argv[3], NULL, 0) : 2048;
+	uint32_t  burst      = argc > 4 ? strtoul(argv[4], NULL, 0) : 32;
+	pthread_t consumer;
+	uint64_t  received = 0, dropped = 0, gaps = 0, bytes = 0, high_water = 0;
+	double    start, secs;
+	unsigned  i;
+
+	num_producers     = argc > 1 ? strtoul(argv[1], NULL, 0) : 4;
+	consumer_delay_us = argc > 5 ? strtoul(argv[5], NULL, 0) : 0;
+	if(num_producers < 1 || num_producers > MAX_PRODUCERS) {
+		fprintf(stderr, "1 to %d producers\n", MAX_PRODUCERS);
+		return 1;
+	}
+
+	for(i = 0; i < num_producers; ++i) {
+		struct producer * p = &producers[i];
+
+		p->id    = i;
+		p->count = count;
+		p->burst = burst;
+		p->buf   = malloc(ring_bytes);
+		if(p->buf == NULL || !spsc_ring_init(&p->ring, p->buf, ring_bytes)) {
+			fprintf(stderr, "ring bytes must be a power of two\n");
+			return 1;
+		}
+	}
+
+	start = now_s();
+	pthread_create(&consumer, NULL, consumer_thread, NULL);
+	for(i = 0; i < num_producers; ++i) {
+		pthread_create(&producers[i].thread, NULL, producer_thread, &producers[i]);
+	}
+	for(i = 0; i < num_producers; ++i) {
+		pthread_join(producers[i].thread, NULL);
+	}
+	pthread_join(consumer, NULL);
+	secs = now_s() - start;
+
+	for(i = 0; i < num_producers; ++i) {
+		struct producer * p = &producers[i];
+
+		// drops at the very end don't show up as gaps
+		p->gaps += p->count - p->next_seq;
+		if(p->received != p->ring.records || p->gaps != p->ring.dropped) {
+			printf("producer %u: committed %u received %llu, dropped %u gaps %llu\n",
+			       p->id, p->ring.records, (unsigned long long) p->received,
+			       p->ring.dropped, (unsigned long long) p->gaps);
+			++errors;
+		}
+		received += p->received;
+		dropped  += p->ring.dropped;
+		gaps     += p->gaps;
+		bytes    += p->bytes;
+		if(p->ring.high_water > high_water) {
+			high_water = p->ring.high_water;
+		}
+		free(p->buf);
+	}
+
+	printf("%u producers x %u records, %u byte rings, bursts of %u, consumer delay %uus\n",
+	       num_producers, count, ring_bytes, burst, consumer_delay_us);
+	printf("received %llu dropped %llu (%.3f%%) in %.3f s: %.2f M records/s %.1f MB/s, high water %llu bytes\n",
+	       (unsigned long long) received, (unsigned long long) dropped,
+	       100.0 * dropped / ((double) count * num_producers), secs,
+	       received / secs / 1e6, bytes / secs / 1e6, (unsigned long long) high_water);
+	if(errors) {
+		printf("%llu errors\n", (unsigned long long) errors);
+		return 1;
+	}
+	return 0;
+}
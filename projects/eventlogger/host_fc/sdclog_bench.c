@@ -0,0 +1,188 @@
+/*
+ * sdclog_bench.c
+ *
+ * Runs the SD card log writers against a plain file so their card traffic
+ * can be compared without a board:
+ *
+ *  - legacy: what eventlogger used to do through psas_sdclog.c, BOM +
+ *    GENERIC_message, checksum, SDC_MARKER_BYTES of eod marks and a seek
+ *    back over them for every record.
+ *  - block:  the sdcblock.c engine, whole blocks written through an
+ *    SDCStorage backed by pwrite, with only the message head and payload
+ *    bytes of each message in the log.
+ *
+ * usage: sdclog_bench [file] [records] [payload bytes]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "crc_16_reflect.h"
+#include "sdcblock.h"
+
+/* sizeof(GENERIC_message) in psas_sdclog.h, which can't be built here */
+#define RECORD_BYTES          178
+/* offsetof(GENERIC_message, data) */
+#define HEAD_BYTES            28
+#define LEGACY_MARKER_BYTES   200
+#define LEGACY_SYNC_COUNT     40
+
+struct counters {
+	uint64_t bytes;
+	uint64_t writes;
+	uint64_t syncs;
+};
+
+static struct counters cnt;
+
+static double now_s(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void fill_record(uint8_t * rec, uint32_t index) {
+	unsigned int i;
+	memcpy(rec, "BNCH", 4);
+	memcpy(rec + 4, &index, sizeof(index));
+	for(i = 8; i < RECORD_BYTES; ++i) {
+		rec[i] = (uint8_t) (index * 31 + i);
+	}
+}
+
+static int counted_pwrite(int fd, const void * buf, size_t len, off_t ofs) {
+	++cnt.writes;
+	cnt.bytes += len;
+	return pwrite(fd, buf, len, ofs) == (ssize_t) len ? 0 : -1;
+}
+
+static SDC_ERRORCode file_write(void * ctx, uint32_t ofs, const void * buf, size_t len) {
+	return counted_pwrite(*(int *) ctx, buf, len, ofs) ? SDC_FWRITE_ERROR : SDC_OK;
+}
+
+static SDC_ERRORCode file_read(void * ctx, uint32_t ofs, void * buf, size_t len) {
+	return pread(*(int *) ctx, buf, len, ofs) == (ssize_t) len ? SDC_OK : SDC_FREAD_ERROR;
+}
+
+static SDC_ERRORCode file_sync(void * ctx) {
+	++cnt.syncs;
+	return fdatasync(*(int *) ctx) ? SDC_SYNC_ERROR : SDC_OK;
+}
+
+static void run_legacy(int fd, uint32_t records) {
+	static const uint16_t bom = SDC_BOM_MARK;
+	uint8_t  rec[RECORD_BYTES];
+	uint8_t  eod[LEGACY_MARKER_BYTES];
+	off_t    ofs = 0;
+	int      sync_wait = LEGACY_SYNC_COUNT;
+	uint32_t i;
+
+	memset(eod, SDC_EOD_BYTE, sizeof(eod));
+	for(i = 0; i < records; ++i) {
+		crc_t crc16;
+
+		fill_record(rec, i);
+		crc16 = crc_finalize(crc_update(crc_init(), rec, sizeof(rec)));
+
+		counted_pwrite(fd, &bom, sizeof(bom), ofs);
+		ofs += sizeof(bom);
+		counted_pwrite(fd, rec, sizeof(rec), ofs);
+		ofs += sizeof(rec);
+		counted_pwrite(fd, &crc16, sizeof(crc16), ofs);
+		ofs += sizeof(crc16);
+		counted_pwrite(fd, eod, sizeof(eod), ofs);
+		// sdc_f_write counts every f_write towards the f_sync interval
+		sync_wait -= 4;
+		if(sync_wait <= 0) {
+			++cnt.syncs;
+			fdatasync(fd);
+			sync_wait = LEGACY_SYNC_COUNT;
+		}
+	}
+}
+
+static int run_block(int fd, uint32_t records, size_t payload, SDCBlockLog * log) {
+	SDCStorage st = {
+		.write = file_write,
+		.read  = file_read,
+		.sync  = file_sync,
+		.ctx   = &fd,
+	};
+	uint8_t  rec[RECORD_BYTES];
+	uint32_t i;
+
+	if(sdc_block_init(log, &st, RECORD_BYTES, 0x1234) != SDC_OK) {
+		return -1;
+	}
+	for(i = 0; i < records; ++i) {
+		fill_record(rec, i);
+		if(sdc_block_append(log, rec, HEAD_BYTES + payload) != SDC_OK) {
+			return -1;
+		}
+	}
+	if(sdc_block_flush(log) != SDC_OK) {
+		return -1;
+	}
+	fdatasync(fd);
+
+	// recover the end of data the way a reboot would
+	if(sdc_block_init(log, &st, RECORD_BYTES, 0) != SDC_OK ||
+	   sdc_block_seek_eod(log) != SDC_OK || log->records != records) {
+		fprintf(stderr, "block: recovered %u of %u records\n", log->records, records);
+		return -1;
+	}
+	return 0;
+}
+
+static void report(const char * name, uint32_t records, size_t payload_bytes, double secs) {
+	double payload = (double) records * payload_bytes;
+	printf("%-7s %8u records %10.3f s %10llu writes %6llu syncs %12llu bytes"
+	       " %6.2f bytes/payload byte %8.2f MB/s payload\n",
+	       name, records, secs,
+	       (unsigned long long) cnt.writes, (unsigned long long) cnt.syncs,
+	       (unsigned long long) cnt.bytes, cnt.bytes / payload,
+	       payload / secs / 1e6);
+}
+
+int main(int argc, char * argv[]) {
+	static SDCBlockLog log;
+	const char * path    = argc > 1 ? argv[1] : "LOGSMALL.bin";
+	uint32_t     records = argc > 2 ? strtoul(argv[2], NULL, 0) : 100000;
+	size_t       payload = argc > 3 ? strtoul(argv[3], NULL, 0) : 24;
+	double       start;
+	int          fd;
+
+	if(payload > RECORD_BYTES - HEAD_BYTES) {
+		fprintf(stderr, "payload is at most %d bytes\n", RECORD_BYTES - HEAD_BYTES);
+		return 1;
+	}
+
+	fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if(fd < 0) {
+		perror("open");
+		return 1;
+	}
+	memset(&cnt, 0, sizeof(cnt));
+	start = now_s();
+	run_legacy(fd, records);
+	report("legacy", records, HEAD_BYTES + payload, now_s() - start);
+
+	if(ftruncate(fd, 0)) {
+		perror("ftruncate");
+		return 1;
+	}
+	memset(&cnt, 0, sizeof(cnt));
+	start = now_s();
+	if(run_block(fd, records, payload, &log)) {
+		return 1;
+	}
+	report("block", records, HEAD_BYTES + payload, now_s() - start);
+
+	close(fd);
+	return 0;
+}
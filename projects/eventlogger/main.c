@@ -4,8 +4,12 @@
 #include "hal.h"
 #include "chprintf.h"
 #include "rtc.h"
+#include "lwipthread.h"
 
 #include "eventlogger.h"
+#include "rci.h"
+#include "utils_sockets.h"
+#include "net_addrs.h"
 #include "MPU9150.h"
 #include "psas_rtc.h"
 #include "psas_sdclog.h"
@@ -109,6 +113,10 @@ static WORKING_AREA(wa_thread_mpu9150_dispatch, 512);
 int main(void) {
     static const evhandler_t sdc_handlers[] = { sdc_insert_handler, sdc_remove_handler };
     struct EventListener insertion_listener, removal_listener;
+    struct RCICommand commands[] = {
+        RCI_CMD_ELOG,
+        {NULL}
+    };
 
     /*!
      * System initializations.
@@ -169,6 +177,12 @@ int main(void) {
      */
     eventlogger_init();
 
+    /*!
+     * Starts lwip and the RCI so #ELOG can report the logging statistics
+     */
+    lwipThreadStart(EVENTLOGGER_LWIP);
+    RCICreate(commands);
+
     /*!
      * Initializes MPU9150 & associated I2C connection
      */
@@ -16,6 +16,18 @@
 
 #define MPU9150_DEBUG false
 
+/* Room for about 40 logged samples while the SD card is busy */
+#define MPU9150_LOG_RING_BYTES 2048
+
+
+
+/**
+ ** Private Global Variables
+ ***************************/
+
+static uint8_t      mpu9150_log_buf[MPU9150_LOG_RING_BYTES] __attribute__((aligned(4)));
+static EventLogRing mpu9150_log;
+
 
 
 /**
@@ -70,7 +82,7 @@ void mpu9150_int_event_handler(eventid_t _ UNUSED) {
     count++;
 
     if (count % 10 == 0) {
-        log_event("MPU9", (uint8_t*) &mpu9150_current_read, 14);
+        log_event_ring(&mpu9150_log, "MPU9", (uint8_t*) &mpu9150_current_read, 14);
     }
 
 #if MPU9150_DEBUG
@@ -94,6 +106,7 @@ msg_t Thread_mpu9150_int_dispatch(void* _ UNUSED) {
 	const  evhandler_t    evhndl_mpu9150[] = { mpu9150_int_event_handler };
 
 	chRegSetThreadName("mpu9150_int");
+	eventlogger_ring_init(&mpu9150_log, mpu9150_log_buf, sizeof(mpu9150_log_buf));
 	mpu9150_init(mpu9150_driver.i2c_instance);
 	chEvtRegister(&mpu9150_int_event, &evl_mpu9150, 0);
 
@@ -0,0 +1,246 @@
+/*
+ * gps_raw_rx.c
+ *
+ * Captures the GPS front end's raw Ethernet stream (#RAWE) on Linux.
+ *
+ * The kernel fills a TPACKET_V3 ring of blocks mmap()ed into this process,
+ * so no frame is ever copied out of the kernel one recv() at a time. Each
+ * block handed over holds whatever frames arrived in it; the samples are
+ * written from the ring straight to their offset in the output file, which
+ * leaves a hole wherever frames were lost, and the block goes back to the
+ * kernel. Frames share their offsets with the board's UDP datagrams, so a
+ * stretch sent over UDP between #RAWE switches counts as lost and leaves a
+ * hole at the offsets the datagrams carried. Needs CAP_NET_RAW.
+ *
+ * usage: gps_raw_rx [-i interface] [-o samples file] [-t seconds] [-n frames]
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <linux/if_packet.h>
+#include <net/ethernet.h>
+#include <net/if.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+
+#include "packetizer.h"
+
+#define ETHERTYPE_PSAS  0x88B5              // RAWETHER_TYPE_PSAS in utils_rawether.h
+#define ETH_HEADER      14
+#define BLOCK_SIZE      (1 << 22)
+#define BLOCKS          16
+#define FRAME_SIZE      2048
+#define BLOCK_TIMEOUT   50                  // ms before a part full block is handed over
+
+struct ring {
+	int                 fd;
+	uint8_t*            map;
+	struct tpacket_req3 req;
+	unsigned            block;              // next block to look at
+};
+
+struct stats {
+	uint64_t frames;
+	uint64_t bytes;
+	uint64_t blocks;
+	uint64_t seq_lost;
+	uint64_t bytes_lost;                    // by the offsets
+	uint64_t backwards;                     // frames behind the last one
+	uint64_t short_frames;
+	uint32_t next_seq;
+	uint64_t next_offset;
+};
+
+static volatile sig_atomic_t stop;
+
+static void on_signal(int sig) {
+	(void) sig;
+	stop = 1;
+}
+
+static int ring_open(struct ring* r, const char* ifname) {
+	int version = TPACKET_V3;
+	struct sockaddr_ll sll;
+
+	memset(r, 0, sizeof(*r));
+	r->fd = socket(AF_PACKET, SOCK_RAW, htons(ETHERTYPE_PSAS));
+	if(r->fd < 0) {
+		return -1;
+	}
+	if(setsockopt(r->fd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) < 0) {
+		return -1;
+	}
+
+	r->req.tp_block_size       = BLOCK_SIZE;
+	r->req.tp_block_nr         = BLOCKS;
+	r->req.tp_frame_size       = FRAME_SIZE;
+	r->req.tp_frame_nr         = BLOCK_SIZE / FRAME_SIZE * BLOCKS;
+	r->req.tp_retire_blk_tov   = BLOCK_TIMEOUT;
+	r->req.tp_feature_req_word = TP_FT_REQ_FILL_RXHASH;
+	if(setsockopt(r->fd, SOL_PACKET, PACKET_RX_RING, &r->req, sizeof(r->req)) < 0) {
+		return -1;
+	}
+	r->map = mmap(NULL, (size_t) BLOCK_SIZE * BLOCKS, PROT_READ | PROT_WRITE,
+	              MAP_SHARED | MAP_LOCKED, r->fd, 0);
+	if(r->map == MAP_FAILED) {
+		// MAP_LOCKED needs RLIMIT_MEMLOCK room, it only keeps the ring out of swap
+		r->map = mmap(NULL, (size_t) BLOCK_SIZE * BLOCKS, PROT_READ | PROT_WRITE, MAP_SHARED, r->fd, 0);
+		if(r->map == MAP_FAILED) {
+			return -1;
+		}
+	}
+
+	memset(&sll, 0, sizeof(sll));
+	sll.sll_family   = AF_PACKET;
+	sll.sll_protocol = htons(ETHERTYPE_PSAS);
+	sll.sll_ifindex  = ifname ? (int) if_nametoindex(ifname) : 0;
+	if(ifname && sll.sll_ifindex == 0) {
+		errno = ENODEV;
+		return -1;
+	}
+	return bind(r->fd, (struct sockaddr*) &sll, sizeof(sll));
+}
+
+static void frame(struct stats* s, const uint8_t* p, uint32_t len, int out) {
+	uint32_t seq;
+	uint64_t offset;
+	int n;
+
+	if(len < ETH_HEADER || (p[12] << 8 | p[13]) != ETHERTYPE_PSAS) {
+		return;
+	}
+	n = packetizerParse(p + ETH_HEADER, len - ETH_HEADER, &seq, &offset);
+	if(n < 0) {
+		++s->short_frames;
+		return;
+	}
+
+	if(s->frames && offset < s->next_offset) {
+		++s->backwards;
+	} else if(s->frames) {
+		s->seq_lost   += seq - s->next_seq;
+		s->bytes_lost += offset - s->next_offset;
+	}
+	if(s->frames == 0 || offset >= s->next_offset) {
+		s->next_seq    = seq + 1;
+		s->next_offset = offset + n;
+	}
+	++s->frames;
+	s->bytes += n;
+
+	// straight from the ring to where the samples belong
+	if(out >= 0 && pwrite(out, p + ETH_HEADER + PACKETIZER_HEADER, n, offset) != n) {
+		perror("pwrite");
+		exit(1);
+	}
+}
+
+/* Handles every block the kernel has finished with. Returns blocks handled */
+static int ring_drain(struct ring* r, struct stats* s, int out) {
+	int handled = 0;
+
+	while(true) {
+		struct tpacket_block_desc* b = (struct tpacket_block_desc*) (r->map + (size_t) r->block * BLOCK_SIZE);
+		struct tpacket3_hdr* h;
+		uint32_t i;
+
+		if(!(__atomic_load_n(&b->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER)) {
+			return handled;
+		}
+		h = (struct tpacket3_hdr*) ((uint8_t*) b + b->hdr.bh1.offset_to_first_pkt);
+		for(i = 0; i < b->hdr.bh1.num_pkts; ++i) {
+			frame(s, (uint8_t*) h + h->tp_mac, h->tp_snaplen, out);
+			h = (struct tpacket3_hdr*) ((uint8_t*) h + h->tp_next_offset);
+		}
+		++s->blocks;
+		++handled;
+		__atomic_store_n(&b->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+		r->block = (r->block + 1) % BLOCKS;
+	}
+}
+
+static double now_s(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char* argv[]) {
+	const char* ifname = NULL;
+	const char* path = NULL;
+	double seconds = 0, start;
+	uint64_t max_frames = 0;
+	struct tpacket_stats_v3 ks;
+	socklen_t kslen = sizeof(ks);
+	struct stats s;
+	struct ring r;
+	int out = -1, opt;
+
+	while((opt = getopt(argc, argv, "i:o:t:n:")) != -1) {
+		switch(opt) {
+		case 'i':
+			ifname = optarg;
+			break;
+		case 'o':
+			path = optarg;
+			break;
+		case 't':
+			seconds = atof(optarg);
+			break;
+		case 'n':
+			max_frames = strtoull(optarg, NULL, 0);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-i interface] [-o samples file] [-t seconds] [-n frames]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	if(ring_open(&r, ifname) < 0) {
+		perror("packet ring");
+		return 1;
+	}
+	if(path != NULL && (out = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0) {
+		perror(path);
+		return 1;
+	}
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
+
+	memset(&s, 0, sizeof(s));
+	start = now_s();
+	while(!stop && (seconds <= 0 || now_s() - start < seconds) && (max_frames == 0 || s.frames < max_frames)) {
+		struct pollfd pfd = { .fd = r.fd, .events = POLLIN | POLLERR };
+
+		if(ring_drain(&r, &s, out) == 0) {
+			poll(&pfd, 1, 100);
+		}
+	}
+	ring_drain(&r, &s, out);
+
+	if(getsockopt(r.fd, SOL_PACKET, PACKET_STATISTICS, &ks, &kslen) < 0) {
+		memset(&ks, 0, sizeof(ks));
+	}
+	printf("%llu frames, %llu sample bytes in %llu blocks over %.1f s\n",
+	       (unsigned long long) s.frames, (unsigned long long) s.bytes,
+	       (unsigned long long) s.blocks, now_s() - start);
+	printf("lost %llu frames, %llu sample bytes; %llu out of order, %llu short; kernel dropped %u\n",
+	       (unsigned long long) s.seq_lost, (unsigned long long) s.bytes_lost,
+	       (unsigned long long) s.backwards, (unsigned long long) s.short_frames, ks.tp_drops);
+
+	if(out >= 0) {
+		close(out);
+	}
+	munmap(r.map, (size_t) BLOCK_SIZE * BLOCKS);
+	close(r.fd);
+	return 0;
+}
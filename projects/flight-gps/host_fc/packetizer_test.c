@@ -0,0 +1,212 @@
+/*
+ * packetizer_test.c
+ *
+ * Feeds a made up sample stream through the GPS packetizer in DMA half
+ * sized pieces and in random ones, with a sender that holds on to buffers
+ * the way lwIP does and sometimes fails, then reassembles what was sent by
+ * the header offsets and checks every byte landed where it belongs and
+ * every byte not sent is accounted for. One run switches back and forth to
+ * frames the producer sends itself, the way #RAWE does, and checks they
+ * carry on the datagrams' sequence numbers and offsets.
+ *
+ * usage: packetizer_test [stream bytes]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "packetizer.h"
+
+#define DMA_HALF   1024                 // GPS_BUFFER_SIZE in MAX2769.h
+#define DATAGRAM   (1500 - 20 - 8)      // GPS_DATAGRAM in flight-gps/main.c
+#define MAX_BUFS   8
+
+static int failures;
+
+#define CHECK(cond) do { \
+	if(!(cond)) { \
+		printf("%s:%d: %s\n", __func__, __LINE__, #cond); \
+		++failures; \
+	} \
+} while(0)
+
+static uint8_t stream_byte(uint64_t i) {
+	return (uint8_t) (i * 7 + (i >> 8) + (i >> 16));
+}
+
+struct sender {
+	struct Packetizer* p;
+	const uint8_t*     held[MAX_BUFS];  // oldest first
+	unsigned           nheld;
+	unsigned           fail_every;      // 0 for never
+
+	uint32_t           attempts;
+	uint32_t           next_seq;
+	uint64_t           next_offset;     // where the last datagram ended
+	uint64_t           delivered;       // data bytes in datagrams that went out
+	uint64_t           failed;          // data bytes in failed sends
+	uint64_t           gaps;            // bytes between datagrams
+	uint32_t           short_datagrams;
+	uint32_t           own_frames;      // sent by the producer itself
+	uint8_t*           received;        // reassembled stream
+	uint8_t*           covered;
+	uint64_t           length;
+};
+
+static void release_oldest(struct sender* s) {
+	packetizerRelease(s->p, s->held[0]);
+	memmove(s->held, s->held + 1, --s->nheld * sizeof(s->held[0]));
+}
+
+/* Checks a header follows on from the last one. Returns the data length */
+static int follow(struct sender* s, const uint8_t* buf, size_t len, uint64_t* offset) {
+	uint32_t seq;
+	int n = packetizerParse(buf, len, &seq, offset);
+
+	CHECK(n > 0);
+	CHECK(seq == s->next_seq);
+	CHECK(*offset >= s->next_offset);
+	s->next_seq    = seq + 1;
+	s->gaps       += *offset - s->next_offset;
+	s->next_offset = *offset + n;
+	return n;
+}
+
+static void receive(struct sender* s, const uint8_t* buf, uint64_t offset, int n) {
+	CHECK(offset + n <= s->length);
+	memcpy(s->received + offset, buf + PACKETIZER_HEADER, n);
+	memset(s->covered + offset, 1, n);
+	s->delivered += n;
+}
+
+static int fake_send(uint8_t* buf, size_t len, void* user) {
+	struct sender* s = user;
+	uint64_t offset;
+	int n = follow(s, buf, len, &offset);
+
+	if(len != DATAGRAM) {
+		++s->short_datagrams;
+	}
+
+	if(s->fail_every && ++s->attempts % s->fail_every == 0) {
+		s->failed += n;
+		return -1;
+	}
+
+	receive(s, buf, offset, n);
+	s->held[s->nheld++] = buf;
+	return 0;
+}
+
+/* A frame the producer sends itself, header from packetizerFrame() */
+static void own_send(struct sender* s, const uint8_t* data, size_t len) {
+	static uint8_t frame[PACKETIZER_HEADER + 4096];
+	uint64_t offset;
+	int n;
+
+	packetizerFrame(s->p, frame, len);
+	memcpy(frame + PACKETIZER_HEADER, data, len);
+	n = follow(s, frame, PACKETIZER_HEADER + len, &offset);
+	receive(s, frame, offset, n);
+	++s->own_frames;
+}
+
+/* Pieces are chunk bytes, or random for 0. After each one lwIP sends one
+ * buffer and gives it back, except that every stall_every pieces it stalls
+ * for stall pieces. With own_every, every other own_every pieces go out in
+ * frames of the producer's own instead.
+ */
+static void run(const char* name, uint64_t length, size_t chunk, unsigned bufs,
+                unsigned fail_every, unsigned stall_every, unsigned stall,
+                unsigned own_every) {
+	static uint8_t  pool[MAX_BUFS][DATAGRAM];
+	static volatile uint8_t busy[MAX_BUFS];
+	struct Packetizer p;
+	struct sender s;
+	uint8_t* data = malloc(length);
+	uint64_t i, pos = 0, mismatched = 0;
+	unsigned pieces = 0, switches = 0;
+	unsigned own = 0;
+
+	memset(&s, 0, sizeof(s));
+	s.p          = &p;
+	s.fail_every = fail_every;
+	s.length     = length;
+	s.received   = calloc(length, 1);
+	s.covered    = calloc(length, 1);
+	for(i = 0; i < length; ++i) {
+		data[i] = stream_byte(i);
+	}
+
+	packetizerInit(&p, pool[0], busy, bufs, DATAGRAM, fake_send, &s);
+	while(pos < length) {
+		size_t n = chunk ? chunk : 1 + (size_t) rand() % 3000;
+		if(n > length - pos) {
+			n = length - pos;
+		}
+		if(own_every && (pieces / own_every) % 2 != own) {
+			own = !own;
+			++switches;
+		}
+		if(own) {
+			own_send(&s, data + pos, n);
+		} else {
+			packetizerWrite(&p, data + pos, n);
+		}
+		pos += n;
+		++pieces;
+		if(stall_every && pieces % stall_every < stall) {
+			continue;
+		}
+		if(s.nheld) {
+			release_oldest(&s);
+		}
+	}
+
+	for(i = 0; i < length; ++i) {
+		if(s.covered[i] && s.received[i] != data[i]) {
+			++mismatched;
+		}
+	}
+	CHECK(mismatched == 0);
+	CHECK(p.offset == length);
+	CHECK(s.delivered + s.failed + p.dropped + p.used == length);
+	// a skip since the last datagram shows up in the next one's offset
+	CHECK(s.gaps + (length - p.used - s.next_offset) == p.dropped);
+	CHECK(p.datagrams + p.send_failures + s.own_frames == s.next_seq);
+	CHECK(p.send_failures == (fail_every ? s.attempts / fail_every : 0));
+	// only a switch to own frames sends a datagram before it fills
+	CHECK(s.short_datagrams <= (switches + 1) / 2);
+
+	printf("%-10s %9llu bytes in %6u datagrams (%u a MB, was %u), %u failed, %llu bytes dropped\n",
+	       name, (unsigned long long) length, p.datagrams,
+	       (unsigned) (p.datagrams * 1048576ULL / length), 1048576 / DMA_HALF,
+	       p.send_failures, (unsigned long long) p.dropped);
+
+	while(s.nheld) {
+		release_oldest(&s);
+	}
+	free(data);
+	free(s.received);
+	free(s.covered);
+}
+
+int main(int argc, char* argv[]) {
+	uint64_t length = argc > 1 ? strtoull(argv[1], NULL, 0) : 4 << 20;
+
+	srand(1);
+	run("dma halves", length, DMA_HALF, 4, 0, 0, 0, 0);
+	run("random", length, 0, 4, 0, 0, 0, 0);
+	run("failures", length, DMA_HALF, 4, 37, 0, 0, 0);
+	run("stalls", length, DMA_HALF, 2, 0, 50, 10, 0);
+	run("both", length, 0, 3, 11, 40, 15, 0);
+	run("own frames", length, DMA_HALF, 4, 13, 30, 5, 7);
+
+	if(failures) {
+		printf("%d checks failed\n", failures);
+		return 1;
+	}
+	printf("all checks passed\n");
+	return 0;
+}
@@ -14,6 +14,9 @@
 #include "rci.h"
 #include "utils_rci.h"
 #include "utils_sockets.h"
+#include "utils_zerocopy.h"
+#include "packetizer.h"
+#include "utils_rawether.h"
 #include "utils_general.h"
 #include "utils_led.h"
 #include "MAX2769.h"
@@ -115,8 +118,8 @@ static PWMConfig pwmcfg = {
 
 #define SEQ_COUNTER_OFFSET 4
 
-static uint8_t max2769_buf1[SEQ_COUNTER_OFFSET + GPS_BUFFER_SIZE];
-static uint8_t max2769_buf2[SEQ_COUNTER_OFFSET + GPS_BUFFER_SIZE];
+static uint8_t max2769_buf1[GPS_BUFFER_SIZE];
+static uint8_t max2769_buf2[GPS_BUFFER_SIZE];
 
 const MAX2769Config max2769 = {
 	.max = {
@@ -140,17 +143,88 @@ const MAX2769Config max2769 = {
 		.clk_src_cfg = &pwmcfg,
 		.PWMD = &PWMD12,
 	},
-	// GPS driver shouldn't know about the seqence counter section of the buffer
-	.bufs = {max2769_buf1 + SEQ_COUNTER_OFFSET, max2769_buf2 + SEQ_COUNTER_OFFSET},
+	.bufs = {max2769_buf1, max2769_buf2},
 };
 
-static int max2769_socket;
+/* The sample stream goes out in datagrams that fill an Ethernet frame, cut
+ * wherever the DMA halves happen to end; see packetizer.h for the header.
+ * The DMA is back in a half one half-period after handing it over, before
+ * a datagram spanning it could be sent, so the samples are copied into
+ * datagram buffers that lwIP then sends without copying again.
+ */
+#define GPS_DATAGRAM  (ETH_MTU - 20 - 8)  // less IPv4 and UDP headers
+#define GPS_DATAGRAMS 4
+
+static uint8_t gps_datagrams[GPS_DATAGRAMS][GPS_DATAGRAM];
+static volatile uint8_t gps_datagrams_busy[GPS_DATAGRAMS];
+static struct Packetizer gps_packets;
+static struct ZeroCopySocket max2769_socket;
+
+static int max2769_send(uint8_t * buf, size_t len, void * user UNUSED){
+	return zcSend(&max2769_socket, buf, len);
+}
+
+static void max2769_sent(void * buf, err_t err UNUSED, void * user UNUSED){
+	packetizerRelease(&gps_packets, buf);
+}
+
+/* Raw mode skips lwIP and puts each DMA half in an Ethernet frame of its
+ * own, EtherType RAWETHER_TYPE_PSAS, with the same header as the datagrams.
+ * Filling frames across halves would mean holding a transmit descriptor
+ * between halves, and lwIP's frames would queue up behind it. The headers
+ * come from gps_packets, so raw frames and datagrams share one sequence and
+ * one stream offset across #RAWE switches, and the switch to raw sends the
+ * part-filled datagram first. Dropped frames use up their sequence numbers
+ * and offsets too, so a receiver sees the gap.
+ */
+static struct RawEtherSocket max2769_raw;
+static volatile bool_t raw_mode;
+
 static void max2769_handler(eventid_t id UNUSED){
-	static uint32_t seq_counter = 0;
-	uint8_t *buf = max2769_getdata() - SEQ_COUNTER_OFFSET; //Add back in the sequence counter
-	((uint32_t*)buf)[0] = htonl(seq_counter);
-	write(max2769_socket, buf, SEQ_COUNTER_OFFSET + GPS_BUFFER_SIZE);
-	++seq_counter;
+	uint8_t * data = max2769_getdata();
+
+	if(raw_mode){
+		uint8_t head[PACKETIZER_HEADER];
+		packetizerFrame(&gps_packets, head, GPS_BUFFER_SIZE);
+		rawEtherSend(&max2769_raw, head, sizeof(head), data, GPS_BUFFER_SIZE);
+	} else {
+		packetizerWrite(&gps_packets, data, GPS_BUFFER_SIZE);
+	}
+}
+
+/* #GPSS: datagrams sent, sends that failed, sample bytes dropped for want
+ * of a free datagram buffer, then the zero-copy socket's sent, lwIP errors
+ * and unposted sends, then raw frames sent and dropped.
+ */
+static void gps_stats(struct RCICmdData * cmd UNUSED, struct RCIRetData * ret, void * user UNUSED){
+	ret->len = chsnprintf(ret->data, RCI_MAX_REPLY, "%u %u %u %u %u %u %u %u",
+	                      gps_packets.datagrams, gps_packets.send_failures,
+	                      (uint32_t)gps_packets.dropped, max2769_socket.sent,
+	                      max2769_socket.errors, max2769_socket.dropped,
+	                      max2769_raw.sent, max2769_raw.dropped);
+}
+
+/* #RAWE<destination MAC as 12 hex digits> sends samples in raw frames to
+ * that MAC, FFFFFFFFFFFF for broadcast. #RAWE alone goes back to UDP.
+ */
+static void gps_raw(struct RCICmdData * cmd, struct RCIRetData * ret, void * user UNUSED){
+	uint8_t dst[6];
+	char hex[3] = {0};
+	int i;
+
+	if(cmd->len == 0){
+		raw_mode = FALSE;
+	} else if(cmd->len == 12){
+		for(i = 0; i < 6; ++i){
+			hex[0] = cmd->data[2*i];
+			hex[1] = cmd->data[2*i+1];
+			dst[i] = strtol(hex, NULL, 16);
+		}
+		rawEtherConnect(&max2769_raw, dst);
+		raw_mode = TRUE;
+	}
+	strcpy(ret->data, raw_mode ? "RAW" : "UDP");
+	ret->len = 3;
 }
 
 static int venus_socket;
@@ -218,9 +292,12 @@ void main(void) {
 	chDbgAssert(venus_socket >= 0, "Venus socket failed", NULL);
 	connect(venus_socket, FC_ADDR, sizeof(struct sockaddr));
 
-	max2769_socket = get_udp_socket(GPS_OUT_ADDR);
-	chDbgAssert(max2769_socket >= 0, "MAX2769 socket failed", NULL);
-	connect(max2769_socket, FC_ADDR, sizeof(struct sockaddr));
+	int zc_err = zcSocket(&max2769_socket, GPS_OUT_ADDR, max2769_sent, NULL);
+	chDbgAssert(zc_err == 0, "MAX2769 socket failed", NULL);
+	zcConnect(&max2769_socket, FC_ADDR);
+	packetizerInit(&gps_packets, gps_datagrams[0], gps_datagrams_busy, GPS_DATAGRAMS,
+	               GPS_DATAGRAM, max2769_send, NULL);
+	rawEtherSocket(&max2769_raw, &ETHD1, GPS_LWIP->macaddress, RAWETHER_TYPE_PSAS);
 
 	max2769_init(&max2769);
 	max2769_set(MAX2769_CONF1, conf1);
@@ -232,6 +309,9 @@ void main(void) {
 
 	struct RCICommand commands[] = {
 		RCI_CMD_VERS,
+		RCI_CMD_LWIP,
+		{"#GPSS", gps_stats, NULL},
+		{"#RAWE", gps_raw, NULL},
 #ifndef FLIGHT
 		RCI_CMD_CONF,
 		RCI_CMD_DEBG,
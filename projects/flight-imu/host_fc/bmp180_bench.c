@@ -0,0 +1,221 @@
+/*
+ * bmp180_bench.c
+ *
+ * Checks the firmware's integer BMP180 compensation against the datasheet's
+ * worked example and against the same math done in doubles over the
+ * sensor's whole range, checks the altitude table against the barometric
+ * formula, and times the integer and floating point versions.
+ *
+ * usage: bmp180_bench [iterations]
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#endif
+
+#include "BMP180_comp.h"
+
+/* BST-BMP180-DS000 section 3.5: the calibration, UT, UP at oss 0 and results */
+static const uint8_t datasheet_eeprom[BMP180_CAL_LEN] = {
+	0x01, 0x98,     // AC1 408
+	0xFF, 0xB8,     // AC2 -72
+	0xC7, 0xD1,     // AC3 -14383
+	0x7F, 0xE5,     // AC4 32741
+	0x7F, 0xF5,     // AC5 32757
+	0x5A, 0x71,     // AC6 23153
+	0x18, 0x2E,     // B1 6190
+	0x00, 0x04,     // B2 4
+	0x80, 0x00,     // MB -32768
+	0xDD, 0xF9,     // MC -8711
+	0x0B, 0x34,     // MD 2868
+};
+#define DATASHEET_UT 27898
+#define DATASHEET_UP 23843
+#define DATASHEET_T 150
+#define DATASHEET_P 69964
+
+/* The datasheet's algorithm without the truncation */
+static double ref_temperature(const struct BMP180Calibration * c, double ut, double * b5){
+	double x1 = (ut - c->AC6) * c->AC5 / 32768.0;
+	double x2 = c->MC * 2048.0 / (x1 + c->MD);
+	*b5 = x1 + x2;
+	return (*b5 + 8) / 16;
+}
+
+static double ref_pressure(const struct BMP180Calibration * c, double up, unsigned oss, double b5){
+	double b6 = b5 - 4000;
+	double x3 = c->B2 * (b6 * b6 / 4096) / 2048 + c->AC2 * b6 / 2048;
+	double b3 = ((c->AC1 * 4 + x3) * (1 << oss) + 2) / 4;
+	double b4, b7, p;
+
+	x3 = (c->AC3 * b6 / 8192 + c->B1 * (b6 * b6 / 4096) / 65536 + 2) / 4;
+	b4 = c->AC4 * (x3 + 32768) / 32768;
+	b7 = (up - b3) * (50000 >> oss);
+	p = b7 * 2 / b4;
+	return p + ((p / 256) * (p / 256) * 3038 / 65536 - 7357 * p / 65536 + 3791) / 16;
+}
+
+static double ref_altitude_cm(double pa, double p0){
+	return 4433000.0 * (1 - pow(pa / p0, 1 / 5.255));
+}
+
+static double now_ns(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int check_datasheet(const struct BMP180Calibration * cal){
+	int32_t b5;
+	int32_t t = BMP180Temperature(cal, DATASHEET_UT, &b5);
+	int32_t p = BMP180Pressure(cal, DATASHEET_UP, 0, b5);
+	uint8_t raw[3] = {DATASHEET_UP >> 8, DATASHEET_UP & 0xFF, 0x00};
+
+	if(cal->AC1 != 408 || cal->AC4 != 32741 || cal->MB != -32768 || cal->MD != 2868){
+		printf("datasheet: calibration parsed wrong\n");
+		return -1;
+	}
+	if(BMP180RawPressure(raw, 0) != DATASHEET_UP){
+		printf("datasheet: raw pressure %d, expected %d\n", BMP180RawPressure(raw, 0), DATASHEET_UP);
+		return -1;
+	}
+	/* The example's working floors X2 to -2344 and gets B5 2399, where its
+	 * own C truncates to -2343 and 2400; T and p come out the same.
+	 */
+	if(t != DATASHEET_T || p != DATASHEET_P){
+		printf("datasheet: T %d p %d, expected %d %d\n", t, p, DATASHEET_T, DATASHEET_P);
+		return -1;
+	}
+	printf("datasheet example: T %d.%d C, p %d Pa, ok\n", t / 10, t % 10, p);
+	return 0;
+}
+
+/* -40 to 85 C and 300 to 1100 hPa, the sensor's range, at every oss */
+static int check_range(const struct BMP180Calibration * cal){
+	double worst_t = 0, worst_p = 0;
+	unsigned oss;
+	int32_t ut, up;
+
+	for(ut = 14000; ut <= 40000; ut += 37){
+		int32_t b5;
+		double rb5;
+		int32_t t = BMP180Temperature(cal, ut, &b5);
+		double rt = ref_temperature(cal, ut, &rb5);
+
+		if(rt < -400 || rt > 850){
+			continue;
+		}
+		worst_t = fmax(worst_t, fabs(t - rt));
+		for(oss = 0; oss <= 3; ++oss){
+			for(up = 8000 << oss; up <= (40000 << oss); up += 53 << oss){
+				double rp = ref_pressure(cal, up, oss, rb5);
+				if(rp < 30000 || rp > 110000){
+					continue;
+				}
+				worst_p = fmax(worst_p, fabs(BMP180Pressure(cal, up, oss, b5) - rp));
+			}
+		}
+	}
+	printf("over the range: worst %.2f x 0.1 C, %.2f Pa from the exact math", worst_t, worst_p);
+	/* What the datasheet's own truncations cost: B3 and B4 a count or two,
+	 * which at oss 0 and the temperature extremes reaches about 11 Pa
+	 */
+	if(worst_t > 1.5 || worst_p > 12){
+		printf(", too far\n");
+		return -1;
+	}
+	printf(", ok\n");
+	return 0;
+}
+
+static int check_altitude(void){
+	static const int32_t p0s[] = {BMP180_SEA_LEVEL_PA, 95000, 103000, 87000};
+	double worst_high = 0, worst_low = 0;
+	unsigned i;
+	int32_t pa;
+
+	for(i = 0; i < sizeof(p0s) / sizeof(p0s[0]); ++i){
+		for(pa = 30000; pa <= 110000; pa += 7){
+			double e = fabs(BMP180Altitude(pa, p0s[i]) - ref_altitude_cm(pa, p0s[i]));
+			if((double)pa / p0s[i] < 0.7){
+				worst_high = fmax(worst_high, e);
+			} else {
+				worst_low = fmax(worst_low, e);
+			}
+		}
+	}
+	printf("altitude: worst %.1f cm below 0.7 p0, %.1f cm above", worst_high, worst_low);
+	if(worst_high > 100 || worst_low > 10){
+		printf(", too far\n");
+		return -1;
+	}
+	printf(", ok\n");
+	return 0;
+}
+
+#define SAMPLES 1024
+
+int main(int argc, char * argv[]){
+	long iterations = argc > 1 ? atol(argv[1]) : 2000000;
+	static int32_t ut[SAMPLES], up[SAMPLES];
+	struct BMP180Calibration cal;
+	volatile int64_t sink = 0;
+	volatile double fsink = 0;
+	double start, int_ns, float_ns;
+#if HAVE_TSC
+	uint64_t tsc;
+	double int_cycles;
+#endif
+	unsigned i;
+	long n;
+
+	if(BMP180CalibrationParse(datasheet_eeprom, &cal)){
+		printf("datasheet calibration rejected\n");
+		return 1;
+	}
+	if(check_datasheet(&cal) || check_range(&cal) || check_altitude()){
+		return 1;
+	}
+
+	srand(1);
+	for(i = 0; i < SAMPLES; ++i){
+		ut[i] = 25000 + rand() % 8000;
+		up[i] = (20000 + rand() % 16000) << 3;
+	}
+
+	// a sample's worth: temperature, pressure at oss 3, altitude
+	start = now_ns();
+#if HAVE_TSC
+	tsc = __rdtsc();
+#endif
+	for(n = 0; n < iterations; ++n){
+		int32_t b5;
+		sink += BMP180Temperature(&cal, ut[n % SAMPLES], &b5);
+		sink += BMP180Altitude(BMP180Pressure(&cal, up[n % SAMPLES], 3, b5), BMP180_SEA_LEVEL_PA);
+	}
+#if HAVE_TSC
+	int_cycles = (double)(__rdtsc() - tsc) / iterations;
+#endif
+	int_ns = (now_ns() - start) / iterations;
+
+	start = now_ns();
+	for(n = 0; n < iterations; ++n){
+		double b5;
+		fsink += ref_temperature(&cal, ut[n % SAMPLES], &b5);
+		fsink += ref_altitude_cm(ref_pressure(&cal, up[n % SAMPLES], 3, b5), BMP180_SEA_LEVEL_PA);
+	}
+	float_ns = (now_ns() - start) / iterations;
+
+	printf("per sample: integer %.1f ns", int_ns);
+#if HAVE_TSC
+	printf(" (%.0f TSC cycles)", int_cycles);
+#endif
+	printf(", double and pow() %.1f ns\n", float_ns);
+	return 0;
+}
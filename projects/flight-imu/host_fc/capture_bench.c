@@ -0,0 +1,277 @@
+/*
+ * capture_bench.c
+ *
+ * Sends ADIS sized batched datagrams over loopback and receives them two
+ * ways: the way si_fc used to, one recvfrom() per datagram and a CSV line
+ * per sample, and through fc_capture. Prints how many each kept up with,
+ * then reads the capture file back and checks every datagram in it.
+ *
+ * usage: capture_bench [-n datagrams] [-r datagrams per second, 0 for flat out]
+ */
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+#include "fc_capture.h"
+
+#define PORT          36100
+#define SAMPLES       10
+#define SAMPLE_FIELDS 12
+#define DATAGRAM      (sizeof(uint32_t) + sizeof(uint16_t) + SAMPLES * SAMPLE_FIELDS * sizeof(uint16_t))
+#define CSV_FILE      "capture_bench.csv"
+#define CAPTURE_FILE  "capture_bench.cap"
+
+struct sender {
+	long          count;
+	long          rate;
+	volatile bool done;
+	double        elapsed;
+};
+
+static double now_s(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static uint16_t field(uint32_t seq, int i) {
+	return (uint16_t) (seq * 31 + i);
+}
+
+static void make_datagram(uint8_t* p, uint32_t seq) {
+	uint32_t nseq   = htonl(seq);
+	uint16_t ncount = htons(SAMPLES);
+	int i;
+
+	memcpy(p, &nseq, sizeof(nseq));
+	memcpy(p + sizeof(nseq), &ncount, sizeof(ncount));
+	for(i = 0; i < SAMPLES * SAMPLE_FIELDS; ++i) {
+		uint16_t f = htons(field(seq, i));
+		memcpy(p + sizeof(nseq) + sizeof(ncount) + i * sizeof(f), &f, sizeof(f));
+	}
+}
+
+static int loopback_socket(bool bound) {
+	struct sockaddr_in sa;
+	int s = socket(AF_INET, SOCK_DGRAM, 0);
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sin_family      = AF_INET;
+	sa.sin_port        = htons(PORT);
+	sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if(s < 0) {
+		return -1;
+	}
+	if(bound ? bind(s, (struct sockaddr*) &sa, sizeof(sa)) : connect(s, (struct sockaddr*) &sa, sizeof(sa))) {
+		close(s);
+		return -1;
+	}
+	return s;
+}
+
+static void* sender_thread(void* ptr) {
+	struct sender* s = ptr;
+	uint8_t buf[DATAGRAM];
+	int fd = loopback_socket(false);
+	double start = now_s();
+	long i;
+
+	if(fd < 0) {
+		perror("sender socket");
+		exit(1);
+	}
+	for(i = 0; i < s->count; ++i) {
+		if(s->rate > 0) {
+			while(now_s() - start < (double) i / s->rate) {
+				;
+			}
+		}
+		make_datagram(buf, i);
+		if(send(fd, buf, sizeof(buf), 0) < 0 && errno != ENOBUFS && errno != ECONNREFUSED) {
+			perror("send");
+			exit(1);
+		}
+	}
+	s->elapsed = now_s() - start;
+	close(fd);
+	// anything still queued gets a moment to arrive
+	usleep(300000);
+	s->done = true;
+	return NULL;
+}
+
+static void start_sender(struct sender* s, pthread_t* t) {
+	s->done = false;
+	if(pthread_create(t, NULL, sender_thread, s)) {
+		perror("pthread_create");
+		exit(1);
+	}
+}
+
+/* One recvfrom(), and one gettimeofday() and fprintf() per sample */
+static long run_legacy(struct sender* s) {
+	struct timeval tv = { .tv_sec = 0, .tv_usec = 100000 };
+	uint8_t buf[FC_RECV_MAXLEN];
+	int fd = loopback_socket(true);
+	FILE* fp = fopen(CSV_FILE, "w");
+	pthread_t t;
+	long received = 0;
+
+	if(fd < 0 || fp == NULL) {
+		perror("legacy setup");
+		exit(1);
+	}
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+	start_sender(s, &t);
+
+	while(!s->done) {
+		struct sockaddr_storage from;
+		socklen_t fromlen = sizeof(from);
+		int n = recvfrom(fd, buf, sizeof(buf), 0, (struct sockaddr*) &from, &fromlen);
+		int k, j;
+
+		if(n < 0) {
+			continue;
+		}
+		++received;
+		for(k = 0; k < SAMPLES; ++k) {
+			struct timeval now;
+			uint16_t f[SAMPLE_FIELDS];
+
+			for(j = 0; j < SAMPLE_FIELDS; ++j) {
+				memcpy(&f[j], buf + 6 + (k * SAMPLE_FIELDS + j) * 2, 2);
+				f[j] = ntohs(f[j]);
+			}
+			gettimeofday(&now, NULL);
+			fprintf(fp, "ADIS,%f,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d\n",
+			        now.tv_sec + now.tv_usec * .000001,
+			        f[4], f[5], f[6], f[1], f[2], f[3], f[7], f[8], f[9], f[10]);
+		}
+		fflush(fp);
+	}
+	pthread_join(t, NULL);
+	fclose(fp);
+	close(fd);
+	unlink(CSV_FILE);
+	return received;
+}
+
+static long run_capture(struct sender* s, struct fc_receiver* rx, struct fc_writer* w) {
+	int fd = loopback_socket(true);
+	pthread_t t;
+
+	if(fd < 0 || fc_recv_init(rx, fd) < 0 || fc_writer_open(w, CAPTURE_FILE) < 0) {
+		perror("capture setup");
+		exit(1);
+	}
+	start_sender(s, &t);
+
+	while(true) {
+		int n = fc_recv_poll(rx, w, NULL, NULL);
+		if(n < 0) {
+			perror("fc_recv_poll");
+			exit(1);
+		}
+		if(n == 0 && s->done) {
+			break;
+		}
+	}
+	pthread_join(t, NULL);
+	if(fc_writer_close(w) < 0) {
+		perror("fc_writer_close");
+		exit(1);
+	}
+	close(fd);
+	return rx->datagrams;
+}
+
+/* Every record has to be a datagram we sent, in order, with the right data */
+static int verify(long expect) {
+	struct fc_record r;
+	uint8_t data[FC_RECV_MAXLEN], want[DATAGRAM];
+	FILE* f = fc_capture_open(CAPTURE_FILE);
+	long records = 0;
+	long last = -1;
+	uint64_t last_t = 0;
+	int ret;
+
+	if(f == NULL) {
+		perror(CAPTURE_FILE);
+		return -1;
+	}
+	while((ret = fc_capture_next(f, &r, data)) == 1) {
+		uint32_t seq;
+		memcpy(&seq, data, sizeof(seq));
+		seq = ntohl(seq);
+		make_datagram(want, seq);
+
+		if(r.len != DATAGRAM || memcmp(data, want, DATAGRAM) != 0) {
+			printf("record %ld: wrong contents\n", records);
+			return -1;
+		}
+		if((long) seq <= last || r.t_ns < last_t || r.port == 0 || (r.flags & FC_RECORD_TRUNCATED)) {
+			printf("record %ld: seq %u after %ld\n", records, seq, last);
+			return -1;
+		}
+		last   = seq;
+		last_t = r.t_ns;
+		++records;
+	}
+	fclose(f);
+	unlink(CAPTURE_FILE);
+	if(ret < 0 || records != expect) {
+		printf("capture has %ld records, expected %ld\n", records, expect);
+		return -1;
+	}
+	return 0;
+}
+
+static void report(const char* name, const struct sender* s, long received) {
+	printf("%-8s %8ld sent in %6.3f s, %8ld received, %6.2f%% lost\n",
+	       name, s->count, s->elapsed, received, 100.0 * (s->count - received) / s->count);
+}
+
+int main(int argc, char* argv[]) {
+	static struct fc_receiver rx;
+	struct fc_writer w;
+	struct sender s = { .count = 200000, .rate = 0 };
+	int opt;
+
+	while((opt = getopt(argc, argv, "n:r:")) != -1) {
+		switch(opt) {
+		case 'n':
+			s.count = atol(optarg);
+			break;
+		case 'r':
+			s.rate = atol(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-n datagrams] [-r datagrams per second]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	report("legacy", &s, run_legacy(&s));
+	long received = run_capture(&s, &rx, &w);
+	report("capture", &s, received);
+	printf("         %lu batches, %.1f datagrams each, largest %u, rcvbuf %d, %lu records dropped by the writer\n",
+	       (unsigned long) rx.batches, rx.batches ? (double) rx.datagrams / rx.batches : 0.0,
+	       rx.largest_batch, rx.rcvbuf, (unsigned long) w.dropped);
+
+	if(verify(received - w.dropped) < 0) {
+		printf("capture file check failed\n");
+		return 1;
+	}
+	printf("capture file checked\n");
+	return 0;
+}
@@ -0,0 +1,280 @@
+/*
+ * mux_bench.c
+ *
+ * Sends numbered datagrams over loopback from many nodes at once, each a
+ * socket bound to an address and port of its own, plus one node the mux
+ * doesn't know, and receives them all through fc_mux. Prints what each
+ * stream and thread got and checks the books: every datagram is counted
+ * once, against the right stream, in the order it was sent, and the
+ * captures hold every datagram the writers didn't drop.
+ *
+ * usage: mux_bench [-s nodes] [-t threads] [-c first cpu] [-n datagrams per node]
+ *                  [-r datagrams per second, 0 for flat out]
+ */
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "fc_mux.h"
+
+#define PORT           36110
+#define NODE_PORT      40000
+#define MAX_NODES      64
+#define DATAGRAM       64
+#define CAPTURE_PREFIX "mux_bench"
+
+struct node {
+	int      fd;
+	long     sent;
+	uint32_t next;          // receive side, only the stream's thread writes it
+	long     out_of_order;
+};
+
+static struct node      nodes[MAX_NODES + 1];   // the last one is unknown to the mux
+static struct fc_stream streams[MAX_NODES];
+static char             names[MAX_NODES][16];
+
+static double now_s(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static uint32_t node_addr(int i) {
+	return htonl(INADDR_LOOPBACK + 0x100 + i);     // 127.0.1.i
+}
+
+static int node_socket(int i) {
+	struct sockaddr_in sa;
+	int s = socket(AF_INET, SOCK_DGRAM, 0);
+
+	if(s < 0) {
+		return -1;
+	}
+	memset(&sa, 0, sizeof(sa));
+	sa.sin_family      = AF_INET;
+	sa.sin_port        = htons(NODE_PORT + i);
+	sa.sin_addr.s_addr = node_addr(i);
+	if(bind(s, (struct sockaddr*) &sa, sizeof(sa)) < 0) {
+		close(s);
+		return -1;
+	}
+	sa.sin_port        = htons(PORT);
+	sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if(connect(s, (struct sockaddr*) &sa, sizeof(sa)) < 0) {
+		close(s);
+		return -1;
+	}
+	return s;
+}
+
+static void on_datagram(struct fc_stream* s, const struct fc_record* r, const uint8_t* data, void* user) {
+	struct node* n;
+	uint32_t     seq;
+
+	(void) user;
+	if(s == NULL || r->len != DATAGRAM) {
+		return;
+	}
+	n = &nodes[s - streams];
+	memcpy(&seq, data, sizeof(seq));
+	seq = ntohl(seq);
+	if(seq < n->next) {
+		++n->out_of_order;
+	}
+	n->next = seq + 1;
+}
+
+/* Round robin over the nodes, so every stream is busy at once */
+static double send_all(int count, long per_node, long rate) {
+	uint8_t buf[DATAGRAM];
+	double  start = now_s();
+	long    i, sent = 0;
+	int     k;
+
+	memset(buf, 0, sizeof(buf));
+	for(i = 0; i < per_node; ++i) {
+		uint32_t seq = htonl(i);
+		memcpy(buf, &seq, sizeof(seq));
+		for(k = 0; k < count; ++k, ++sent) {
+			if(rate > 0) {
+				while(now_s() - start < (double) sent / rate) {
+					;
+				}
+			}
+			if(send(nodes[k].fd, buf, sizeof(buf), 0) < 0) {
+				if(errno != ENOBUFS && errno != ECONNREFUSED) {
+					perror("send");
+					exit(1);
+				}
+				continue;
+			}
+			++nodes[k].sent;
+		}
+	}
+	return now_s() - start;
+}
+
+/* The captures together have to hold what the writers kept, all 64 bytes each */
+static int verify_captures(const struct fc_mux* m) {
+	struct fc_record r;
+	uint8_t data[FC_RECV_MAXLEN];
+	char path[64];
+	uint64_t expect = 0, records = 0;
+	unsigned i;
+	int ret;
+
+	for(i = 0; i < m->config.threads; ++i) {
+		FILE* f;
+
+		expect += m->thread[i].writer.records;
+		snprintf(path, sizeof(path), "%s.%u.cap", CAPTURE_PREFIX, i);
+		f = fc_capture_open(path);
+		if(f == NULL) {
+			perror(path);
+			return -1;
+		}
+		while((ret = fc_capture_next(f, &r, data)) == 1) {
+			if(r.len != DATAGRAM) {
+				printf("%s: record of %u bytes\n", path, r.len);
+				return -1;
+			}
+			++records;
+		}
+		fclose(f);
+		unlink(path);
+		if(ret < 0) {
+			printf("%s: cut short or corrupt\n", path);
+			return -1;
+		}
+	}
+	if(records != expect) {
+		printf("captures hold %llu records, writers wrote %llu\n",
+		       (unsigned long long) records, (unsigned long long) expect);
+		return -1;
+	}
+	return 0;
+}
+
+int main(int argc, char* argv[]) {
+	static struct fc_mux m;
+	uint16_t port = PORT;
+	struct fc_mux_config c = {
+		.ports     = &port,
+		.nports    = 1,
+		.streams   = streams,
+		.threads   = 2,
+		.first_cpu = -1,
+		.capture   = CAPTURE_PREFIX,
+		.fn        = on_datagram,
+	};
+	int       count = 16;
+	long      per_node = 20000, rate = 0;
+	long      sent = 0, received = 0, unknown = 0, thread_total = 0, dropped = 0;
+	uint64_t  max_delay = 0;
+	double    elapsed;
+	bool      ok = true;
+	int       opt, i;
+
+	while((opt = getopt(argc, argv, "s:t:c:n:r:")) != -1) {
+		switch(opt) {
+		case 's':
+			count = atoi(optarg);
+			break;
+		case 't':
+			c.threads = atoi(optarg);
+			break;
+		case 'c':
+			c.first_cpu = atoi(optarg);
+			break;
+		case 'n':
+			per_node = atol(optarg);
+			break;
+		case 'r':
+			rate = atol(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-s nodes] [-t threads] [-c first cpu] [-n datagrams per node] "
+			        "[-r datagrams per second]\n", argv[0]);
+			return 1;
+		}
+	}
+	if(count < 1 || count > MAX_NODES) {
+		fprintf(stderr, "between 1 and %d nodes\n", MAX_NODES);
+		return 1;
+	}
+
+	for(i = 0; i <= count; ++i) {
+		nodes[i].fd = node_socket(i);
+		if(nodes[i].fd < 0) {
+			perror("node socket");
+			return 1;
+		}
+		if(i < count) {
+			snprintf(names[i], sizeof(names[i]), "node%d", i);
+			streams[i].name = names[i];
+			streams[i].addr = node_addr(i);
+			streams[i].port = NODE_PORT + i;
+		}
+	}
+	c.nstreams = count;
+
+	if(fc_mux_start(&m, &c) < 0) {
+		perror("fc_mux_start");
+		return 1;
+	}
+	elapsed = send_all(count + 1, per_node, rate);
+	// anything still queued gets a moment to arrive
+	usleep(300000);
+	if(fc_mux_stop(&m) < 0) {
+		perror("fc_mux_stop");
+		ok = false;
+	}
+	fc_mux_report(&m, stdout);
+
+	for(i = 0; i < count; ++i) {
+		struct fc_stream_stats st;
+		fc_stream_stats_read(&streams[i], &st);
+		sent     += nodes[i].sent;
+		received += st.datagrams;
+		if(st.max_delay_ns > max_delay) {
+			max_delay = st.max_delay_ns;
+		}
+		if((long) st.datagrams > nodes[i].sent || nodes[i].out_of_order) {
+			printf("%s: %llu received of %ld sent, %ld out of order\n", streams[i].name,
+			       (unsigned long long) st.datagrams, nodes[i].sent, nodes[i].out_of_order);
+			ok = false;
+		}
+	}
+	for(i = 0; i < (int) c.threads; ++i) {
+		thread_total += m.thread[i].datagrams;
+		unknown      += m.thread[i].unknown;
+		dropped      += m.thread[i].writer.dropped;
+	}
+	if(received + unknown != thread_total || unknown > nodes[count].sent) {
+		printf("streams %ld + unknown %ld != threads %ld\n", received, unknown, thread_total);
+		ok = false;
+	}
+
+	printf("%d nodes, %u threads: %ld sent in %.3f s, %ld received, %.2f%% lost, max delay %.1f us\n",
+	       count, c.threads, sent, elapsed, received, 100.0 * (sent - received) / sent, max_delay / 1000.0);
+	printf("unknown node: %ld sent, %ld received; %ld records dropped by the writers\n",
+	       nodes[count].sent, unknown, dropped);
+
+	if(verify_captures(&m) < 0) {
+		ok = false;
+	}
+	for(i = 0; i <= count; ++i) {
+		close(nodes[i].fd);
+	}
+	printf(ok ? "books balance\n" : "books don't balance\n");
+	return !ok;
+}
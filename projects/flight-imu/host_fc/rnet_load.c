@@ -0,0 +1,809 @@
+/*
+ * rnet_load.c
+ *
+ * Stands in for a whole RocketNet, or several, so FC side receivers can be
+ * pushed without boards. Every emulated node sends what the firmware does,
+ * from the RocketNet ports, in the same datagrams:
+ *
+ *     adis      sensor node, seqBatch of ADIS16405Data, ~8 per datagram
+ *     bmp       sensor node, seqBatch of BMP180Data, 4 per datagram
+ *     rnh_batt  RNH, one BQ3060Data per datagram
+ *     rnh_port  RNH, one rnhPortCurrent per datagram
+ *     gps       GPS, packetizer datagrams of MAX2769 samples
+ *
+ * each starting with its 32 bit sequence number. Sends can be given jitter,
+ * loss in bursts (the sequence numbers, and the GPS offsets, skip what was
+ * lost like they would on the wire) and can go out in bursts.
+ *
+ * By default the nodes are on loopback, node i at 127.0.(i+1).x where x is
+ * the last byte of its RocketNet address, and fc_mux receives them in this
+ * process: the report then has the receiver's sustained throughput, second
+ * by second, and what it dropped, its own and the kernel's. With -o the
+ * datagrams go to a receiver elsewhere, si_fc say, to compare with its own
+ * report; -R sends one RocketNet from the real addresses, which have to be
+ * configured on an interface here.
+ *
+ * usage: rnet_load [-n nodes] [-d seconds] [-x rate scale] [-g GPS bytes per second]
+ *                  [-j jitter us] [-l loss %] [-b loss burst] [-k send burst]
+ *                  [-s streams] [-t sender threads] [-r receiver threads] [-c first cpu]
+ *                  [-o fc address[:port]] [-R]
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <sys/socket.h>
+
+#include "fc_mux.h"
+#include "fc_streams.h"
+#include "packetizer.h"
+#include "swap_plan.h"
+
+#define MAX_NODES       (FC_MUX_SLOTS / 2 / KINDS)   // as many streams as fc_mux takes
+#define MAX_THREADS     16
+#define MAX_DATAGRAM    1472                // ETH_MTU less the IP and UDP headers
+#define GPS_DATAGRAM    MAX_DATAGRAM        // GPS_DATAGRAM in flight-gps/main.c
+#define GPS_RATE        2046000             // bytes/s, 16.368 MHz one bit samples
+
+/* Copies of the firmware structs, the device headers need ChibiOS */
+typedef struct ADIS16405Data {
+	uint16_t supply_out;
+	int16_t xgyro_out;
+	int16_t ygyro_out;
+	int16_t zgyro_out;
+	int16_t xaccl_out;
+	int16_t yaccl_out;
+	int16_t zaccl_out;
+	int16_t xmagn_out;
+	int16_t ymagn_out;
+	int16_t zmagn_out;
+	int16_t temp_out;
+	uint16_t aux_adc;
+} ADIS16405Data;
+
+struct BMP180Data {
+	uint32_t pressure;
+	uint16_t temperature;
+};
+
+struct BQ3060Data {
+	uint16_t Temperature;
+	int16_t TS1Temperature;
+	int16_t TS2Temperature;
+	uint16_t TempRange;
+	uint16_t Voltage;
+	int16_t Current;
+	int16_t AverageCurrent;
+	uint16_t CellVoltage1;
+	uint16_t CellVoltage2;
+	uint16_t CellVoltage3;
+	uint16_t CellVoltage4;
+	uint16_t PackVoltage;
+	uint16_t AverageVoltage;
+};
+
+struct rnhPortCurrent {
+	uint16_t current[8];
+};
+
+/* As in flight-imu/main.c and flight-rnh/main.c */
+static const struct swap adis_swaps[] = {
+	SWAP_FIELD(ADIS16405Data, supply_out),
+	SWAP_FIELD(ADIS16405Data, xgyro_out),
+	SWAP_FIELD(ADIS16405Data, ygyro_out),
+	SWAP_FIELD(ADIS16405Data, zgyro_out),
+	SWAP_FIELD(ADIS16405Data, xaccl_out),
+	SWAP_FIELD(ADIS16405Data, yaccl_out),
+	SWAP_FIELD(ADIS16405Data, zaccl_out),
+	SWAP_FIELD(ADIS16405Data, xmagn_out),
+	SWAP_FIELD(ADIS16405Data, ymagn_out),
+	SWAP_FIELD(ADIS16405Data, zmagn_out),
+	SWAP_FIELD(ADIS16405Data, temp_out),
+	SWAP_FIELD(ADIS16405Data, aux_adc),
+	{0},
+};
+
+static const struct swap bmp_swaps[] = {
+	SWAP_FIELD(struct BMP180Data, pressure),
+	SWAP_FIELD(struct BMP180Data, temperature),
+	{0},
+};
+
+static const struct swap BQ3060_swaps[] = {
+	SWAP_FIELD(struct BQ3060Data, Temperature),
+	SWAP_FIELD(struct BQ3060Data, TS1Temperature),
+	SWAP_FIELD(struct BQ3060Data, TS2Temperature),
+	SWAP_FIELD(struct BQ3060Data, TempRange),
+	SWAP_FIELD(struct BQ3060Data, Voltage),
+	SWAP_FIELD(struct BQ3060Data, Current),
+	SWAP_FIELD(struct BQ3060Data, AverageCurrent),
+	SWAP_FIELD(struct BQ3060Data, CellVoltage1),
+	SWAP_FIELD(struct BQ3060Data, CellVoltage2),
+	SWAP_FIELD(struct BQ3060Data, CellVoltage3),
+	SWAP_FIELD(struct BQ3060Data, CellVoltage4),
+	SWAP_FIELD(struct BQ3060Data, PackVoltage),
+	SWAP_FIELD(struct BQ3060Data, AverageVoltage),
+	{0},
+};
+
+static const struct swap port_swaps[] = {
+	SWAP_ARRAY(struct rnhPortCurrent, current),
+	{0},
+};
+
+enum kind_id { ADIS, BMP, RNH_BATT, RNH_PORT, GPS, KINDS };
+
+struct kind {
+	const char*        name;
+	uint32_t           addr;       // RocketNet address, network order
+	uint16_t           port;
+	const struct swap* swaps;      // NULL for the GPS stream
+	unsigned           batch;      // samples per seqBatch, 0 for one per seqWrite
+	double             rate;       // datagrams per second
+	bool               on;
+	struct swap_plan   plan;
+};
+
+/* Rates are what the firmware sends: ADIS at 819Hz goes out on the 10ms
+ * batch latency, the BMP180 pump gives ~50 samples a second, the BQ3060
+ * timer runs at 1Hz and the port currents at their default sample rate.
+ */
+static struct kind kinds[KINDS] = {
+	[ADIS]     = { "adis",     FC_SENSOR_IP, 35020, adis_swaps,   8, 819.2 / 8, true },
+	[BMP]      = { "bmp",      FC_SENSOR_IP, 35011, bmp_swaps,    4, 50.0 / 4,  true },
+	[RNH_BATT] = { "rnh_batt", FC_RNH_IP,    36101, BQ3060_swaps, 0, 1,         true },
+	[RNH_PORT] = { "rnh_port", FC_RNH_IP,    36102, port_swaps,   0, 1000,      true },
+	[GPS]      = { "gps",      FC_GPS_IP,    35050, NULL,         0, 0,         true },
+};
+
+/* One socket of one emulated node */
+struct flow {
+	const struct kind* kind;
+	unsigned           node;
+	int                fd;
+	uint64_t           nominal_ns;  // when its next burst is due, jitter aside
+	uint64_t           due_ns;
+	uint64_t           period_ns;   // between bursts
+	uint32_t           seq;
+	uint64_t           offset;      // GPS stream offset
+	uint32_t           sample;
+	unsigned           losing;      // datagrams still to lose in this loss burst
+
+	// sender side, only its sender thread writes these
+	uint64_t           sent;
+	uint64_t           lost;        // on purpose
+	uint64_t           errors;
+	uint64_t           bytes;
+
+	// receive side, only the stream's mux thread writes these
+	uint64_t           received;
+	uint64_t           out_of_order;
+	uint32_t           next_seq;
+};
+
+struct sender {
+	pthread_t    thread;
+	unsigned     index;
+	unsigned*    heap;              // flow indexes, soonest due first
+	unsigned     n;
+	uint32_t     random;
+	uint64_t     sent;              // read by main while running
+};
+
+struct config {
+	unsigned  nodes;
+	double    seconds;
+	double    jitter_us;
+	double    loss;                 // chance a datagram starts a loss burst
+	unsigned  loss_burst;
+	unsigned  send_burst;
+	unsigned  threads;
+	bool      real;
+	struct sockaddr_in fc;
+};
+
+static struct config      cfg;
+static struct flow        flows[MAX_NODES * KINDS];
+static unsigned           nflows;
+static struct fc_stream   streams[MAX_NODES * KINDS];
+static char               names[MAX_NODES * KINDS][24];
+static struct sender      senders[MAX_THREADS];
+static uint64_t           start_ns, end_ns;
+
+static uint64_t now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void sleep_until(uint64_t ns) {
+	struct timespec ts = { .tv_sec = ns / 1000000000ull, .tv_nsec = ns % 1000000000ull };
+	while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+		;
+	}
+}
+
+/* xorshift32, each sender has its own */
+static uint32_t next_random(uint32_t* r) {
+	*r ^= *r << 13;
+	*r ^= *r >> 17;
+	*r ^= *r << 5;
+	return *r;
+}
+
+static double uniform(uint32_t* r) {
+	return next_random(r) / 4294967296.0;
+}
+
+static uint32_t node_addr(const struct kind* k, unsigned node) {
+	if(cfg.real) {
+		return k->addr;
+	}
+	return htonl(INADDR_LOOPBACK | (node + 1) << 8 | (ntohl(k->addr) & 0xff));
+}
+
+static int flow_socket(const struct flow* f) {
+	struct sockaddr_in sa;
+	int s = socket(AF_INET, SOCK_DGRAM, 0);
+
+	if(s < 0) {
+		return -1;
+	}
+	memset(&sa, 0, sizeof(sa));
+	sa.sin_family      = AF_INET;
+	sa.sin_port        = htons(f->kind->port);
+	sa.sin_addr.s_addr = node_addr(f->kind, f->node);
+	if(bind(s, (struct sockaddr*) &sa, sizeof(sa)) < 0
+	   || connect(s, (struct sockaddr*) &cfg.fc, sizeof(cfg.fc)) < 0) {
+		close(s);
+		return -1;
+	}
+	return s;
+}
+
+/* Something that changes from sample to sample, in every field */
+static void fill_sample(const struct flow* f, void* sample) {
+	uint16_t v = f->sample + f->node;
+	unsigned i;
+
+	switch(f->kind - kinds) {
+	case ADIS: {
+		ADIS16405Data* d = sample;
+		d->supply_out = 0x0814;
+		d->xgyro_out = d->ygyro_out = d->zgyro_out = v;
+		d->xaccl_out = d->yaccl_out = d->zaccl_out = -v;
+		d->xmagn_out = d->ymagn_out = d->zmagn_out = v >> 4;
+		d->temp_out = 0x10;
+		d->aux_adc = v;
+		break;
+	}
+	case BMP: {
+		struct BMP180Data* d = sample;
+		d->pressure = 101325 - v;
+		d->temperature = 250 + (v & 0xff);
+		break;
+	}
+	case RNH_BATT: {
+		struct BQ3060Data* d = sample;
+		uint16_t* w = (uint16_t*) d;
+		for(i = 0; i < sizeof(*d) / sizeof(*w); ++i) {
+			w[i] = v + i;
+		}
+		break;
+	}
+	case RNH_PORT: {
+		struct rnhPortCurrent* d = sample;
+		for(i = 0; i < 8; ++i) {
+			d->current[i] = v + i;
+		}
+		break;
+	}
+	}
+}
+
+/* Writes the flow's next datagram into buf, as the node would. Returns its
+ * length.
+ */
+static size_t build(struct flow* f, uint8_t* buf) {
+	const struct kind* k = f->kind;
+	union {
+		ADIS16405Data         adis;
+		struct BMP180Data     bmp;
+		struct BQ3060Data     batt;
+		struct rnhPortCurrent port;
+	} sample;
+	uint32_t seq = f->seq++;
+	size_t len;
+	unsigned i;
+
+	if(k->swaps == NULL) {
+		// packetizer datagram, the samples themselves don't matter here
+		packetizerPutHeader(buf, seq, f->offset);
+		f->offset += GPS_DATAGRAM - PACKETIZER_HEADER;
+		return GPS_DATAGRAM;
+	}
+
+	seq = htonl(seq);
+	memcpy(buf, &seq, sizeof(seq));
+	if(k->batch == 0) {
+		fill_sample(f, &sample);
+		++f->sample;
+		swap_plan_write(&k->plan, &sample, buf + sizeof(seq));
+		return sizeof(seq) + k->plan.len;
+	}
+
+	uint16_t count = htons(k->batch);
+	memcpy(buf + sizeof(seq), &count, sizeof(count));
+	len = sizeof(seq) + sizeof(count);
+	for(i = 0; i < k->batch; ++i, len += k->plan.len) {
+		fill_sample(f, &sample);
+		++f->sample;
+		swap_plan_write(&k->plan, &sample, buf + len);
+	}
+	return len;
+}
+
+static void send_one(struct sender* t, struct flow* f) {
+	uint8_t buf[MAX_DATAGRAM];
+	size_t len = build(f, buf);
+
+	if(f->losing) {
+		--f->losing;
+		++f->lost;
+		return;
+	}
+	if(cfg.loss > 0 && uniform(&t->random) < cfg.loss) {
+		f->losing = cfg.loss_burst - 1;
+		++f->lost;
+		return;
+	}
+	if(send(f->fd, buf, len, 0) < 0) {
+		if(errno != ENOBUFS && errno != ECONNREFUSED && errno != EAGAIN) {
+			perror("send");
+			exit(1);
+		}
+		++f->errors;
+		return;
+	}
+	++f->sent;
+	f->bytes += len;
+	__atomic_add_fetch(&t->sent, 1, __ATOMIC_RELAXED);
+}
+
+static void schedule(struct sender* t, struct flow* f) {
+	f->nominal_ns += f->period_ns;
+	f->due_ns = f->nominal_ns;
+	if(cfg.jitter_us > 0) {
+		f->due_ns += (uint64_t) (uniform(&t->random) * cfg.jitter_us * 1000);
+	}
+}
+
+static bool sooner(const struct sender* t, unsigned a, unsigned b) {
+	return flows[t->heap[a]].due_ns < flows[t->heap[b]].due_ns;
+}
+
+static void swap_heap(struct sender* t, unsigned a, unsigned b) {
+	unsigned x = t->heap[a];
+	t->heap[a] = t->heap[b];
+	t->heap[b] = x;
+}
+
+static void sift_down(struct sender* t, unsigned i) {
+	while(true) {
+		unsigned l = 2 * i + 1, r = l + 1, m = i;
+		if(l < t->n && sooner(t, l, m)) {
+			m = l;
+		}
+		if(r < t->n && sooner(t, r, m)) {
+			m = r;
+		}
+		if(m == i) {
+			return;
+		}
+		swap_heap(t, i, m);
+		i = m;
+	}
+}
+
+static void* sender_main(void* arg) {
+	struct sender* t = arg;
+	unsigned i;
+
+	for(i = t->n / 2; i-- > 0;) {
+		sift_down(t, i);
+	}
+	while(t->n) {
+		struct flow* f = &flows[t->heap[0]];
+
+		if(f->due_ns >= end_ns) {
+			break;
+		}
+		if(f->due_ns > now_ns()) {
+			sleep_until(f->due_ns);
+		}
+		for(i = 0; i < cfg.send_burst; ++i) {
+			send_one(t, f);
+		}
+		schedule(t, f);
+		sift_down(t, 0);
+	}
+	return NULL;
+}
+
+static void on_datagram(struct fc_stream* s, const struct fc_record* r, const uint8_t* data, void* user) {
+	struct flow* f;
+	uint32_t seq;
+
+	(void) user;
+	if(s == NULL || r->len < sizeof(seq)) {
+		return;
+	}
+	f = &flows[s - streams];
+	memcpy(&seq, data, sizeof(seq));
+	seq = ntohl(seq);
+	if(f->received++ && seq < f->next_seq) {
+		++f->out_of_order;
+	} else {
+		f->next_seq = seq + 1;
+	}
+}
+
+/* The kernel's UDP receive buffer overflows, from /proc/net/snmp */
+static long udp_rcvbuf_errors(void) {
+	char head[512], vals[512];
+	char *h, *v, *hs, *vs;
+	long ret = -1;
+	FILE* f = fopen("/proc/net/snmp", "r");
+
+	if(f == NULL) {
+		return -1;
+	}
+	while(fgets(head, sizeof(head), f) && fgets(vals, sizeof(vals), f)) {
+		if(strncmp(head, "Udp:", 4) != 0) {
+			continue;
+		}
+		h = strtok_r(head, " \n", &hs);
+		v = strtok_r(vals, " \n", &vs);
+		while(h && v) {
+			if(strcmp(h, "RcvbufErrors") == 0) {
+				ret = atol(v);
+			}
+			h = strtok_r(NULL, " \n", &hs);
+			v = strtok_r(NULL, " \n", &vs);
+		}
+		break;
+	}
+	fclose(f);
+	return ret;
+}
+
+static uint64_t total_received(void) {
+	struct fc_stream_stats st;
+	uint64_t n = 0;
+	unsigned i;
+
+	for(i = 0; i < nflows; ++i) {
+		fc_stream_stats_read(&streams[i], &st);
+		n += st.datagrams;
+	}
+	return n;
+}
+
+static uint64_t total_sent(void) {
+	uint64_t n = 0;
+	unsigned i;
+
+	for(i = 0; i < cfg.threads; ++i) {
+		n += __atomic_load_n(&senders[i].sent, __ATOMIC_RELAXED);
+	}
+	return n;
+}
+
+static int parse_fc(const char* arg) {
+	char host[64];
+	const char* colon = strchr(arg, ':');
+	size_t n = colon ? (size_t) (colon - arg) : strlen(arg);
+
+	if(n >= sizeof(host)) {
+		return -1;
+	}
+	memcpy(host, arg, n);
+	host[n] = '\0';
+	cfg.fc.sin_family = AF_INET;
+	cfg.fc.sin_port = htons(colon ? atoi(colon + 1) : FC_LISTEN_PORT);
+	return inet_pton(AF_INET, host, &cfg.fc.sin_addr) == 1 ? 0 : -1;
+}
+
+static int select_streams(char* list) {
+	char* save;
+	char* name;
+	int i;
+
+	for(i = 0; i < KINDS; ++i) {
+		kinds[i].on = false;
+	}
+	for(name = strtok_r(list, ",", &save); name; name = strtok_r(NULL, ",", &save)) {
+		for(i = 0; i < KINDS && strcmp(kinds[i].name, name) != 0; ++i) {
+			;
+		}
+		if(i == KINDS) {
+			return -1;
+		}
+		kinds[i].on = true;
+	}
+	return 0;
+}
+
+static void usage(const char* name) {
+	fprintf(stderr, "usage: %s [-n nodes] [-d seconds] [-x rate scale] [-g GPS bytes per second]\n"
+	        "       [-j jitter us] [-l loss %%] [-b loss burst] [-k send burst]\n"
+	        "       [-s streams] [-t sender threads] [-r receiver threads] [-c first cpu]\n"
+	        "       [-o fc address[:port]] [-R]\n"
+	        "streams are a comma separated list of adis,bmp,rnh_batt,rnh_port,gps\n", name);
+}
+
+int main(int argc, char* argv[]) {
+	static struct fc_mux m;
+	uint16_t port = FC_LISTEN_PORT;
+	struct fc_mux_config mc = {
+		.ports     = &port,
+		.nports    = 1,
+		.streams   = streams,
+		.threads   = 2,
+		.first_cpu = -1,
+		.fn        = on_datagram,
+	};
+	double scale = 1, gps_rate = GPS_RATE, per_s_min = INFINITY, per_s_max = 0, elapsed;
+	uint64_t last, next_s, sent = 0, lost = 0, errors = 0, received = 0, late = 0, bytes = 0;
+	long kernel_before, kernel_after;
+	bool local = true, ok = true;
+	unsigned i, node, seconds = 0;
+	int opt;
+
+	cfg.nodes = 1;
+	cfg.seconds = 5;
+	cfg.loss_burst = 1;
+	cfg.send_burst = 1;
+	cfg.threads = 1;
+	cfg.fc.sin_family = AF_INET;
+	cfg.fc.sin_port = htons(FC_LISTEN_PORT);
+	cfg.fc.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	while((opt = getopt(argc, argv, "n:d:x:g:j:l:b:k:s:t:r:c:o:R")) != -1) {
+		switch(opt) {
+		case 'n':
+			cfg.nodes = atoi(optarg);
+			break;
+		case 'd':
+			cfg.seconds = atof(optarg);
+			break;
+		case 'x':
+			scale = atof(optarg);
+			break;
+		case 'g':
+			gps_rate = atof(optarg);
+			break;
+		case 'j':
+			cfg.jitter_us = atof(optarg);
+			break;
+		case 'l':
+			cfg.loss = atof(optarg) / 100;
+			break;
+		case 'b':
+			cfg.loss_burst = atoi(optarg);
+			break;
+		case 'k':
+			cfg.send_burst = atoi(optarg);
+			break;
+		case 's':
+			if(select_streams(optarg) < 0) {
+				usage(argv[0]);
+				return 1;
+			}
+			break;
+		case 't':
+			cfg.threads = atoi(optarg);
+			break;
+		case 'r':
+			mc.threads = atoi(optarg);
+			break;
+		case 'c':
+			mc.first_cpu = atoi(optarg);
+			break;
+		case 'o':
+			if(parse_fc(optarg) < 0) {
+				fprintf(stderr, "bad fc address %s\n", optarg);
+				return 1;
+			}
+			local = false;
+			break;
+		case 'R':
+			cfg.real = true;
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if(cfg.nodes < 1 || cfg.nodes > MAX_NODES || (cfg.real && cfg.nodes != 1)) {
+		fprintf(stderr, "between 1 and %d nodes, and only one with -R\n", MAX_NODES);
+		return 1;
+	}
+	if(cfg.threads < 1 || cfg.threads > MAX_THREADS || cfg.loss_burst < 1 || cfg.send_burst < 1
+	   || scale <= 0 || cfg.seconds <= 0) {
+		usage(argv[0]);
+		return 1;
+	}
+	if(local && cfg.real) {
+		fprintf(stderr, "-R needs -o, the real addresses aren't on loopback\n");
+		return 1;
+	}
+	kinds[GPS].rate = gps_rate / (GPS_DATAGRAM - PACKETIZER_HEADER);
+
+	for(i = 0; i < KINDS; ++i) {
+		if(kinds[i].swaps && swap_plan_compile(kinds[i].swaps, &kinds[i].plan) < 0) {
+			fprintf(stderr, "%s: swap table doesn't compile\n", kinds[i].name);
+			return 1;
+		}
+	}
+
+	// the flows, dealt out to the sender threads in turn
+	for(node = 0; node < cfg.nodes; ++node) {
+		for(i = 0; i < KINDS; ++i) {
+			struct flow* f = &flows[nflows];
+			if(!kinds[i].on || kinds[i].rate <= 0) {
+				continue;
+			}
+			f->kind = &kinds[i];
+			f->node = node;
+			f->period_ns = 1e9 * cfg.send_burst / (kinds[i].rate * scale);
+			f->fd = flow_socket(f);
+			if(f->fd < 0) {
+				perror(kinds[i].name);
+				return 1;
+			}
+			snprintf(names[nflows], sizeof(names[nflows]), "%s.%u", kinds[i].name, node);
+			streams[nflows].name = names[nflows];
+			streams[nflows].addr = node_addr(&kinds[i], node);
+			streams[nflows].port = kinds[i].port;
+			++nflows;
+		}
+	}
+	if(nflows == 0) {
+		fprintf(stderr, "no streams\n");
+		return 1;
+	}
+	mc.nstreams = nflows;
+	for(i = 0; i < cfg.threads; ++i) {
+		senders[i].index = i;
+		senders[i].random = 0x9e3779b9u * (i + 1);
+		senders[i].heap = calloc(nflows, sizeof(unsigned));
+	}
+
+	if(local && fc_mux_start(&m, &mc) < 0) {
+		perror("fc_mux_start");
+		return 1;
+	}
+	kernel_before = udp_rcvbuf_errors();
+
+	// every flow starts somewhere in its first period so they don't line up
+	start_ns = now_ns() + 10000000;
+	end_ns = start_ns + (uint64_t) (cfg.seconds * 1e9);
+	for(i = 0; i < nflows; ++i) {
+		struct sender* t = &senders[i % cfg.threads];
+		flows[i].nominal_ns = start_ns + (uint64_t) (uniform(&t->random) * flows[i].period_ns);
+		flows[i].due_ns = flows[i].nominal_ns;
+		t->heap[t->n++] = i;
+	}
+	for(i = 0; i < cfg.threads; ++i) {
+		if(pthread_create(&senders[i].thread, NULL, sender_main, &senders[i]) != 0) {
+			perror("pthread_create");
+			return 1;
+		}
+	}
+
+	// throughput second by second, what the receiver got or else what was sent
+	sleep_until(start_ns);
+	last = 0;
+	for(next_s = start_ns + 1000000000ull; next_s <= end_ns; next_s += 1000000000ull, ++seconds) {
+		uint64_t n;
+		sleep_until(next_s);
+		n = local ? total_received() : total_sent();
+		if(n - last < per_s_min) {
+			per_s_min = n - last;
+		}
+		if(n - last > per_s_max) {
+			per_s_max = n - last;
+		}
+		last = n;
+	}
+	for(i = 0; i < cfg.threads; ++i) {
+		pthread_join(senders[i].thread, NULL);
+	}
+	elapsed = (now_ns() - start_ns) / 1e9;
+	if(local) {
+		// anything still queued gets a moment to arrive
+		usleep(300000);
+		if(fc_mux_stop(&m) < 0) {
+			perror("fc_mux_stop");
+			ok = false;
+		}
+	}
+	kernel_after = udp_rcvbuf_errors();
+
+	printf("%-9s %10s %10s %8s %10s %10s %6s %10s\n", "stream", "sent", "lost", "errors",
+	       "received", "dropped", "late", "kB/s");
+	for(i = 0; i < KINDS; ++i) {
+		uint64_t ks = 0, kl = 0, ke = 0, kr = 0, klate = 0, kb = 0;
+		unsigned j;
+
+		if(!kinds[i].on) {
+			continue;
+		}
+		for(j = 0; j < nflows; ++j) {
+			if(flows[j].kind != &kinds[i]) {
+				continue;
+			}
+			ks += flows[j].sent;
+			kl += flows[j].lost;
+			ke += flows[j].errors;
+			kr += flows[j].received;
+			klate += flows[j].out_of_order;
+			kb += flows[j].bytes;
+			if(local && flows[j].received > flows[j].sent) {
+				printf("%s: received %llu of %llu sent\n", names[j],
+				       (unsigned long long) flows[j].received, (unsigned long long) flows[j].sent);
+				ok = false;
+			}
+		}
+		if(local) {
+			printf("%-9s %10llu %10llu %8llu %10llu %10llu %6llu %10.1f\n", kinds[i].name,
+			       (unsigned long long) ks, (unsigned long long) kl, (unsigned long long) ke,
+			       (unsigned long long) kr, (unsigned long long) (ks - kr), (unsigned long long) klate,
+			       kb / elapsed / 1000);
+		} else {
+			printf("%-9s %10llu %10llu %8llu %10s %10s %6s %10.1f\n", kinds[i].name,
+			       (unsigned long long) ks, (unsigned long long) kl, (unsigned long long) ke,
+			       "-", "-", "-", kb / elapsed / 1000);
+		}
+		sent += ks;
+		lost += kl;
+		errors += ke;
+		received += kr;
+		late += klate;
+		bytes += kb;
+	}
+
+	printf("%u node%s, %u flows, %u sender threads: %llu datagrams, %.2f MB/s sent over %.2f s\n",
+	       cfg.nodes, cfg.nodes > 1 ? "s" : "", nflows, cfg.threads, (unsigned long long) sent,
+	       bytes / elapsed / 1e6, elapsed);
+	if(seconds) {
+		printf("%s per second: min %.0f, mean %.0f, max %.0f\n", local ? "received" : "sent",
+		       per_s_min, (double) last / seconds, per_s_max);
+	}
+	if(local) {
+		printf("receiver: %llu datagrams, dropped %llu (%.3f%%), %llu late, %u threads\n",
+		       (unsigned long long) received, (unsigned long long) (sent - received),
+		       sent ? 100.0 * (sent - received) / sent : 0.0, (unsigned long long) late, mc.threads);
+	}
+	if(kernel_before >= 0 && kernel_after >= 0) {
+		printf("kernel UDP receive buffer drops: %ld, every UDP socket on this host\n",
+		       kernel_after - kernel_before);
+	}
+
+	for(i = 0; i < nflows; ++i) {
+		close(flows[i].fd);
+	}
+	for(i = 0; i < cfg.threads; ++i) {
+		free(senders[i].heap);
+	}
+	return !ok;
+}
@@ -137,6 +137,16 @@ struct ADIS_packet {
 } __attribute__((packed));
 typedef struct ADIS_packet ADIS_packet;
 
+/*! \typedef
+ * Head of a batched ADIS datagram, see SeqBatch in common/net/utils_sockets.h.
+ * count ADIS16405_burst_data samples follow, everything in network order.
+ */
+struct ADIS_batch_head {
+    uint32_t             seq;
+    uint16_t             count;
+} __attribute__((packed));
+typedef struct ADIS_batch_head ADIS_batch_head;
+
 #endif
 
 
@@ -0,0 +1,208 @@
+/*! \file si_fc_csv.c
+ *
+ * Turns si_fc captures into the per sensor CSV logs si_fc used to write
+ * as it went: adis16405_log.txt, mpu9150_log.txt and mpl3115a2_log.txt.
+ * The timestamp on each line is when the host's kernel received the
+ * datagram, so every sample in an ADIS batch shares its batch's time.
+ * Each si_fc receive thread writes a capture of its own; the records of
+ * all of them are merged back into receive time order.
+ *
+ * usage: si_fc_csv [capture files, default si_fc.0.cap]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+
+#include <arpa/inet.h>
+
+#include "fc_net.h"
+#include "fc_capture.h"
+
+#include "device_net.h"
+#include "si_fc.h"
+
+static double record_time(const struct fc_record* r) {
+	return r->t_ns / 1000000000ULL + (r->t_ns % 1000000000ULL) * .000000001;
+}
+
+/*! \brief Copy one ADIS sample out of a datagram
+ *
+ * The sensor node sends every field in network byte order.
+ */
+static void adis_sample_from_net(ADIS16405_burst_data* d, const uint8_t* p) {
+	uint16_t       field;
+	adis_reg_data* out = (adis_reg_data*) d;
+	unsigned int   i;
+
+	for(i = 0; i < sizeof(*d) / sizeof(adis_reg_data); ++i) {
+		memcpy(&field, p + i * sizeof(field), sizeof(field));
+		out[i] = ntohs(field);
+	}
+}
+
+static FILE* open_log(const char* path, const char* name, const char* columns) {
+	FILE* fp = fopen(path, "w");
+
+	if(fp == NULL) {
+		perror(path);
+		exit(1);
+	}
+	fprintf(fp, "# %s data\n", name);
+	fprintf(fp, "# %s raw data\n", name);
+	fprintf(fp, "# %s\n", columns);
+	return fp;
+}
+
+/*! \return samples written, or -1 if the datagram isn't a whole batch */
+static int adis_csv(FILE* fp, const struct fc_record* r, const uint8_t* data) {
+	ADIS_batch_head      head;
+	ADIS16405_burst_data d;
+	uint16_t             count, k;
+
+	if(r->len < sizeof(ADIS_batch_head)) {
+		return -1;
+	}
+	memcpy(&head, data, sizeof(head));
+	count = ntohs(head.count);
+	if(r->len != sizeof(ADIS_batch_head) + count * sizeof(ADIS16405_burst_data)) {
+		return -1;
+	}
+
+	for(k = 0; k < count; ++k) {
+		adis_sample_from_net(&d, data + sizeof(ADIS_batch_head) + k * sizeof(ADIS16405_burst_data));
+		fprintf(fp, "ADIS,%f,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d\n",
+		        record_time(r),
+		        d.adis_xaccl_out, d.adis_yaccl_out, d.adis_zaccl_out,
+		        d.adis_xgyro_out, d.adis_ygyro_out, d.adis_zgyro_out,
+		        d.adis_xmagn_out, d.adis_ymagn_out, d.adis_zmagn_out,
+		        d.adis_temp_out);
+	}
+	return count;
+}
+
+static int mpu_csv(FILE* fp, const struct fc_record* r, const uint8_t* data) {
+	MPU_packet        p;
+	MPU9150_read_data d;
+
+	if(r->len != sizeof(MPU_packet)) {
+		return -1;
+	}
+	memcpy(&p, data, sizeof(p));
+	d = p.data;
+	fprintf(fp, "%c%c%c%c,%f,%d,%d,%d,%d,%d,%d,%d\n",
+	        p.ID[0], p.ID[1], p.ID[2], p.ID[3],
+	        record_time(r),
+	        d.accel_xyz.x, d.accel_xyz.y, d.accel_xyz.z,
+	        d.gyro_xyz.x, d.gyro_xyz.y, d.gyro_xyz.z,
+	        d.celsius);
+	return 1;
+}
+
+static int mpl_csv(FILE* fp, const struct fc_record* r, const uint8_t* data) {
+	MPL_packet          p;
+	MPL3115A2_read_data d;
+
+	if(r->len != sizeof(MPL_packet)) {
+		return -1;
+	}
+	memcpy(&p, data, sizeof(p));
+	d = p.data;
+	fprintf(fp, "%c%c%c%c,%f,%d,%d\n",
+	        p.ID[0], p.ID[1], p.ID[2], p.ID[3],
+	        record_time(r),
+	        d.mpu_pressure,
+	        d.mpu_temperature);
+	return 1;
+}
+
+/* One capture being merged, with its next record read ahead */
+struct capture {
+	const char*      path;
+	FILE*            f;
+	int              ret;
+	struct fc_record r;
+	uint8_t          data[FC_RECV_MAXLEN];
+};
+
+static void capture_next(struct capture* c) {
+	c->ret = fc_capture_next(c->f, &c->r, c->data);
+	if(c->ret < 0) {
+		fprintf(stderr, "%s: cut short or corrupt, stopped there\n", c->path);
+	}
+}
+
+/*! \return the capture with the earliest next record, or NULL when all are done */
+static struct capture* capture_earliest(struct capture* c, int n) {
+	struct capture* first = NULL;
+	int             i;
+
+	for(i = 0; i < n; ++i) {
+		if(c[i].ret == 1 && (first == NULL || c[i].r.t_ns < first->r.t_ns)) {
+			first = &c[i];
+		}
+	}
+	return first;
+}
+
+int main(int argc, char* argv[]) {
+	static const char* default_path = "si_fc.0.cap";
+	struct capture*  caps;
+	struct capture*  c;
+	int              ncaps = argc > 1 ? argc - 1 : 1;
+	FILE             *fp_adis, *fp_mpu, *fp_mpl;
+	unsigned long    adis = 0, mpu = 0, mpl = 0, bad = 0, other = 0;
+	bool             failed = false;
+	int              i, n;
+
+	caps = calloc(ncaps, sizeof(*caps));
+	if(caps == NULL) {
+		perror("calloc");
+		return 1;
+	}
+	for(i = 0; i < ncaps; ++i) {
+		caps[i].path = argc > 1 ? argv[i + 1] : default_path;
+		caps[i].f    = fc_capture_open(caps[i].path);
+		if(caps[i].f == NULL) {
+			perror(caps[i].path);
+			return 1;
+		}
+		capture_next(&caps[i]);
+	}
+	fp_adis = open_log("adis16405_log.txt", "adis16405 IMU", "timestamp,ax,ay,az,gx,gy,gz,mx,my,mz,C");
+	fp_mpu  = open_log("mpu9150_log.txt", "mpu9150 IMU", "timestamp,ax,ay,az,gx,gy,gz,C");
+	fp_mpl  = open_log("mpl3115a2_log.txt", "mpl3115a2 Pressure Sensor", "timestamp,P,T");
+
+	while((c = capture_earliest(caps, ncaps)) != NULL) {
+		if(c->r.port == IMU_A_TX_PORT_ADIS) {
+			n = adis_csv(fp_adis, &c->r, c->data);
+			adis += n > 0 ? n : 0;
+		} else if(c->r.port == IMU_A_TX_PORT_MPU) {
+			n = mpu_csv(fp_mpu, &c->r, c->data);
+			mpu += n > 0 ? n : 0;
+		} else if(c->r.port == IMU_A_TX_PORT_MPL) {
+			n = mpl_csv(fp_mpl, &c->r, c->data);
+			mpl += n > 0 ? n : 0;
+		} else {
+			++other;
+			n = 0;
+		}
+		if(n < 0) {
+			++bad;
+		}
+		capture_next(c);
+	}
+
+	for(i = 0; i < ncaps; ++i) {
+		failed |= caps[i].ret < 0;
+		fclose(caps[i].f);
+	}
+	free(caps);
+	fclose(fp_adis);
+	fclose(fp_mpu);
+	fclose(fp_mpl);
+	printf("%lu ADIS, %lu MPU, %lu MPL samples; %lu bad datagrams, %lu from other ports\n",
+	       adis, mpu, mpl, bad, other);
+	return failed;
+}
@@ -0,0 +1,263 @@
+/*
+ * swap_bench.c
+ *
+ * Checks that compiled swap plans produce the same packets as the table
+ * walking write_swapped() for the sensor structs we send, that
+ * swap_plan_read() round trips them, and times both.
+ *
+ * usage: swap_bench [iterations]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "swap_plan.h"
+
+/* Copies of the firmware structs, the device headers need ChibiOS */
+typedef struct ADIS16405Data {
+	uint16_t supply_out;
+	int16_t xgyro_out;
+	int16_t ygyro_out;
+	int16_t zgyro_out;
+	int16_t xaccl_out;
+	int16_t yaccl_out;
+	int16_t zaccl_out;
+	int16_t xmagn_out;
+	int16_t ymagn_out;
+	int16_t zmagn_out;
+	int16_t temp_out;
+	uint16_t aux_adc;
+} ADIS16405Data;
+
+struct BMP180Data {
+	uint32_t pressure;
+	uint16_t temperature;
+};
+
+struct BQ3060Data {
+	uint16_t Temperature;
+	int16_t TS1Temperature;
+	int16_t TS2Temperature;
+	uint16_t TempRange;
+	uint16_t Voltage;
+	int16_t Current;
+	int16_t AverageCurrent;
+	uint16_t CellVoltage1;
+	uint16_t CellVoltage2;
+	uint16_t CellVoltage3;
+	uint16_t CellVoltage4;
+	uint16_t PackVoltage;
+	uint16_t AverageVoltage;
+};
+
+struct rnhPortCurrent {
+	uint16_t current[8];
+};
+
+struct MPL3115A2Data {
+	uint8_t status;
+	uint32_t pressure;
+	int16_t temperature;
+};
+
+static const struct swap adis_swaps[] = {
+	SWAP_FIELD(ADIS16405Data, supply_out),
+	SWAP_FIELD(ADIS16405Data, xgyro_out),
+	SWAP_FIELD(ADIS16405Data, ygyro_out),
+	SWAP_FIELD(ADIS16405Data, zgyro_out),
+	SWAP_FIELD(ADIS16405Data, xaccl_out),
+	SWAP_FIELD(ADIS16405Data, yaccl_out),
+	SWAP_FIELD(ADIS16405Data, zaccl_out),
+	SWAP_FIELD(ADIS16405Data, xmagn_out),
+	SWAP_FIELD(ADIS16405Data, ymagn_out),
+	SWAP_FIELD(ADIS16405Data, zmagn_out),
+	SWAP_FIELD(ADIS16405Data, temp_out),
+	SWAP_FIELD(ADIS16405Data, aux_adc),
+	{0},
+};
+
+static const struct swap bmp_swaps[] = {
+	SWAP_FIELD(struct BMP180Data, pressure),
+	SWAP_FIELD(struct BMP180Data, temperature),
+	{0},
+};
+
+static const struct swap BQ3060_swaps[] = {
+	SWAP_FIELD(struct BQ3060Data, Temperature),
+	SWAP_FIELD(struct BQ3060Data, TS1Temperature),
+	SWAP_FIELD(struct BQ3060Data, TS2Temperature),
+	SWAP_FIELD(struct BQ3060Data, TempRange),
+	SWAP_FIELD(struct BQ3060Data, Voltage),
+	SWAP_FIELD(struct BQ3060Data, Current),
+	SWAP_FIELD(struct BQ3060Data, AverageCurrent),
+	SWAP_FIELD(struct BQ3060Data, CellVoltage1),
+	SWAP_FIELD(struct BQ3060Data, CellVoltage2),
+	SWAP_FIELD(struct BQ3060Data, CellVoltage3),
+	SWAP_FIELD(struct BQ3060Data, CellVoltage4),
+	SWAP_FIELD(struct BQ3060Data, PackVoltage),
+	SWAP_FIELD(struct BQ3060Data, AverageVoltage),
+	{0},
+};
+
+static const struct swap port_swaps[] = {
+	SWAP_ARRAY(struct rnhPortCurrent, current),
+	{0}
+};
+
+static const struct swap mpl_swaps[] = {
+	SWAP_FIELD(struct MPL3115A2Data, status),
+	SWAP_FIELD(struct MPL3115A2Data, pressure),
+	SWAP_FIELD(struct MPL3115A2Data, temperature),
+	{0},
+};
+
+/* write_swapped() and len_swapped() as in common/util/utils_general.c */
+static void swap(int length, const void * in, void * out){
+	switch(length){
+	case 1:
+		*(uint8_t *) out = *(const uint8_t *) in;
+		break;
+	case 2:
+		*(uint16_t *) out = __builtin_bswap16(*(const uint16_t *) in);
+		break;
+	case 4:
+		*(uint32_t *) out = __builtin_bswap32(*(const uint32_t *) in);
+		break;
+	}
+}
+
+static size_t len_swapped(const struct swap *swaps){
+	size_t len = 0;
+	while(swaps->length){
+		len += swaps->length * swaps->elements;
+		++swaps;
+	}
+	return len;
+}
+
+static void write_swapped(const struct swap *swaps, const void *data, uint8_t *buffer){
+	while(swaps->length){
+		for(size_t i = 0; i < swaps->elements; ++i) {
+			size_t index = i * swaps->length;
+			const char *current = (const char *) data + swaps->offset + index;
+			swap(swaps->length, current, buffer);
+			buffer += swaps->length;
+		}
+		++swaps;
+	}
+}
+
+struct table {
+	const char * name;
+	const struct swap * swaps;
+	size_t size;
+};
+
+static const struct table tables[] = {
+	{"ADIS16405", adis_swaps, sizeof(ADIS16405Data)},
+	{"BMP180", bmp_swaps, sizeof(struct BMP180Data)},
+	{"BQ3060", BQ3060_swaps, sizeof(struct BQ3060Data)},
+	{"RNH port", port_swaps, sizeof(struct rnhPortCurrent)},
+	{"MPL3115A2", mpl_swaps, sizeof(struct MPL3115A2Data)},
+};
+
+#define SAMPLES 256
+
+static double now_ns(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* Checks bytes that the table covers, padding is left alone by both */
+static int check(const struct table * t, const struct swap_plan * plan, const uint8_t * data){
+	uint8_t legacy[128], planned[128], back[128], back_legacy[128];
+	const struct swap * s;
+
+	memset(legacy, 0xaa, sizeof(legacy));
+	memset(planned, 0x55, sizeof(planned));
+	write_swapped(t->swaps, data, legacy);
+	swap_plan_write(plan, data, planned);
+	if(memcmp(legacy, planned, plan->len)){
+		printf("%s: packets differ\n", t->name);
+		return -1;
+	}
+
+	memset(back, 0, sizeof(back));
+	memset(back_legacy, 0, sizeof(back_legacy));
+	swap_plan_read(plan, back, planned);
+	for(s = t->swaps; s->length; ++s){
+		memcpy(back_legacy + s->offset, data + s->offset, s->length * s->elements);
+	}
+	if(memcmp(back, back_legacy, t->size)){
+		printf("%s: read doesn't round trip\n", t->name);
+		return -1;
+	}
+	return 0;
+}
+
+int main(int argc, char * argv[]){
+	long iterations = argc > 1 ? atol(argv[1]) : 200000;
+	static uint8_t data[SAMPLES][128];
+	static uint8_t out[SAMPLES][128];
+	volatile uint8_t sink = 0;
+	unsigned i, t;
+	long n;
+
+	srand(1);
+	for(i = 0; i < SAMPLES; ++i){
+		for(t = 0; t < sizeof(data[i]); ++t){
+			data[i][t] = rand();
+		}
+	}
+
+#if defined(__SSSE3__)
+	printf("SSSE3 runs\n");
+#else
+	printf("word runs\n");
+#endif
+	printf("%-10s %5s %5s %12s %12s %8s\n", "table", "bytes", "runs",
+	       "legacy ns", "plan ns", "speedup");
+
+	for(t = 0; t < sizeof(tables) / sizeof(tables[0]); ++t){
+		const struct table * tb = &tables[t];
+		struct swap_plan plan;
+		double start, legacy_ns, plan_ns;
+
+		if(swap_plan_compile(tb->swaps, &plan)){
+			printf("%s: compile failed\n", tb->name);
+			return 1;
+		}
+		if(plan.len != len_swapped(tb->swaps)){
+			printf("%s: plan length %u, expected %zu\n", tb->name, plan.len,
+			       len_swapped(tb->swaps));
+			return 1;
+		}
+		for(i = 0; i < SAMPLES; ++i){
+			if(check(tb, &plan, data[i])){
+				return 1;
+			}
+		}
+
+		start = now_ns();
+		for(n = 0; n < iterations; ++n){
+			write_swapped(tb->swaps, data[n % SAMPLES], out[n % SAMPLES]);
+			sink ^= out[n % SAMPLES][0];
+		}
+		legacy_ns = (now_ns() - start) / iterations;
+
+		start = now_ns();
+		for(n = 0; n < iterations; ++n){
+			swap_plan_write(&plan, data[n % SAMPLES], out[n % SAMPLES]);
+			sink ^= out[n % SAMPLES][0];
+		}
+		plan_ns = (now_ns() - start) / iterations;
+
+		printf("%-10s %5u %5u %12.1f %12.1f %7.2fx\n", tb->name, plan.len, plan.runs,
+		       legacy_ns, plan_ns, legacy_ns / plan_ns);
+	}
+	return 0;
+}
@@ -17,8 +17,19 @@
 #include "ADIS16405.h"
 #include "BMP180.h"
 
-static struct SeqSocket adis_socket = DECL_SEQ_SOCKET(sizeof(ADIS16405Data));
-static struct SeqSocket bmp_socket = DECL_SEQ_SOCKET(sizeof(struct BMP180Data));
+/* Samples are batched into datagrams of up to this many samples, waiting no
+ * longer than this many milliseconds for a batch to fill. At 819Hz an ADIS
+ * batch usually goes out on the latency limit with around 8 samples.
+ */
+#define ADIS_BATCH_SAMPLES 32
+#define ADIS_BATCH_MS 10
+#define BMP_BATCH_SAMPLES 4
+#define BMP_BATCH_MS 50
+
+static struct SeqSocket adis_socket = DECL_SEQ_SOCKET(SEQ_BATCH_BYTES(ADIS_BATCH_SAMPLES, sizeof(ADIS16405Data)));
+static struct SeqSocket bmp_socket = DECL_SEQ_SOCKET(SEQ_BATCH_BYTES(BMP_BATCH_SAMPLES, sizeof(struct BMP180Data)));
+static struct SeqBatch adis_batch;
+static struct SeqBatch bmp_batch;
 
 static const struct swap adis_swaps[] = {
 	SWAP_FIELD(ADIS16405Data, supply_out),
@@ -42,18 +53,31 @@ static const struct swap bmp_swaps[] = {
 	{0},
 };
 
+/* compiled from the tables above in main() */
+static struct swap_plan adis_plan;
+static struct swap_plan bmp_plan;
+
 static void adis_drdy_handler(eventid_t id UNUSED){
+	const ADIS16405Frame * frames;
 	ADIS16405Data data;
-	adis_get_data(&data);
-	write_swapped(adis_swaps, &data, adis_socket.buffer);
-	seqWrite(&adis_socket, len_swapped(adis_swaps));
+	unsigned count, i;
+
+	// send every frame that came in since the last event, not just the latest
+	while((count = adis_frames_acquire(&frames)) > 0){
+		for(i = 0; i < count; ++i){
+			adis_frame_decode(&frames[i], &data);
+			swap_plan_write(&adis_plan, &data, seqBatchNext(&adis_batch));
+			seqBatchCommit(&adis_batch);
+		}
+		adis_frames_release(count);
+	}
 }
 
 static void bmp_drdy_handler(eventid_t id UNUSED){
 	struct BMP180Data data;
 	BMP180_getSample(&data);
-	write_swapped(bmp_swaps, &data, bmp_socket.buffer);
-	seqWrite(&bmp_socket, len_swapped(bmp_swaps));
+	swap_plan_write(&bmp_plan, &data, seqBatchNext(&bmp_batch));
+	seqBatchCommit(&bmp_batch);
 }
 
 void bmpid(struct RCICmdData * cmd UNUSED, struct RCIRetData * ret, void * user UNUSED) {
@@ -75,6 +99,7 @@ void main(void){
 
 	struct RCICommand commands[] = {
 		RCI_CMD_VERS,
+		RCI_CMD_I2CS,
 		{"#BMID", bmpid, NULL},
 		{NULL}
 	};
@@ -93,6 +118,12 @@ void main(void){
 	connect(adis_socket.socket, FC_ADDR, sizeof(struct sockaddr));
 	connect(bmp_socket.socket, FC_ADDR, sizeof(struct sockaddr));
 
+	int swap_err = swap_plan_compile(adis_swaps, &adis_plan);
+	swap_err |= swap_plan_compile(bmp_swaps, &bmp_plan);
+	chDbgAssert(swap_err == 0, "swap plan failed", NULL);
+	seqBatchInit(&adis_batch, &adis_socket, adis_plan.len, MS2ST(ADIS_BATCH_MS));
+	seqBatchInit(&bmp_batch, &bmp_socket, bmp_plan.len, MS2ST(BMP_BATCH_MS));
+
 	adis_init(&adis_olimex_e407);
 	static struct BMP180Config conf = {
 		.i2cd = &I2CD2,
@@ -111,6 +142,9 @@ void main(void){
 	chEvtRegister(&BMP180DataEvt, &bmp_drdy, 1);
 	chEvtRegister(&BMP180Timer.et_es, &bmp_pump, 2);
 	while(TRUE){
-		chEvtDispatch(evhndl, chEvtWaitAny(ALL_EVENTS));
+		// wake up often enough to send batches that stopped filling
+		chEvtDispatch(evhndl, chEvtWaitAnyTimeout(ALL_EVENTS, MS2ST(ADIS_BATCH_MS)));
+		seqBatchPoll(&adis_batch);
+		seqBatchPoll(&bmp_batch);
 	}
 }
@@ -188,7 +188,7 @@ static void sdc_log_data(eventid_t id) {
 
             // calc checksum
             crc16                   = crc_init();
-            crc16                   = crc_update(crc16, (const unsigned char*) &datafile_state.log_data, sizeof(GENERIC_message));
+            crc16                   = crc_update(crc16, (const unsigned char*) &datafile_state.log_data, sdc_message_bytes(&datafile_state.log_data));
             crc16                   = crc_finalize(crc16);
 
             sdc_ret = sdc_write_checksum(&datafile_state.DATAFil, &crc16, &bw) ;
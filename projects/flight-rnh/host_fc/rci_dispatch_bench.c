@@ -0,0 +1,172 @@
+/*
+ * rci_dispatch_bench.c
+ *
+ * Checks rciDispatchFind() against a straightforward search of the command
+ * table and times it against the old linear strncmp() walk for tables the
+ * size of the RNH's and bigger.
+ *
+ * usage: rci_dispatch_bench [lookups]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "rci_dispatch.h"
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#define MAX_COMMANDS (RCI_DISPATCH_SLOTS / 2)
+#define REQUESTS 1024
+
+/* The RNH's table, then made up names to fill out bigger boards */
+static const char * rnh_names[] = {
+	"#TIME", "#YOLO", "#SAFE", "#RRDY", "#SLEP", "#UMBD", "#PORT", "#VERS",
+};
+
+static void nop(struct RCICmdData * cmd, struct RCIRetData * ret, void * user) {
+	(void) cmd;
+	(void) ret;
+	(void) user;
+}
+
+/* handle_command()'s search before the dispatch table */
+static struct RCICommand * linear_find(struct RCICommand * cmd, const char * data, int len) {
+	for(; cmd->name != NULL; ++cmd) {
+		if(cmd->function == NULL) {
+			break;
+		}
+		int rclen = strlen(cmd->name);
+		if(!strncmp(data, cmd->name, MIN(len, rclen))) {
+			return cmd;
+		}
+	}
+	return NULL;
+}
+
+/* What the lookup should find: the command whose whole name data starts with */
+static struct RCICommand * exact_find(struct RCICommand * cmd, const char * data, int len) {
+	for(; cmd->name != NULL; ++cmd) {
+		if(len >= RCI_NAME_LEN && !memcmp(data, cmd->name, RCI_NAME_LEN)) {
+			return cmd;
+		}
+	}
+	return NULL;
+}
+
+static double now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void build(struct RCICommand * table, char names[][RCI_NAME_LEN + 1], int n) {
+	int i;
+
+	for(i = 0; i < n; ++i) {
+		if(i < (int) (sizeof(rnh_names) / sizeof(rnh_names[0]))) {
+			strcpy(names[i], rnh_names[i]);
+		} else {
+			snprintf(names[i], RCI_NAME_LEN + 1, "#X%03d", i % 1000);
+		}
+		table[i].name     = names[i];
+		table[i].function = nop;
+		table[i].user     = NULL;
+	}
+	table[n].name     = NULL;
+	table[n].function = NULL;
+}
+
+static int check(struct RCIDispatch * d, struct RCICommand * table, int n) {
+	static const char * misses[] = {"", "#", "#TIM", "TIME#", "#time", "#ZZZZ", "#X99"};
+	char req[16];
+	int i;
+
+	for(i = 0; i < n; ++i) {
+		// the bare name, and the name with data after it
+		snprintf(req, sizeof(req), "%s", table[i].name);
+		if(rciDispatchFind(d, req, strlen(req)) != &table[i]) {
+			printf("%s not found\n", req);
+			return -1;
+		}
+		snprintf(req, sizeof(req), "%sA", table[i].name);
+		if(rciDispatchFind(d, req, strlen(req)) != &table[i]) {
+			printf("%s not found\n", req);
+			return -1;
+		}
+	}
+	for(i = 0; i < (int) (sizeof(misses) / sizeof(misses[0])); ++i) {
+		int len = strlen(misses[i]);
+		if(rciDispatchFind(d, misses[i], len) != exact_find(table, misses[i], len)) {
+			printf("\"%s\" matched a command\n", misses[i]);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+int main(int argc, char * argv[]) {
+	static const int sizes[] = {8, 16, 32};
+	long lookups = argc > 1 ? atol(argv[1]) : 10000000;
+	struct RCICommand table[MAX_COMMANDS + 1];
+	char names[MAX_COMMANDS][RCI_NAME_LEN + 1];
+	char requests[REQUESTS][16];
+	struct RCIDispatch d;
+	volatile uintptr_t sink = 0;
+	unsigned t;
+	long i;
+
+	// the old search takes #TI as #TIME, and an empty request as the first
+	// command
+	build(table, names, 8);
+	printf("linear \"#TI\" -> %s, \"\" -> %s\n",
+	       linear_find(table, "#TI", 3) ? linear_find(table, "#TI", 3)->name : "none",
+	       linear_find(table, "", 0) ? linear_find(table, "", 0)->name : "none");
+
+	// a bad table is refused
+	table[1].name = "#TIME";
+	if(rciDispatchInit(&d, table) == 0) {
+		printf("duplicate name accepted\n");
+		return 1;
+	}
+	table[1].name = "#YOLOX";
+	if(rciDispatchInit(&d, table) == 0) {
+		printf("six character name accepted\n");
+		return 1;
+	}
+
+	printf("%8s %14s %14s %8s\n", "commands", "linear ns", "dispatch ns", "speedup");
+	for(t = 0; t < sizeof(sizes) / sizeof(sizes[0]); ++t) {
+		int n = sizes[t];
+		double start, linear_ns, dispatch_ns;
+
+		build(table, names, n);
+		if(rciDispatchInit(&d, table) || check(&d, table, n)) {
+			printf("%d commands: failed\n", n);
+			return 1;
+		}
+
+		// requests spread evenly over the table, with a data byte
+		srand(n);
+		for(i = 0; i < REQUESTS; ++i) {
+			snprintf(requests[i], sizeof(requests[i]), "%sA", table[rand() % n].name);
+		}
+
+		start = now_ns();
+		for(i = 0; i < lookups; ++i) {
+			const char * req = requests[i % REQUESTS];
+			sink += (uintptr_t) linear_find(table, req, RCI_NAME_LEN + 1);
+		}
+		linear_ns = (now_ns() - start) / lookups;
+
+		start = now_ns();
+		for(i = 0; i < lookups; ++i) {
+			const char * req = requests[i % REQUESTS];
+			sink += (uintptr_t) rciDispatchFind(&d, req, RCI_NAME_LEN + 1);
+		}
+		dispatch_ns = (now_ns() - start) / lookups;
+
+		printf("%8d %14.1f %14.1f %7.1fx\n", n, linear_ns, dispatch_ns, linear_ns / dispatch_ns);
+	}
+	return 0;
+}
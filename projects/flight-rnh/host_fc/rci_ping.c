@@ -0,0 +1,170 @@
+/*
+ * rci_ping.c
+ *
+ * Round trip latency of RCI commands. Sends the same command count times
+ * over the UDP RCI and, with -T, over a single shot TCP connection per
+ * command as the ground station does today, then prints the latency
+ * distribution of each.
+ *
+ * usage: rci_ping [-n count] [-c command] [-t timeout ms] [-T] <board address> [port]
+ *
+ * The default command is #VERS, which any board answers and which has no
+ * side effects.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include "rci_udp.h"
+
+static double now_us(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static int tcp_call(const char * addr, int port, const char * cmd, char * reply, size_t replylen) {
+	struct sockaddr_in sa;
+	char    req[256];
+	size_t  got = 0;
+	ssize_t n;
+	int     s, one = 1;
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sin_family = AF_INET;
+	sa.sin_port   = htons(port);
+	inet_pton(AF_INET, addr, &sa.sin_addr);
+
+	s = socket(AF_INET, SOCK_STREAM, 0);
+	if(s < 0) {
+		return -1;
+	}
+	setsockopt(s, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	if(connect(s, (struct sockaddr *) &sa, sizeof(sa)) < 0) {
+		close(s);
+		return -1;
+	}
+	n = snprintf(req, sizeof(req), "%s\r\n", cmd);
+	if(write(s, req, n) != n) {
+		close(s);
+		return -1;
+	}
+	// single shot: the board closes once it has replied
+	while(got < replylen && (n = read(s, reply + got, replylen - got)) > 0) {
+		got += n;
+	}
+	close(s);
+	return (int) got;
+}
+
+static int cmp_double(const void * a, const void * b) {
+	double x = *(const double *) a, y = *(const double *) b;
+	return x < y ? -1 : x > y;
+}
+
+static void report(const char * name, double * us, int n, int failed) {
+	double total = 0;
+	int    i;
+
+	if(n == 0) {
+		printf("%-5s no replies, %d failed\n", name, failed);
+		return;
+	}
+	qsort(us, n, sizeof(*us), cmp_double);
+	for(i = 0; i < n; ++i) {
+		total += us[i];
+	}
+	printf("%-5s %6d ok %4d failed  min %8.1f  mean %8.1f  p50 %8.1f  p90 %8.1f  p99 %8.1f  max %8.1f us\n",
+	       name, n, failed, us[0], total / n, us[n / 2], us[n * 9 / 10], us[n * 99 / 100], us[n - 1]);
+}
+
+int main(int argc, char * argv[]) {
+	const char *   cmd       = "#VERS";
+	int            count     = 1000;
+	int            timeout   = 20;
+	int            tcp       = 0;
+	int            port      = RCI_UDP_PORT;
+	struct rci_udp c;
+	char           reply[RCI_UDP_MAX_REPLY];
+	double *       us;
+	int            opt, i, n, ok, failed;
+
+	while((opt = getopt(argc, argv, "n:c:t:T")) != -1) {
+		switch(opt) {
+		case 'n':
+			count = atoi(optarg);
+			break;
+		case 'c':
+			cmd = optarg;
+			break;
+		case 't':
+			timeout = atoi(optarg);
+			break;
+		case 'T':
+			tcp = 1;
+			break;
+		default:
+			goto usage;
+		}
+	}
+	if(optind >= argc || count <= 0) {
+		goto usage;
+	}
+	if(optind + 1 < argc) {
+		port = atoi(argv[optind + 1]);
+	}
+
+	us = malloc(count * sizeof(*us));
+	if(!us) {
+		return 1;
+	}
+
+	if(rci_udp_open(&c, argv[optind], port) < 0) {
+		perror("rci_udp_open");
+		return 1;
+	}
+	for(i = ok = failed = 0; i < count; ++i) {
+		double start = now_us();
+		n = rci_udp_call(&c, cmd, reply, sizeof(reply), timeout, 5);
+		if(n < 0) {
+			++failed;
+		} else {
+			us[ok++] = now_us() - start;
+		}
+	}
+	if(ok) {
+		n = rci_udp_call(&c, cmd, reply, sizeof(reply) - 1, timeout, 5);
+		if(n >= 0) {
+			reply[n < (int) sizeof(reply) - 1 ? n : (int) sizeof(reply) - 1] = '\0';
+			printf("%s -> %d bytes \"%s\"\n", cmd, n, reply);
+		}
+	}
+	report("udp", us, ok, failed);
+	printf("      %u retries, %u late replies dropped\n", c.retries, c.stale);
+	rci_udp_close(&c);
+
+	if(tcp) {
+		for(i = ok = failed = 0; i < count; ++i) {
+			double start = now_us();
+			if(tcp_call(argv[optind], port, cmd, reply, sizeof(reply)) < 0) {
+				++failed;
+			} else {
+				us[ok++] = now_us() - start;
+			}
+		}
+		report("tcp", us, ok, failed);
+	}
+	free(us);
+	return 0;
+
+usage:
+	fprintf(stderr, "usage: rci_ping [-n count] [-c command] [-t timeout ms] [-T] <board address> [port]\n");
+	return 1;
+}
@@ -0,0 +1,120 @@
+/*
+ * rci_udp.c
+ *
+ * Host side client for the UDP RCI, see rci_udp.h.
+ */
+
+#include <errno.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "rci_udp.h"
+
+#define ID_LEN sizeof(uint32_t)
+
+static long long now_ms(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+int rci_udp_open(struct rci_udp * c, const char * addr, int port) {
+	struct sockaddr_in sa;
+
+	memset(c, 0, sizeof(*c));
+	memset(&sa, 0, sizeof(sa));
+	sa.sin_family = AF_INET;
+	sa.sin_port   = htons(port);
+	if(inet_pton(AF_INET, addr, &sa.sin_addr) != 1) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	c->socket = socket(AF_INET, SOCK_DGRAM, 0);
+	if(c->socket < 0) {
+		return -1;
+	}
+	// connected, so the kernel drops datagrams from anyone else
+	if(connect(c->socket, (struct sockaddr *) &sa, sizeof(sa)) < 0) {
+		close(c->socket);
+		c->socket = -1;
+		return -1;
+	}
+
+	// ids only have to differ from the last few calls on the board's cache,
+	// starting somewhere random keeps a restarted client from matching them
+	srand(time(NULL) ^ getpid());
+	c->next_id = rand();
+	return 0;
+}
+
+void rci_udp_close(struct rci_udp * c) {
+	if(c->socket >= 0) {
+		close(c->socket);
+	}
+	c->socket = -1;
+}
+
+/* Waits for the reply to id until deadline, dropping any others */
+static int wait_reply(struct rci_udp * c, uint32_t id, char * reply, size_t replylen,
+                      long long deadline) {
+	uint8_t buf[ID_LEN + RCI_UDP_MAX_REPLY];
+	struct pollfd pfd = {.fd = c->socket, .events = POLLIN};
+	long long left;
+
+	while((left = deadline - now_ms()) > 0) {
+		if(poll(&pfd, 1, (int) left) <= 0) {
+			continue;
+		}
+		ssize_t n = recv(c->socket, buf, sizeof(buf), 0);
+		if(n < (ssize_t) ID_LEN) {
+			continue;
+		}
+		if(memcmp(buf, &id, ID_LEN)) {
+			++c->stale;
+			continue;
+		}
+		n -= ID_LEN;
+		memcpy(reply, buf + ID_LEN, (size_t) n < replylen ? (size_t) n : replylen);
+		return (int) n;
+	}
+	return -1;
+}
+
+int rci_udp_call(struct rci_udp * c, const char * cmd, char * reply, size_t replylen,
+                 int timeout_ms, int attempts) {
+	uint8_t  req[ID_LEN + RCI_UDP_MAX_REPLY];
+	size_t   len = strlen(cmd);
+	uint32_t id  = htonl(c->next_id++);
+	int      i, n;
+
+	if(len > RCI_UDP_MAX_REPLY) {
+		errno = EMSGSIZE;
+		return -1;
+	}
+	memcpy(req, &id, ID_LEN);
+	memcpy(req + ID_LEN, cmd, len);
+
+	++c->calls;
+	for(i = 0; i < attempts; ++i) {
+		if(i) {
+			++c->retries;
+		}
+		if(send(c->socket, req, ID_LEN + len, 0) < 0) {
+			return -1;
+		}
+		n = wait_reply(c, id, reply, replylen, now_ms() + timeout_ms);
+		if(n >= 0) {
+			return n;
+		}
+	}
+	++c->failures;
+	errno = ETIMEDOUT;
+	return -1;
+}
@@ -0,0 +1,45 @@
+/*
+ * rci_udp.h
+ *
+ * Host side client for the UDP RCI (RCICreateUDP() in common/net/rci.h).
+ *
+ *     struct rci_udp c;
+ *     char reply[RCI_UDP_MAX_REPLY];
+ *     rci_udp_open(&c, "10.0.0.5", RCI_UDP_PORT);
+ *     int n = rci_udp_call(&c, "#TIME", reply, sizeof(reply), 20, 5);
+ *
+ * Every call gets a new request id. A timed out attempt is resent with the
+ * same id, which the board answers from its reply cache rather than running
+ * the command again, so retrying commands like #RRDY A is safe.
+ */
+
+#ifndef RCI_UDP_H_
+#define RCI_UDP_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define RCI_UDP_PORT       23
+#define RCI_UDP_MAX_REPLY  1496   // ETH_MTU less the request id
+
+struct rci_udp {
+	int      socket;
+	uint32_t next_id;
+	uint32_t calls;
+	uint32_t retries;      // attempts resent after a timeout
+	uint32_t stale;        // replies to earlier ids that turned up late
+	uint32_t failures;     // calls that ran out of attempts
+};
+
+/* Returns 0, or -1 with errno set */
+int rci_udp_open(struct rci_udp * c, const char * addr, int port);
+void rci_udp_close(struct rci_udp * c);
+
+/* Sends cmd and waits up to timeout_ms for the reply, attempts times in all.
+ * Copies at most replylen bytes of the reply and returns its length, or -1
+ * if no reply came.
+ */
+int rci_udp_call(struct rci_udp * c, const char * cmd, char * reply, size_t replylen,
+                 int timeout_ms, int attempts);
+
+#endif
@@ -204,25 +204,27 @@ static const struct swap BQ3060_swaps[] = {
 	SWAP_FIELD(struct BQ3060Data, AverageVoltage),
 	{0},
 };
+static struct swap_plan BQ3060_plan;
 
 static void BQ3060_SendData(eventid_t id UNUSED){
 	struct BQ3060Data data;
 	BQ3060_get_data(&data);
-	write_swapped(BQ3060_swaps, &data, battery_socket.buffer);
-	seqWrite(&battery_socket, len_swapped(BQ3060_swaps));
+	swap_plan_write(&BQ3060_plan, &data, battery_socket.buffer);
+	seqWrite(&battery_socket, BQ3060_plan.len);
 }
 
 static const struct swap port_swaps[] = {
 	SWAP_ARRAY(struct rnhPortCurrent, current),
 	{0}
 };
+static struct swap_plan port_plan;
 
 static void portCurrent_SendData(eventid_t id UNUSED){
 	struct rnhPortCurrent sample;
 	rnhPortGetCurrentData(&sample);
 	sample.current[4] = BQ24725_IMON();
-	write_swapped(port_swaps, &sample, port_socket.buffer);
-	seqWrite(&port_socket, len_swapped(port_swaps));
+	swap_plan_write(&port_plan, &sample, port_socket.buffer);
+	seqWrite(&port_socket, port_plan.len);
 }
 
 static void batteryFault_Handler(eventid_t id UNUSED) {
@@ -268,6 +270,7 @@ void main(void) {
 		{UMBD, cmd_umbdet, NULL},
 		RCI_CMD_PORT,
 		RCI_CMD_VERS,
+		RCI_CMD_I2CS,
 		{NULL}
 	};
 
@@ -291,6 +294,7 @@ void main(void) {
 	//Init networking
 	lwipThreadStart(RNH_LWIP);
 	RCICreate(commands);
+	RCICreateUDP(commands);
 
 	// Set up sockets
 	seqSocket(&battery_socket, RNH_BATTERY_ADDR);
@@ -309,6 +313,10 @@ void main(void) {
 	connect(port_socket.socket, FC_ADDR, sizeof(struct sockaddr));
 	connect(alarm_socket.socket, FC_ADDR, sizeof(struct sockaddr));
 	connect(umbdet_socket.socket, FC_ADDR, sizeof(struct sockaddr));
+
+	int swap_err = swap_plan_compile(BQ3060_swaps, &BQ3060_plan);
+	swap_err |= swap_plan_compile(port_swaps, &port_plan);
+	chDbgAssert(swap_err == 0, DBG_PREFIX"Swap plan failed", NULL);
 	evtInit(&umbdebounce, MS2ST(25));
 	struct pin umbdetpin = {GPIOC, GPIO_C13_UMB_DETECT};
 	extAddCallback(&umbdetpin, EXT_CH_MODE_BOTH_EDGES | EXT_CH_MODE_AUTOSTART, umbdet_interrupt);
@@ -30,18 +30,24 @@ static const struct swap burst_swaps[] = {
 	SWAP_FIELD(struct MPL3115A2Data, temperature),
 	{0},
 };
+static struct swap_plan burst_plan;
 
 static void mpl_handler(eventid_t id UNUSED){
 
-	struct MPL3115A2Data data;
+	const struct MPL3115A2Sample * samples;
 	uint8_t buffer[7];
+	unsigned count, i;
 
 	palTogglePad(GPIOF, GPIOF_PIN14);
-	MPL3115A2GetData(&data);
-
-	write_swapped(burst_swaps, &data, buffer);
-	if(write(sendsocket, buffer, sizeof(buffer)) < 0){
-		ledError();
+	// one datagram per sample, as many as came in since the last event
+	while((count = MPL3115A2SamplesAcquire(&samples)) > 0){
+		for(i = 0; i < count; ++i){
+			swap_plan_write(&burst_plan, &samples[i].data, buffer);
+			if(write(sendsocket, buffer, sizeof(buffer)) < 0){
+				ledError();
+			}
+		}
+		MPL3115A2SamplesRelease(count);
 	}
 
 }
@@ -67,8 +73,12 @@ void main(void){
 	static struct MPL3115A2Config conf = {
 		.i2cd = &I2CD2,
 		.pins = {.SDA = {GPIOF, GPIOF_PIN0}, .SCL = {GPIOF, GPIOF_PIN1}},
-		.interrupt = {GPIOF, GPIOF_PIN3}
+		.interrupt = {GPIOF, GPIOF_PIN3},
+		.os = MPL_OS_8,       // 34ms conversions
 	};
+	if(swap_plan_compile(burst_swaps, &burst_plan)){
+		ledError();
+	}
 	MPL3115A2Start(&conf);
 
 	/* Manage MPL events */
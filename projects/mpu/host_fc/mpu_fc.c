@@ -29,6 +29,7 @@
 #include <unistd.h>
 
 #include "fc_net.h"
+#include "fc_capture.h"
 #include "device_net.h"
 #include "mpu_fc.h"
 
@@ -37,6 +38,7 @@
 #define         NUM_THREADS          1
 #define         TIMEBUFLEN           80
 #define         STRINGBUFLEN         80
+#define         CAPTURE_FILE         "mpu_fc.cap"
 
 static          pthread_mutex_t      msg_mutex;
 
@@ -52,20 +54,8 @@ static double mpu9150_temp_to_dC(int16_t raw_temp) {
 }
 
 
-struct timeval GetTimeStamp() {
-    struct timeval tv;
-    gettimeofday(&tv,NULL);
-    return tv;
-}
-
-static double timestamp_now() {
-	struct timeval tv;
-	double tstamp;
-
-	tv          = GetTimeStamp();
-	tstamp      = tv.tv_sec + (tv.tv_usec * .000001);
-
-	return tstamp;
+static double record_time(const struct fc_record* r) {
+	return r->t_ns / 1000000000ULL + (r->t_ns % 1000000000ULL) * .000000001;
 }
 
 /*!
@@ -151,6 +141,52 @@ static void init_thread_state(Ports* p, unsigned int i) {
 	p->thread_id = i;
 }
 
+/*! \brief Where show_datagram() logs and echoes to */
+struct Showtalk {
+	FILE*              fp;
+	int                clientsocket_fd;
+	struct addrinfo*   ai_client;
+};
+
+/*! \brief Print, log and echo each datagram as fc_recv_poll() captures it
+ */
+static void show_datagram(const struct fc_record* r, const uint8_t* recvbuf, void* ptr) {
+	struct Showtalk*          t = ptr;
+	char                      sbuf[PORT_STRING_LEN];
+	int                       numbytes;
+
+	snprintf(sbuf, sizeof(sbuf), "%u", r->port);
+	if(ports_equal(sbuf, IMU_A_TX_PORT)) {
+		printf("IMU Packet port %s\n", sbuf);
+	} else if (ports_equal(sbuf, ROLL_CTL_TX_PORT)) {
+		printf("\tROLL CTL Packet: port %s\n", sbuf);
+	} else {
+		printf("Unrecognized Packet port %s\n", sbuf);
+	}
+
+	printf("fc: size of data struct: %d\n", sizeof(MPU9150_read_data));
+	memcpy (&mpu9150_udp_data, recvbuf, sizeof (MPU9150_read_data));
+
+	printf("fc: packet is %d bytes long\n", r->len);
+	fprintf(t->fp, "%f,%d,%d,%d,%d,%d,%d,%3.2f\n",
+			record_time(r),
+			mpu9150_udp_data.accel_xyz.x,
+			mpu9150_udp_data.accel_xyz.y,
+			mpu9150_udp_data.accel_xyz.z,
+			mpu9150_udp_data.gyro_xyz.x,
+			mpu9150_udp_data.gyro_xyz.y,
+			mpu9150_udp_data.gyro_xyz.z,
+			mpu9150_temp_to_dC(mpu9150_udp_data.celsius) );
+
+	printf("\r\nraw_temp: %3.2f C\r\n", mpu9150_temp_to_dC(mpu9150_udp_data.celsius));
+	printf("ACCL:  x: %d\ty: %d\tz: %d\r\n", mpu9150_udp_data.accel_xyz.x, mpu9150_udp_data.accel_xyz.y, mpu9150_udp_data.accel_xyz.z);
+	printf("GRYO:  x: 0x%x\ty: 0x%x\tz: 0x%x\r\n", mpu9150_udp_data.gyro_xyz.x, mpu9150_udp_data.gyro_xyz.y, mpu9150_udp_data.gyro_xyz.z);
+	if ((numbytes = sendto(t->clientsocket_fd, recvbuf, r->len, 0,
+			t->ai_client->ai_addr, t->ai_client->ai_addrlen)) == -1) {
+		die_nice("client sendto");
+	}
+}
+
 /*! \brief Thread routine I/O
  *
  * @param ptr  pointer to Ports type with input and output ip address and port.
@@ -164,22 +200,20 @@ void *datap_io_thread (void* ptr) {
 	int                       retval;
 	int                       hostsocket_fd;
 	int                       clientsocket_fd;
-	int                       numbytes;
-	socklen_t                 addr_len;
 
 	char                      timestring[TIMEBUFLEN];
 	char                      ipstr[INET6_ADDRSTRLEN];
-	char                      recvbuf[MAXBUFLEN];
 	char                      s[INET6_ADDRSTRLEN];
 
 	pthread_t                 my_id;
 
 	FILE                   *fp;
 
+	static struct fc_receiver rx;
+	struct fc_writer          writer;
+	struct Showtalk           talk;
+
 	struct addrinfo           hints, *res, *p, *ai_client;
-	struct sockaddr_storage   client_addr;
-	socklen_t                 client_addr_len;
-	client_addr_len           = sizeof(struct sockaddr_storage);
 
 	memset(&hints, 0, sizeof hints);
 	hints.ai_family                = AF_UNSPEC;  // AF_INET or AF_INET6 to force version
@@ -263,54 +297,24 @@ void *datap_io_thread (void* ptr) {
 		die_nice("failed to bind control socket\n");
 	}
 
-	for(i=0; i<NPACK; ++i) {
-
-		struct sockaddr        *sa;
-		socklen_t              len;
-		char hbuf[NI_MAXHOST], sbuf[NI_MAXSERV];
-
-		addr_len = sizeof client_addr;
-		if ((numbytes = recvfrom(hostsocket_fd, recvbuf, MAXBUFLEN-1 , 0,
-				(struct sockaddr *)&client_addr, &addr_len)) == -1) {
-			die_nice("recvfrom");
-		}
-
-		if (getnameinfo((struct sockaddr *)&client_addr, client_addr_len, hbuf, sizeof(hbuf), sbuf,
-		            sizeof(sbuf), NI_NUMERICHOST | NI_NUMERICSERV) == 0) {
-
-			if(ports_equal(sbuf, IMU_A_TX_PORT)) {
-				printf("IMU Packet %s:%s\n", hbuf, sbuf);
-			} else if (ports_equal(sbuf, ROLL_CTL_TX_PORT)) {
-				printf("\tROLL CTL Packet: %s:%s\n", hbuf, sbuf);
-			} else {
-				printf("Unrecognized Packet %s:%s\n", hbuf, sbuf);
-			}
-		}
-
-		printf("fc: size of data struct: %d\n", sizeof(MPU9150_read_data));
-        memcpy (&mpu9150_udp_data, recvbuf, sizeof (MPU9150_read_data));
-
-		printf("fc: packet is %d bytes long\n", numbytes);
-		// recvbuf[numbytes] = '\0';
-		//printf("fc: packet contains \"%s\"\n\n", recvbuf);
-		fprintf(fp, "%f,%d,%d,%d,%d,%d,%d,%3.2f\n",
-				timestamp_now(),
-				mpu9150_udp_data.accel_xyz.x,
-				mpu9150_udp_data.accel_xyz.y,
-				mpu9150_udp_data.accel_xyz.z,
-				mpu9150_udp_data.gyro_xyz.x,
-				mpu9150_udp_data.gyro_xyz.y,
-				mpu9150_udp_data.gyro_xyz.z,
-				mpu9150_temp_to_dC(mpu9150_udp_data.celsius) );
-
-		printf("\r\nraw_temp: %3.2f C\r\n", mpu9150_temp_to_dC(mpu9150_udp_data.celsius));
-		printf("ACCL:  x: %d\ty: %d\tz: %d\r\n", mpu9150_udp_data.accel_xyz.x, mpu9150_udp_data.accel_xyz.y, mpu9150_udp_data.accel_xyz.z);
-		printf("GRYO:  x: 0x%x\ty: 0x%x\tz: 0x%x\r\n", mpu9150_udp_data.gyro_xyz.x, mpu9150_udp_data.gyro_xyz.y, mpu9150_udp_data.gyro_xyz.z);
-		if ((numbytes = sendto(clientsocket_fd, recvbuf, strlen(recvbuf), 0,
-				ai_client->ai_addr, ai_client->ai_addrlen)) == -1) {
-			die_nice("client sendto");
+	/* Every datagram also goes to CAPTURE_FILE with its kernel receive time */
+	talk.fp              = fp;
+	talk.clientsocket_fd = clientsocket_fd;
+	talk.ai_client       = ai_client;
+	if(fc_writer_open(&writer, CAPTURE_FILE) < 0) {
+		die_nice("open " CAPTURE_FILE);
+	}
+	if(fc_recv_init(&rx, hostsocket_fd) < 0) {
+		die_nice("capture socket setup");
+	}
+	while(rx.datagrams < NPACK) {
+		if(fc_recv_poll(&rx, &writer, show_datagram, &talk) < 0) {
+			die_nice("recvmmsg");
 		}
 	}
+	if(fc_writer_close(&writer) < 0) {
+		log_error("capture file write failed");
+	}
 	get_current_time(timestring) ;
 	fprintf(fp, "# mpu9150 IMU data closed at: %s\n", timestring);
 	fclose(fp);
@@ -70,7 +70,9 @@ static const uint8_t default_mac_address[] = {0xAA, 0x55, 0x13,
 static stm32_eth_rx_descriptor_t rd[STM32_MAC_RECEIVE_BUFFERS];
 static stm32_eth_tx_descriptor_t td[STM32_MAC_TRANSMIT_BUFFERS];
 
+#if !STM32_MAC_RX_ZERO_COPY
 static uint32_t rb[STM32_MAC_RECEIVE_BUFFERS][BUFFER_SIZE];
+#endif
 static uint32_t tb[STM32_MAC_TRANSMIT_BUFFERS][BUFFER_SIZE];
 
 /*===========================================================================*/
@@ -234,7 +236,14 @@ void mac_lld_init(void) {
      word is not initialized here but in mac_lld_start().*/
   for (i = 0; i < STM32_MAC_RECEIVE_BUFFERS; i++) {
     rd[i].rdes1 = STM32_RDES1_RCH | STM32_MAC_BUFFERS_SIZE;
+    /* Only every Nth descriptor interrupts, the watchdog covers the rest.*/
+    if ((i + 1) % STM32_MAC_RX_COALESCE_FRAMES != 0)
+      rd[i].rdes1 |= STM32_RDES1_DIC;
+#if STM32_MAC_RX_ZERO_COPY
+    rd[i].rdes2 = 0;
+#else
     rd[i].rdes2 = (uint32_t)rb[i];
+#endif
     rd[i].rdes3 = (uint32_t)&rd[(i + 1) % STM32_MAC_RECEIVE_BUFFERS];
   }
   for (i = 0; i < STM32_MAC_TRANSMIT_BUFFERS; i++) {
@@ -305,6 +314,21 @@ void mac_lld_init(void) {
 void mac_lld_start(MACDriver *macp) {
   unsigned i;
 
+#if STM32_MAC_RX_ZERO_COPY
+  /* Fills the ring, buffers kept from an earlier start are reused.*/
+  chDbgAssert(macp->rxalloc != NULL, "mac_lld_start(), #1",
+              "no receive allocator");
+  for (i = 0; i < STM32_MAC_RECEIVE_BUFFERS; i++) {
+    if (macp->rxhandle[i] == NULL) {
+      uint8_t *buf;
+      macp->rxhandle[i] = macp->rxalloc(&buf);
+      chDbgAssert(macp->rxhandle[i] != NULL, "mac_lld_start(), #2",
+                  "not enough receive buffers to fill the ring");
+      rd[i].rdes2 = (uint32_t)buf;
+    }
+  }
+#endif
+
   /* Resets the state of all descriptors.*/
   for (i = 0; i < STM32_MAC_RECEIVE_BUFFERS; i++)
     rd[i].rdes0 = STM32_RDES0_OWN;
@@ -356,6 +380,8 @@ void mac_lld_start(MACDriver *macp) {
   /* Enabling required interrupt sources.*/
   ETH->DMASR    = ETH->DMASR;
   ETH->DMAIER   = ETH_DMAIER_NISE | ETH_DMAIER_RIE | ETH_DMAIER_TIE;
+  ETH->DMARSWTR = STM32_MAC_RX_WATCHDOG;
+  (void)ETH->DMAMFBOCR; /* Clears the missed frame counters.*/
 
   /* DMA general settings.*/
   ETH->DMABMR   = ETH_DMABMR_AAB | ETH_DMABMR_RDP_1Beat | ETH_DMABMR_PBL_1Beat;
@@ -492,9 +518,15 @@ void mac_lld_release_transmit_descriptor(MACTransmitDescriptor *tdp) {
 msg_t mac_lld_get_receive_descriptor(MACDriver *macp,
                                      MACReceiveDescriptor *rdp) {
   stm32_eth_rx_descriptor_t *rdes;
+  uint32_t missed;
 
   chSysLock();
 
+  /* Frames the DMA couldn't take, the counters clear on read.*/
+  missed = ETH->DMAMFBOCR;
+  macp->rx_ring_full += missed & ETH_DMAMFBOCR_MFC;
+  macp->rx_overflow  += (missed & ETH_DMAMFBOCR_MFA) >> 17;
+
   /* Get Current RX descriptor.*/
   rdes = macp->rxptr;
 
@@ -689,6 +721,58 @@ size_t mac_lld_read_receive_descriptor(MACReceiveDescriptor *rdp,
   return size;
 }
 
+#if STM32_MAC_RX_ZERO_COPY || defined(__DOXYGEN__)
+/**
+ * @brief   Sets the allocator receive buffers come from.
+ * @note    Must be called before the driver is started.
+ *
+ * @param[in] macp      pointer to the @p MACDriver object
+ * @param[in] alloc     the allocator
+ *
+ * @api
+ */
+void mac_lld_set_receive_allocator(MACDriver *macp, macrxalloc_t alloc) {
+
+  macp->rxalloc = alloc;
+}
+
+/**
+ * @brief   Takes a received frame's buffer out of the ring.
+ * @details A new buffer from the allocator takes its place, and the frame's
+ *          buffer, holding @p rdp->size bytes of frame, is now the caller's.
+ *          If the allocator has none the frame stays in the ring to be
+ *          dropped, and NULL is returned. Either way the descriptor must
+ *          then be released as usual.
+ *
+ * @param[in] rdp       pointer to a @p MACReceiveDescriptor structure
+ * @return              The allocator's handle for the frame's buffer.
+ * @retval NULL         if no buffer was free to replace it.
+ *
+ * @api
+ */
+void *mac_lld_take_receive_buffer(MACReceiveDescriptor *rdp) {
+  unsigned i = rdp->physdesc - rd;
+  void *frame;
+  uint8_t *buf;
+  void *handle;
+
+  chDbgAssert(!(rdp->physdesc->rdes0 & STM32_RDES0_OWN),
+              "mac_lld_take_receive_buffer(), #1",
+              "attempt to take a buffer owned by DMA");
+
+  handle = ETHD1.rxalloc(&buf);
+  if (handle == NULL) {
+    ETHD1.rx_nobuf++;
+    return NULL;
+  }
+  frame = ETHD1.rxhandle[i];
+  ETHD1.rxhandle[i] = handle;
+  rdp->physdesc->rdes2 = (uint32_t)buf;
+  rdp->offset = rdp->size;
+  return frame;
+}
+#endif /* STM32_MAC_RX_ZERO_COPY */
+
 #if MAC_USE_ZERO_COPY || defined(__DOXYGEN__)
 /**
  * @brief   Returns a pointer to the next transmit buffer in the descriptor
@@ -185,6 +185,43 @@
 #if !defined(STM32_MAC_IP_CHECKSUM_OFFLOAD) || defined(__DOXYGEN__)
 #define STM32_MAC_IP_CHECKSUM_OFFLOAD       0
 #endif
+
+/**
+ * @brief   Receive straight into buffers owned by the network stack.
+ * @details The receive descriptors point at buffers handed out by the
+ *          allocator given to @p mac_lld_set_receive_allocator(), and a
+ *          received frame's buffer is passed up whole with
+ *          @p mac_lld_take_receive_buffer(), a fresh one taking its place
+ *          in the ring. Each buffer must hold @p STM32_MAC_BUFFERS_SIZE
+ *          bytes, be word aligned and be reachable by the Ethernet DMA.
+ */
+#if !defined(STM32_MAC_RX_ZERO_COPY) || defined(__DOXYGEN__)
+#define STM32_MAC_RX_ZERO_COPY              FALSE
+#endif
+
+/**
+ * @brief   Receive interrupt coalescing, frames per interrupt.
+ * @details With more than one, only every Nth receive descriptor raises
+ *          the receive interrupt on completion and the receive watchdog
+ *          catches the frames in between.
+ */
+#if !defined(STM32_MAC_RX_COALESCE_FRAMES) || defined(__DOXYGEN__)
+#define STM32_MAC_RX_COALESCE_FRAMES        1
+#endif
+
+/**
+ * @brief   Receive watchdog, in units of 256 HCLK cycles (1 to 255).
+ * @details The longest a frame that didn't interrupt waits for one.
+ */
+#if !defined(STM32_MAC_RX_WATCHDOG) || defined(__DOXYGEN__)
+#define STM32_MAC_RX_WATCHDOG               0
+#endif
+
+/**
+ * @brief   Not a setting: tells users this driver, not ChibiOS's own, is
+ *          installed, so @p MACDriver has the receive counters.
+ */
+#define STM32_MAC_HAS_RX_COUNTERS           TRUE
 /** @} */
 
 /*===========================================================================*/
@@ -195,6 +232,16 @@
 #error "STM32_MAC_PHY_TIMEOUT requires the realtime counter service"
 #endif
 
+#if (STM32_MAC_RX_COALESCE_FRAMES < 1) ||                                   \
+    (STM32_MAC_RX_COALESCE_FRAMES > STM32_MAC_RECEIVE_BUFFERS)
+#error "STM32_MAC_RX_COALESCE_FRAMES out of range"
+#endif
+
+#if (STM32_MAC_RX_COALESCE_FRAMES > 1) &&                                   \
+    ((STM32_MAC_RX_WATCHDOG < 1) || (STM32_MAC_RX_WATCHDOG > 255))
+#error "STM32_MAC_RX_COALESCE_FRAMES requires STM32_MAC_RX_WATCHDOG"
+#endif
+
 /*===========================================================================*/
 /* Driver data structures and types.                                         */
 /*===========================================================================*/
@@ -219,6 +266,14 @@ typedef struct {
   volatile uint32_t     tdes3;
 } stm32_eth_tx_descriptor_t;
 
+/**
+ * @brief   Receive buffer allocator for @p STM32_MAC_RX_ZERO_COPY.
+ * @details Returns a handle for a buffer of @p STM32_MAC_BUFFERS_SIZE bytes
+ *          and writes the buffer's address to @p bufp, or returns NULL if
+ *          none is free. Called from thread context.
+ */
+typedef void *(*macrxalloc_t)(uint8_t **bufp);
+
 /**
  * @brief   Driver configuration structure.
  */
@@ -273,6 +328,28 @@ struct MACDriver {
    * @brief Transmit next frame pointer.
    */
   stm32_eth_tx_descriptor_t *txptr;
+#if STM32_MAC_RX_ZERO_COPY || defined(__DOXYGEN__)
+  /**
+   * @brief Receive buffer allocator.
+   */
+  macrxalloc_t              rxalloc;
+  /**
+   * @brief Handle of the buffer in each receive descriptor.
+   */
+  void                      *rxhandle[STM32_MAC_RECEIVE_BUFFERS];
+  /**
+   * @brief Frames dropped because no buffer could replace theirs.
+   */
+  uint32_t                  rx_nobuf;
+#endif
+  /**
+   * @brief Frames lost because every receive descriptor was full.
+   */
+  uint32_t                  rx_ring_full;
+  /**
+   * @brief Frames lost to a receive FIFO overflow.
+   */
+  uint32_t                  rx_overflow;
 };
 
 /**
@@ -344,6 +421,10 @@ extern "C" {
   size_t mac_lld_read_receive_descriptor(MACReceiveDescriptor *rdp,
                                          uint8_t *buf,
                                          size_t size);
+#if STM32_MAC_RX_ZERO_COPY
+  void mac_lld_set_receive_allocator(MACDriver *macp, macrxalloc_t alloc);
+  void *mac_lld_take_receive_buffer(MACReceiveDescriptor *rdp);
+#endif
 #if MAC_USE_ZERO_COPY
   uint8_t *mac_lld_get_next_transmit_buffer(MACTransmitDescriptor *tdp,
                                             size_t size,
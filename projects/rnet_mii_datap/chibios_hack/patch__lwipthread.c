@@ -0,0 +1,105 @@
+--- /tmp/lwipthread.c
++++ /work/Projects/stm32/ChibiOS/os/various/lwip_bindings/lwipthread.c
+@@ -145,45 +145,53 @@
+   return ERR_OK;
+ }
+ 
++#if STM32_MAC_RX_ZERO_COPY
++/*
++ * Receive buffers for the MAC, a pool pbuf holding a whole frame.
++ */
++static void *low_level_rxalloc(uint8_t **bufp) {
++  struct pbuf *p;
++
++  p = pbuf_alloc(PBUF_RAW, STM32_MAC_BUFFERS_SIZE, PBUF_POOL);
++  if (p == NULL)
++    return NULL;
++  if (p->next != NULL) {
++    /* PBUF_POOL_BUFSIZE is too small for a frame.*/
++    pbuf_free(p);
++    return NULL;
++  }
++  *bufp = (uint8_t *)p->payload;
++  return p;
++}
++#endif
++
+ /*
+  * Receives a frame.
+  * Allocates a pbuf and transfers the data from the incoming buffer into the
+  * pbuf.
+  *
+  * @return a pbuf filled with the received packet (including MAC header)
+  *         NULL on memory error
+  */
+ static struct pbuf *low_level_input(struct netif *netif) {
+   MACReceiveDescriptor rd;
+   struct pbuf *p, *q;
+   u16_t len;
+ 
+   (void)netif;
+   if (macWaitReceiveDescriptor(&ETHD1, &rd, TIME_IMMEDIATE) == RDY_OK) {
+     len = (u16_t)rd.size;
+ 
++#if STM32_MAC_RX_ZERO_COPY
++#if ETH_PAD_SIZE
++#error "STM32_MAC_RX_ZERO_COPY needs ETH_PAD_SIZE 0"
++#endif
++    /* The frame is already in a pbuf, swap it for a fresh one.*/
++    (void)q;
++    p = mac_lld_take_receive_buffer(&rd);
++    macReleaseReceiveDescriptor(&rd);
++    if (p != NULL) {
++      pbuf_realloc(p, len);
++      LINK_STATS_INC(link.recv);
++    }
++    else {
++      LINK_STATS_INC(link.memerr);
++      LINK_STATS_INC(link.drop);
++    }
++    return p;
++#else
+ #if ETH_PAD_SIZE
+     len += ETH_PAD_SIZE;        /* allow room for Ethernet padding */
+ #endif
+ 
+     /* We allocate a pbuf chain of pbufs from the pool. */
+     p = pbuf_alloc(PBUF_RAW, len, PBUF_POOL);
+ 
+     if (p != NULL) {
+ 
+ #if ETH_PAD_SIZE
+       pbuf_header(p, -ETH_PAD_SIZE); /* drop the padding word */
+ #endif
+ 
+       /* Iterates through the pbuf chain. */
+       for(q = p; q != NULL; q = q->next)
+         macReadReceiveDescriptor(&rd, (uint8_t *)q->payload, (size_t)q->len);
+       macReleaseReceiveDescriptor(&rd);
+ 
+ #if ETH_PAD_SIZE
+       pbuf_header(p, ETH_PAD_SIZE); /* reclaim the padding word */
+ #endif
+ 
+       LINK_STATS_INC(link.recv);
+     }
+     else {
+       macReleaseReceiveDescriptor(&rd);
+       LINK_STATS_INC(link.memerr);
+       LINK_STATS_INC(link.drop);
+     }
+     return p;
++#endif
+   }
+   return NULL;
+ }
+@@ -230,6 +238,9 @@
+   /* Initializes the thing.*/
+   sys_sem_signal(arg);
+ 
++#if STM32_MAC_RX_ZERO_COPY
++  mac_lld_set_receive_allocator(&ETHD1, low_level_rxalloc);
++#endif
+   macStart(&ETHD1, &mac_config);
+ 
+   /* Registers the MAC event handlers.*/
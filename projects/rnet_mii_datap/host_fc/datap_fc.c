@@ -29,6 +29,7 @@
 #include <unistd.h>
 
 #include "fc_net.h"
+#include "fc_capture.h"
 #include "device_net.h"
 #include "datap_fc.h"
 
@@ -123,6 +124,40 @@ static void init_thread_state(Ports* p, unsigned int i) {
 	p->thread_id = i;
 }
 
+/*! \brief Where show_datagram() echoes to */
+struct Showtalk {
+	int                clientsocket_fd;
+	struct addrinfo*   ai_client;
+};
+
+/*! \brief Print and echo each datagram as fc_recv_poll() captures it
+ */
+static void show_datagram(const struct fc_record* r, const uint8_t* data, void* ptr) {
+	struct Showtalk*          t = ptr;
+	char                      recvbuf[FC_RECV_MAXLEN + 1];
+	char                      sbuf[PORT_STRING_LEN];
+	int                       numbytes;
+
+	snprintf(sbuf, sizeof(sbuf), "%u", r->port);
+	if(ports_equal(sbuf, IMU_A_TX_PORT)) {
+		printf("IMU Packet port %s\n", sbuf);
+	} else if (ports_equal(sbuf, RNET_A_TX_PORT)) {
+		printf("\tRNET_A Packet: port %s\n", sbuf);
+	} else {
+		printf("Unrecognized Packet port %s\n", sbuf);
+	}
+
+	printf("fc: packet is %d bytes long\n", r->len);
+	memcpy(recvbuf, data, r->len);
+	recvbuf[r->len] = '\0';
+	printf("fc: packet contains \"%s\"\n\n", recvbuf);
+
+	if ((numbytes = sendto(t->clientsocket_fd, recvbuf, strlen(recvbuf), 0,
+			t->ai_client->ai_addr, t->ai_client->ai_addrlen)) == -1) {
+		die_nice("client sendto");
+	}
+}
+
 /*! \brief Thread routine I/O
  *
  * @param ptr  pointer to Ports type with input and output ip address and port.
@@ -136,19 +171,18 @@ void *datap_io_thread (void* ptr) {
 	int                       retval;
 	int                       hostsocket_fd;
 	int                       clientsocket_fd;
-	int                       numbytes;
-	socklen_t                 addr_len;
 
 	char                      ipstr[INET6_ADDRSTRLEN];
-	char                      recvbuf[MAXBUFLEN];
 	char                      s[INET6_ADDRSTRLEN];
 
 	pthread_t                 my_id;
 
+	struct fc_receiver*       rx;
+	struct fc_writer          writer;
+	struct Showtalk           talk;
+	char                      capture_file[STRINGBUFLEN];
+
 	struct addrinfo           hints, *res, *p, *ai_client;
-	struct sockaddr_storage   client_addr;
-	socklen_t                 client_addr_len;
-	client_addr_len           = sizeof(struct sockaddr_storage);
 
 	memset(&hints, 0, sizeof hints);
 	hints.ai_family                = AF_UNSPEC;  // AF_INET or AF_INET6 to force version
@@ -227,37 +261,29 @@ void *datap_io_thread (void* ptr) {
 		die_nice("failed to bind control socket\n");
 	}
 
-	for(i=0; i<NPACK; ++i) {
-		struct sockaddr        *sa;
-		socklen_t              len;
-		char hbuf[NI_MAXHOST], sbuf[NI_MAXSERV];
-
-		addr_len = sizeof client_addr;
-		if ((numbytes = recvfrom(hostsocket_fd, recvbuf, MAXBUFLEN-1 , 0,
-				(struct sockaddr *)&client_addr, &addr_len)) == -1) {
-			die_nice("recvfrom");
-		}
-
-		if (getnameinfo((struct sockaddr *)&client_addr, client_addr_len, hbuf, sizeof(hbuf), sbuf,
-		            sizeof(sbuf), NI_NUMERICHOST | NI_NUMERICSERV) == 0) {
-			if(ports_equal(sbuf, IMU_A_TX_PORT)) {
-				printf("IMU Packet %s:%s\n", hbuf, sbuf);
-			} else if (ports_equal(sbuf, RNET_A_TX_PORT)) {
-				printf("\tRNET_A Packet: %s:%s\n", hbuf, sbuf);
-			} else {
-				printf("Unrecognized Packet %s:%s\n", hbuf, sbuf);
-			}
-		}
-
-		printf("fc: packet is %d bytes long\n", numbytes);
-		recvbuf[numbytes] = '\0';
-		printf("fc: packet contains \"%s\"\n\n", recvbuf);
-
-		if ((numbytes = sendto(clientsocket_fd, recvbuf, strlen(recvbuf), 0,
-				ai_client->ai_addr, ai_client->ai_addrlen)) == -1) {
-			die_nice("client sendto");
+	/* Every datagram also goes to a capture file with its kernel receive time */
+	rx = malloc(sizeof(*rx));
+	if(rx == NULL) {
+		die_nice("malloc");
+	}
+	talk.clientsocket_fd = clientsocket_fd;
+	talk.ai_client       = ai_client;
+	snprintf(capture_file, sizeof(capture_file), "datap_fc_%s.cap", port_info->host_listen_port);
+	if(fc_writer_open(&writer, capture_file) < 0) {
+		die_nice("open capture file");
+	}
+	if(fc_recv_init(rx, hostsocket_fd) < 0) {
+		die_nice("capture socket setup");
+	}
+	while(rx->datagrams < NPACK) {
+		if(fc_recv_poll(rx, &writer, show_datagram, &talk) < 0) {
+			die_nice("recvmmsg");
 		}
 	}
+	if(fc_writer_close(&writer) < 0) {
+		log_error("capture file write failed");
+	}
+	free(rx);
 	close(hostsocket_fd);
 	close(clientsocket_fd);
 	freeaddrinfo(res); // free the linked list
@@ -405,7 +405,7 @@
  * PBUF_POOL_SIZE: the number of buffers in the pbuf pool.
  */
 #ifndef PBUF_POOL_SIZE
-#define PBUF_POOL_SIZE                  16
+#define PBUF_POOL_SIZE                  24
 #endif
 
 /*
@@ -1095,7 +1095,11 @@
  * TCP_MSS, IP header, and link header.
  */
 #ifndef PBUF_POOL_BUFSIZE
-#define PBUF_POOL_BUFSIZE               LWIP_MEM_ALIGN_SIZE(TCP_MSS+40+PBUF_LINK_HLEN)
+/* A whole STM32_MAC_BUFFERS_SIZE frame, the MAC receives straight into pool
+ * pbufs (STM32_MAC_RX_ZERO_COPY, chibios_hack/README.hack). The pool has to
+ * stay out of CCM RAM, the Ethernet DMA can't reach it.
+ */
+#define PBUF_POOL_BUFSIZE               LWIP_MEM_ALIGN_SIZE(1522)
 #endif
 
 /*
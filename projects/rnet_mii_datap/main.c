@@ -175,6 +175,25 @@ void cmd_show(BaseSequentialStream *chp, int argc, char *argv[]) {
 
 }
 
+#if defined(STM32_MAC_HAS_RX_COUNTERS)
+/*! \brief MAC receive counters
+ *
+ * @param chp
+ * @param argc
+ * @param argv
+ */
+void cmd_macstats(BaseSequentialStream *chp, int argc, char *argv[]) {
+	(void)argv;
+	(void)argc;
+
+	chprintf(chp, "rx ring full:\t%u\r\n", ETHD1.rx_ring_full);
+	chprintf(chp, "rx overflow:\t%u\r\n", ETHD1.rx_overflow);
+#if STM32_MAC_RX_ZERO_COPY
+	chprintf(chp, "rx no pbuf:\t%u\r\n", ETHD1.rx_nobuf);
+#endif
+}
+#endif
+
 #define DATA_UDP_SEND_THREAD_STACK_SIZE      512
 #define DATA_UDP_RECEIVE_THREAD_STACK_SIZE   512
 
@@ -232,6 +251,9 @@ static const ShellCommand commands[] = {
 		{"show"    , cmd_show},
 		{"mem"    , cmd_mem},
 		{"threads", cmd_threads},
+#if defined(STM32_MAC_HAS_RX_COUNTERS)
+		{"macstats", cmd_macstats},
+#endif
 		{NULL, NULL}
 };
 
@@ -177,12 +177,21 @@
  * MAC driver system settings.
  */
 #define STM32_MAC_TRANSMIT_BUFFERS          2
-#define STM32_MAC_RECEIVE_BUFFERS           4
+#define STM32_MAC_RECEIVE_BUFFERS           8
 #define STM32_MAC_BUFFERS_SIZE              1522
 #define STM32_MAC_PHY_TIMEOUT               100
 #define STM32_MAC_ETH1_CHANGE_PHY_STATE     TRUE
 #define STM32_MAC_ETH1_IRQ_PRIORITY         13
 #define STM32_MAC_IP_CHECKSUM_OFFLOAD       0
+/* Only in chibios_hack/mac_lld.c, see chibios_hack/README.hack. Zero copy
+ * also needs lwipthread.c patched; the Makefile sets RNET_MAC_RX_ZERO_COPY
+ * when it finds the patch, stock drivers ignore the rest.
+ */
+#if defined(RNET_MAC_RX_ZERO_COPY)
+#define STM32_MAC_RX_ZERO_COPY              TRUE
+#endif
+#define STM32_MAC_RX_COALESCE_FRAMES        4
+#define STM32_MAC_RX_WATCHDOG               64      /* 64*256 HCLK, ~100us */
 
 /*
  * PWM driver system settings.